@@ -0,0 +1,711 @@
+/*********************************************************************************************
+Lutefisk is software for de novo sequencing of peptides from tandem mass spectra.
+Copyright (C) 1995  Richard S. Johnson
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+Contact:
+
+Richard S Johnson
+4650 Forest Ave SE
+Mercer Island, WA 98040
+
+jsrichar@alum.mit.edu
+*********************************************************************************************/
+
+/*
+	Batch mode.  A list of CID files (from the command line, a directory, or a manifest file
+	with one pathname per line) is sequenced on several threads at once.  Each thread starts out
+	with an equal share of the list, and when a thread runs out it steals the last file from
+	whichever thread has the most left, so a few slow spectra don't hold up the others.
+
+	Each spectrum is searched in its own tSearchContext, and the output file names are worked out
+	ahead of time in list order, so the .lut files are the same as those made by running the
+	files one at a time.  An MGF file counts as one spectrum per BEGIN IONS block, and an mzML
+	or mzXML file as one per MS2 scan; the mzML files are read through once to find where the
+	scans are, and then each thread reads the ones it does for itself.
+*/
+
+/* ANSI headers */
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if !defined(__MWERKS__)
+	#include <dirent.h>
+	#include <pthread.h>
+	#include <unistd.h>
+	#include <sys/stat.h>
+	#include <sys/time.h>
+	#include <sys/types.h>
+#endif
+
+/* Lutefisk headers */
+#include "LutefiskPrototypes.h"
+#include "LutefiskDefinitions.h"
+
+/*Definitions for this file*/
+#define BATCH_LIST_GROW		256		/*Number of file names added to the list at a time*/
+
+/*Globals for this file only.*/
+typedef struct
+{
+	char			*cidFile;		/*CID file the spectrum is in*/
+	char			fileType;		/*'M' for MGF, 'Z' for mzML or mzXML, otherwise 0*/
+	char			*cidBlock;		/*The spectrum, if its in an MGF file*/
+	INT_4			cidBlockLength;
+	INT_4			cidBlockNum;	/*Spectrum number in an MGF file, or mzML scan number*/
+	long			offset;			/*Where the scan is in an mzML or mzXML file*/
+	char			*outputFile;	/*Where its output goes*/
+	BOOLEAN			searched;		/*FALSE if no data could be read*/
+}tBatchSpectrum;
+
+typedef struct
+{
+	tSearchContext	*configPtr;		/*What each search starts out with*/
+	tBatchSpectrum	*spectrum;
+	INT_4			fileNum;		/*Number of spectra*/
+	tMGFFile		**mgfFile;		/*MGF files stay mapped until the batch is done*/
+	INT_4			mgfFileNum;
+	BOOLEAN			forkScrambles;	/*FALSE if the mass scrambles must not fork (threads are running)*/
+#if !defined(__MWERKS__)
+	INT_4			*first;			/*Thread i has files first[i] thru last[i] - 1 still to do*/
+	INT_4			*last;
+	pthread_mutex_t	*lock;			/*Guards first[i] and last[i]*/
+	INT_4			threadNum;
+#endif
+}tBatch;
+
+typedef struct
+{
+	tBatch	*batchPtr;
+	INT_4	index;
+}tBatchThread;
+
+static void ListBatchSpectra(tBatch *batchPtr, char **fileList, INT_4 fileNum);
+static tBatchSpectrum *AddBatchSpectrum(tBatch *batchPtr, char *cidFile, char fileType);
+static void RunBatchFile(tBatch *batchPtr, INT_4 fileIndex);
+#if !defined(__MWERKS__)
+static void *BatchThread(void *arg);
+static INT_4 NextBatchFile(tBatch *batchPtr, INT_4 threadIndex);
+static int CompareFileNames(const void *a, const void *b);
+#endif
+
+
+/******************************AddBatchFile************************************************
+*
+*	Adds a copy of fileName to the end of the list of CID files, making the list longer if
+*	need be.  Returns the list, which may have moved.
+*/
+char **AddBatchFile(char **fileList, INT_4 *fileNum, char *fileName)
+{
+	char *nameCopy;
+
+	if (*fileNum % BATCH_LIST_GROW == 0)
+	{
+		fileList = (char **) realloc(fileList, (*fileNum + BATCH_LIST_GROW) * sizeof(char *));
+		if (fileList == NULL)
+		{
+			printf("AddBatchFile:  Out of memory");
+			exit(1);
+		}
+	}
+
+	nameCopy = (char *) malloc(strlen(fileName) + 1);
+	if (nameCopy == NULL)
+	{
+		printf("AddBatchFile:  Out of memory");
+		exit(1);
+	}
+	strcpy(nameCopy, fileName);
+	fileList[*fileNum] = nameCopy;
+	(*fileNum)++;
+
+	return(fileList);
+}
+
+/******************************IsCIDFileName**********************************************
+*
+*	Returns TRUE if the file name ends in one of the extensions that ChangeOutputName knows
+*	about (ie, it looks like a CID data file).  Used for picking files out of a directory.
+*/
+BOOLEAN IsCIDFileName(char *fileName)
+{
+	INT_4 length;
+
+	if (IsMGFFileName(fileName) || IsMzMLFileName(fileName))
+	{
+		return(TRUE);
+	}
+
+	length = strlen(fileName);
+	if (length <= 4 || fileName[length - 4] != '.')
+	{
+		return(FALSE);
+	}
+	if (!strcmp(fileName + length - 4, ".dta") || !strcmp(fileName + length - 4, ".DTA")
+		|| !strcmp(fileName + length - 4, ".dat") || !strcmp(fileName + length - 4, ".DAT")
+		|| !strcmp(fileName + length - 4, ".txt") || !strcmp(fileName + length - 4, ".TXT"))
+	{
+		return(TRUE);
+	}
+
+	return(FALSE);
+}
+
+/******************************MultiSpectrumFileType**************************************
+*
+*	Returns 'M' if fileName is to be read as an MGF file, 'Z' if it is to be read as an mzML 
+*	or mzXML file, or zero if it holds a single spectrum.  The file name decides it, unless it
+*	doesn't end in .mgf, .mzML or .mzXML, in which case CIDfileType (from the params) does.
+*/
+char MultiSpectrumFileType(char *fileName, char CIDfileType)
+{
+	if (IsMGFFileName(fileName))
+	{
+		return('M');
+	}
+	if (IsMzMLFileName(fileName))
+	{
+		return('Z');
+	}
+	if (CIDfileType == 'M' || CIDfileType == 'Z')
+	{
+		return(CIDfileType);
+	}
+
+	return(0);
+}
+
+/******************************ReadBatchList***********************************************
+*
+*	Adds the CID files named by batchFile to the list.  If batchFile is a directory, then all
+*	of the CID files in it are added in alphabetical order.  Otherwise its a manifest, a text
+*	file with one CID file pathname per line; blank lines and lines starting with '#' are
+*	skipped.  Returns the list, which may have moved.
+*/
+char **ReadBatchList(char *batchFile, char **fileList, INT_4 *fileNum)
+{
+	FILE *fp;
+	char stringBuffer[512], pathName[512];
+	char *start, *end;
+#if !defined(__MWERKS__)
+	struct stat fileInfo;
+	DIR *dirPtr;
+	struct dirent *entryPtr;
+	INT_4 firstFromDir;
+
+	if (stat(batchFile, &fileInfo) == 0 && S_ISDIR(fileInfo.st_mode))
+	{
+		dirPtr = opendir(batchFile);
+		if (dirPtr == NULL)
+		{
+			printf("Cannot open the directory %s.\n", batchFile);
+			exit(1);
+		}
+		firstFromDir = *fileNum;
+		while ((entryPtr = readdir(dirPtr)) != NULL)
+		{
+			if (entryPtr->d_name[0] == '.' || !IsCIDFileName(entryPtr->d_name))
+			{
+				continue;
+			}
+			sprintf(pathName, "%s/%s", batchFile, entryPtr->d_name);
+			fileList = AddBatchFile(fileList, fileNum, pathName);
+		}
+		closedir(dirPtr);
+
+		/*readdir returns them in no particular order*/
+		qsort(fileList + firstFromDir, *fileNum - firstFromDir, sizeof(char *), CompareFileNames);
+
+		return(fileList);
+	}
+#endif
+
+	fp = fopen(batchFile, "r");
+	if (fp == NULL)
+	{
+		printf("Cannot open the batch file %s.\n", batchFile);
+		exit(1);
+	}
+
+	while (fgets(stringBuffer, sizeof(stringBuffer), fp) != NULL)
+	{
+		start = stringBuffer;
+		while (*start != '\0' && isspace(*start))
+		{
+			start++;
+		}
+		end = start + strlen(start);
+		while (end > start && isspace(*(end - 1)))	/*also gets rid of \r from DOS files*/
+		{
+			end--;
+		}
+		*end = '\0';
+
+		if (*start == '\0' || *start == '#')
+		{
+			continue;
+		}
+		fileList = AddBatchFile(fileList, fileNum, start);
+	}
+	fclose(fp);
+
+	return(fileList);
+}
+
+/******************************RunBatch****************************************************
+*
+*	Sequences the fileNum CID files in fileList using up to gParam.workerNum threads (zero
+*	means one per processor), and reports how many spectra per second were done.  configPtr
+*	holds the params, residues, etc. that each search starts with.
+*/
+void RunBatch(tSearchContext *configPtr, char **fileList, INT_4 fileNum)
+{
+	tBatch batch;
+	tSearchContext *namePtr, *previousPtr;
+	INT_4 i, threadNum, searchedNum;
+	REAL_8 seconds;
+	FILE *fp;
+#if !defined(__MWERKS__)
+	pthread_t *threadID;
+	tBatchThread *thread;
+	struct timeval startTime, endTime;
+#else
+	time_t startTime, endTime;
+#endif
+
+	if (fileNum == 0)
+	{
+		printf("There are no CID files to sequence.\n");
+		return;
+	}
+
+	if (strlen(configPtr->param.outputFile) > 0)
+	{
+		printf("In batch mode each CID file gets its own output file; ignoring %s.\n",
+				configPtr->param.outputFile);
+		configPtr->param.outputFile[0] = '\0';
+	}
+
+	batch.configPtr = configPtr;
+	ListBatchSpectra(&batch, fileList, fileNum);
+	fileNum = batch.fileNum;
+	if (fileNum == 0)
+	{
+		printf("There are no spectra to sequence.\n");
+		return;
+	}
+
+/*
+*	Name the output files in list order, the same way that Run would if the files were done one
+*	at a time.  Each name is claimed by making an empty file, so that ChangeOutputName numbers
+*	the next one that would have the same name.
+*/
+	namePtr = NewSearchContext(configPtr);
+	previousPtr = BindSearchContext(namePtr);
+	for (i = 0; i < fileNum; i++)
+	{
+		strncpy(gParam.cidFilename, batch.spectrum[i].cidFile, sizeof(gParam.cidFilename) - 1);
+		gSearch->cidBlockNum = batch.spectrum[i].cidBlockNum;
+		gParam.outputFile[0] = '\0';
+		ChangeOutputName();
+
+		fp = fopen(gParam.outputFile, "w");
+		if (fp == NULL)
+		{
+			printf("Cannot open %s to write the output.\n", gParam.outputFile);
+			exit(1);
+		}
+		fclose(fp);
+
+		batch.spectrum[i].outputFile = (char *) malloc(strlen(gParam.outputFile) + 1);
+		if (batch.spectrum[i].outputFile == NULL)
+		{
+			printf("RunBatch:  Out of memory");
+			exit(1);
+		}
+		strcpy(batch.spectrum[i].outputFile, gParam.outputFile);
+		batch.spectrum[i].searched = FALSE;
+	}
+	BindSearchContext(previousPtr);
+	FreeSearchContext(namePtr);
+
+	threadNum = configPtr->param.workerNum;
+#if !defined(__MWERKS__)
+	if (threadNum == 0)
+	{
+		threadNum = sysconf(_SC_NPROCESSORS_ONLN);
+	}
+#endif
+	if (threadNum < 1)
+	{
+		threadNum = 1;
+	}
+	if (threadNum > fileNum)
+	{
+		threadNum = fileNum;
+	}
+
+#if !defined(__MWERKS__)
+	gettimeofday(&startTime, NULL);
+
+	if (threadNum == 1)
+	{
+		batch.forkScrambles = TRUE;
+		for (i = 0; i < fileNum; i++)
+		{
+			RunBatchFile(&batch, i);
+		}
+	}
+	else
+	{
+		batch.forkScrambles = FALSE;	/*forking a process that has threads running is asking for trouble*/
+		batch.threadNum = threadNum;
+		batch.first = (INT_4 *) malloc(threadNum * sizeof(INT_4));
+		batch.last = (INT_4 *) malloc(threadNum * sizeof(INT_4));
+		batch.lock = (pthread_mutex_t *) malloc(threadNum * sizeof(pthread_mutex_t));
+		threadID = (pthread_t *) malloc(threadNum * sizeof(pthread_t));
+		thread = (tBatchThread *) malloc(threadNum * sizeof(tBatchThread));
+		if (batch.first == NULL || batch.last == NULL || batch.lock == NULL
+			|| threadID == NULL || thread == NULL)
+		{
+			printf("RunBatch:  Out of memory");
+			exit(1);
+		}
+
+		/*Start each thread with an equal share of the files.*/
+		for (i = 0; i < threadNum; i++)
+		{
+			batch.first[i] = (REAL_8)fileNum * i / threadNum;
+			batch.last[i] = (REAL_8)fileNum * (i + 1) / threadNum;
+			pthread_mutex_init(&batch.lock[i], NULL);
+			thread[i].batchPtr = &batch;
+			thread[i].index = i;
+		}
+
+		fflush(NULL);
+		for (i = 0; i < threadNum; i++)
+		{
+			if (pthread_create(&threadID[i], NULL, BatchThread, &thread[i]) != 0)
+			{
+				printf("RunBatch:  Could not start a thread.\n");
+				exit(1);
+			}
+		}
+		for (i = 0; i < threadNum; i++)
+		{
+			pthread_join(threadID[i], NULL);
+		}
+
+		for (i = 0; i < threadNum; i++)
+		{
+			pthread_mutex_destroy(&batch.lock[i]);
+		}
+		free(batch.first);
+		free(batch.last);
+		free(batch.lock);
+		free(threadID);
+		free(thread);
+	}
+
+	gettimeofday(&endTime, NULL);
+	seconds = (endTime.tv_sec - startTime.tv_sec) + (endTime.tv_usec - startTime.tv_usec) / 1000000.0;
+#else
+	startTime = time(NULL);
+	threadNum = 1;
+	batch.forkScrambles = FALSE;
+	for (i = 0; i < fileNum; i++)
+	{
+		RunBatchFile(&batch, i);
+	}
+	endTime = time(NULL);
+	seconds = difftime(endTime, startTime);
+#endif
+
+	searchedNum = 0;
+	for (i = 0; i < fileNum; i++)
+	{
+		if (batch.spectrum[i].searched)
+		{
+			searchedNum++;
+		}
+		else if (batch.spectrum[i].fileType == 'M')
+		{
+			printf("No data could be read from spectrum %d of %s.\n", 
+					batch.spectrum[i].cidBlockNum, batch.spectrum[i].cidFile);
+		}
+		else if (batch.spectrum[i].fileType == 'Z')
+		{
+			printf("No data could be read from scan %d of %s.\n", 
+					batch.spectrum[i].cidBlockNum, batch.spectrum[i].cidFile);
+		}
+		else
+		{
+			printf("No data could be read from %s.\n", batch.spectrum[i].cidFile);
+		}
+		free(batch.spectrum[i].outputFile);
+	}
+	free(batch.spectrum);
+	for (i = 0; i < batch.mgfFileNum; i++)
+	{
+		CloseMGFFile(batch.mgfFile[i]);
+	}
+	free(batch.mgfFile);
+
+	printf("\nBatch:  %d spectra (%d with data) in %.1f seconds using %d threads; %.2f spectra/sec\n",
+			fileNum, searchedNum, seconds, threadNum,
+			(seconds > 0) ? fileNum / seconds : 0.0);
+	fflush(stdout);
+
+	return;
+}
+
+/******************************ListBatchSpectra********************************************
+*
+*	Makes the list of spectra to be done, in order:  one for each CID file in fileList, except
+*	that each MGF file gives one for each of its BEGIN IONS blocks, and each mzML or mzXML file
+*	one for each MS2 scan that gets past the filters.  The file names are not copied; they point
+*	into fileList.
+*/
+static void ListBatchSpectra(tBatch *batchPtr, char **fileList, INT_4 fileNum)
+{
+	INT_4 i, blockLength, firstNum;
+	char *block, fileType;
+	tMGFFile *mgfPtr;
+	tMzMLFile *mzmlPtr;
+	tMzMLSpectrum mzmlSpectrum;
+	tBatchSpectrum *spectrumPtr;
+	
+	batchPtr->fileNum = 0;
+	batchPtr->spectrum = NULL;
+	batchPtr->mgfFileNum = 0;
+	batchPtr->mgfFile = (tMGFFile **) malloc((fileNum + 1) * sizeof(tMGFFile *));
+	if (batchPtr->mgfFile == NULL)
+	{
+		printf("ListBatchSpectra:  Out of memory");
+		exit(1);
+	}
+
+	for (i = 0; i < fileNum; i++)
+	{
+		firstNum = batchPtr->fileNum;
+		fileType = MultiSpectrumFileType(fileList[i], batchPtr->configPtr->param.CIDfileType);
+		if (fileType == 'M')
+		{
+			mgfPtr = OpenMGFFile(fileList[i]);
+			batchPtr->mgfFile[batchPtr->mgfFileNum++] = mgfPtr;
+			while (NextMGFSpectrum(mgfPtr, &block, &blockLength))
+			{
+				spectrumPtr = AddBatchSpectrum(batchPtr, fileList[i], fileType);
+				spectrumPtr->cidBlock = block;
+				spectrumPtr->cidBlockLength = blockLength;
+				spectrumPtr->cidBlockNum = mgfPtr->spectrumNum;
+			}
+		}
+		else if (fileType == 'Z')
+		{
+			/*Just find the scans for now; the peaks are read when they are sequenced.*/
+			mzmlPtr = OpenMzMLFile(fileList[i], &batchPtr->configPtr->param);
+			while (NextMzMLSpectrum(mzmlPtr, &mzmlSpectrum, FALSE))
+			{
+				spectrumPtr = AddBatchSpectrum(batchPtr, fileList[i], fileType);
+				spectrumPtr->cidBlockNum = mzmlSpectrum.scanNum;
+				spectrumPtr->offset = mzmlSpectrum.offset;
+			}
+			CloseMzMLFile(mzmlPtr);
+		}
+		else
+		{
+			AddBatchSpectrum(batchPtr, fileList[i], fileType);
+		}
+
+		if (batchPtr->fileNum == firstNum)
+		{
+			printf("There are no spectra to sequence in %s.\n", fileList[i]);
+		}
+	}
+
+	return;
+}
+
+/******************************AddBatchSpectrum********************************************
+*
+*	Adds a spectrum to the end of the batch list, and returns it.
+*/
+static tBatchSpectrum *AddBatchSpectrum(tBatch *batchPtr, char *cidFile, char fileType)
+{
+	tBatchSpectrum *spectrumPtr;
+
+	if (batchPtr->fileNum % BATCH_LIST_GROW == 0)
+	{
+		batchPtr->spectrum = (tBatchSpectrum *) realloc(batchPtr->spectrum, 
+								(batchPtr->fileNum + BATCH_LIST_GROW) * sizeof(tBatchSpectrum));
+		if (batchPtr->spectrum == NULL)
+		{
+			printf("AddBatchSpectrum:  Out of memory");
+			exit(1);
+		}
+	}
+
+	spectrumPtr = &batchPtr->spectrum[batchPtr->fileNum++];
+	memset(spectrumPtr, 0, sizeof(tBatchSpectrum));
+	spectrumPtr->cidFile = cidFile;
+	spectrumPtr->fileType = fileType;
+
+	return(spectrumPtr);
+}
+
+/******************************RunBatchFile************************************************
+*
+*	Sequences one of the CID files in the batch on the calling thread.
+*/
+static void RunBatchFile(tBatch *batchPtr, INT_4 fileIndex)
+{
+	tSearchContext *searchPtr;
+	tBatchSpectrum *spectrumPtr = &batchPtr->spectrum[fileIndex];
+	tMzMLFile *mzmlPtr;
+	tMzMLSpectrum mzmlSpectrum;
+
+	searchPtr = NewSearchContext(batchPtr->configPtr);
+	strncpy(searchPtr->param.cidFilename, spectrumPtr->cidFile,
+			sizeof(searchPtr->param.cidFilename) - 1);
+	strcpy(searchPtr->param.outputFile, spectrumPtr->outputFile);
+	searchPtr->cidBlockNum = spectrumPtr->cidBlockNum;
+	if (spectrumPtr->fileType == 'M')
+	{
+		searchPtr->param.CIDfileType = 'M';
+		searchPtr->param.centroidOrProfile = 'C';	/*MGF files are peak lists*/
+		searchPtr->cidBlock = spectrumPtr->cidBlock;
+		searchPtr->cidBlockLength = spectrumPtr->cidBlockLength;
+	}
+	else if (spectrumPtr->fileType == 'Z')
+	{
+		/*Each thread reads its own scans, so the file is opened here.*/
+		mzmlPtr = OpenMzMLFile(spectrumPtr->cidFile, &batchPtr->configPtr->param);
+		SeekMzMLSpectrum(mzmlPtr, spectrumPtr->offset);
+		if (!NextMzMLSpectrum(mzmlPtr, &mzmlSpectrum, TRUE))
+		{
+			CloseMzMLFile(mzmlPtr);		/*the file has changed since the scans were found*/
+			FreeSearchContext(searchPtr);
+			spectrumPtr->searched = FALSE;
+			return;
+		}
+		CloseMzMLFile(mzmlPtr);
+		searchPtr->param.CIDfileType = 'Z';
+		if (mzmlSpectrum.centroided)
+		{
+			searchPtr->param.centroidOrProfile = 'C';
+		}
+		searchPtr->cidPeakList = mzmlSpectrum.peakList;
+		searchPtr->cidPrecursorMZ = mzmlSpectrum.precursorMZ;
+		searchPtr->cidPrecursorCharge = mzmlSpectrum.precursorCharge;
+	}
+	if (!batchPtr->forkScrambles)
+	{
+		searchPtr->param.workerNum = 1;
+	}
+
+	spectrumPtr->searched = Run(searchPtr);
+
+	FreeSearchContext(searchPtr);
+	return;
+}
+
+#if !defined(__MWERKS__)
+/******************************BatchThread*************************************************
+*
+*	Each thread keeps sequencing files until there are none left for it to do or steal.
+*/
+static void *BatchThread(void *arg)
+{
+	tBatchThread *threadPtr = (tBatchThread *)arg;
+	INT_4 fileIndex;
+
+	while ((fileIndex = NextBatchFile(threadPtr->batchPtr, threadPtr->index)) >= 0)
+	{
+		RunBatchFile(threadPtr->batchPtr, fileIndex);
+	}
+
+	FreeHaggisPools();	/*the thread's Haggis pools were kept from one file to the next*/
+	FreeSequenceArena();
+	FreeScoringTables();
+	FreeFourierPlan();
+	return(NULL);
+}
+
+/******************************NextBatchFile***********************************************
+*
+*	Returns the index of the next file for thread threadIndex to do, or -1 if there are none.
+*	Threads take files from the front of their own share; once that is empty they steal from
+*	the back of the share of the thread with the most files left.
+*/
+static INT_4 NextBatchFile(tBatch *batchPtr, INT_4 threadIndex)
+{
+	INT_4 i, fileIndex, victim, mostLeft, left;
+
+	pthread_mutex_lock(&batchPtr->lock[threadIndex]);
+	fileIndex = -1;
+	if (batchPtr->first[threadIndex] < batchPtr->last[threadIndex])
+	{
+		fileIndex = batchPtr->first[threadIndex];
+		batchPtr->first[threadIndex]++;
+	}
+	pthread_mutex_unlock(&batchPtr->lock[threadIndex]);
+
+	while (fileIndex < 0)
+	{
+		/*Find the thread with the most left (its only a guess, since it can change once the lock is let go).*/
+		victim = -1;
+		mostLeft = 0;
+		for (i = 0; i < batchPtr->threadNum; i++)
+		{
+			pthread_mutex_lock(&batchPtr->lock[i]);
+			left = batchPtr->last[i] - batchPtr->first[i];
+			pthread_mutex_unlock(&batchPtr->lock[i]);
+			if (left > mostLeft)
+			{
+				mostLeft = left;
+				victim = i;
+			}
+		}
+		if (victim < 0)
+		{
+			break;	/*nothing left anywhere*/
+		}
+
+		pthread_mutex_lock(&batchPtr->lock[victim]);
+		if (batchPtr->first[victim] < batchPtr->last[victim])
+		{
+			batchPtr->last[victim]--;
+			fileIndex = batchPtr->last[victim];
+		}
+		pthread_mutex_unlock(&batchPtr->lock[victim]);
+	}
+
+	return(fileIndex);
+}
+
+/******************************CompareFileNames********************************************
+*
+*	For qsort'ing the file names from a directory.
+*/
+static int CompareFileNames(const void *a, const void *b)
+{
+	return(strcmp(*(char **)a, *(char **)b));
+}
+#endif
@@ -0,0 +1,294 @@
+/*********************************************************************************************
+Lutefisk is software for de novo sequencing of peptides from tandem mass spectra.
+Copyright (C) 1995  Richard S. Johnson
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+Contact:
+
+Richard S Johnson
+4650 Forest Ave SE
+Mercer Island, WA 98040
+
+jsrichar@alum.mit.edu
+*********************************************************************************************/
+
+
+
+/*
+	Preprocessed spectrum cache.  GetCidData spends most of its time turning the raw peaks into
+	the final peak list (smoothing, finding the peak width and threshold, condensing, removing 
+	isotopes, window filtering, etc.), and that work comes out the same every time a spectrum is 
+	searched again with different search settings.  When "Spectrum Cache" is on in the params 
+	file the final list is saved in a .lfc file next to the CID file (name.dta.lfc, or 
+	name.mgf.N.lfc for spectrum N of an MGF or mzML file), and the next run maps it into memory
+	instead of doing the preprocessing over.
+
+	A .lfc file is a tSpectrumCacheHeader followed by the tMSData structs of the peak list, in
+	the byte order of the machine that wrote it.  The header holds a hash of the raw peaks and of 
+	every parameter that the preprocessing looks at, so a file left over from a different raw 
+	spectrum or different settings is not used (it gets written over instead).
+*/
+
+/* ANSI headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(__MWERKS__)
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <sys/types.h>
+#endif
+
+/* Lutefisk headers */
+#include "LutefiskPrototypes.h"
+#include "LutefiskDefinitions.h"
+#include "ListRoutines.h"
+
+#define FNV_OFFSET_BASIS	14695981039346656037ULL		/*64 bit FNV-1a hash*/
+#define FNV_PRIME			1099511628211ULL
+
+static unsigned long long HashBytes(unsigned long long hash, void *bytes, long length);
+static void SpectrumCacheName(char *cacheName);
+
+
+/******************************HashBytes***************************************************
+*
+*	Adds length bytes to a 64 bit FNV-1a hash.
+*/
+static unsigned long long HashBytes(unsigned long long hash, void *bytes, long length)
+{
+	unsigned char *bytePtr = (unsigned char *) bytes;
+	long i;
+
+	for (i = 0; i < length; i++)
+	{
+		hash ^= bytePtr[i];
+		hash *= FNV_PRIME;
+	}
+
+	return(hash);
+}
+
+/******************************SpectrumCacheName*******************************************
+*
+*	The .lfc file for the spectrum being searched is put next to the CID file.  Spectra from
+*	an MGF, mzML or mzXML file get their spectrum or scan number in the name as well.
+*/
+static void SpectrumCacheName(char *cacheName)
+{
+	if (gSearch->cidBlockNum > 0)
+	{
+		sprintf(cacheName, "%s.%d.lfc", gParam.cidFilename, gSearch->cidBlockNum);
+	}
+	else
+	{
+		sprintf(cacheName, "%s.lfc", gParam.cidFilename);
+	}
+}
+
+/******************************SpectrumCacheKey*******************************************
+*
+*	Hashes the raw peaks read in by ReadCIDFile together with the parameters that GetCidData's
+*	preprocessing depends on.  It has to be called before any of them are changed, ie, before 
+*	the peak width or fragmentation pattern are worked out.
+*/
+unsigned long long SpectrumCacheKey(tMSDataList *rawList)
+{
+	unsigned long long key = FNV_OFFSET_BASIS;
+	INT_4 i;
+
+	for (i = 0; i < rawList->numObjects; i++)
+	{
+		key = HashBytes(key, &rawList->mass[i].mOverZ, sizeof(REAL_4));
+		key = HashBytes(key, &rawList->mass[i].intensity, sizeof(INT_4));
+	}
+	key = HashBytes(key, &msms.scanMassLow, sizeof(REAL_4));
+	key = HashBytes(key, &msms.scanMassHigh, sizeof(REAL_4));
+
+	key = HashBytes(key, &gParam.peptideMW, sizeof(REAL_4));
+	key = HashBytes(key, &gParam.chargeState, sizeof(INT_4));
+	key = HashBytes(key, &gParam.maxent3, sizeof(BOOLEAN));
+	key = HashBytes(key, &gParam.fragmentErr, sizeof(REAL_4));
+	key = HashBytes(key, &gParam.ionOffset, sizeof(REAL_4));
+	key = HashBytes(key, &gParam.fragmentPattern, sizeof(char));
+	key = HashBytes(key, &gParam.proteolysis, sizeof(char));
+	key = HashBytes(key, &gParam.centroidOrProfile, sizeof(char));
+	key = HashBytes(key, &gParam.monoToAv, sizeof(INT_4));
+	key = HashBytes(key, &gParam.ionsPerWindow, sizeof(REAL_4));
+	key = HashBytes(key, &gParam.modifiedNTerm, sizeof(REAL_4));
+	key = HashBytes(key, &gParam.modifiedCTerm, sizeof(REAL_4));
+	key = HashBytes(key, &gParam.peakWidth, sizeof(REAL_4));
+	key = HashBytes(key, &gParam.ionThreshold, sizeof(REAL_4));
+	key = HashBytes(key, &gParam.peptideErr, sizeof(REAL_4));
+	key = HashBytes(key, &gParam.ionsPerResidue, sizeof(REAL_4));
+	key = HashBytes(key, &gParam.CIDfileType, sizeof(char));
+	key = HashBytes(key, gMonoMass, sizeof(gMonoMass));	/*residue masses, including cysteine*/
+
+	return(key);
+}
+
+/******************************ReadSpectrumCache******************************************
+*
+*	If there is a .lfc file for this spectrum that was made with the same key, the peak list
+*	in it is returned and the gParam values that GetCidData would have worked out are set from
+*	its header.  Otherwise NULL is returned and nothing is changed.
+*/
+tMSDataList *ReadSpectrumCache(unsigned long long key)
+{
+	char cacheName[300];
+	char *data = NULL;
+	long size = 0;
+	tSpectrumCacheHeader *headerPtr;
+	tMSDataList *peakList = NULL;
+#if !defined(__MWERKS__)
+	INT_4 fd;
+	struct stat fileInfo;
+#else
+	FILE *fp;
+#endif
+
+	SpectrumCacheName(cacheName);
+
+#if !defined(__MWERKS__)
+	fd = open(cacheName, O_RDONLY);
+	if (fd < 0)
+	{
+		return(NULL);
+	}
+	if (fstat(fd, &fileInfo) == 0 && fileInfo.st_size >= (long)sizeof(tSpectrumCacheHeader))
+	{
+		size = fileInfo.st_size;
+		data = (char *) mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == (char *) MAP_FAILED)
+		{
+			data = NULL;
+		}
+	}
+	close(fd);	/*the mapping stays put*/
+#else
+	fp = fopen(cacheName, "rb");
+	if (fp == NULL)
+	{
+		return(NULL);
+	}
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	if (size >= (long)sizeof(tSpectrumCacheHeader))
+	{
+		data = (char *) malloc(size);
+		if (data != NULL && fread(data, 1, size, fp) != size)
+		{
+			free(data);
+			data = NULL;
+		}
+	}
+	fclose(fp);
+#endif
+	if (data == NULL)
+	{
+		return(NULL);
+	}
+
+	headerPtr = (tSpectrumCacheHeader *) data;
+	if (!memcmp(headerPtr->magic, SPECTRUM_CACHE_MAGIC, 4)
+		&& headerPtr->version == SPECTRUM_CACHE_VERSION
+		&& headerPtr->byteOrder == SPECTRUM_CACHE_BYTE_ORDER
+		&& headerPtr->key == key
+		&& headerPtr->numObjects > 0
+		&& size == (long)(sizeof(tSpectrumCacheHeader) + headerPtr->numObjects * sizeof(tMSData)))
+	{
+		peakList = (tMSDataList *) CreateNewList(sizeof(tMSData), headerPtr->numObjects, 10);
+		if (peakList == NULL)
+		{
+			printf("ReadSpectrumCache:  Out of memory");
+			exit(1);
+		}
+		memcpy(peakList->mass, data + sizeof(tSpectrumCacheHeader), 
+				headerPtr->numObjects * sizeof(tMSData));
+		peakList->numObjects = headerPtr->numObjects;
+
+		if (gParam.fMonitor)
+		{
+			printf("Using the preprocessed spectrum in '%s'\n", cacheName);
+		}
+		if (gParam.peakWidth == 0)
+		{
+			printf("The peak width is %5.2f\n", headerPtr->peakWidth * 2);
+		}
+		gParam.peakWidth = headerPtr->peakWidth;
+		gParam.fragmentErr = headerPtr->fragmentErr;
+		gParam.intThreshold = headerPtr->intThreshold;
+		gParam.centroidOrProfile = headerPtr->centroidOrProfile;
+		gParam.fragmentPattern = headerPtr->fragmentPattern;
+		if (gParam.fMonitor)
+		{
+			printf("Number of ions: %d \n", peakList->numObjects);
+		}
+	}
+
+#if !defined(__MWERKS__)
+	munmap(data, size);
+#else
+	free(data);
+#endif
+
+	return(peakList);
+}
+
+/******************************WriteSpectrumCache*****************************************
+*
+*	Saves the final peak list from GetCidData, along with the gParam values it worked out,
+*	in the .lfc file for this spectrum.  The file is written under a temporary name and then
+*	renamed, so a run that is killed part way through never leaves half a file behind.  If 
+*	the file can't be written (eg, the CID file is in a read-only directory) nothing is saved.
+*/
+void WriteSpectrumCache(unsigned long long key, tMSDataList *peakList)
+{
+	char cacheName[300], tempName[310];
+	tSpectrumCacheHeader header;
+	FILE *fp;
+	BOOLEAN written;
+
+	memset(&header, 0, sizeof(tSpectrumCacheHeader));
+	memcpy(header.magic, SPECTRUM_CACHE_MAGIC, 4);
+	header.version = SPECTRUM_CACHE_VERSION;
+	header.byteOrder = SPECTRUM_CACHE_BYTE_ORDER;
+	header.numObjects = peakList->numObjects;
+	header.key = key;
+	header.peakWidth = gParam.peakWidth;
+	header.fragmentErr = gParam.fragmentErr;
+	header.intThreshold = gParam.intThreshold;
+	header.centroidOrProfile = gParam.centroidOrProfile;
+	header.fragmentPattern = gParam.fragmentPattern;
+
+	SpectrumCacheName(cacheName);
+	sprintf(tempName, "%s.tmp", cacheName);
+	fp = fopen(tempName, "wb");
+	if (fp == NULL)
+	{
+		return;
+	}
+	written = fwrite(&header, sizeof(tSpectrumCacheHeader), 1, fp) == 1
+			&& fwrite(peakList->mass, sizeof(tMSData), peakList->numObjects, fp) == peakList->numObjects;
+	if (fclose(fp) != 0 || !written || rename(tempName, cacheName) != 0)
+	{
+		remove(tempName);
+	}
+}
@@ -29,6 +29,7 @@ jsrichar@alum.mit.edu
 #define _LUTEFISK_DEFS_
 
 
+#include <stdio.h>
 #include <time.h>
 
 #define DEBUG   /* Uncomment this line for debugging */
@@ -143,6 +144,14 @@ jsrichar@alum.mit.edu
 #define BOOLEAN	unsigned char
 #endif
 
+/*	Storage class for per-thread state.  Compilers without thread local storage get ordinary 
+	globals, which is fine as long as only one search runs at a time.	*/
+#if defined __GNUC__
+#define THREAD_LOCAL	__thread
+#else
+#define THREAD_LOCAL
+#endif
+
        
 /*	Define a few constants.	*/
 #define AMINO_ACID_NUMBER 25	/*Number of amino acids.*/
@@ -189,6 +198,9 @@ jsrichar@alum.mit.edu
 										to a function that sorts the ions.*/
 #define SPECTRAL_WINDOW_WIDTH 120	/*Width of spectrum that has a limit on the number of ions.*/
 #define MULTIPLIER_SWITCH 2.5	/*Used in determining gMultiplier*/
+#define SPECTRUM_CACHE_MAGIC "LFSC"	/*The first four bytes of a .lfc preprocessed spectrum file*/
+#define SPECTRUM_CACHE_VERSION 1	/*Bump this whenever the .lfc layout or the preprocessing changes*/
+#define SPECTRUM_CACHE_BYTE_ORDER 0x01020304
 #define GRAPH_LENGTH 400000	/*The maximum graph size (ie, peptides must be less than 4000 Da).*/
 #define AV_TO_MONO	0.999371395	/*The weighted average ratio between average and monoisotopic 
 								amino acid masses.*/
@@ -204,6 +216,9 @@ jsrichar@alum.mit.edu
 								required to hold that charge.*/
 #define MAX_PEPTIDE_LENGTH 60 	/*35 Maximum peptide length.*/
 #define MAX_GAPLIST (AMINO_ACID_NUMBER * AMINO_ACID_NUMBER)
+#define EXTENSION_GAP_LIST	1	/*ExtensionMassType flags:  the mass is in gGapList,*/
+#define EXTENSION_THREE_AA	2	/*it is the sum of three single amino acid masses,*/
+#define EXTENSION_NEAR_AA	4	/*or it is within gParam.fragmentErr of a single amino acid.*/
 #define AV_RESIDUE_MASS 119	/*This is the weighted average amino acid residue mass.*/
 #define TAG_MULTIPLIER 10
 #define AV_MONO_TRANSITION	400	/*The factor that converts average to mono is transitioned over
@@ -319,6 +334,49 @@ typedef struct
 	tMSData   *mass;
 }tMSDataList;
 
+typedef struct	/*Occupied node positions of the sequence graph, in increasing order.*/
+{
+	INT_4      numObjects;
+	INT_4      limit;
+	INT_4      sizeofobject;
+	INT_4      growNum;
+	INT_4     *node;
+}tNodeList;
+
+#define NODE_PAGE_BITS	8
+#define NODE_PAGE_SIZE	(1 << NODE_PAGE_BITS)
+
+typedef struct	/*Node values by nominal mass, w/ a page allocated only once a node on it is set.*/
+{
+	char     **page;			/*Unset pages point at a shared page of zero's.*/
+	INT_4      pageNum;
+	INT_4      valueSize;		/*sizeof(SCHAR) or sizeof(INT_4).*/
+}tNodeStore;
+
+#define NodeValue(storePtr, node)		(((SCHAR *)(storePtr)->page[(node) >> NODE_PAGE_BITS])[(node) & (NODE_PAGE_SIZE - 1)])
+#define NodeIntValue(storePtr, node)	(((INT_4 *)(storePtr)->page[(node) >> NODE_PAGE_BITS])[(node) & (NODE_PAGE_SIZE - 1)])
+
+typedef struct	/*Mass buckets over the sorted fragment ion m/z array used for scoring.*/
+{
+	INT_4      *fragMOverZ;		/*The array that was indexed (NULL if none).*/
+	INT_4      fragNum;
+	INT_4      lowMass;			/*m/z of the first bucket.*/
+	INT_4      bucketWidth;
+	INT_4      bucketNum;
+	INT_4      bucketLimit;		/*Number of INT_4's allocated for firstIon.*/
+	INT_4      *firstIon;		/*Index of the first ion at or above the bottom of each bucket.*/
+}tIonIndex;
+
+typedef struct	/*Cumulative fragment masses of one sequence, used to calculate b and y ions.*/
+{
+	INT_4      seqLength;
+	INT_4      limit;			/*Number of INT_4's allocated for each array.*/
+	INT_4      *residue;		/*The residue masses the ladder was built from.*/
+	INT_4      *bMass;			/*Summed mass of residues 0 thru i-1.*/
+	INT_4      *bCorrection;	/*Summed node correction of residues 0 thru i-1.*/
+	INT_4      *yCorrection;	/*Summed node correction of residues i thru seqLength-1.*/
+}tFragLadder;
+
 typedef struct 	/*Structure to hold data about the CID file.*/
 {
 	REAL_4 scanMassLow;
@@ -327,7 +385,6 @@ typedef struct 	/*Structure to hold data about the CID file.*/
 	char  centroidOrProfile;
 }tmsms;
 
-extern tmsms msms;
 
 typedef struct
 {
@@ -355,9 +412,13 @@ typedef struct 				/*Used to hold Lutefisk's parameters.*/
 {
 	char		fMonitor;
 	char		fVerbose;
+	char		fBatch;			/*TRUE to sequence the CID files on parallel threads*/
 	clock_t 	startTicks;
 	clock_t 	searchTime;
 	char		paramFile[256];
+	char		batchFile[256];	/*directory or manifest listing the CID files for batch mode*/
+	char		fServer;		/*TRUE to take spectrum requests on stdin or serverSocket*/
+	char		serverSocket[256];	/*Unix domain socket for server mode, see LutefiskServer.c*/
 	char		outputFile[256];
 	char 		cidFilename[256];
 	char            detailsFilename[256];
@@ -398,29 +459,95 @@ typedef struct 				/*Used to hold Lutefisk's parameters.*/
 	char		edmanFilename[256];
 	REAL_4 		ionsPerResidue;
 	char		CIDfileType;
+	INT_4		firstScan;		/*Only MS2 scans firstScan thru lastScan are read from mzML and */
+	INT_4		lastScan;		/*mzXML files (zero means no limit)...*/
+	REAL_4		minPrecursorMZ;	/*...and only those with a precursor m/z in this range*/
+	REAL_4		maxPrecursorMZ;
+	BOOLEAN		spectrumCache;	/*TRUE to keep preprocessed spectra in .lfc files, see LutefiskCache.c*/
 	char		databaseSequences[256];
 	BOOLEAN		quality;
 	INT_4		wrongSeqNum;
-	
-	INT_4		topSeqNum_orig;
-	REAL_4 		peptideMW_orig;
-	REAL_4 		peptideErr_orig;
-	REAL_4 		fragmentErr_orig;
-	REAL_4 		peakWidth_orig;
-	INT_4 		monoToAv_orig;
-	REAL_4		qtofErr_orig;
-	REAL_4 		ionOffset_orig;
-	REAL_4 		cysMW_orig;
-	REAL_4 		tagNMass_orig;
-	REAL_4 		tagCMass_orig; 
-	REAL_4		modifiedNTerm_orig;
-	REAL_4		modifiedCTerm_orig;
-        INT_4 		maxGapNum_orig;
-	char		outputFile_orig[256];
-        
+	INT_4		workerNum;	/*number of parallel workers; 0 means one per processor*/
+	BOOLEAN		fastXCorr;	/*TRUE to score cross-correlation as a sparse dot product, see LutefiskXCorr.c*/
+	char		subseqEngine;	/*'E' for exact top paths, 'C' to compare them w/ the beam search, else beam*/
+
 }tParam;
 
-extern tParam gParam;
+
+
+typedef struct		/*Used to pass back the scores from a mass scramble worker process.*/
+{
+	INT_4		wrongNum;	/*how much the pass advanced gWrongIndex (0 or 1)*/
+	BOOLEAN		stored;		/*TRUE if the pass filled in gWrong*Score[gWrongIndex]*/
+	REAL_4		xCorrScore;
+	REAL_4		intScore;
+	REAL_4		probScore;
+	REAL_4		qualityScore;
+	REAL_4		comboScore;
+}tScrambleResult;
+
+typedef struct		/*An MGF (Mascot generic format) file, see LutefiskMGF.c*/
+{
+	char		*data;			/*The whole file, mapped into memory*/
+	long		size;
+	long		position;		/*Where NextMGFSpectrum starts looking for BEGIN IONS*/
+	INT_4		spectrumNum;	/*How many BEGIN IONS blocks have been found so far*/
+	BOOLEAN		mapped;			/*FALSE if data was read in with fread instead*/
+}tMGFFile;
+
+typedef struct		/*The start of a .lfc preprocessed spectrum file, see LutefiskCache.c*/
+{
+	char		magic[4];		/*SPECTRUM_CACHE_MAGIC*/
+	INT_4		version;		/*SPECTRUM_CACHE_VERSION*/
+	INT_4		byteOrder;		/*SPECTRUM_CACHE_BYTE_ORDER as written by the machine that made it*/
+	INT_4		numObjects;		/*Number of tMSData structs that follow the header*/
+	unsigned long long	key;	/*Hash of the raw peaks and the preprocessing parameters*/
+	REAL_4		peakWidth;		/*gParam values that GetCidData may have changed*/
+	REAL_4		fragmentErr;
+	INT_4		intThreshold;
+	char		centroidOrProfile;
+	char		fragmentPattern;
+	char		unused[2];
+}tSpectrumCacheHeader;
+
+typedef struct		/*An mzML or mzXML file being read a piece at a time, see LutefiskMzML.c*/
+{
+	FILE		*fp;
+	char		format;			/*'L' for mzML, 'X' for mzXML*/
+	char		*buffer;		/*The part of the file being looked at*/
+	INT_4		bufferLength;
+	INT_4		bufferPosition;
+	long		bufferOffset;	/*Where buffer[0] is in the file*/
+	char		*tag;			/*The last tag read, without the < and >*/
+	INT_4		tagLength;
+	INT_4		tagSize;
+	char		*text;			/*The text after it, if asked for*/
+	INT_4		textLength;
+	INT_4		textSize;
+	unsigned char	*bytes;		/*Decoded base64, and then uncompressed*/
+	INT_4		bytesSize;
+	unsigned char	*inflated;
+	INT_4		inflatedSize;
+	REAL_8		*mzValues;		/*The peak arrays of the current spectrum*/
+	INT_4		mzValueNum;
+	INT_4		mzValueSize;
+	REAL_8		*intValues;
+	INT_4		intValueNum;
+	INT_4		intValueSize;
+	INT_4		spectrumNum;	/*How many spectra (of any MS level) have been started*/
+	INT_4		firstScan, lastScan;			/*Filters, from tParam*/
+	REAL_4		minPrecursorMZ, maxPrecursorMZ;
+}tMzMLFile;
+
+typedef struct		/*An MS2 spectrum from an mzML or mzXML file*/
+{
+	INT_4		scanNum;
+	REAL_4		precursorMZ;
+	INT_4		precursorCharge;	/*zero if the file doesn't say*/
+	BOOLEAN		centroided;
+	long		offset;				/*Where its start tag is in the file, for SeekMzMLSpectrum*/
+	tMSDataList	*peakList;			/*NULL unless the peaks were asked for*/
+}tMzMLSpectrum;
 
 
 extern struct Sequence		/*Used to hold sequence info during subsequencing.*/
@@ -482,60 +609,120 @@ typedef struct extension {
 } extension;
 
 
-extern char gSingAA[AMINO_ACID_NUMBER];
-  
-extern REAL_4 gMonoMass[AMINO_ACID_NUMBER];
-
-extern REAL_4 gAvMass[AMINO_ACID_NUMBER];
-
-extern INT_4 gNomMass[AMINO_ACID_NUMBER];
-
 extern REAL_4 gElementMass[ELEMENT_NUMBER];
 
-extern INT_4 gGapList[MAX_GAPLIST];
-
-extern INT_4 gAminoAcidNumber;
-
-extern INT_4 gGapListIndex;
-
 extern INT_4 gEdmanData[MAX_PEPTIDE_LENGTH][AMINO_ACID_NUMBER], gMaxCycleNum;
 
-extern REAL_4 H2O, NH3;
-
-extern INT_4 gElementMass_x100[ELEMENT_NUMBER];	/*Values assigned in 
-												CreateGlobalIntegerMassArrays*/
-extern INT_4 gMonoMass_x100[AMINO_ACID_NUMBER];	/*Values assigned in 
-												CreateGlobalIntegerMassArrays*/
-extern INT_4 gMultiplier;	/*Value determined in CreateGlobalIntegerMassArrays*/
-
-extern INT_4 gNodeCorrection[MAX_GAPLIST]; /*Value determined in CreateGlobalIntegerMassArrays*/
-
-extern INT_4 gElementCorrection[ELEMENT_NUMBER]; /*Value determined in CreateGlobalIntegerMassArrays*/
-
-extern INT_4 gAvMonoTransition, gWater, gAmmonia, gCO, gAvResidueMass, gGraphLength;
-
-extern REAL_4 gWrongXCorrScore[WRONG_SEQ_NUM + 1];
-
-extern REAL_4 gWrongIntScore[WRONG_SEQ_NUM + 1];
-
-extern REAL_4 gWrongProbScore[WRONG_SEQ_NUM + 1];
-
-extern REAL_4 gWrongQualityScore[WRONG_SEQ_NUM + 1];
-
-extern REAL_4 gWrongComboScore[WRONG_SEQ_NUM + 1];
-
-extern INT_4 gSingleAACleavageSites;
-
-extern INT_4 gWrongIndex;
-
-extern INT_4 gTagLength;
-
-extern BOOLEAN gCorrectMass;
+extern REAL_4 gIonTypeWeightingTotal;
 
-extern BOOLEAN gFirstTimeThru;
 
-extern REAL_4 gIonTypeWeightingTotal;
+/*
+*	Everything that a search reads and writes as it goes is kept in a tSearchContext.  The one
+*	that main fills in from the Lutefisk.params, .residues, and .details files is never used 
+*	for sequencing; each call to Run gets a fresh copy of it (see NewSearchContext), so nothing
+*	carries over from one spectrum to the next, and two searches can run at once on different 
+*	threads.  BindSearchContext makes a context the current one for the calling thread, and the 
+*	old global names below refer to the fields of whichever context is current.
+*/
+struct HaggisState;		/*Defined in LutefiskHaggis.c*/
+struct PreparedSpectrum;	/*Defined in LutefiskScore.c*/
 
-extern BOOLEAN gDatabaseSeqCorrect;
+typedef struct
+{
+	tParam		param;
+	tmsms		msms;
+	
+	char		singAA[AMINO_ACID_NUMBER];		/*These four get altered during scoring.*/
+	REAL_4		monoMass[AMINO_ACID_NUMBER];
+	REAL_4		avMass[AMINO_ACID_NUMBER];
+	INT_4		nomMass[AMINO_ACID_NUMBER];
+	INT_4		aminoAcidNumber;
+	REAL_4		h2o, nh3;
+	
+	INT_4		elementMass_x100[ELEMENT_NUMBER];	/*Values assigned in 
+													CreateGlobalIntegerMassArrays*/
+	INT_4		monoMass_x100[AMINO_ACID_NUMBER];
+	INT_4		multiplier;
+	INT_4		nodeCorrection[MAX_GAPLIST];
+	INT_4		elementCorrection[ELEMENT_NUMBER];
+	INT_4		avMonoTransition, water, ammonia, co, avResidueMass, graphLength;
+	
+	INT_4		gapList[MAX_GAPLIST];			/*Values assigned in SetupGapList*/
+	INT_4		gapListIndex;
+	char		*extensionMass;		/*EXTENSION_ flags for each mass, made in SetupGapList*/
+	INT_4		extensionMassLimit;
+	
+	REAL_4		wrongXCorrScore[WRONG_SEQ_NUM + 1];	/*Best scores for the wrong masses*/
+	REAL_4		wrongIntScore[WRONG_SEQ_NUM + 1];
+	REAL_4		wrongProbScore[WRONG_SEQ_NUM + 1];
+	REAL_4		wrongQualityScore[WRONG_SEQ_NUM + 1];
+	REAL_4		wrongComboScore[WRONG_SEQ_NUM + 1];
+	INT_4		wrongIndex;
+	
+	INT_4		singleAACleavageSites;
+	INT_4		tagLength;
+	BOOLEAN		correctMass;
+	BOOLEAN		firstTimeThru;
+	BOOLEAN		databaseSeqCorrect;
+	
+	REAL_4		*spectrum1;		/*Cross-correlation buffers, see LutefiskFourier.c*/
+	REAL_4		*spectrum2;
+	REAL_4		*tau;
+	REAL_4		*spectrum1FT;	/*Fourier transform of spectrum1, see TransformSpectrum1*/
+	UINT_4		sizeofSpectra;
+	REAL_4		*xcorrSpectrum;	/*Offset-corrected spectrum1 for the fast cross-correlation...*/
+	INT_4		*mockBins;		/*...and the spectrum2 bins that a candidate has filled in*/
+	INT_4		mockBinNum;
+	
+	struct HaggisState	*haggis;	/*Allocated the first time Haggis is used*/
+	struct PreparedSpectrum	*preparedSpectrum;	/*Ion arrays shared by the mass passes, see 
+												PrepareSpectrum*/
+	
+	char		*cidBlock;		/*If not NULL, ReadCIDFile reads the CID data from here (one MGF 
+								spectrum) rather than opening cidFilename; it belongs to the caller*/
+	INT_4		cidBlockLength;
+	INT_4		cidBlockNum;	/*Which spectrum in the MGF file it is, counting from one, or the 
+								scan number in an mzML or mzXML file*/
+	tMSDataList	*cidPeakList;	/*If not NULL, the peaks of one mzML or mzXML spectrum, which 
+								ReadCIDFile takes over...*/
+	REAL_4		cidPrecursorMZ;	/*...along with its precursor*/
+	INT_4		cidPrecursorCharge;
+}tSearchContext;
+
+extern THREAD_LOCAL tSearchContext *gSearch;
+
+#define gParam					(gSearch->param)
+#define msms					(gSearch->msms)
+#define gSingAA					(gSearch->singAA)
+#define gMonoMass				(gSearch->monoMass)
+#define gAvMass					(gSearch->avMass)
+#define gNomMass				(gSearch->nomMass)
+#define gAminoAcidNumber		(gSearch->aminoAcidNumber)
+#define H2O						(gSearch->h2o)
+#define NH3						(gSearch->nh3)
+#define gElementMass_x100		(gSearch->elementMass_x100)
+#define gMonoMass_x100			(gSearch->monoMass_x100)
+#define gMultiplier				(gSearch->multiplier)
+#define gNodeCorrection			(gSearch->nodeCorrection)
+#define gElementCorrection		(gSearch->elementCorrection)
+#define gAvMonoTransition		(gSearch->avMonoTransition)
+#define gWater					(gSearch->water)
+#define gAmmonia				(gSearch->ammonia)
+#define gCO						(gSearch->co)
+#define gAvResidueMass			(gSearch->avResidueMass)
+#define gGraphLength			(gSearch->graphLength)
+#define gGapList				(gSearch->gapList)
+#define gGapListIndex			(gSearch->gapListIndex)
+#define gWrongXCorrScore		(gSearch->wrongXCorrScore)
+#define gWrongIntScore			(gSearch->wrongIntScore)
+#define gWrongProbScore			(gSearch->wrongProbScore)
+#define gWrongQualityScore		(gSearch->wrongQualityScore)
+#define gWrongComboScore		(gSearch->wrongComboScore)
+#define gWrongIndex				(gSearch->wrongIndex)
+#define gSingleAACleavageSites	(gSearch->singleAACleavageSites)
+#define gTagLength				(gSearch->tagLength)
+#define gCorrectMass			(gSearch->correctMass)
+#define gFirstTimeThru			(gSearch->firstTimeThru)
+#define gDatabaseSeqCorrect		(gSearch->databaseSeqCorrect)
 
 #endif /* _LUTEFISK_DEFS_ */
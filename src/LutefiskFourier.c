@@ -54,12 +54,36 @@ jsrichar@alum.mit.edu
 #include "LutefiskPrototypes.h"
 #include "LutefiskDefinitions.h"
 
-REAL_4 *	spectrum1 = NULL;
-REAL_4 * spectrum2 = NULL;
-REAL_4 * tau = NULL;
-
-extern UINT_4 SIZEOF_SPECTRA;
-
+/*	The cross-correlation buffers belong to the current search context.	*/
+#define spectrum1		(gSearch->spectrum1)
+#define spectrum2		(gSearch->spectrum2)
+#define tau				(gSearch->tau)
+#define spectrum1FT		(gSearch->spectrum1FT)
+#define SIZEOF_SPECTRA	(gSearch->sizeofSpectra)
+#define xcorrSpectrum	(gSearch->xcorrSpectrum)
+#define mockBins		(gSearch->mockBins)
+#define mockBinNum		(gSearch->mockBinNum)
+
+/*Definitions for this file*/
+#define XCORR_OFFSET_BINS	75	/*Half-width of the background window for the fast cross-correlation*/
+
+typedef struct	/*Everything about an FFT that depends only on its size*/
+{
+	UINT_4	n;				/*Number of real points; zero if the plan has not been made yet*/
+	REAL_8	*twiddleR;		/*cos and sin for each butterfly of each stage of FastFourier,*/
+	REAL_8	*twiddleI[2];	/*for the stage w/ span mmax starting at mmax/2 - 1; the sines are
+							for the forward and then the inverse transform*/
+	UINT_4	*swap[2];		/*Bit reversal swaps for n and n/2 complex points...*/
+	UINT_4	swapNum[2];		/*...as pairs of array indices*/
+	REAL_8	*realR;			/*cos and sin used by realft*/
+	REAL_8	*realI;
+	REAL_4	*workSpace;		/*Scratch space for CrossCorrelate, 2n long*/
+}tFFTPlan;
+
+THREAD_LOCAL tFFTPlan gFFTPlan;
+
+static void FFTPlan(UINT_4 n);
+static UINT_4 MakeBitReversal(UINT_4 *swap, UINT_4 nn);
 static void FastFourier(REAL_4 *data, UINT_4 nn, INT_4 isign);
 static void twofft(REAL_4 data1[], REAL_4 data2[], REAL_4 fft1[], REAL_4 fft2[], UINT_4 n);
 static void realft(REAL_4 data[], UINT_4 n, int isign);
@@ -276,7 +300,9 @@ void FillInSpectrum1(struct MSData *firstMassPtr)
 /*************************************SetupCrossCorrelation**********************************
 *
 *  Sets aside memory blocks for the two spectra that will be dummied up and padded, and for
-*  the array to contain the cross-correlation results, tau.
+*  the array to contain the cross-correlation results, tau.  The blocks are kept in the search
+*  context for the next peptide MW pass (FreeSearchContext frees them), so after the first 
+*  pass they only need to be cleared.
 */
 void SetupCrossCorrelation(void) 
 {
@@ -289,16 +315,14 @@ void SetupCrossCorrelation(void)
 	*/
 	SIZEOF_SPECTRA = SIZEOF_SPECTRA_BIG;
 	
-	if (spectrum1) 
-	{
-		free(spectrum1);   /* Throw away the old data (if any exists) */
-	}	
-
-	spectrum1 = (REAL_4 *) malloc(SIZEOF_SPECTRA*sizeof(REAL_4));
-	if (NULL == spectrum1)
+	if (NULL == spectrum1) 
 	{
-		printf("Not enough memory to allocate spectrum1");
-		exit(1);
+		spectrum1 = (REAL_4 *) malloc(SIZEOF_SPECTRA*sizeof(REAL_4));
+		if (NULL == spectrum1)
+		{
+			printf("Not enough memory to allocate spectrum1");
+			exit(1);
+		}
 	}
 
 	for(i = 0; i < SIZEOF_SPECTRA; i++)
@@ -307,15 +331,14 @@ void SetupCrossCorrelation(void)
 	}
 	
 	
-	if (spectrum2) {
-		free(spectrum2);   /* Throw away the old data (if any exists) */
-	}	
-
-	spectrum2 = (REAL_4 *) malloc(SIZEOF_SPECTRA*sizeof(REAL_4));
-	if (NULL == spectrum2)
+	if (NULL == spectrum2) 
 	{
-		printf("Not enough memory to allocate spectrum2");
-		exit(1);
+		spectrum2 = (REAL_4 *) malloc(SIZEOF_SPECTRA*sizeof(REAL_4));
+		if (NULL == spectrum2)
+		{
+			printf("Not enough memory to allocate spectrum2");
+			exit(1);
+		}
 	}
 
 	for(i = 0; i < SIZEOF_SPECTRA; i++)
@@ -324,17 +347,16 @@ void SetupCrossCorrelation(void)
 	}
 	
 	
-	if (tau) {	/* tau will be the array for the results of the cross-correlation
-				*  and it needs to be twice as large as the spectra.
-				*/
-		free(tau);   /* Throw away the old data (if any exists) */
-	}	
-
-	tau = (REAL_4 *) malloc(SIZEOF_SPECTRA * 2 * sizeof(REAL_4));
-	if (NULL == tau)
-	{
-		printf("Not enough memory to allocate tau");
-		exit(1);
+	if (NULL == tau) 
+	{	/* tau will be the array for the results of the cross-correlation
+		*  and it needs to be twice as large as the spectra.
+		*/
+		tau = (REAL_4 *) malloc(SIZEOF_SPECTRA * 2 * sizeof(REAL_4));
+		if (NULL == tau)
+		{
+			printf("Not enough memory to allocate tau");
+			exit(1);
+		}
 	}
 
 	for(i = 0; i < (SIZEOF_SPECTRA) * 2; i++)
@@ -342,8 +364,81 @@ void SetupCrossCorrelation(void)
 		tau[i] = 0;
 	}
 }
+/*************************************SetupFastXCorr**********************************
+*
+*  Does the part of the cross-correlation that only depends on the spectrum, so that each
+*  candidate can be scored as a dot product over the handful of bins in its mock spectrum
+*  (see FastXCorrScore in LutefiskXCorr.c).  This is Eng's fast Sequest trick:  since
+*  tau(k) = sum of spectrum2[n] * spectrum1[n - k], the mean of tau(k) over the offsets 
+*  -XCORR_OFFSET_BINS <= k <= XCORR_OFFSET_BINS (k != 0) is spectrum2 dotted with a running 
+*  mean of spectrum1, and tau(0) minus that mean is spectrum2 dotted with xcorrSpectrum below.
+*  The spectrum1 and spectrum2 that SetupCrossCorrelation allocated must already be there, and 
+*  spectrum1 filled in.  Returns the same score for spectrum1 against itself, which is what the
+*  candidate scores are normalized by.
+*/
+REAL_4 SetupFastXCorr(void) 
+{
+
+	INT_4	i, windowLow, windowHigh;
+	REAL_8	windowSum, autocorrelation;
+	
+	if (NULL == xcorrSpectrum) 
+	{
+		xcorrSpectrum = (REAL_4 *) malloc(SIZEOF_SPECTRA*sizeof(REAL_4));
+		if (NULL == xcorrSpectrum)
+		{
+			printf("Not enough memory to allocate xcorrSpectrum");
+			exit(1);
+		}
+	}
+	
+	if (NULL == mockBins) 
+	{
+		mockBins = (INT_4 *) malloc(SIZEOF_SPECTRA*sizeof(INT_4));
+		if (NULL == mockBins)
+		{
+			printf("Not enough memory to allocate mockBins");
+			exit(1);
+		}
+	}
+	mockBinNum = 0;
+	
+/*	Slide a window of +/- XCORR_OFFSET_BINS along spectrum1, leaving out the bin in the middle.*/
+	windowSum = 0;
+	for(i = 1; i <= XCORR_OFFSET_BINS && i < SIZEOF_SPECTRA; i++)
+	{
+		windowSum += spectrum1[i];
+	}
+	autocorrelation = 0;
+	for(i = 0; i < SIZEOF_SPECTRA; i++)
+	{
+		xcorrSpectrum[i] = spectrum1[i] - windowSum / (2 * XCORR_OFFSET_BINS);
+		autocorrelation += spectrum1[i] * xcorrSpectrum[i];
+		
+		windowLow = i - XCORR_OFFSET_BINS;	/*move the window up one bin*/
+		windowHigh = i + XCORR_OFFSET_BINS + 1;
+		if(windowLow >= 0)
+		{
+			windowSum -= spectrum1[windowLow];
+		}
+		windowSum += spectrum1[i];
+		if(i + 1 < SIZEOF_SPECTRA)
+		{
+			windowSum -= spectrum1[i + 1];
+		}
+		if(windowHigh < SIZEOF_SPECTRA)
+		{
+			windowSum += spectrum1[windowHigh];
+		}
+	}
+	
+	return((REAL_4) autocorrelation);
+}
 /*************************************CrossCorrelate**********************************
 *
+*  Cross-correlates array1 with array2 (both 1-based and n long) and puts the result in
+*  result[1] through result[n], with the negative offsets wrapped around to the end.  result
+*  must have room for 2n values.
 */
 void CrossCorrelate(REAL_4 *array1, REAL_4 *array2, UINT_4 n, REAL_4 *result) 
 {
@@ -353,28 +448,207 @@ void CrossCorrelate(REAL_4 *array1, REAL_4 *array2, UINT_4 n, REAL_4 *result)
 	REAL_4				*workSpace;
 	
 	
-	workSpace = (REAL_4 *) malloc((n * 2) * sizeof(REAL_4));
-	for(i = 0; i < (n * 2); i++)
+	FFTPlan(n);
+	workSpace = gFFTPlan.workSpace - 1;	/* This is done so the array is not treated as 0 based. */
+	twofft(array1, array2, workSpace, result, n);
+	for (i = 2; i <= n+2; i += 2) {
+		result[i-1] = (workSpace[i-1] * (temp = result[i-1]) + workSpace[i] * result[i])/(n * 2);
+		result[i] = (workSpace[i] * temp - workSpace[i-1] * result[i])/(n * 2);
+	}
+	result[2] = result[n+1];
+	realft(result, n, -1);
+}	
+
+/*************************************TransformSpectrum1**********************************
+*
+*  Spectrum1 is the same for every candidate sequence, so its Fourier transform is done just
+*  once, after FillInSpectrum1, and kept in spectrum1FT for CrossCorrelateSpectrum1.
+*/
+void TransformSpectrum1(void) 
+{
+
+	UINT_4	i;
+	
+	if (NULL == spectrum1FT) 
 	{
-		workSpace[i] = 0;
-	}
-	if (workSpace) {
-		workSpace--;	/* This is done so the array is not treated as 0 based. */
-		twofft(array1, array2, workSpace, result, n);
-		for (i = 2; i <= n+2; i += 2) {
-			result[i-1] = (workSpace[i-1] * (temp = result[i-1]) + workSpace[i] * result[i])/(n * 2);
-			result[i] = (workSpace[i] * temp - workSpace[i-1] * result[i])/(n * 2);
+		spectrum1FT = (REAL_4 *) malloc(SIZEOF_SPECTRA*sizeof(REAL_4));
+		if (NULL == spectrum1FT)
+		{
+			printf("Not enough memory to allocate spectrum1FT");
+			exit(1);
 		}
-		result[2] = result[n+1];
-		realft(result, n, -1);
-		
-		workSpace++;
-		free(workSpace);
-	}	
-}	
+	}
+	
+	for(i = 0; i < SIZEOF_SPECTRA; i++)
+	{
+		spectrum1FT[i] = spectrum1[i];
+	}
+	FFTPlan(SIZEOF_SPECTRA);
+	realft(spectrum1FT-1, SIZEOF_SPECTRA, 1);
+}
+
+/*************************************CrossCorrelateSpectrum1**********************************
+*
+*  Does the same thing as CrossCorrelate(array1, spectrum1-1, SIZEOF_SPECTRA, result), using 
+*  the transform that TransformSpectrum1 kept, so only array1 has to be transformed.  array1
+*  and result are 1-based, as for CrossCorrelate, and array1 is left alone.
+*/
+void CrossCorrelateSpectrum1(REAL_4 *array1, REAL_4 *result) 
+{
+
+	UINT_4		i, n;
+	REAL_4		temp;
+	REAL_4		*transform;
+	
+	n = SIZEOF_SPECTRA;
+	transform = spectrum1FT - 1;
+	
+	for (i = 1; i <= n; i++) 
+	{
+		result[i] = array1[i];
+	}
+	realft(result, n, 1);
+	
+	result[1] = (result[1] * transform[1])/(n * 2);	/*zero and n/2 frequencies are real*/
+	result[2] = (result[2] * transform[2])/(n * 2);
+	for (i = 4; i <= n; i += 2) {
+		result[i-1] = ((temp = result[i-1]) * transform[i-1] + result[i] * transform[i])/(n * 2);
+		result[i] = (result[i] * transform[i-1] - temp * transform[i])/(n * 2);
+	}
+	realft(result, n, -1);
+}
+
+/*************************************FFTPlan**********************************
+*
+*  Makes the plan for FFTs of n real points (n a power of two) for the calling thread, unless
+*  it already has one.  The twiddle factors are worked out with the same trig recurrences,
+*  in the same order, that FastFourier and realft used to use, so the transforms come out 
+*  exactly the same as before.
+*/
+static void FFTPlan(UINT_4 n) 
+{
+
+	UINT_4	m, mmax, i;
+	REAL_8	wtemp, wr, wpr, wpi, wi, theta;
+	
+	if (gFFTPlan.n == n)
+	{
+		return;
+	}
+	FreeFourierPlan();
+	
+	gFFTPlan.twiddleR = (REAL_8 *) malloc(n * sizeof(REAL_8));
+	gFFTPlan.twiddleI[0] = (REAL_8 *) malloc(n * sizeof(REAL_8));
+	gFFTPlan.twiddleI[1] = (REAL_8 *) malloc(n * sizeof(REAL_8));
+	gFFTPlan.swap[0] = (UINT_4 *) malloc(n * 2 * sizeof(UINT_4));
+	gFFTPlan.swap[1] = (UINT_4 *) malloc(n * sizeof(UINT_4));
+	gFFTPlan.realR = (REAL_8 *) malloc((n / 4 + 1) * sizeof(REAL_8));
+	gFFTPlan.realI = (REAL_8 *) malloc((n / 4 + 1) * sizeof(REAL_8));
+	gFFTPlan.workSpace = (REAL_4 *) malloc(n * 2 * sizeof(REAL_4));
+	if (gFFTPlan.twiddleR == NULL || gFFTPlan.twiddleI[0] == NULL || gFFTPlan.twiddleI[1] == NULL
+		|| gFFTPlan.swap[0] == NULL 
+		|| gFFTPlan.swap[1] == NULL || gFFTPlan.realR == NULL || gFFTPlan.realI == NULL 
+		|| gFFTPlan.workSpace == NULL)
+	{
+		printf("FFTPlan:  Out of memory");
+		exit(1);
+	}
+	
+/*	FastFourier is called with up to n complex points, which is 2n array values.*/
+	for (mmax = 2; mmax < n * 2; mmax <<= 1) {
+		theta = 6.28318530717959/mmax;
+		wpr = -2.0 * pow(sin(0.5 * theta),2);
+		wpi = sin(theta);
+		wr = 1.0;
+		wi = 0.0;
+		for (m = 1; m < mmax; m += 2) {
+			gFFTPlan.twiddleR[(mmax >> 1) - 1 + (m >> 1)] = wr;
+			gFFTPlan.twiddleI[0][(mmax >> 1) - 1 + (m >> 1)] = wi;
+			gFFTPlan.twiddleI[1][(mmax >> 1) - 1 + (m >> 1)] = -wi;	/*theta is negative*/
+			wr = (wtemp = wr) * wpr - wi * wpi + wr;
+			wi = wi * wpr + wtemp * wpi + wi;
+		}
+	}
+	
+	gFFTPlan.swapNum[0] = MakeBitReversal(gFFTPlan.swap[0], n);
+	gFFTPlan.swapNum[1] = MakeBitReversal(gFFTPlan.swap[1], n >> 1);
+	
+	theta = 3.141592653589793/(REAL_8) (n>>1);
+	wtemp = sin(0.5 * theta);
+	wpr = -2.0 * wtemp * wtemp;
+	wpi = sin(theta);
+	wr  = 1.0 + wpr;
+	wi  = wpi;
+	for (i=2; i<=(n>>2); i++) {
+		gFFTPlan.realR[i] = wr;
+		gFFTPlan.realI[i] = wi;
+		wr = (wtemp = wr) * wpr - wi * wpi + wr;
+		wi = wi * wpr + wtemp * wpi + wi;
+	}
+	
+	gFFTPlan.n = n;
+}
+
+/*************************************MakeBitReversal**********************************
+*
+*  Lists the swaps that put nn complex points in bit reversed order, as pairs of 1-based
+*  array indices, and returns the number of pairs.
+*/
+static UINT_4 MakeBitReversal(UINT_4 *swap, UINT_4 nn) 
+{
+
+	UINT_4	n, m, j, i, swapNum;
+	
+	n = nn << 1;
+	j = 1;
+	swapNum = 0;
+	for (i = 1; i < n; i += 2) {
+		if (j > i) {
+			swap[swapNum * 2] = i;
+			swap[swapNum * 2 + 1] = j;
+			swapNum++;
+		}
+		m = n >> 1;
+		while (m >= 2 && j > m) {
+			j -= m;
+			m >>= 1;
+		}
+		j += m;
+	}
+	
+	return(swapNum);
+}
+
+/*************************************FreeFourierPlan**********************************
+*
+*  Frees the calling thread's FFT plan.  A thread that has done some cross-correlation 
+*  calls this before it finishes.
+*/
+void FreeFourierPlan(void) 
+{
+	free(gFFTPlan.twiddleR);
+	free(gFFTPlan.twiddleI[0]);
+	free(gFFTPlan.twiddleI[1]);
+	free(gFFTPlan.swap[0]);
+	free(gFFTPlan.swap[1]);
+	free(gFFTPlan.realR);
+	free(gFFTPlan.realI);
+	free(gFFTPlan.workSpace);
+	gFFTPlan.twiddleR = NULL;
+	gFFTPlan.twiddleI[0] = NULL;
+	gFFTPlan.twiddleI[1] = NULL;
+	gFFTPlan.swap[0] = NULL;
+	gFFTPlan.swap[1] = NULL;
+	gFFTPlan.realR = NULL;
+	gFFTPlan.realI = NULL;
+	gFFTPlan.workSpace = NULL;
+	gFFTPlan.n = 0;
+}
 
 /*************************************FastFourier**********************************
 *
+*  The plan for this size has to have been made already.  The butterflies of each stage are
+*  done one block at a time, so that the inner loop runs straight through the array.
 */
 static void FastFourier(REAL_4 *array, UINT_4 nn, INT_4 isign) 
 {
@@ -385,40 +659,42 @@ static void FastFourier(REAL_4 *array, UINT_4 nn, INT_4 isign)
 	UINT_4 		j;
 	UINT_4		istep;
 	UINT_4		i;
+	UINT_4		k;
+	UINT_4		swapNum;
+	UINT_4		*swap;
 	REAL_4				tempr;
 	REAL_4				tempi;
-	REAL_8 				wtemp;
 	REAL_8 				wr;
-	REAL_8			 	wpr;
-	REAL_8				wpi;
 	REAL_8				wi;
-	REAL_8				theta;
+	REAL_8				*twiddleR;
+	REAL_8				*twiddleI;
 	
 	n = nn << 1;
-	j = 1;
-	for (i = 1; i < n; i += 2) {
-		if (j > i) {
-			SWAP(array[j],array[i]);
-			SWAP(array[j+1],array[i+1]);
-		}
-		m = n >> 1;
-		while (m >= 2 && j > m) {
-			j -= m;
-			m >>= 1;
-		}
-		j += m;
+	if (nn == gFFTPlan.n) {
+		swap = gFFTPlan.swap[0];
+		swapNum = gFFTPlan.swapNum[0];
+	}
+	else {
+		swap = gFFTPlan.swap[1];
+		swapNum = gFFTPlan.swapNum[1];
+	}
+	for (k = 0; k < swapNum; k++) {
+		i = swap[k * 2];
+		j = swap[k * 2 + 1];
+		SWAP(array[j],array[i]);
+		SWAP(array[j+1],array[i+1]);
 	}	
 	
 	mmax = 2;
 	while (n> mmax) {
 		istep = mmax << 1;
-		theta = isign * (6.28318530717959/mmax);
-		wpr = -2.0 * pow(sin(0.5 * theta),2);
-		wpi = sin(theta);
-		wr = 1.0;
-		wi = 0.0;
-		for (m=1; m<mmax; m+=2) {
-			for (i=m; i<=n; i+=istep) {
+		twiddleR = gFFTPlan.twiddleR + (mmax >> 1) - 1;
+		twiddleI = gFFTPlan.twiddleI[isign < 0] + (mmax >> 1) - 1;
+		for (k = 1; k <= n; k += istep) {
+			for (m = 1; m < mmax; m += 2) {
+				wr = twiddleR[m >> 1];
+				wi = twiddleI[m >> 1];
+				i = k + m - 1;
 				j = i + mmax;
 				tempr = wr * array[j] - wi * array[j+1];
 				tempi = wr * array[j+1] + wi * array[j];
@@ -427,8 +703,6 @@ static void FastFourier(REAL_4 *array, UINT_4 nn, INT_4 isign)
 				array[i] += tempr;
 				array[i+1] += tempi;
 			}
-			wr = (wtemp = wr) * wpr - wi * wpi + wr;
-			wi = wi * wpr + wtemp * wpi + wi;
 		}
 		mmax = istep;
 	}
@@ -481,25 +755,21 @@ static void realft(REAL_4 *array, UINT_4 n, int isign)
 
 	UINT_4 i, i1, i2, i3, i4, np3;
 	REAL_4  c1=0.5, c2, h1r, h1i, h2r, h2i;
-	REAL_8 wr, wi, wpr, wpi, wtemp, theta;
+	REAL_8 wr, wi;
 	
-	theta = 3.141592653589793/(REAL_8) (n>>1);
 	if (isign == 1) {
 		c2 = -0.5;
 		FastFourier(array, n>>1, 1);
 	}
 	else {
 		c2 = 0.5;
-		theta = -theta;
 	}
 	
-	wtemp = sin(0.5 * theta);
-	wpr = -2.0 * wtemp * wtemp;
-	wpi = sin(theta);
-	wr  = 1.0 + wpr;
-	wi  = wpi;
 	np3 = n + 3;
 	for (i=2; i<=(n>>2); i++) {
+		wr = gFFTPlan.realR[i];	/*from the plan for this size*/
+		wi = gFFTPlan.realI[i];
+		if (isign != 1) wi = -wi;
 		i4 = 1 + (i3 = np3 - (i2 = 1 + (i1 = i + i - 1)));
 		h1r = c1 * (array[i1] + array[i3]);
 		h1i = c1 * (array[i2] - array[i4]);
@@ -509,9 +779,6 @@ static void realft(REAL_4 *array, UINT_4 n, int isign)
 		array[i2] =  h1i + wr * h2i + wi * h2r;
 		array[i3] =  h1r - wr * h2r + wi * h2i;
 		array[i4] = -h1i + wr * h2i + wi * h2r;
-		wr = (wtemp = wr) * wpr - wi * wpi + wr;
-		wi = wi * wpr + wtemp * wpi + wi;
-	
 	}
 	if (isign == 1) {
 	
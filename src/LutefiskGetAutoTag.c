@@ -33,10 +33,10 @@ jsrichar@alum.mit.edu
 
 
 /*Globals for this file only.*/
-tsequenceList *TagSeqList;
-tsequenceList *TagSubseqList;
+THREAD_LOCAL tsequenceList *TagSeqList;
+THREAD_LOCAL tsequenceList *TagSubseqList;
 
-tMSDataList   *TagMassList;
+THREAD_LOCAL tMSDataList   *TagMassList;
 
 /************************************* SortExtension **************************************
 *
@@ -221,7 +221,7 @@ void FilterTagMasses(INT_4 charge)
 *	a struct of type Sequence, which is the first element in a linked list of subsequences.
 */
 
-INT_4 NterminalTags(char *tagNode, INT_4 *tagNodeIntensity)
+INT_4 NterminalTags(tNodeStore *tagNode, tNodeStore *tagNodeIntensity)
 {
 	struct Sequence *subsequencePtr;
 	tsequence subsequenceToAdd;
@@ -287,11 +287,11 @@ INT_4 NterminalTags(char *tagNode, INT_4 *tagNodeIntensity)
 		if(gGapList[i] != 0)
 		{
 			testValue = nTerminus + gGapList[i];
-			if(tagNode[testValue] != 0)
+			if(testValue < gGraphLength && NodeValue(tagNode, testValue) != 0)
 			{
 				extensions[extNum] = gGapList[i];
 				singleAAExtension[extNum] = gGapList[i];
-				extScore[extNum] = tagNodeIntensity[testValue];
+				extScore[extNum] = NodeIntValue(tagNodeIntensity, testValue);
 				extNum++;
 				singleAAExtNum++;
 			}
@@ -306,10 +306,10 @@ INT_4 NterminalTags(char *tagNode, INT_4 *tagNodeIntensity)
 															extensions and move up from there.*/
 	{
 		testValue = nTerminus + gGapList[i];/*This is the test mass (nominal).*/
-		if(tagNode[testValue] != 0)	/*If there is any evidence at that mass.*/
+		if(testValue < gGraphLength && NodeValue(tagNode, testValue) != 0)	/*If there is any evidence at that mass.*/
 		{
 			extensions[extNum] = gGapList[i];
-			extScore[extNum] = tagNodeIntensity[testValue];
+			extScore[extNum] = NodeIntValue(tagNodeIntensity, testValue);
 			extNum++;
 		}
 	}
@@ -407,18 +407,17 @@ INT_4 NterminalTags(char *tagNode, INT_4 *tagNodeIntensity)
 *	struct in the list has the lowest score.  This function returns the number of extensions.
 */
 
-INT_4 AlternateNterminalTags(char *tagNode, INT_4 *tagNodeIntensity)
+INT_4 AlternateNterminalTags(tNodeStore *tagNode, tNodeStore *tagNodeIntensity)
 {
 	tsequence subsequenceToAdd;
-	INT_4 i, j, k, m, testValue, nTerminus;
+	INT_4 i, j, k, testValue, nTerminus;
 	INT_4 *extensions, *extScore, extNum;
 	INT_4 *bestExtensions, *bestExtScore, bestExtNum;
 	INT_4 highestExtensionScore;
 	INT_4 threshold;
 	/*INT_4 *peptide;*/
-	INT_4 *threeAA, threeAANum, sum;
 	INT_4 sameNum, averageExtension, *sameExtension;
-	char nTerminusPossible, duplicateFlag;
+	char nTerminusPossible;
 	char sameTest;
 	
 	sameExtension = (int *) malloc(gParam.fragmentErr * 10 * sizeof(INT_4));
@@ -428,13 +427,6 @@ INT_4 AlternateNterminalTags(char *tagNode, INT_4 *tagNodeIntensity)
 		exit(1);
 	}
 	
-	threeAA = (int *) malloc(gAminoAcidNumber*gAminoAcidNumber*gAminoAcidNumber*sizeof(INT_4));
-	if(threeAA == NULL)
-	{
-		printf("AlternateNterminalTags:  Out of memory.");
-		exit(1);
-	}
-
 	extensions = (int *) malloc(MAX_GAPLIST * sizeof(INT_4));
 	if(extensions == NULL)
 	{
@@ -470,99 +462,25 @@ INT_4 AlternateNterminalTags(char *tagNode, INT_4 *tagNodeIntensity)
 		exit(1);
 	}*/
 
-/*	Fill in the masses for three amino acids.*/
-
-	threeAANum = 0;
-	for(i = 0; i < gAminoAcidNumber; i++)	/*Fill in the masses of the 3 AA extensions.*/
-	{
-		for(j = 0; j < gAminoAcidNumber; j++)
-		{
-			for(k = 0; k < gAminoAcidNumber; k++)
-			{
-				if(gGapList[i] != 0 && gGapList[j] != 0 && gGapList[k] != 0)
-				{
-					sum = gGapList[i] + gGapList[j] + gGapList[k];
-					duplicateFlag = FALSE;
-					for(m = 0; m < threeAANum; m++)
-					{
-						if(threeAA[m] == sum)
-						{
-							/* We already have this mass in threeAA so don't add it to the list. */
-							duplicateFlag = TRUE;
-							break;
-						}
-					}
-					if(duplicateFlag == FALSE)
-					{
-						for(m = 0; m <= gGapListIndex; m++)
-						{
-							if(gGapList[m] == sum)
-							{
-							/* We already have this mass  so don't add it to the list. */
-							duplicateFlag = true;
-							break;
-							}
-						}
-					}
-					if(!duplicateFlag)
-					{
-						threeAA[threeAANum] = sum;
-						threeAANum++;
-						if(threeAANum >= gAminoAcidNumber*gAminoAcidNumber*gAminoAcidNumber)
-						{
-							printf("AlternateNTerminalTags:  threeAANum >= gAminoAcidNumber*gAminoAcidNumber*gAminoAcidNumber\n");
-							exit(1);
-						}
-					}
-				}
-			}
-		}
-	}
-	
 /*	Find the n-terminus.*/
 	extNum = 0;
 	/*Figure out what the N-terminal node is.*/
 	nTerminus = gParam.modifiedNTerm + 0.5;
 
-/*	Find the one, two, and three amino acid jumps from gGapList and threeAA.*/
+/*	Find the one, two, and three amino acid jumps (see ExtensionMassType).*/
 
 	for(i = nTerminus + gMonoMass_x100[G]; i < gMonoMass_x100[W] * 3; i++)	/*step thru each node*/
 	{
-		if(tagNode[i] != 0 && i < gGraphLength)	/*ignore the nodes w/ zero evidence*/
+		if(i < gGraphLength && NodeValue(tagNode, i) != 0)	/*ignore the nodes w/ zero evidence*/
 		{
-			nTerminusPossible = FALSE;	/*start assuming that this is not an extension*/
-/*	Check for one and two amino acid extensions using the gGapList array.*/
-			for(j = 0; j <= gGapListIndex; j++)	
-			{
-				if(gGapList[j] != 0)
-				{
-					if(i - nTerminus == gGapList[j])
-					{
-						nTerminusPossible = TRUE;	/*its a possible extension*/
-						break;
-					}
-				}
-			}
-/*	Now check for three amino acid extensions if it wasn't a one or two aa extension.*/
-			if(nTerminusPossible == FALSE)
-			{
-				for(j = 0; j < threeAANum; j++)
-				{
-					if(threeAA[j] != 0)
-					{
-					 	if(i - nTerminus == threeAA[j])
-					 	{
-					 		nTerminusPossible = TRUE;
-					 		break;
-					 	}
-					}
-				}
-			}
+			/*Is it a one, two, or three amino acid extension?*/
+			nTerminusPossible = (ExtensionMassType(i - nTerminus) 
+								& (EXTENSION_GAP_LIST | EXTENSION_THREE_AA)) != 0;
 					
 			if(nTerminusPossible)	/*save as an extension?*/
 			{
 				extensions[extNum] = i - nTerminus;
-				extScore[extNum] = tagNodeIntensity[i];
+				extScore[extNum] = NodeIntValue(tagNodeIntensity, i);
 				extNum++;
 				if(extNum >= MAX_GAPLIST)
 				{
@@ -576,10 +494,10 @@ INT_4 AlternateNterminalTags(char *tagNode, INT_4 *tagNodeIntensity)
 /*	If there are no extensions that match combinations of three amino acids, then look for anything*/
 	for(i = nTerminus + gMonoMass_x100[G]; i < gMonoMass_x100[W] * 3; i++)	/*step thru each node*/
 	{
-		if(tagNode[i] != 0 && i < gGraphLength)	/*ignore the nodes w/ zero evidence*/
+		if(i < gGraphLength && NodeValue(tagNode, i) != 0)	/*ignore the nodes w/ zero evidence*/
 		{
 			extensions[extNum] = i - nTerminus;
-			extScore[extNum] = tagNodeIntensity[i];
+			extScore[extNum] = NodeIntValue(tagNodeIntensity, i);
 			extNum++;
 			if(extNum == MAX_GAPLIST - 1)
 				break;
@@ -677,16 +595,9 @@ INT_4 AlternateNterminalTags(char *tagNode, INT_4 *tagNodeIntensity)
 					if(extScore[j] != 0)
 					{
 						testValue = extensions[j] - extensions[i];
-						for(k = 0; k < gAminoAcidNumber; k++)
+						if(ExtensionMassType(testValue) & EXTENSION_NEAR_AA)
 						{
-							if(gGapList[k] != 0)
-							{
-								if(testValue <= gGapList[k] + gParam.fragmentErr &&
-									testValue >= gGapList[k] - gParam.fragmentErr)
-								{
-									extScore[j] = -1;
-								}
-							}
+							extScore[j] = -1;
 						}
 					}
 				}
@@ -749,7 +660,6 @@ INT_4 AlternateNterminalTags(char *tagNode, INT_4 *tagNodeIntensity)
 			free(bestExtensions);
 			free(bestExtScore);
 			free(sameExtension);
-			free(threeAA);
 			/*free(peptide);*/
 			return(extNum);
 		}
@@ -762,7 +672,6 @@ INT_4 AlternateNterminalTags(char *tagNode, INT_4 *tagNodeIntensity)
 	free(bestExtScore);
 	/*free(peptide);*/
 	free(sameExtension);
-	free(threeAA);
 	
 	
 	return(extNum);
@@ -777,7 +686,7 @@ INT_4 AlternateNterminalTags(char *tagNode, INT_4 *tagNodeIntensity)
 *
 */
 
-void TagMaker(char *tagNode, INT_4 *tagNodeIntensity, INT_4 totalIonIntensity)
+void TagMaker(tNodeStore *tagNode, tNodeStore *tagNodeIntensity, INT_4 totalIonIntensity)
 {
 
 	INT_4 topSeqNum;
@@ -820,7 +729,7 @@ void TagMaker(char *tagNode, INT_4 *tagNodeIntensity, INT_4 totalIonIntensity)
 *
 */
 
-void AlternateTagMaker(char *tagNode, INT_4 *tagNodeIntensity, INT_4 totalIonIntensity)
+void AlternateTagMaker(tNodeStore *tagNode, tNodeStore *tagNodeIntensity, INT_4 totalIonIntensity)
 {
 	INT_4 topSeqNum;
 	INT_4 extensions;
@@ -860,7 +769,7 @@ void AlternateTagMaker(char *tagNode, INT_4 *tagNodeIntensity, INT_4 totalIonInt
 */
 
 void FindTagB2Ions(struct MSData *firstMassPtr, INT_4 *totalIntensity, 
-					char *tagNode, INT_4 *tagNodeIntensity)
+					tNodeStore *tagNode, tNodeStore *tagNodeIntensity)
 {
 	INT_4 ionNum;
 	struct MSData *currPtr;
@@ -920,23 +829,23 @@ void FindTagB2Ions(struct MSData *firstMassPtr, INT_4 *totalIntensity,
 /*Find highest mass node.*/
 				bMass = bMass + gParam.fragmentErr;
 				bMassMax = bMass;		/*Truncate w/o rounding up.*/
-				tagNode[bMassMax] = 1;
-				tagNodeIntensity[bMassMax] += ionInt[i];
+				SetNodeValue(tagNode, bMassMax, 1);
+				SetNodeIntValue(tagNodeIntensity, bMassMax, NodeIntValue(tagNodeIntensity, bMassMax) + ionInt[i]);
 /*Next I'll find the lowest mass node.*/
 				bMass = bMass - gParam.fragmentErr - gParam.fragmentErr + 0.5;
 				bMassMin = bMass;	/*Truncate after rounding up.*/
 				if(bMassMin != bMassMax)
 				{
-					tagNode[bMassMin] = 1;
-					tagNodeIntensity[bMassMin] += ionInt[i];
+					SetNodeValue(tagNode, bMassMin, 1);
+					SetNodeIntValue(tagNodeIntensity, bMassMin, NodeIntValue(tagNodeIntensity, bMassMin) + ionInt[i]);
 				}
 /*Fill in the space.*/
 				if((bMassMax - bMassMin) > 1)
 				{
 					for(k = (bMassMin + 1); k < bMassMax; k++)
 					{
-						tagNode[k] = 1;
-						tagNodeIntensity[k] += ionInt[i];
+						SetNodeValue(tagNode, k, 1);
+						SetNodeIntValue(tagNodeIntensity, k, NodeIntValue(tagNodeIntensity, k) + ionInt[i]);
 					}
 				}
 			}
@@ -965,7 +874,7 @@ void FreeTagStructs(struct Sequence *currPtr)
 	{
 		freeMePtr = currPtr;
 		currPtr = currPtr->next;
-		free(freeMePtr);
+		DisposeSequenceStruct(freeMePtr);
 	}
 	return;
 }
@@ -973,12 +882,15 @@ void FreeTagStructs(struct Sequence *currPtr)
 *
 *	MaskSequenceNodeWithTags ....blah blah blah
 *
+*	The nodes up thru the N-terminal tag positions and from maxTagRegion on up are left 
+*	alone, so tagNode is only set in between.  Only the nodes in nodeList can be non-zero
+*	in sequenceNode.
 */
 
-void MaskSequenceNodeWithTags(SCHAR *sequenceNode, char *tagNode)
+void MaskSequenceNodeWithTags(tNodeStore *sequenceNode, tNodeStore *tagNode, tNodeList *nodeList)
 {
 
-	INT_4 i, maxTagRegion;
+	INT_4 i, k, maxTagRegion;
 	INT_4 firstNode, currentNode;
 	INT_4 charge = gParam.chargeState - 1;
 	INT_4 stop, firstZeroNode;
@@ -997,16 +909,13 @@ void MaskSequenceNodeWithTags(SCHAR *sequenceNode, char *tagNode)
 	}
 	
 /*	Initialize tagNode to zero's.*/
-	for(i = 0; i < gGraphLength; i++)	
-	{
-		tagNode[i] = 0;
-	}
+	ClearNodeStore(tagNode);
 	
 /*	Find the N-terminal node.  This will equal the nominal mass of the N-terminal group R-NH-.*/
 
 	firstNode = gParam.modifiedNTerm;
 
-	tagNode[firstNode] = 1;	/*Give the N-terminal node a value of one.*/
+	SetNodeValue(tagNode, firstNode, 1);	/*Give the N-terminal node a value of one.*/
 
 /*	For each tag, assign the nodes a value of one.*/
 			
@@ -1022,7 +931,7 @@ void MaskSequenceNodeWithTags(SCHAR *sequenceNode, char *tagNode)
 				printf("MaskSequenceNodeWithTags:  currentNode >= gGraphLength\n");
 				exit(1);
 			}
-			tagNode[currentNode] = 1;
+			SetNodeValue(tagNode, currentNode, 1);
 		}
 		currentTag++;
 	}
@@ -1032,10 +941,10 @@ void MaskSequenceNodeWithTags(SCHAR *sequenceNode, char *tagNode)
 	and from that node on up reassign each node to a value of one.
 */
 
-	i = gGraphLength - 1;
-	while(tagNode[i] == 0)
+	i = LastStoredNode(tagNode, gGraphLength - 1);
+	while(NodeValue(tagNode, i) == 0)
 	{
-		i--;
+		i = LastStoredNode(tagNode, i - 1);
 	}
 	i = i + gMonoMass_x100[G];
 	
@@ -1048,12 +957,6 @@ void MaskSequenceNodeWithTags(SCHAR *sequenceNode, char *tagNode)
 	{
 		maxTagRegion = i;
 	}
-		
-	
-	for(i = maxTagRegion; i < gGraphLength; i++)
-	{
-		tagNode[i] = 1;
-	}
 	
 /*	If the N-terminal position contains more than two aa's, then give a value of one to 
 	these N-terminal positions in the array.*/
@@ -1072,12 +975,7 @@ void MaskSequenceNodeWithTags(SCHAR *sequenceNode, char *tagNode)
 		printf("MaskSequenceNodeWithTags:  currentNode >= gGraphLength\n");
 		exit(1);
 	}
-	for(i = 0; i <= currentNode; i++)
-	{
-		tagNode[i] = 1;
-	}
-	
-	firstZeroNode = currentNode + 1;
+	firstZeroNode = currentNode + 1;	/*The nodes below are left as they are.*/
 	
 /*	For tags that contain W, N, Q, R, or W, the program inserts a value of one at those
 	positions corresponding to two amino acid combinations.  This allows data in regions
@@ -1100,7 +998,7 @@ void MaskSequenceNodeWithTags(SCHAR *sequenceNode, char *tagNode)
 			{
 				if(gGapList[G] != 0)
 				{
-					tagNode[currentNode - gGapList[G]] = 1;
+					SetNodeValue(tagNode, currentNode - gGapList[G], 1);
 				}
 			}
 			if(currentTag->peptide[i] == gGapList[K] 
@@ -1108,49 +1006,49 @@ void MaskSequenceNodeWithTags(SCHAR *sequenceNode, char *tagNode)
 			{
 				if(gGapList[A] != 0)
 				{
-					tagNode[currentNode - gGapList[A]] = 1;
+					SetNodeValue(tagNode, currentNode - gGapList[A], 1);
 				}
 				if(gGapList[G] != 0)
 				{
-					tagNode[currentNode - gGapList[G]] = 1;
+					SetNodeValue(tagNode, currentNode - gGapList[G], 1);
 				}
 			}
 			if(currentTag->peptide[i] == gGapList[R])	/*Arg*/
 			{
 				if(gGapList[G] != 0)
 				{
-					tagNode[currentNode - gGapList[G]] = 1;
+					SetNodeValue(tagNode, currentNode - gGapList[G], 1);
 				}
 				if(gGapList[V] != 0)
 				{
-					tagNode[currentNode - gGapList[V]] = 1;
+					SetNodeValue(tagNode, currentNode - gGapList[V], 1);
 				}
 			}
 			if(currentTag->peptide[i] == gNomMass[W])	/*Trp*/
 			{
 				if(gGapList[A] != 0)
 				{
-					tagNode[currentNode - gGapList[A]] = 1;
+					SetNodeValue(tagNode, currentNode - gGapList[A], 1);
 				}
 				if(gGapList[D] != 0)
 				{
-					tagNode[currentNode - gGapList[D]] = 1;
+					SetNodeValue(tagNode, currentNode - gGapList[D], 1);
 				}
 				if(gGapList[E] != 0)
 				{
-					tagNode[currentNode - gGapList[E]] = 1;
+					SetNodeValue(tagNode, currentNode - gGapList[E], 1);
 				}
 				if(gGapList[G] != 0)
 				{
-					tagNode[currentNode - gGapList[G]] = 1;
+					SetNodeValue(tagNode, currentNode - gGapList[G], 1);
 				}
 				if(gGapList[S] != 0)
 				{
-					tagNode[currentNode - gGapList[S]] = 1;
+					SetNodeValue(tagNode, currentNode - gGapList[S], 1);
 				}
 				if(gGapList[V] != 0)
 				{
-					tagNode[currentNode - gGapList[V]] = 1;
+					SetNodeValue(tagNode, currentNode - gGapList[V], 1);
 				}
 			}
 		}
@@ -1160,24 +1058,28 @@ void MaskSequenceNodeWithTags(SCHAR *sequenceNode, char *tagNode)
 	
 /*	Assign value of one to gParam.fragmentErr region around each node.*/
 	
-	i = firstZeroNode;
+	i = NextStoredNode(tagNode, firstZeroNode);
 	while(i < maxTagRegion && i < gGraphLength)
 	{
-		if(i != firstNode && tagNode[i] != 0)
+		if(i != firstNode && NodeValue(tagNode, i) != 0)
 		{
 			i = i - gParam.fragmentErr;
 			stop = i + gParam.fragmentErr * 2;
+			if(i < 0)
+			{
+				i = 0;
+			}
 			while(i <= stop && i < gGraphLength)
 			{
-				tagNode[i] = 1;
+				SetNodeValue(tagNode, i, 1);
 				i++;
 			}
 		}
-		i++;
+		i = NextStoredNode(tagNode, i + 1);
 	}
 	for(i = firstZeroNode; i <= firstZeroNode + gParam.fragmentErr; i++)
 	{
-		tagNode[i] = 1;
+		SetNodeValue(tagNode, i, 1);
 	}
 
 /*
@@ -1185,9 +1087,13 @@ void MaskSequenceNodeWithTags(SCHAR *sequenceNode, char *tagNode)
 *   only sequences identified as possible tags are allowed.
 */
 
-	for(i = 0; i < gGraphLength; i++)
+	for(k = 0; k < nodeList->numObjects; k++)
 	{
-		sequenceNode[i] = tagNode[i] * sequenceNode[i];
+		i = nodeList->node[k];
+		if(i >= firstZeroNode && i < maxTagRegion)
+		{
+			SetNodeValue(sequenceNode, i, NodeValue(tagNode, i) * NodeValue(sequenceNode, i));
+		}
 	}
 		
 	return;
@@ -1210,7 +1116,7 @@ void MaskSequenceNodeWithTags(SCHAR *sequenceNode, char *tagNode)
 *	the list starting with subsequencePtr and newSubsequencePtr).
 */
 
-INT_4 TagExtensions(char *tagNode, INT_4 topSeqNum, INT_4 *tagNodeIntensity,
+INT_4 TagExtensions(tNodeStore *tagNode, INT_4 topSeqNum, tNodeStore *tagNodeIntensity,
 				   INT_4 totalIonIntensity)
 {
 
@@ -1284,11 +1190,11 @@ INT_4 TagExtensions(char *tagNode, INT_4 topSeqNum, INT_4 *tagNodeIntensity,
 			if(gGapList[i] != 0)
 			{
 				testValue = currPtr->nodeValue + gGapList[i];
-				if(tagNode[testValue] != 0)
+				if(testValue < gGraphLength && NodeValue(tagNode, testValue) != 0)
 				{
 					extensionList[extNum].mass         = gGapList[i];
 					extensionList[extNum].gapSize      = 0;
-					extensionList[extNum].score        = tagNodeIntensity[testValue];
+					extensionList[extNum].score        = NodeIntValue(tagNodeIntensity, testValue);
 					extensionList[extNum].singleAAFLAG = 1;
 					extNum++;
 					if(extNum >= MAX_GAPLIST)
@@ -1307,11 +1213,11 @@ INT_4 TagExtensions(char *tagNode, INT_4 topSeqNum, INT_4 *tagNodeIntensity,
 				if(plusPro[i] != 0)
 				{
 					testValue = currPtr->nodeValue + plusPro[i];
-					if(tagNode[testValue] != 0)
+					if(testValue < gGraphLength && NodeValue(tagNode, testValue) != 0)
 					{
 						extensionList[extNum].mass         = plusPro[i];
 						extensionList[extNum].gapSize      = 0;
-						extensionList[extNum].score        = tagNodeIntensity[testValue];
+						extensionList[extNum].score        = NodeIntValue(tagNodeIntensity, testValue);
 						extensionList[extNum].singleAAFLAG = 1;
 						extNum++;
 						if(extNum >= MAX_GAPLIST)
@@ -1508,7 +1414,7 @@ INT_4 TagExtensions(char *tagNode, INT_4 topSeqNum, INT_4 *tagNodeIntensity,
 *	additional value of gWeightedIonValues.y.  
 */
 
-void FindTagYIons(char *tagNode, INT_4 charge, INT_4 *tagNodeIntensity)
+void FindTagYIons(tNodeStore *tagNode, INT_4 charge, tNodeStore *tagNodeIntensity)
 {
 	tMSData *tagMassPtr;
 	INT_4 yMassMin, yMassMax, j;
@@ -1585,8 +1491,8 @@ void FindTagYIons(char *tagNode, INT_4 charge, INT_4 *tagNodeIntensity)
 		}
 		for(j = yMassMin; j <= yMassMax; j++)
 		{
-			tagNode[j] = 1;
-			tagNodeIntensity[j] = tagMassPtr->intensity;
+			SetNodeValue(tagNode, j, 1);
+			SetNodeIntValue(tagNodeIntensity, j, tagMassPtr->intensity);
 		}
 		tagMassPtr++;
 	}
@@ -1602,23 +1508,20 @@ void FindTagYIons(char *tagNode, INT_4 charge, INT_4 *tagNodeIntensity)
 *	value.  There may be more than one C-terminal node, depending on the mass and the error.
 */
 
-void TagNodeInit(char *tagNode, INT_4 *tagNodeIntensity)
+void TagNodeInit(tNodeStore *tagNode, tNodeStore *tagNodeIntensity)
 {
 	INT_4 i, firstNode;
 	REAL_4 lastNode;
 	REAL_8 aToMFactor;
 	INT_4 lastNodeHigh, lastNodeLow;
 
-	for(i = 0; i < gGraphLength; i++)	/*Initialize tagNode to zero's.*/
-	{
-		tagNode[i] = 0;
-		tagNodeIntensity[i] = 0;
-	}
+	ClearNodeStore(tagNode);	/*Initialize tagNode to zero's.*/
+	ClearNodeStore(tagNodeIntensity);
 	
 /*	Find the N-terminal node.  This will equal the nominal mass of the N-terminal group R-NH-.*/
 
 	firstNode = gParam.modifiedNTerm + 0.5;
-	tagNode[firstNode] = 1;	/*Give the N-terminal node a value of one.*/
+	SetNodeValue(tagNode, firstNode, 1);	/*Give the N-terminal node a value of one.*/
 	
 /*Figure out what the C-terminal node(s) are.*/
 
@@ -1663,7 +1566,7 @@ void TagNodeInit(char *tagNode, INT_4 *tagNodeIntensity)
 	}
 	for(i = lastNodeLow; i <= lastNodeHigh; i++)
 	{
-		tagNode[i] = 1;
+		SetNodeValue(tagNode, i, 1);
 	}
 
 	return;
@@ -1675,13 +1578,13 @@ void TagNodeInit(char *tagNode, INT_4 *tagNodeIntensity)
 *
 */
 
-void GetAutoTag(struct MSData *firstMassPtr, SCHAR *sequenceNode)
+void GetAutoTag(struct MSData *firstMassPtr, tNodeStore *sequenceNode, tNodeList *nodeList)
 {
 	struct MSData *currPtr;
 	struct Sequence *firstTagPtr;
-	INT_4 threshold, charge, *tagNodeIntensity, totalIntensity;
+	INT_4 threshold, charge, totalIntensity;
 	INT_4 *peptide, count;
-	char *tagNode;
+	tNodeStore *tagNode, *tagNodeIntensity;
 	REAL_4 precursor, maxMOverZ;
 
 	TagMassList = (tMSDataList *) CreateNewList( sizeof(tMSData), 10, 10 );
@@ -1710,18 +1613,8 @@ void GetAutoTag(struct MSData *firstMassPtr, SCHAR *sequenceNode)
 		exit(1);
 	}
 	
-	tagNode = (char  *) malloc(gGraphLength * sizeof(char));	/*set aside some space for the tagNode*/
-	if(tagNode == NULL)
-	{
-		printf("GetAutoTag:  Out of memory.");
-		exit(1);
-	}
-	tagNodeIntensity = (int *) malloc(gGraphLength * sizeof(INT_4));
-	if(tagNodeIntensity == NULL)
-	{
-		printf("GetAutoTag:  Out of memory.");
-		exit(1);
-	}
+	tagNode = CreateNodeStore(sizeof(SCHAR));	/*set aside some space for the tagNode*/
+	tagNodeIntensity = CreateNodeStore(sizeof(INT_4));
 
 	gTagLength = 0;	/*initialize; used for spectrum quality assessment*/
 	
@@ -1740,8 +1633,8 @@ void GetAutoTag(struct MSData *firstMassPtr, SCHAR *sequenceNode)
 	
 	if(charge == 0)
 	{
-		free(tagNode);
-		free(tagNodeIntensity);
+		DisposeNodeStore(tagNode);
+		DisposeNodeStore(tagNodeIntensity);
 		free(peptide);
 		DisposeList(TagMassList);
 		DisposeList(TagSeqList);
@@ -1771,8 +1664,8 @@ void GetAutoTag(struct MSData *firstMassPtr, SCHAR *sequenceNode)
 	}
 	if(count == 0) 
 	{
-		free(tagNode);
-		free(tagNodeIntensity);
+		DisposeNodeStore(tagNode);
+		DisposeNodeStore(tagNodeIntensity);
 		free(peptide);
 		DisposeList(TagMassList);
 		DisposeList(TagSeqList);
@@ -1810,8 +1703,8 @@ void GetAutoTag(struct MSData *firstMassPtr, SCHAR *sequenceNode)
 				massToAdd.normIntensity = currPtr->intensity;
 				if(!AddToList(&massToAdd, TagMassList)) 
 				{
-					free(tagNode);
-					free(tagNodeIntensity);
+					DisposeNodeStore(tagNode);
+					DisposeNodeStore(tagNodeIntensity);
 					free(peptide);
 					DisposeList(TagMassList);
 					DisposeList(TagSeqList);
@@ -1901,7 +1794,7 @@ void GetAutoTag(struct MSData *firstMassPtr, SCHAR *sequenceNode)
 
 	if(TagSeqList->numObjects)
 	{
-		MaskSequenceNodeWithTags(sequenceNode, tagNode);
+		MaskSequenceNodeWithTags(sequenceNode, tagNode, nodeList);
 	}
 	
 		
@@ -1951,8 +1844,8 @@ void GetAutoTag(struct MSData *firstMassPtr, SCHAR *sequenceNode)
 	}
 
 /*	Free memory allocations specific to this function.*/
-	free(tagNode);
-	free(tagNodeIntensity);
+	DisposeNodeStore(tagNode);
+	DisposeNodeStore(tagNodeIntensity);
 	free(peptide);
 	DisposeList(TagMassList);
 	DisposeList(TagSeqList);
@@ -26,6 +26,7 @@ jsrichar@alum.mit.edu
 *********************************************************************************************/
 
 /* ANSI Headers */
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
@@ -44,8 +45,8 @@ tMSDataList *ReadFinniganFile(char *filename) {
         exit(1);
 }
 /*    Declare pointers to a struct that is global only within LutefiskGetCID.c.    */
-static struct MSData *gGroupingPtr;
-static struct MSData *gLastDataPtr;
+static THREAD_LOCAL struct MSData *gGroupingPtr;
+static THREAD_LOCAL struct MSData *gLastDataPtr;
 
 /*Definitions for this file*/
 #define MIN_NUM_IONS 5  /*Minimum number of ions after processing in GetCID*/
@@ -80,13 +81,9 @@ struct MSData *GetCidData(void)
 {
     tMSDataList     *MSDataList = NULL;
     tMSDataList     *peakList   = NULL;
-    struct MSData     *firstAvMassPtr = NULL;
-    INT_4 i, finalIonCount;
+    INT_4 finalIonCount;
     REAL_4    excessIonRatio;
-    REAL_4 generalQuality = 0;
-    REAL_4 lowMassQuality = 0;
-    REAL_4 highMassQuality = 0;
-    REAL_4 quality = 0;
+    unsigned long long cacheKey = 0;
 
 
     if(gParam.fMonitor)
@@ -96,6 +93,11 @@ struct MSData *GetCidData(void)
 
     MSDataList = ReadCIDFile(gParam.cidFilename);
 
+    if (MSDataList->numObjects == 0 && (gParam.CIDfileType == 'M' || gParam.CIDfileType == 'Z'))
+    {
+        DisposeList(MSDataList);
+        return NULL;    /*just this spectrum of the MGF or mzML file is skipped*/
+    }
     if (MSDataList->numObjects == 0)
     {
         printf("There doesn't seem to be any data in the firstDataPtr linked list.\n");
@@ -115,6 +117,22 @@ struct MSData *GetCidData(void)
     FindTheMultiplier();
 
 
+/*
+*    If this spectrum has been through here before with the same preprocessing parameters,
+*    the final peak list is read back from its .lfc file and the rest is skipped.
+*/
+    if(gParam.spectrumCache)
+    {
+        cacheKey = SpectrumCacheKey(MSDataList);
+        peakList = ReadSpectrumCache(cacheKey);
+        if(peakList != NULL)
+        {
+            DisposeList(MSDataList);
+            return(FinishCidData(peakList));
+        }
+    }
+
+
 /*
 *    If the 'Autodetect' value for the centroidOrProfile variable in the .params file was,
 *    selected, the program tries to figure out what type of file is being used here.
@@ -331,7 +349,8 @@ struct MSData *GetCidData(void)
 *    Verify that the selected ions have a signal to noise ratio greater than SIGNAL_NOISE that
 *    is #defined in LutefiskDefinitions.  The dta files from qtof data are also checked for s/n problems.
 */
-    if(gParam.centroidOrProfile == 'P' || gParam.CIDfileType == 'X' || gParam.CIDfileType == 'D')
+    if(gParam.centroidOrProfile == 'P' || gParam.CIDfileType == 'X' || gParam.CIDfileType == 'D'
+        || gParam.CIDfileType == 'M' || gParam.CIDfileType == 'Z')
     {
         CheckSignalToNoise(peakList, MSDataList);
     }
@@ -453,9 +472,33 @@ struct MSData *GetCidData(void)
         NormalizeIntensity(peakList);
     }
 
+/*    Save the final list for the next time this spectrum is searched.*/
+    if(gParam.spectrumCache)
+    {
+        WriteSpectrumCache(cacheKey, peakList);
+    }
+
 /*    Now get rid of the raw CID data.*/    
     DisposeList(MSDataList);
-    
+
+    return(FinishCidData(peakList));
+}
+
+/*****************************FinishCidData****************************************************
+*
+*       Turns the final peak list into the linked list of MSData structs that GetCidData returns, 
+*       and checks the data quality if asked to.  peakList is disposed of.
+*
+*/
+struct MSData *FinishCidData(tMSDataList *peakList)
+{
+    struct MSData     *firstAvMassPtr = NULL;
+    INT_4 i;
+    REAL_4 generalQuality = 0;
+    REAL_4 lowMassQuality = 0;
+    REAL_4 highMassQuality = 0;
+    REAL_4 quality = 0;
+
 /*    Print the final list*/
     if(gParam.fVerbose)
     {
@@ -1150,6 +1193,10 @@ tMSDataList *ReadCIDFile(char *inFilename)
     char *     stringBuffer2   = NULL;
     BOOLEAN    firstNumberFlag = true;
     BOOLEAN    headerFlag      = true;
+    char *     blockPtr        = NULL;
+    char *     blockEnd        = NULL;
+    REAL_4     precursorMZ     = 0.0;
+    INT_4      precursorCharge = 0;
 
 	msms.scanMassHigh = -1;
     stringBuffer = (char *)malloc(258);
@@ -1178,6 +1225,29 @@ tMSDataList *ReadCIDFile(char *inFilename)
         
         MSDataList = ReadFinniganFile(inFilename);
     }
+    else if (gParam.CIDfileType == 'Z')
+    {
+        /* One spectrum from an mzML or mzXML file, already decoded (see RunMzMLFile). */
+        MSDataList = gSearch->cidPeakList;
+        gSearch->cidPeakList = NULL;    /*it's ours now*/
+        if (MSDataList == NULL)
+        {
+            printf("mzML and mzXML files (CID file type 'Z') can only be read one spectrum at a time.\n");
+            goto problem;
+        }
+        precursorMZ = gSearch->cidPrecursorMZ;
+        precursorCharge = gSearch->cidPrecursorCharge;
+        for (i = 0; i < MSDataList->numObjects; i++)
+        {
+            if (firstNumberFlag)
+            {
+                msms.scanMassLow = MSDataList->mass[i].mOverZ;
+                firstNumberFlag = false;
+            }
+            if (MSDataList->mass[i].mOverZ > msms.scanMassHigh)
+                msms.scanMassHigh = MSDataList->mass[i].mOverZ;
+        }
+    }
     else 
     {
         /* Open the ASCII data file and make a linked list of m/z and intensity values.*/
@@ -1189,18 +1259,34 @@ tMSDataList *ReadCIDFile(char *inFilename)
             goto problem;
         }
     
-        fp = fopen(inFilename,"r");
-        if (fp == NULL)
+        if (gParam.CIDfileType == 'M')
         {
-            printf("Cannot open the CID file '%s'.\n", inFilename);
-            goto problem;
+            /* One spectrum from an MGF file, already in memory (see RunMGFFile). */
+            fp = NULL;
+            blockPtr = gSearch->cidBlock;
+            blockEnd = blockPtr + gSearch->cidBlockLength;
+            if (blockPtr == NULL)
+            {
+                printf("MGF files (CID file type 'M') can only be read one spectrum at a time.\n");
+                goto problem;
+            }
+        }
+        else
+        {
+            fp = fopen(inFilename,"r");
+            if (fp == NULL)
+            {
+                printf("Cannot open the CID file '%s'.\n", inFilename);
+                goto problem;
+            }
         }
     
         i=0;
         oldMassValue = 0;
         oldIonIntensity = 0;
     
-        while (my_fgets(stringBuffer, 256, fp) != NULL)
+        while ((fp != NULL && my_fgets(stringBuffer, 256, fp) != NULL)
+               || (fp == NULL && my_bgets(stringBuffer, 256, &blockPtr, blockEnd) != NULL))
         {    
             i+=1;
             
@@ -1287,6 +1373,27 @@ tMSDataList *ReadCIDFile(char *inFilename)
                     headerFlag = FALSE;
                     continue; /*the next line is the start of the data*/
                 }
+                else if (gParam.CIDfileType == 'M') /* Mascot generic format (MGF) */
+                {
+                    /*The header is KEYWORD=value lines (and maybe comments), ending at 
+                    the first m/z value.  Only PEPMASS and CHARGE are of any use here.*/
+                    if (isdigit(stringBuffer[0]) || stringBuffer[0] == '.')
+                    {
+                        headerFlag = FALSE;    /*this line is data*/
+                    }
+                    else
+                    {
+                        if (!strncmp(stringBuffer, "PEPMASS=", 8))
+                        {
+                            sscanf(stringBuffer + 8, "%f", &precursorMZ);
+                        }
+                        else if (!strncmp(stringBuffer, "CHARGE=", 7))
+                        {
+                            sscanf(stringBuffer + 7, "%d", &precursorCharge);  /*2+, or the first of 2+ and 3+*/
+                        }
+                        continue;
+                    }
+                }
                 else {
                         printf("Whoa! Pleading ignorace of CID file type '%c'\n", gParam.CIDfileType);
                         goto problem;
@@ -1349,6 +1456,15 @@ tMSDataList *ReadCIDFile(char *inFilename)
                 sscanf(stringBuffer, "%f %f", &massToAdd.mOverZ, &intensityAsReal);
                 massToAdd.intensity = (INT_4) intensityAsReal;
             }
+            else if (gParam.CIDfileType == 'M') /* Mascot generic format (MGF) */
+            {
+                /* m/z, intensity, and sometimes the fragment charge, which is ignored */
+                if (sscanf(stringBuffer, "%f %f", &massToAdd.mOverZ, &intensityAsReal) != 2)
+                {
+                    continue;    /*a comment, or a keyword line out of place*/
+                }
+                massToAdd.intensity = (INT_4) intensityAsReal;
+            }
   
             
             if (massToAdd.mOverZ < -1 || massToAdd.intensity < 0)
@@ -1387,7 +1503,34 @@ tMSDataList *ReadCIDFile(char *inFilename)
             }
         }
 
-        fclose(fp);
+        if (fp != NULL)
+        {
+            fclose(fp);
+        }
+    }
+
+    if (gParam.CIDfileType == 'M' || gParam.CIDfileType == 'Z')
+    {
+        /*PEPMASS is the precursor m/z: read if these values are zero from the params file*/
+        if(gParam.peptideMW == 0 || gParam.chargeState == 0)
+        {
+            if (precursorCharge > 0)
+            {
+                gParam.chargeState = precursorCharge;
+            }
+            if (precursorMZ <= 0 || gParam.chargeState <= 0)
+            {
+                printf("Spectrum %d of %s has no precursor m/z or charge.\n", gSearch->cidBlockNum, inFilename);
+                MSDataList->numObjects = 0;    /*GetCidData skips it*/
+            }
+            gParam.peptideMW = (precursorMZ * gParam.chargeState) 
+                                - (gParam.chargeState * gElementMass[HYDROGEN]);
+            if (gParam.fVerbose) 
+            {
+               printf("  Precursor Mass:  %.3f\n", gParam.peptideMW);
+               printf("Precursor Charge:  %d\n", gParam.chargeState);
+            }
+        }
     }
  
     free(stringBuffer);
@@ -1809,7 +1952,8 @@ void CheckSignalToNoise(tMSDataList *inPeakList, tMSDataList *inMSDataList)
     deltaMassNum = 0;
     
     
-    if(gParam.CIDfileType == 'X' || gParam.CIDfileType == 'D')    /*QTof .dta data*/
+    if(gParam.CIDfileType == 'X' || gParam.CIDfileType == 'D' 
+        || gParam.CIDfileType == 'M' || gParam.CIDfileType == 'Z')    /*QTof .dta (or .mgf, .mzML) data*/
     {
         while(currPtr < ptrOfNoReturn)
         {
@@ -4561,6 +4705,37 @@ char *my_fgets(char *s, INT_4 n, FILE *fp)
   return(s);
 }
 
+/* -------------------------------------------------------------------------
+//  my_bgets 
+//  Like my_fgets, but reads the next line from the block of memory from *blockPtr up to 
+//  blockEnd (which need not be null terminated), and moves *blockPtr along to the line after.
+*/
+char *my_bgets(char *s, INT_4 n, char **blockPtr, char *blockEnd)
+{
+  register char *t = s;
+  register char *b = *blockPtr;
+
+  if (n < 1 || b >= blockEnd)
+    return(NULL);
+
+  while (--n && b < blockEnd) {
+    *t = *b++;
+    if (*t == '\n' || *t == '\32') { t++; break; }
+    /* This is to handle stupid windows files that end each line with \r\n */
+    else if (*t == '\r') {
+      t++;
+      if (b < blockEnd && *b == '\n') b++;
+      break;
+    }
+    t++;
+  }
+
+  *t = '\0';
+  *blockPtr = b;
+
+  return(s);
+}
+
 #ifdef DEBUG
 /**************************** DumpMassList **************************************
 *
@@ -24,44 +24,19 @@ Mercer Island, WA 98040
 
 jsrichar@alum.mit.edu
 *********************************************************************************************/
-#include "LutefiskDefinitions.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
-/*	Global variables that have been declared in LutefiskGlobals.h */	
+#include "LutefiskPrototypes.h"
+#include "LutefiskDefinitions.h"
+#include "ListRoutines.h"
 
-tmsms  msms;   /* Structure to hold data about the CID file. */
+/*	Global variables that have been declared in LutefiskGlobals.h.  These are set up once, 
+	from the Lutefisk.details and Lutefisk.edman files, and are only read after that.  */	
 
 tionWeights gWeightedIonValues;
 
-tParam gParam; /* Structure for the Lutefisk parameters loaded from Lutefisk.param */
-
-char gSingAA[AMINO_ACID_NUMBER];
-
-REAL_4 gMonoMass[AMINO_ACID_NUMBER];
-
-REAL_4 gAvMass[AMINO_ACID_NUMBER];
-
-INT_4 gNomMass[AMINO_ACID_NUMBER];
-
-REAL_4 gWrongXCorrScore[WRONG_SEQ_NUM + 1];
-
-REAL_4 gWrongIntScore[WRONG_SEQ_NUM + 1];
-
-REAL_4 gWrongProbScore[WRONG_SEQ_NUM + 1];
-
-REAL_4 gWrongQualityScore[WRONG_SEQ_NUM + 1];
-
-REAL_4 gWrongComboScore[WRONG_SEQ_NUM + 1];
-
-INT_4 gWrongIndex = 0;
-
-INT_4 gTagLength;
-
-INT_4 gSingleAACleavageSites = 0;
-
-BOOLEAN gCorrectMass;
-
-BOOLEAN gFirstTimeThru;
-
 REAL_4 gElementMass[ELEMENT_NUMBER] = {
 	 1.007825035, 		/* H */
 	12.00,     		 	/* C */
@@ -71,28 +46,127 @@ REAL_4 gElementMass[ELEMENT_NUMBER] = {
 	31.972070698		/* S */
 };
 
-INT_4 gAminoAcidNumber = AMINO_ACID_NUMBER;
-
-INT_4 gMonoMass_x100[AMINO_ACID_NUMBER];	/*Values assigned in 
-											CreateGlobalIntegerMassArrays*/
-INT_4 gElementMass_x100[ELEMENT_NUMBER];	/*Values assigned in 
-											CreateGlobalIntegerMassArrays*/
-INT_4 gMultiplier;							/*Value assigned in 
-											CreateGlobalIntegerMassArrays*/
-INT_4 gNodeCorrection[AMINO_ACID_NUMBER * AMINO_ACID_NUMBER];	/*Value assigned in 
-											CreateGlobalIntegerMassArrays*/
-INT_4 gElementCorrection[ELEMENT_NUMBER]; 	/*Value assigned in 
-											CreateGlobalIntegerMassArrays*/
-INT_4 gAvMonoTransition, gWater, gAmmonia, gCO, gAvResidueMass, gGraphLength;
-											
-INT_4 gGapList[MAX_GAPLIST];
-INT_4 gGapListIndex;
 INT_4 gEdmanData[MAX_PEPTIDE_LENGTH][AMINO_ACID_NUMBER];
 INT_4 gMaxCycleNum;
 
-REAL_4 H2O;
-REAL_4 NH3;
-
 REAL_4 gIonTypeWeightingTotal;
 
-BOOLEAN	gDatabaseSeqCorrect;
+/*	The search context that is current for this thread.	*/
+
+THREAD_LOCAL tSearchContext *gSearch = NULL;
+
+
+/******************************NewSearchContext*******************************************
+*
+*	Returns a new search context.  If templatePtr is NULL, then the context starts out empty 
+*	except for the amino acid count; otherwise it is a copy of templatePtr, minus any buffers
+*	that templatePtr may have allocated (those belong to templatePtr).
+*/
+tSearchContext *NewSearchContext(tSearchContext *templatePtr)
+{
+	tSearchContext *searchPtr;
+	
+	searchPtr = (tSearchContext *) calloc(1, sizeof(tSearchContext));
+	if (searchPtr == NULL)
+	{
+		printf("NewSearchContext:  Out of memory");
+		exit(1);
+	}
+	
+	if (templatePtr != NULL)
+	{
+		memcpy(searchPtr, templatePtr, sizeof(tSearchContext));
+		searchPtr->spectrum1 = NULL;
+		searchPtr->spectrum2 = NULL;
+		searchPtr->tau = NULL;
+		searchPtr->spectrum1FT = NULL;
+		searchPtr->xcorrSpectrum = NULL;
+		searchPtr->mockBins = NULL;
+		searchPtr->haggis = NULL;
+		searchPtr->preparedSpectrum = NULL;
+		searchPtr->extensionMass = NULL;
+		searchPtr->extensionMassLimit = 0;
+		searchPtr->cidPeakList = NULL;
+	}
+	else
+	{
+		searchPtr->aminoAcidNumber = AMINO_ACID_NUMBER;
+	}
+	
+	return(searchPtr);
+}
+
+/******************************FreeSearchContext******************************************
+*
+*	Frees the context and whatever buffers were allocated for it during the search.
+*/
+void FreeSearchContext(tSearchContext *searchPtr)
+{
+	if (searchPtr == NULL)
+	{
+		return;
+	}
+	
+	if (searchPtr->spectrum1 != NULL)
+	{
+		free(searchPtr->spectrum1);
+	}
+	if (searchPtr->spectrum2 != NULL)
+	{
+		free(searchPtr->spectrum2);
+	}
+	if (searchPtr->tau != NULL)
+	{
+		free(searchPtr->tau);
+	}
+	if (searchPtr->spectrum1FT != NULL)
+	{
+		free(searchPtr->spectrum1FT);
+	}
+	if (searchPtr->xcorrSpectrum != NULL)
+	{
+		free(searchPtr->xcorrSpectrum);
+	}
+	if (searchPtr->mockBins != NULL)
+	{
+		free(searchPtr->mockBins);
+	}
+	if (searchPtr->haggis != NULL)
+	{
+		FreeHaggisState(searchPtr->haggis);
+	}
+	if (searchPtr->preparedSpectrum != NULL)
+	{
+		FreePreparedSpectrum(searchPtr->preparedSpectrum);
+	}
+	if (searchPtr->extensionMass != NULL)
+	{
+		free(searchPtr->extensionMass);
+	}
+	if (searchPtr->cidPeakList != NULL)
+	{
+		DisposeList(searchPtr->cidPeakList);	/*the search never got as far as reading it*/
+	}
+	if (gSearch == searchPtr)
+	{
+		gSearch = NULL;
+	}
+	
+	free(searchPtr);
+	return;
+}
+
+/******************************BindSearchContext******************************************
+*
+*	Makes searchPtr the current context for the calling thread, and returns the one that was
+*	current before.
+*/
+tSearchContext *BindSearchContext(tSearchContext *searchPtr)
+{
+	tSearchContext *previousPtr;
+	
+	previousPtr = gSearch;
+	gSearch = searchPtr;
+	
+	return(previousPtr);
+}
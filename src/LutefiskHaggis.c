@@ -67,26 +67,235 @@ jsrichar@alum.mit.edu
 //#define MAX_HIGH_MASS 			100		/*Max number of ions greater than precursor*/
 //#define MAX_ION_NUM				200		/*Max number of ions*/
 #define MAX_SEQUENCES	10000	/*Max number of sequences to store*/
+#define MAX_NODE_SERIES	1000	/*Max number of ion series ending at each ion*/
+#define DECOMP_MASS_LIMIT	750		/*Nominal mass limit of the decomposition table; more than the 
+									largest unsequenced mass that GetBestCtermSeq looks at*/
 //#define MAX_MASS 				2500	/*Peptides above this mass are tossed out.*/
 //#define MIN_MASS 				800		/*Peptides below this mass are tossed out.*/
 //#define LOW_MASS_ION_NUM 		19		/*Number of peptide-related low mass ions*/
 
-/*Global variables for this file*/
-INT_4 gForwardNodeConnect[MAX_ION_NUM][AMINO_ACID_NUMBER];
-INT_4 gBackwardNodeConnect[MAX_ION_NUM][AMINO_ACID_NUMBER];
-INT_4 gForwardNum[MAX_ION_NUM], gBackwardNum[MAX_ION_NUM];
-INT_4 gIonCount;
-INT_4 gEdgeNum;
-INT_4 gSequenceNodes[MAX_SEQUENCES][MAX_ION_NUM];
-INT_4 gSeqCount;
-INT_4 gSequenceNum;
-INT_4 gPepLength[MAX_SEQUENCES*2];
-INT_4 gPepMassSeq[MAX_SEQUENCES*2][MAX_PEPTIDE_LENGTH];
-INT_4 gMatchSeries[MAX_SEQUENCES*2];
-INT_4 gAAArray[AMINO_ACID_NUMBER];
-INT_4 gAAMonoArray[AMINO_ACID_NUMBER];
-INT_4 gAANum, gMassRange, gCTermKIndex, gCTermRIndex, gLutefiskSequenceCount;
-BOOLEAN gNotTooManySequences = TRUE;
+/*A series of ions connected by residue masses, ending at an ion.  It is the series number 
+prevRank ending at the ion prevNode, plus one more edge; prevNode is zero if it starts here.*/
+typedef struct
+{
+	INT_4 prevNode;
+	INT_4 prevRank;
+	INT_4 edgeNum;
+	INT_4 gapNum;			/*edges that are not quite a residue mass*/
+	BOOLEAN fullOfGaps;		/*TRUE if it can only be kept w/ gParam.maxGapNum gaps*/
+}tIonSeries;
+
+/*A sequence, by the index of its residue mass sequence, and one of its masses*/
+typedef struct
+{
+	INT_4 mass;
+	INT_4 index;
+}tMassIndex;
+
+/*Global variables for this file.  These are kept in the search context, and are only allocated 
+if Haggis is actually used.*/
+struct HaggisState
+{
+	INT_4 ionCount;
+	INT_4 seqCount;
+	INT_4 sequenceNum;
+	INT_4 aaArray[AMINO_ACID_NUMBER];
+	INT_4 aaMonoArray[AMINO_ACID_NUMBER];
+	INT_4 aaNum, cTermKIndex, cTermRIndex, lutefiskSequenceCount;
+	char *decompTable;				/*decompTable[n * (DECOMP_MASS_LIMIT + 1) + m] is TRUE if n
+									residues from aaArray add up to the nominal mass m*/
+	INT_4 decompLength;				/*rows in decompTable, less one*/
+	INT_4 decompAA[AMINO_ACID_NUMBER], decompAANum;	/*the aaArray that decompTable was made from*/
+};
+
+/*The node connections, node sequences and residue mass sequences are held in pools that belong
+to the thread.  They are sized to the number of ions and to the number of sequences actually found,
+only ever grow, and are reused from one spectrum to the next.*/
+struct HaggisPools
+{
+	INT_4 (*forwardNodeConnect)[AMINO_ACID_NUMBER];
+	INT_4 (*backwardNodeConnect)[AMINO_ACID_NUMBER];
+	INT_4 *forwardNum, *backwardNum;
+	INT_4 ionLimit;				/*rows in the four arrays above*/
+	INT_4 *sequenceNodes;		/*node sequences of seqWidth nodes each, zero terminated*/
+	INT_4 seqWidth;
+	INT_4 seqLimit;				/*number of node sequences there is room for*/
+	INT_4 (*pepMassSeq)[MAX_PEPTIDE_LENGTH];
+	INT_4 *pepLength, *matchSeries;
+	INT_4 pepLimit;				/*rows in the three arrays above*/
+	INT_4 *seriesFirst, *seriesNum;	/*where the series ending at each ion are in series*/
+	tIonSeries *series;
+	INT_4 seriesLimit;
+	tIonSeries *cand;			/*series being sorted out in FindNodeSequences*/
+	INT_4 candLimit;
+};
+
+static THREAD_LOCAL struct HaggisPools gHaggisPools;
+
+#define gForwardNodeConnect		(gHaggisPools.forwardNodeConnect)
+#define gBackwardNodeConnect	(gHaggisPools.backwardNodeConnect)
+#define gForwardNum				(gHaggisPools.forwardNum)
+#define gBackwardNum			(gHaggisPools.backwardNum)
+#define gIonCount				(gSearch->haggis->ionCount)
+#define gSequenceNodes(seq)		(gHaggisPools.sequenceNodes + (seq) * gHaggisPools.seqWidth)
+#define gSeqCount				(gSearch->haggis->seqCount)
+#define gSequenceNum			(gSearch->haggis->sequenceNum)
+#define gPepLength				(gHaggisPools.pepLength)
+#define gPepMassSeq				(gHaggisPools.pepMassSeq)
+#define gMatchSeries			(gHaggisPools.matchSeries)
+#define gAAArray				(gSearch->haggis->aaArray)
+#define gAAMonoArray			(gSearch->haggis->aaMonoArray)
+#define gAANum					(gSearch->haggis->aaNum)
+#define gCTermKIndex			(gSearch->haggis->cTermKIndex)
+#define gCTermRIndex			(gSearch->haggis->cTermRIndex)
+#define gLutefiskSequenceCount	(gSearch->haggis->lutefiskSequenceCount)
+
+/*****************************FreeHaggisState*********************************************
+*
+*	Called by FreeSearchContext.
+*/
+void FreeHaggisState(struct HaggisState *haggisPtr)
+{
+	free(haggisPtr->decompTable);
+	free(haggisPtr);
+	return;
+}
+
+/*****************************FreeHaggisPools*********************************************
+*
+*	Frees the calling thread's pools.  Called by threads that are about to exit; otherwise
+*	the pools are kept for the next spectrum.
+*/
+void FreeHaggisPools(void)
+{
+	free(gHaggisPools.forwardNodeConnect);
+	free(gHaggisPools.backwardNodeConnect);
+	free(gHaggisPools.forwardNum);
+	free(gHaggisPools.backwardNum);
+	free(gHaggisPools.sequenceNodes);
+	free(gHaggisPools.pepMassSeq);
+	free(gHaggisPools.pepLength);
+	free(gHaggisPools.matchSeries);
+	free(gHaggisPools.seriesFirst);
+	free(gHaggisPools.seriesNum);
+	free(gHaggisPools.series);
+	free(gHaggisPools.cand);
+	memset(&gHaggisPools, 0, sizeof(struct HaggisPools));
+	return;
+}
+
+/*****************************GrowHaggisPool*********************************************
+*
+*	Returns poolPtr, reallocated if need be so that it holds at least neededNum objects of
+*	size objectSize.  *limit is the number of objects that poolPtr had room for, and is 
+*	updated.  Pools at least double when they grow.
+*/
+static void *GrowHaggisPool(void *poolPtr, INT_4 *limit, INT_4 neededNum, size_t objectSize)
+{
+	INT_4 newLimit;
+	
+	if(neededNum <= *limit && poolPtr != NULL)
+	{
+		return(poolPtr);
+	}
+	
+	newLimit = *limit * 2;
+	if(newLimit < neededNum)
+	{
+		newLimit = neededNum;
+	}
+	poolPtr = realloc(poolPtr, newLimit * objectSize);
+	if(poolPtr == NULL)
+	{
+		printf("Haggis:  Out of memory");
+		exit(1);
+	}
+	*limit = newLimit;
+	
+	return(poolPtr);
+}
+
+/*****************************GetIonPool**************************************************
+*
+*	Makes sure that the node connection arrays have a row for each of the ionNum ions, and
+*	zeroes those rows.
+*/
+static void GetIonPool(INT_4 ionNum)
+{
+	INT_4 limit;
+	
+	limit = gHaggisPools.ionLimit;
+	gForwardNodeConnect = GrowHaggisPool(gForwardNodeConnect, &limit, ionNum, 
+										sizeof(gForwardNodeConnect[0]));
+	limit = gHaggisPools.ionLimit;
+	gBackwardNodeConnect = GrowHaggisPool(gBackwardNodeConnect, &limit, ionNum, 
+										sizeof(gBackwardNodeConnect[0]));
+	limit = gHaggisPools.ionLimit;
+	gForwardNum = GrowHaggisPool(gForwardNum, &limit, ionNum, sizeof(INT_4));
+	limit = gHaggisPools.ionLimit;
+	gBackwardNum = GrowHaggisPool(gBackwardNum, &limit, ionNum, sizeof(INT_4));
+	limit = gHaggisPools.ionLimit;
+	gHaggisPools.seriesFirst = GrowHaggisPool(gHaggisPools.seriesFirst, &limit, ionNum, 
+											sizeof(INT_4));
+	limit = gHaggisPools.ionLimit;
+	gHaggisPools.seriesNum = GrowHaggisPool(gHaggisPools.seriesNum, &limit, ionNum, 
+											sizeof(INT_4));
+	gHaggisPools.ionLimit = limit;
+	
+	memset(gForwardNodeConnect, 0, ionNum * sizeof(gForwardNodeConnect[0]));
+	memset(gBackwardNodeConnect, 0, ionNum * sizeof(gBackwardNodeConnect[0]));
+	memset(gForwardNum, 0, ionNum * sizeof(INT_4));
+	memset(gBackwardNum, 0, ionNum * sizeof(INT_4));
+	
+	return;
+}
+
+/*****************************GetSequenceNodes********************************************
+*
+*	Makes sure there is room for node sequence seqIndex, and returns it zeroed.
+*/
+static INT_4 *GetSequenceNodes(INT_4 seqIndex)
+{
+	INT_4 seqNum, limit;
+	
+	seqNum = seqIndex + 1;
+	if(seqNum > gHaggisPools.seqLimit)
+	{
+		limit = gHaggisPools.seqLimit * gHaggisPools.seqWidth;
+		gHaggisPools.sequenceNodes = GrowHaggisPool(gHaggisPools.sequenceNodes, &limit,
+										seqNum * gHaggisPools.seqWidth, sizeof(INT_4));
+		gHaggisPools.seqLimit = limit / gHaggisPools.seqWidth;
+	}
+	
+	memset(gSequenceNodes(seqIndex), 0, gHaggisPools.seqWidth * sizeof(INT_4));
+	
+	return(gSequenceNodes(seqIndex));
+}
+
+/*****************************GetPepMassSeq***********************************************
+*
+*	Makes sure there is room for residue mass sequence seqIndex, and starts it out empty.
+*	There is always a spare row at the end, since the residue mass sequences are sometimes 
+*	read one past their length.
+*/
+static void GetPepMassSeq(INT_4 seqIndex)
+{
+	INT_4 limit;
+	
+	limit = gHaggisPools.pepLimit;
+	gPepMassSeq = GrowHaggisPool(gPepMassSeq, &limit, seqIndex + 2, sizeof(gPepMassSeq[0]));
+	limit = gHaggisPools.pepLimit;
+	gPepLength = GrowHaggisPool(gPepLength, &limit, seqIndex + 2, sizeof(INT_4));
+	limit = gHaggisPools.pepLimit;
+	gMatchSeries = GrowHaggisPool(gMatchSeries, &limit, seqIndex + 2, sizeof(INT_4));
+	gHaggisPools.pepLimit = limit;
+	
+	memset(gPepMassSeq[seqIndex], 0, 2 * sizeof(gPepMassSeq[0]));
+	gPepLength[seqIndex] = 0;
+	gMatchSeries[seqIndex] = -1;
+	
+	return;
+}
 
 /*****************************Haggis*************************************************
 *
@@ -112,7 +321,18 @@ struct Sequence *Haggis(struct Sequence *firstSequencePtr , struct MSData *first
 	INT_4 nodeValue;
 	INT_2 nodeCorrection;
 	INT_4 gapNum, lutefiskSequenceCount;
-	struct Sequence *currPtr;
+	struct Sequence *currPtr, *lastPtr;
+	
+	/*Get the space for the globals in this file (once per search)*/
+	if(gSearch->haggis == NULL)
+	{
+		gSearch->haggis = (struct HaggisState *) calloc(1, sizeof(struct HaggisState));
+		if(gSearch->haggis == NULL)
+		{
+			printf("Haggis:  Out of memory");
+			exit(1);
+		}
+	}
 	
 	/*Count and report the number of Lutefisk-derived sequences*/
 	lutefiskSequenceCount = 0;
@@ -123,7 +343,7 @@ struct Sequence *Haggis(struct Sequence *firstSequencePtr , struct MSData *first
 		currPtr = currPtr->next;
 	}
 	printf("Lutefisk sequences: %ld \n", lutefiskSequenceCount);
-	gLutefiskSequenceCount = lutefiskSequenceCount;	/*need to be global for StoreSeq*/
+	gLutefiskSequenceCount = lutefiskSequenceCount;	/*need to be global for MinSeriesEdgeNum*/
 	
 	/*Don't bother working on precursor charge states more than 3*/
 	if(gParam.chargeState > 3)
@@ -152,14 +372,6 @@ struct Sequence *Haggis(struct Sequence *firstSequencePtr , struct MSData *first
 	
 	/*Initialize variables*/
 	gSequenceNum = 0;
-	for(i = 0; i < MAX_SEQUENCES * 2; i++)
-	{
-		gPepLength[i] = 0;
-		for(j = 0; j < MAX_PEPTIDE_LENGTH; j++)
-		{
-			gPepMassSeq[i][j] = 0;
-		}
-	}
 	
 	
 	/*Consider different charge states for fragment ions*/
@@ -193,8 +405,9 @@ struct Sequence *Haggis(struct Sequence *firstSequencePtr , struct MSData *first
 	ModifyHaggisSequences(firstMassPtr);
 	
 
-	/*Find the highest score in the linked list*/
+	/*Find the highest score and the last sequence in the linked list*/
 	score = 0;
+	lastPtr = NULL;
 	currPtr = firstSequencePtr;
 	while(currPtr != NULL)
 	{
@@ -202,6 +415,7 @@ struct Sequence *Haggis(struct Sequence *firstSequencePtr , struct MSData *first
 		{
 			score = currPtr->score;
 		}
+		lastPtr = currPtr;
 		currPtr = currPtr->next;
 	}
 	if(score == 0)
@@ -214,7 +428,7 @@ struct Sequence *Haggis(struct Sequence *firstSequencePtr , struct MSData *first
 	nodeCorrection = 0;
 	gapNum = 0;
 	
-	/*Add sequences to linked list*/
+	/*Add sequences to the end of the linked list*/
 	for(i = 0; i < gSequenceNum; i++)
 	{
 		peptideLength = gPepLength[i];
@@ -226,8 +440,17 @@ struct Sequence *Haggis(struct Sequence *firstSequencePtr , struct MSData *first
 				peptide[j] = gPepMassSeq[i][j];
 			}
 			
-			firstSequencePtr = LinkHaggisSubsequenceList(firstSequencePtr, LoadHaggisSequenceStruct(peptide, 
-								peptideLength, score, nodeValue, gapNum, nodeCorrection));
+			currPtr = LoadHaggisSequenceStruct(peptide, peptideLength, score, nodeValue, 
+								gapNum, nodeCorrection);
+			if(lastPtr == NULL)
+			{
+				firstSequencePtr = currPtr;
+			}
+			else
+			{
+				lastPtr->next = currPtr;
+			}
+			lastPtr = currPtr;
 		}
 	}
 	
@@ -378,17 +601,74 @@ BOOLEAN	FindYIon(INT_4 sequenceIndex,INT_4 residueIndex, struct MSData *firstMas
 	return(yIonPresent);
 }
 
+/*********************************MassIndexSortAscend************************************************
+*
+*	For qsort of a tMassIndex array by mass, and then by sequence index.
+*/
+static int	MassIndexSortAscend(const void *n1, const void *n2)
+{
+	const tMassIndex *a = (const tMassIndex *)n1;
+	const tMassIndex *b = (const tMassIndex *)n2;
+	
+	if(a->mass != b->mass)
+	{
+		return(a->mass < b->mass ? -1 : 1);
+	}
+	return(a->index < b->index ? -1 : (a->index > b->index));
+}
+
+/*********************************IntSortAscend******************************************************
+*
+*	For qsort of INT_4's.
+*/
+static int	IntSortAscend(const void *n1, const void *n2)
+{
+	INT_4 a = *(const INT_4 *)n1;
+	INT_4 b = *(const INT_4 *)n2;
+	
+	return(a < b ? -1 : (a > b));
+}
+
+/*********************************MassIndexLow*******************************************************
+*
+*	Returns the first entry of the sorted index massIndex (of num entries) w/ a mass of at 
+*	least mass, or num if there is none.
+*/
+static INT_4	MassIndexLow(tMassIndex *massIndex, INT_4 num, INT_4 mass)
+{
+	INT_4 low = 0, high = num, middle;
+	
+	while(low < high)
+	{
+		middle = (low + high) / 2;
+		if(massIndex[middle].mass < mass)
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+	return(low);
+}
+
 /*********************************AppendSequences****************************************************
 *
-*	This function finds two sequences that could be combined into a new one.  
+*	This function finds two sequences that could be combined into a new one.  The sequences
+*	are indexed by their N-terminal unsequenced mass, so that for each N-terminal bit only the 
+*	sequences whose unsequenced mass is far enough past its sequenced part (and, if there 
+*	are a lot of sequences, by a one or two amino acid mass) are looked at.
 */
 
 void	AppendSequences()
 {
-	INT_4	i, j, k, testMass, massDiff, newSeqNum, massLimit;
+	INT_4	i, j, k, testMass, massDiff, newSeqNum, massLimit, seqNum, partnerNum;
 	INT_4	newSeqIndex[MAX_SEQUENCES][2];
+	INT_4	*gapMass, gapMassNum, *partner, low, high;
+	tMassIndex *massIndex;
 	REAL_8 	maxSequences = MAX_SEQUENCES;
-	BOOLEAN	storeIt, saveAll;
+	BOOLEAN	saveAll;
 	
 	massLimit = gMonoMass_x100[A] * 2 - gParam.fragmentErr;	/*unsequenced mass separating the N- and C-terminal
 															sequences has to be more than this value*/
@@ -405,65 +685,98 @@ void	AppendSequences()
 		saveAll = FALSE;	/*need to save only the ones that correspond to certain masse*/
 	}
 	
+	/*Index the sequences by their N-terminal unsequenced mass, and sort the one and two 
+	amino acid masses*/
+	seqNum = gSequenceNum;
+	massIndex = (tMassIndex *) malloc((seqNum + 1) * sizeof(tMassIndex));
+	partner = (INT_4 *) malloc((seqNum + 1) * sizeof(INT_4));
+	gapMass = (INT_4 *) malloc((gGapListIndex + 1) * sizeof(INT_4));
+	if(massIndex == NULL || partner == NULL || gapMass == NULL)
+	{
+		printf("AppendSequences:  Out of memory");
+		exit(1);
+	}
+	for(i = 0; i < seqNum; i++)
+	{
+		massIndex[i].mass = gPepMassSeq[i][0];
+		massIndex[i].index = i;
+	}
+	qsort(massIndex, seqNum, sizeof(tMassIndex), MassIndexSortAscend);
+	gapMassNum = 0;
+	for(k = 0; k < gGapListIndex; k++)
+	{
+		if(gGapList[k] > 0)
+		{
+			gapMass[gapMassNum++] = gGapList[k];
+		}
+	}
+	qsort(gapMass, gapMassNum, sizeof(INT_4), IntSortAscend);
+	
 	/*Start the search for new sequences derived by sticking two old ones together*/
 	newSeqNum = 0;
-	for(i = 0; i < gSequenceNum; i++)
+	for(i = 0; i < seqNum && newSeqNum < MAX_SEQUENCES; i++)
 	{
 		testMass = 0;
 		for(j = 0; j < gPepLength[i] - 1; j++)
 		{
 			testMass += gPepMassSeq[i][j];	/*Find N-terminal mass plus sequence of first one*/
 		}
-		for(j = i; j < gSequenceNum; j++)
+		
+		/*Find the sequences whose C-terminal unsequenced mass minus the N-terminal mass of 
+		the first one is more than 2xAla, and if not all are saved, is a one or two amino 
+		acid mass*/
+		partnerNum = 0;
+		if(saveAll)
+		{
+			for(k = MassIndexLow(massIndex, seqNum, testMass + massLimit + 1); k < seqNum; k++)
+			{
+				partner[partnerNum++] = massIndex[k].index;
+			}
+		}
+		else
 		{
-			massDiff = gPepMassSeq[j][0] - testMass; /*Subtract C-terminal unsequenced mass from
-														N-terminal mass of first one */
-			if(massDiff > massLimit)	/*At moment only requirement is that mass diff be more than 2xAla*/
+			high = 0;
+			for(k = 0; k < gapMassNum; k++)
 			{
-				if(gMatchSeries[j] != i && newSeqNum < MAX_SEQUENCES)	/*don't append a sequence that is the 
-																		reverse of itself*/
+				low = MassIndexLow(massIndex, seqNum, testMass + gapMass[k] - gParam.fragmentErr);
+				if(low < high)
 				{
-					storeIt = FALSE;	/*assume the worst*/
-					if(saveAll)
-					{
-						storeIt = TRUE;	/*not enough sequences to worry about overflow*/
-					}
-					else
-					{
-			//			if(massDiff > gMonoMass_x100[W] * 2 && massDiff < 400 * gMultiplier)
-			//			{
-			//				storeIt = FALSE;	/*if the mass diff is between 372 and 500, save it*/
-			//			}
-			//			else
-			//			{
-							for(k = 0; k < gGapListIndex; k++)
-							{
-								if(massDiff <= gGapList[k] + gParam.fragmentErr &&
-									massDiff >= gGapList[k] - gParam.fragmentErr)
-								{
-									storeIt = TRUE;	/*if its a one or two amino acid mass, save it*/
-									break;
-								}
-							}
-			//			}
-					}
-					if(storeIt)	/*Store the index values of the two old sequences*/
+					low = high;	/*this one overlaps the last one*/
+				}
+				for(high = low; high < seqNum && 
+					massIndex[high].mass <= testMass + gapMass[k] + gParam.fragmentErr; high++)
+				{
+					if(massIndex[high].mass - testMass > massLimit)
 					{
-						newSeqIndex[newSeqNum][0] = i;	/*N-terminal bit*/
-						newSeqIndex[newSeqNum][1] = j;	/*C-terminal bit*/
-						newSeqNum++;
+						partner[partnerNum++] = massIndex[high].index;
 					}
 				}
 			}
-			
+		}
+		qsort(partner, partnerNum, sizeof(INT_4), IntSortAscend);
+		
+		for(k = 0; k < partnerNum; k++)
+		{
+			j = partner[k];
+			if(j >= i && gMatchSeries[j] != i && newSeqNum < MAX_SEQUENCES)	/*don't append a 
+																	sequence that is the reverse of itself*/
+			{
+				newSeqIndex[newSeqNum][0] = i;	/*N-terminal bit*/
+				newSeqIndex[newSeqNum][1] = j;	/*C-terminal bit*/
+				newSeqNum++;
+			}
 		}
 	}
+	free(massIndex);
+	free(partner);
+	free(gapMass);
 	
 	/*Make the new sequences and add them to the global list*/
 	for(i = 0; i < newSeqNum; i++)
 	{
 		if(gSequenceNum < MAX_SEQUENCES * 2)
 		{
+			GetPepMassSeq(gSequenceNum);
 			testMass = 0;
 			for(j = 0; j < gPepLength[newSeqIndex[i][0]] - 1; j++)
 			{
@@ -503,14 +816,14 @@ void FleshOutSequenceEnds(struct MSData *firstMassPtr)
 	
 	
 	/*Assign space to arrays*/
-	cTermMasses 			= (int *) malloc(MAX_SEQUENCES * 2 * sizeof(INT_4));
+	cTermMasses 			= (int *) malloc((gSequenceNum + 1) * sizeof(INT_4));
 	if(cTermMasses == NULL)
 	{
 		printf("Haggis:FleshOutSequences memory error");
 		exit(1);
 	}
 	
-	nTermMasses 			= (int *) malloc(MAX_SEQUENCES * 2 * sizeof(INT_4));
+	nTermMasses 			= (int *) malloc((gSequenceNum + 1) * sizeof(INT_4));
 	if(nTermMasses == NULL)
 	{
 		printf("Haggis:FleshOutSequences memory error");
@@ -534,7 +847,7 @@ void FleshOutSequenceEnds(struct MSData *firstMassPtr)
 	/*Initialize*/
 	cTermMassNum = 0;
 	nTermMassNum = 0;
-	for(i = 0; i < MAX_SEQUENCES*2; i++)
+	for(i = 0; i < gSequenceNum + 1; i++)
 	{
 		cTermMasses[i] = 0;
 		nTermMasses[i] = 0;
@@ -654,12 +967,12 @@ void FleshOutSequenceEnds(struct MSData *firstMassPtr)
 void	GetBestCtermSeq(INT_4 *sequenceToAdd, INT_4 mass, char cTerm, struct MSData *firstMassPtr)
 {
 	INT_4 	maxResidues, minResidues, residueNum, *sequence, i, j, k;	
-	INT_4	ratchetMass, nominalMass, loopNumber, newMass;
-	REAL_4	testNum, position, score, bestScore;
+	INT_4	nominalMass, loopNumber, newMass;
+	REAL_4	testNum, score, bestScore;
 	REAL_4	massLimit = 747;	/*largest bit of unsequenced mass to be examined*/
 	char	cTermAA;
 	
-	if((clock() - gParam.startTicks)/ CLOCKS_PER_SEC > 45)
+	if((SearchTicks() - gParam.startTicks)/ CLOCKS_PER_SEC > 45)
 	{
 		massLimit = 600;
 	}
@@ -757,65 +1070,52 @@ void	GetBestCtermSeq(INT_4 *sequenceToAdd, INT_4 mass, char cTerm, struct MSData
 		for(residueNum = minResidues; residueNum <= maxResidues; residueNum++)
 		{
 			/*Initialize each time the sequence length changes*/
-			ratchetMass = 0;
-			for(i = 0; i < residueNum; i++)
-			{
-				sequence[i] = 0;
-				ratchetMass += gAAArray[0];
-			}
-			sequence[0] = -1;	/*The first time through Ratchet moves this to zero*/
-			position	= 0;
+			sequence[0] = -1;	/*The first call to NextHaggisSequence starts from here*/
 			
-			/*Ratchet produces a new sequence until all have been done, at which point it returns a NULL*/
-			while(ratchetMass != 0)
+			/*NextHaggisSequence produces each sequence that fits the mass in turn, and returns FALSE
+			when all have been done*/
+			while(NextHaggisSequence(sequence, residueNum, nominalMass))
 			{
-				/*Ratchets through all possible sequences, and returns mass of sequence*/
-				ratchetMass = RatchetHaggis(sequence, residueNum, position, ratchetMass, nominalMass);
+				/*Score the sequence*/
+				if(cTermAA == 'K')
+				{
+					sequence[residueNum] = gCTermKIndex;
+					score = CSequenceScore(mass, sequence, residueNum + 1, firstMassPtr);
+				}
+				else if(cTermAA == 'R')
+				{
+					sequence[residueNum] = gCTermRIndex;
+					score = CSequenceScore(mass, sequence, residueNum + 1, firstMassPtr);
+				}
+				else
+				{
+					score = CSequenceScore(mass, sequence, residueNum, firstMassPtr);
+				}
 				
-			
-				if(ratchetMass == nominalMass)
+				/*Check if this is the highest scoring sequence so far (save it)*/
+				if(score > bestScore)
 				{
-					/*Score the sequence*/
-					if(cTermAA == 'K')
-					{
-						sequence[residueNum] = gCTermKIndex;
-						score = CSequenceScore(mass, sequence, residueNum + 1, firstMassPtr);
-					}
-					else if(cTermAA == 'R')
+					bestScore = score;
+					if(cTermAA == 'K' || cTermAA == 'R')
 					{
-						sequence[residueNum] = gCTermRIndex;
-						score = CSequenceScore(mass, sequence, residueNum + 1, firstMassPtr);
+						for(i = 0; i < residueNum + 1; i++)
+						{
+							sequenceToAdd[i] = gAAArray[sequence[i]];	/*puts nominal masses into array*/
+						}
+						for(i = residueNum + 1; i < MAX_PEPTIDE_LENGTH; i++)
+						{
+							sequenceToAdd[i] = 0;	/*backfill*/
+						}
 					}
 					else
 					{
-						score = CSequenceScore(mass, sequence, residueNum, firstMassPtr);
-					}
-					
-					/*Check if this is the highest scoring sequence so far (save it)*/
-					if(score > bestScore)
-					{
-						bestScore = score;
-						if(cTermAA == 'K' || cTermAA == 'R')
+						for(i = 0; i < residueNum; i++)
 						{
-							for(i = 0; i < residueNum + 1; i++)
-							{
-								sequenceToAdd[i] = gAAArray[sequence[i]];	/*puts nominal masses into array*/
-							}
-							for(i = residueNum + 1; i < MAX_PEPTIDE_LENGTH; i++)
-							{
-								sequenceToAdd[i] = 0;	/*backfill*/
-							}
+							sequenceToAdd[i] = gAAArray[sequence[i]];	/*puts nominal masses into array*/
 						}
-						else
+						for(i = residueNum; i < MAX_PEPTIDE_LENGTH; i++)
 						{
-							for(i = 0; i < residueNum; i++)
-							{
-								sequenceToAdd[i] = gAAArray[sequence[i]];	/*puts nominal masses into array*/
-							}
-							for(i = residueNum; i < MAX_PEPTIDE_LENGTH; i++)
-							{
-								sequenceToAdd[i] = 0;	/*backfill*/
-							}
+							sequenceToAdd[i] = 0;	/*backfill*/
 						}
 					}
 				}
@@ -1019,6 +1319,67 @@ char	CheckCterm(struct MSData *firstMassPtr)
 	return(cTerm);
 }
 
+/*********************************MakeDecompositionTable************************************
+*
+*	Fills in the decomposition table for the residue masses in gAAArray, unless it was already
+*	made for the same ones.  Row n lists which nominal masses up to DECOMP_MASS_LIMIT can be
+*	made from n residues.
+*/
+
+static void	MakeDecompositionTable(void)
+{
+	struct HaggisState *haggisPtr = gSearch->haggis;
+	INT_4 i, n, mass, rowSize;
+	char *row, *lastRow;
+	
+	if(haggisPtr->decompTable != NULL && haggisPtr->decompAANum == gAANum &&
+		memcmp(haggisPtr->decompAA, gAAArray, gAANum * sizeof(INT_4)) == 0)
+	{
+		return;	/*same residues as last time*/
+	}
+	
+	/*No more residues than MAX_PEPTIDE_LENGTH, or than the number of the smallest that fit*/
+	haggisPtr->decompLength = MAX_PEPTIDE_LENGTH;
+	if(gAANum > 0 && gAAArray[0] > 0 && DECOMP_MASS_LIMIT / gAAArray[0] < MAX_PEPTIDE_LENGTH)
+	{
+		haggisPtr->decompLength = DECOMP_MASS_LIMIT / gAAArray[0];
+	}
+	
+	rowSize = DECOMP_MASS_LIMIT + 1;
+	free(haggisPtr->decompTable);
+	haggisPtr->decompTable = (char *) calloc((haggisPtr->decompLength + 1) * rowSize, sizeof(char));
+	if(haggisPtr->decompTable == NULL)
+	{
+		printf("Haggis:  Out of memory");
+		exit(1);
+	}
+	
+	haggisPtr->decompTable[0] = TRUE;	/*no residues, no mass*/
+	for(n = 1; n <= haggisPtr->decompLength; n++)
+	{
+		lastRow = haggisPtr->decompTable + (n - 1) * rowSize;
+		row 	= haggisPtr->decompTable + n * rowSize;
+		for(mass = 0; mass < rowSize; mass++)
+		{
+			if(lastRow[mass])
+			{
+				for(i = 0; i < gAANum; i++)
+				{
+					if(mass + gAAArray[i] < rowSize)
+					{
+						row[mass + gAAArray[i]] = TRUE;
+					}
+				}
+			}
+		}
+	}
+	
+	memcpy(haggisPtr->decompAA, gAAArray, gAANum * sizeof(INT_4));
+	haggisPtr->decompAANum = gAANum;
+	
+	return;
+}
+
 /***********************************MakeAAArray********************************************
 *
 *
@@ -1087,7 +1448,7 @@ void	MakeAAArray(void)
 		}
 	}
 	
-	gMassRange = gAAArray[gAANum - 1] - gAAArray[0];
+	MakeDecompositionTable();
 	
 	return;
 }
@@ -1102,8 +1463,8 @@ void	MakeAAArray(void)
 void	GetBestNtermSeq(INT_4 *sequenceToAdd, INT_4 mass, struct MSData *firstMassPtr)
 {
 	INT_4 	maxResidues, minResidues, residueNum, *sequence, i, j;	
-	INT_4	ratchetMass, nominalMass;
-	REAL_4	testNum, position, score, bestScore;
+	INT_4	nominalMass;
+	REAL_4	testNum, score, bestScore;
 	REAL_4	massLimit = 600;	/*largest bit of unsequenced mass to be examined*/
 	
 	
@@ -1154,39 +1515,26 @@ void	GetBestNtermSeq(INT_4 *sequenceToAdd, INT_4 mass, struct MSData *firstMassP
 	for(residueNum = minResidues; residueNum <= maxResidues; residueNum++)
 	{
 		/*Initialize each time the sequence length changes*/
-		ratchetMass = 0;
-		for(i = 0; i < residueNum; i++)
-		{
-			sequence[i] = 0;
-			ratchetMass += gAAArray[0];
-		}
-		sequence[0] = -1;	/*The first time through Ratchet moves this to zero*/
-		position	= 0;
+		sequence[0] = -1;	/*The first call to NextHaggisSequence starts from here*/
 		
-		/*Ratchet produces a new sequence until all have been done, at which point it returns a NULL*/
-		while(ratchetMass != 0)
+		/*NextHaggisSequence produces each sequence that fits the mass in turn, and returns FALSE
+		when all have been done*/
+		while(NextHaggisSequence(sequence, residueNum, nominalMass))
 		{
-			/*Ratchets through all possible sequences, and returns mass of sequence*/
-			ratchetMass = RatchetHaggis(sequence, residueNum, position, ratchetMass, nominalMass);
+			/*Score the sequence*/
+			score = NSequenceScore(mass, sequence, residueNum, firstMassPtr);
 			
-		
-			if(ratchetMass == nominalMass)
+			/*Check if this is the highest scoring sequence so far (save it)*/
+			if(score > bestScore)
 			{
-				/*Score the sequence*/
-				score = NSequenceScore(mass, sequence, residueNum, firstMassPtr);
-				
-				/*Check if this is the highest scoring sequence so far (save it)*/
-				if(score > bestScore)
+				bestScore = score;
+				for(i = 0; i < residueNum; i++)
 				{
-					bestScore = score;
-					for(i = 0; i < residueNum; i++)
-					{
-						sequenceToAdd[i] = gAAArray[sequence[i]];	/*puts nominal masses into array*/
-					}
-					for(i = residueNum; i < MAX_PEPTIDE_LENGTH; i++)
-					{
-						sequenceToAdd[i] = 0;	/*backfill*/
-					}
+					sequenceToAdd[i] = gAAArray[sequence[i]];	/*puts nominal masses into array*/
+				}
+				for(i = residueNum; i < MAX_PEPTIDE_LENGTH; i++)
+				{
+					sequenceToAdd[i] = 0;	/*backfill*/
 				}
 			}
 		}
@@ -1322,78 +1670,89 @@ REAL_4	NSequenceScore(INT_4 mass, INT_4 *sequence, INT_4 residueNum, struct MSDa
 	return(score);
 }
 
-/*********************************RatchetHaggis**********************************************
-*
+/*********************************Decomposable**********************************************
 *
+*	Returns TRUE if residueNum residues from gAAArray can add up to the nominal mass.
 */
 
-INT_4	RatchetHaggis(INT_4 *sequence, INT_4 residueNum, INT_4 position, INT_4 ratchetMass, INT_4 correctMass)
+static BOOLEAN	Decomposable(INT_4 residueNum, INT_4 mass)
 {
-	INT_4 i;
-
-	if(ratchetMass == 0)
+	if(mass < 0 || mass > DECOMP_MASS_LIMIT || residueNum > gSearch->haggis->decompLength)
 	{
-		return(0);	/*make sure that this recursive call unwinds itself*/
+		return(FALSE);
 	}
 	
-	if(sequence[0] == -1)	/*just starting out*/
-	{
-		sequence[0] += 1;
-	}
-	else if(sequence[position] < gAANum - 1)	/*changing the right most amino acid*/
-	{
-		ratchetMass = ratchetMass - gAAArray[sequence[position]];
-		sequence[position] += 1;
-		ratchetMass += gAAArray[sequence[position]];
-	}
-	else	/*need to ratchet*/
+	return(gSearch->haggis->decompTable[residueNum * (DECOMP_MASS_LIMIT + 1) + mass]);
+}
+
+/*********************************FillHaggisSequence****************************************
+*
+*	Fills sequence[0] thru sequence[position] w/ the first (in the order used by 
+*	NextHaggisSequence) residues that add up to mass.  Decomposable(position + 1, mass) 
+*	must be TRUE.
+*/
+
+static void	FillHaggisSequence(INT_4 *sequence, INT_4 position, INT_4 mass)
+{
+	INT_4 i;
+	
+	for(; position >= 0; position--)
 	{
-		if(sequence[position] + 1 >= gAANum && position < residueNum)
+		for(i = 0; i < gAANum; i++)
 		{
-			ratchetMass = ratchetMass - gAAArray[gAANum - 1];
-			ratchetMass += gAAArray[0];
-			sequence[position] = 0;
-			position += 1;
-			if(position >= residueNum)
+			if(Decomposable(position, mass - gAAArray[i]))
 			{
-				return(0);
+				break;
 			}
-			ratchetMass = RatchetHaggis(sequence, residueNum, position, ratchetMass, correctMass);
-		}
-		else
-		{
-			return(0);	/*you've reached the end of the road*/
 		}
+		sequence[position] = i;
+		mass -= gAAArray[i];
 	}
 	
-	/*Try to skip if nowhere near the right mass*/
-	if(/*sequence[0] == 0 &&*/ ratchetMass != 0 && position < residueNum)
+	return;
+}
+
+/*********************************NextHaggisSequence****************************************
+*
+*	Steps sequence (residueNum indices into gAAArray) to the next sequence whose nominal mass
+*	is correctMass, and returns FALSE if there are no more.  sequence[0] is -1 the first time.
+*	The sequences come in the same order as counting, w/ sequence[0] as the fastest changing
+*	position; the decomposition table is used to skip over the ones that can't fit the mass.
+*/
+
+BOOLEAN	NextHaggisSequence(INT_4 *sequence, INT_4 residueNum, INT_4 correctMass)
+{
+	INT_4 i, position, mass;
+
+	if(sequence[0] == -1)	/*just starting out*/
 	{
-		if(ratchetMass + gMassRange < correctMass)	/*if the mass is nowhere near close enough*/
+		if(!Decomposable(residueNum, correctMass))
 		{
-			ratchetMass = ratchetMass - gAAArray[sequence[0]];
-			ratchetMass += gAAArray[gAANum - 1];
-			sequence[0] = gAANum - 1;
-			position = 0;
-			ratchetMass = RatchetHaggis(sequence, residueNum, position, ratchetMass, correctMass);
+			return(FALSE);
 		}
-		if(ratchetMass > correctMass)	/*if the mass is already to much*/
+		FillHaggisSequence(sequence, residueNum - 1, correctMass);
+		return(TRUE);
+	}
+	
+	/*Find the lowest position that can take a larger residue, and still fit the mass*/
+	mass = 0;	/*mass of positions 0 thru position*/
+	for(position = 0; position < residueNum; position++)
+	{
+		mass += gAAArray[sequence[position]];
+		for(i = sequence[position] + 1; i < gAANum; i++)
 		{
-			for(i = 0; i <= position; i++)
+			if(Decomposable(position, mass - gAAArray[i]))
 			{
-				ratchetMass = ratchetMass - gAAArray[sequence[i]];
-				ratchetMass += gAAArray[gAANum - 1];
-				sequence[i] = gAANum - 1;
+				sequence[position] = i;
+				FillHaggisSequence(sequence, position - 1, mass - gAAArray[i]);
+				return(TRUE);
 			}
-			position = 0;
-			ratchetMass = RatchetHaggis(sequence, residueNum, position, ratchetMass, correctMass);
 		}
 	}
 	
-	return(ratchetMass);
+	return(FALSE);	/*you've reached the end of the road*/
 }
 
-
 /**********************GetCTermMasses****************************************************
 *
 *	Make a list of c-terminal unsequenced masses.
@@ -1471,12 +1830,7 @@ struct Sequence *LoadHaggisSequenceStruct(INT_4 *peptide, INT_4 peptideLength,
 	struct Sequence *currPtr;
 	INT_4 i;	
 
-	currPtr = (struct Sequence *) malloc(sizeof(struct Sequence));
-	if(currPtr == NULL)
-	{
-		printf("LoadSequenceStruct in Haggis:  Out of mammories");
-		exit(1);
-	}
+	currPtr = NewSequenceStruct();
 	
 	for(i = 0; i < peptideLength; i++)
 	{
@@ -1493,47 +1847,18 @@ struct Sequence *LoadHaggisSequenceStruct(INT_4 *peptide, INT_4 peptideLength,
 }
 
 
-/****************LinkHaggisSubsequenceList**********************************************************
-*
-* 	This function adds a subsequence onto the existing linked list of structs of type Sequence.
-*	It adds structs in order of their score fields, so that the first in the list has the
-*	highest score and the last in the list has the lowest score.
+/***************************************GetSequenceOfResidues******************************
 *
+*	Convert sequence of nodes to sequence of amino acid residue masses.  If a mass does
+*	not equal a known residue mass then save the mass as is.
 */
-
-struct Sequence *LinkHaggisSubsequenceList(struct Sequence *firstPtr, struct Sequence *newPtr)
-{
-	struct Sequence *lastPtr;
-	char test = TRUE;
-		
-	if(firstPtr == NULL)	/*If this is the first struct of the list then do this.*/
-		firstPtr = newPtr;
-	else
-	{
-		/*Find the last sequence in the list*/
-		lastPtr = firstPtr;
-		while(lastPtr->next != NULL)
-		{
-			lastPtr = lastPtr->next;
-		}
-		lastPtr->next = newPtr;
-	}
-	
-	return(firstPtr);
-}
-
-/***************************************GetSequenceOfResidues******************************
-*
-*	Convert sequence of nodes to sequence of amino acid residue masses.  If a mass does
-*	not equal a known residue mass then save the mass as is.
-*/
-void	GetSequenceOfResidues(INT_4 *mass)
+void	GetSequenceOfResidues(INT_4 *mass)
 {
 	INT_4 i, j, testMass, k, y1R, y1K, residueMass;
 	BOOLEAN y1Found, weirdMass;
 	
 	/*Initialize*/
-	for(i = 0; i < MAX_SEQUENCES*2; i++)
+	for(i = 0; i < gSequenceNum; i++)
 	{
 		gMatchSeries[i] = -1;
 	}
@@ -1543,31 +1868,32 @@ void	GetSequenceOfResidues(INT_4 *mass)
 	{
 		//Assume y ions
 		j = 0; 
-		while(gSequenceNodes[i][j] != 0)
+		while(gSequenceNodes(i)[j] != 0)
 		{
 			j++;	//find the end of the sequence
 		}
+		GetPepMassSeq(gSequenceNum);
 		gPepLength[gSequenceNum] = j + 1;
-		testMass = mass[gSequenceNodes[i][0]] - gParam.modifiedCTerm
+		testMass = mass[gSequenceNodes(i)[0]] - gParam.modifiedCTerm
 														- gElementMass_x100[HYDROGEN]*2;
 		gPepMassSeq[gSequenceNum][j] = ResidueMass(testMass);	/*provide mass from gMonoMass_x100 if possible*/
 		j--;
 		k = 1;
 		while(j > 0)
 		{
-			testMass = mass[gSequenceNodes[i][k]] - mass[gSequenceNodes[i][k-1]];
+			testMass = mass[gSequenceNodes(i)[k]] - mass[gSequenceNodes(i)[k-1]];
 			gPepMassSeq[gSequenceNum][j] = ResidueMass(testMass);	/*provide mass from gMonoMass_x100 if possible*/
 			j--;
 			k++;
 		}
-		testMass = gParam.peptideMW + gElementMass_x100[HYDROGEN] - mass[gSequenceNodes[i][k-1]];
+		testMass = gParam.peptideMW + gElementMass_x100[HYDROGEN] - mass[gSequenceNodes(i)[k-1]];
 		gPepMassSeq[gSequenceNum][0] = ResidueMass(testMass);	/*provide mass from gMonoMass_x100 if possible*/
 		gSequenceNum++;
 		
 		//Assume b ions
 		y1R = gMonoMass_x100[R] + gElementMass_x100[HYDROGEN]*2 + gParam.modifiedCTerm;
 		y1K = gMonoMass_x100[K] + gElementMass_x100[HYDROGEN]*2 + gParam.modifiedCTerm;
-		testMass = mass[gSequenceNodes[i][0]];
+		testMass = mass[gSequenceNodes(i)[0]];
 		if((testMass > y1K - gParam.fragmentErr &&
 			testMass < y1K + gParam.fragmentErr) ||
 			(testMass > y1R - gParam.fragmentErr &&
@@ -1582,17 +1908,18 @@ void	GetSequenceOfResidues(INT_4 *mass)
 		
 		if(!y1Found)	//Don't even store if a y1 ion for Arg or Lys found
 		{
-			testMass = mass[gSequenceNodes[i][0]] - gParam.modifiedNTerm;
+			GetPepMassSeq(gSequenceNum);
+			testMass = mass[gSequenceNodes(i)[0]] - gParam.modifiedNTerm;
 			gPepMassSeq[gSequenceNum][0] = ResidueMass(testMass);
 			gMatchSeries[gSequenceNum] = gSequenceNum - 1;	/*denotes that this is a b ion series repeat*/
 			j = 1;
-			while(gSequenceNodes[i][j] != 0)
+			while(gSequenceNodes(i)[j] != 0)
 			{
-				testMass = mass[gSequenceNodes[i][j]] - mass[gSequenceNodes[i][j-1]];
+				testMass = mass[gSequenceNodes(i)[j]] - mass[gSequenceNodes(i)[j-1]];
 				gPepMassSeq[gSequenceNum][j] = ResidueMass(testMass);
 				j++;
 			}
-			testMass = gParam.peptideMW - gParam.modifiedCTerm - mass[gSequenceNodes[i][j-1]];
+			testMass = gParam.peptideMW - gParam.modifiedCTerm - mass[gSequenceNodes(i)[j-1]];
 			gPepMassSeq[gSequenceNum][j] = ResidueMass(testMass);
 			gPepLength[gSequenceNum] = j + 1;
 			gSequenceNum++;
@@ -1718,65 +2045,266 @@ void	GetSequenceOfResidues(INT_4 *mass)
 
 
 
+/*****************************MinSeriesEdgeNum*********************************************
+*
+*	Returns the fewest edges that a series of ions needs to be worth keeping.  It depends on
+*	the size of the peptide, and on how many sequences Lutefisk has already come up with.
+*/
+static INT_4	MinSeriesEdgeNum(void)
+{
+	INT_4 minEdgeNum;
+	REAL_4 testMass;
+	
+	testMass = gParam.peptideMW / gMultiplier;	/*peptide mass*/
+	testMass = testMass / AV_RESIDUE_MASS;	/*guess at the number of residues*/
+	if(gLutefiskSequenceCount > 10000)
+	{
+		minEdgeNum = testMass / 2 + 0.5;
+	}
+	else if(gLutefiskSequenceCount > 1000)
+	{
+		minEdgeNum = testMass / 3 + 0.5;	/*need a series that covers a third of the sequence*/
+	}
+	else
+	{
+		minEdgeNum = testMass / 4 + 0.5;
+	}
+	if(minEdgeNum < 4)
+		minEdgeNum = 4;	/*bottom limit*/
+	
+	return(minEdgeNum);
+}
+
+/*****************************IonSeriesSortDescend*****************************************
+*
+*	For qsort of ion series, longest first.  Ties go to the series from the lower ion, and 
+*	then to the higher ranked series into that ion, which is the order that they are found.
+*/
+static int	IonSeriesSortDescend(const void *n1, const void *n2)
+{
+	const tIonSeries *a = (const tIonSeries *)n1;
+	const tIonSeries *b = (const tIonSeries *)n2;
+	
+	if(a->edgeNum != b->edgeNum)
+	{
+		return(a->edgeNum > b->edgeNum ? -1 : 1);
+	}
+	if(a->prevNode != b->prevNode)
+	{
+		return(a->prevNode < b->prevNode ? -1 : 1);
+	}
+	if(a->prevRank != b->prevRank)
+	{
+		return(a->prevRank < b->prevRank ? -1 : 1);
+	}
+	return(0);
+}
+
+/*****************************NodeSequenceSortAscend***************************************
+*
+*	For qsort of the zero terminated node sequences, in order of their nodes.
+*/
+static int	NodeSequenceSortAscend(const void *n1, const void *n2)
+{
+	const INT_4 *a = (const INT_4 *)n1;
+	const INT_4 *b = (const INT_4 *)n2;
+	INT_4 i;
+	
+	for(i = 0; a[i] != 0 || b[i] != 0; i++)
+	{
+		if(a[i] != b[i])
+		{
+			return(a[i] < b[i] ? -1 : 1);
+		}
+	}
+	return(0);
+}
+
+/*****************************IsGapEdge****************************************************
+*
+*	Returns TRUE if the jump of massDiff between two connected ions is not quite a residue
+*	mass (the connections allow a fragment error either way, and this does not).
+*/
+static BOOLEAN	IsGapEdge(INT_4 massDiff)
+{
+	INT_4 k;
+	
+	for(k = 0; k < gAminoAcidNumber; k++)
+	{
+		if(massDiff < gMonoMass_x100[k] + gParam.fragmentErr &&
+			massDiff > gMonoMass_x100[k] - gParam.fragmentErr)
+		{
+			return(FALSE);	/*its not a gap*/
+		}
+	}
+	return(TRUE);
+}
+
+/*****************************SeriesNodes**************************************************
+*
+*	Puts the nodes of series number rank into ion node in nodes (low mass first), followed by
+*	a zero.
+*/
+static void	SeriesNodes(INT_4 node, INT_4 rank, INT_4 *nodes)
+{
+	INT_4 i;
+	tIonSeries *seriesPtr;
+	
+	seriesPtr = &gHaggisPools.series[gHaggisPools.seriesFirst[node] + rank];
+	i = seriesPtr->edgeNum;
+	nodes[i + 1] = 0;
+	nodes[i] = node;
+	while(i > 0)
+	{
+		node = seriesPtr->prevNode;
+		rank = seriesPtr->prevRank;
+		i--;
+		nodes[i] = node;
+		seriesPtr = &gHaggisPools.series[gHaggisPools.seriesFirst[node] + rank];
+	}
+	
+	return;
+}
+
 /******************************FindNodeSequences*********************************
 *
 *	Given the ways that the ions can be connected (gForwardNodeConnect and gBackwardNodeConnect),
-*	find all possible pathways through the nodes.
+*	find the longest series of ions that go up to an ion w/ no connections to higher mass, and 
+*	that cannot be made any longer at the low mass end w/o having too many gaps.  The 
+*	connections only go up in mass, so the ions are taken in order, and each one gets the 
+*	MAX_NODE_SERIES longest series that end at it from the series ending at the ions connected 
+*	to it from below.  Of the ones that end at the top, the MAX_SEQUENCES longest that have 
+*	enough edges (see MinSeriesEdgeNum) are stored in gSequenceNodes, in order of their nodes.
 */
 void	FindNodeSequences(INT_4 *mass)
 {
-	INT_4 i, j, k, inputIon;
-	BOOLEAN test;
+	INT_4 i, j, k, node, candNum, seriesNum, endNum, minEdgeNum, gapNum;
+	BOOLEAN top, gapEdge, allGapEdges;
+	tIonSeries *seriesPtr;
 	
-	/*Initialize*/
+	/*Initialize.  A node sequence holds at most one node per ion plus the terminating zero.*/
 	gSeqCount = 0;
-	for(i = 0; i < MAX_SEQUENCES; i++)
+	if(gHaggisPools.seqWidth != gIonCount + 1)
 	{
-		for(j = 0; j < MAX_ION_NUM; j++)
-		{
-			gSequenceNodes[i][j] = 0;
-		}
+		gHaggisPools.seqLimit = gHaggisPools.seqLimit * gHaggisPools.seqWidth / (gIonCount + 1);
+		gHaggisPools.seqWidth = gIonCount + 1;
 	}
-
+	minEdgeNum = MinSeriesEdgeNum();
+	
 /*	Step through the nodes from low mass to high mass*/
-	for(i = 1; i < gIonCount; i++)	/*This is the first node, which is incremented up to the top*/
+	seriesNum = 0;
+	for(node = 1; node < gIonCount; node++)
 	{
-		if(gForwardNum[i] != 0 && gNotTooManySequences)	/*gNotTooManySequences signals that array is filled*/
+		candNum = 0;
+		allGapEdges = TRUE;
+		for(i = 0; i < gBackwardNum[node]; i++)
 		{
-			gEdgeNum 		= 0;	/*Counts the edges as the tree is searched*/
-			test 			= TRUE;	/*Becomes FALSE when all paths are searched from node i*/
-			inputIon 		= i;
-			/*Need to get forward/backward arrays with correct positive/negative values for starting over*/
-			for(j = 0; j < gIonCount; j++)
+			j = gBackwardNodeConnect[node][i];
+			gapEdge = IsGapEdge(mass[node] - mass[j]);
+			if(!gapEdge)
 			{
-				for(k = 0; k < gBackwardNum[j]; k++)
-				{
-					if(gBackwardNodeConnect[j][k] > 0)
-					{
-						gBackwardNodeConnect[j][k] = -1 * gBackwardNodeConnect[j][k];
-					}
-				}
-				for(k = 0; k < gForwardNum[j]; k++)
+				allGapEdges = FALSE;
+			}
+			gHaggisPools.cand = GrowHaggisPool(gHaggisPools.cand, &gHaggisPools.candLimit, 
+									candNum + gHaggisPools.seriesNum[j], sizeof(tIonSeries));
+			for(k = 0; k < gHaggisPools.seriesNum[j]; k++)
+			{
+				seriesPtr = &gHaggisPools.series[gHaggisPools.seriesFirst[j] + k];
+				gapNum = seriesPtr->gapNum + gapEdge;
+				if(gapNum <= gParam.maxGapNum)
 				{
-					if(gForwardNodeConnect[j][k] < 0)
-					{
-						gForwardNodeConnect[j][k] = -1 * gForwardNodeConnect[j][k];
-					}
+					gHaggisPools.cand[candNum].prevNode = j;
+					gHaggisPools.cand[candNum].prevRank = k;
+					gHaggisPools.cand[candNum].edgeNum = seriesPtr->edgeNum + 1;
+					gHaggisPools.cand[candNum].gapNum = gapNum;
+					gHaggisPools.cand[candNum].fullOfGaps = seriesPtr->fullOfGaps;
+					candNum++;
 				}
-			
 			}
-			/*test is positive until the low mass terminal node has no remaining pathways*/
-			while(test)
+		}
+		if(candNum > MAX_NODE_SERIES)
+		{
+			qsort(gHaggisPools.cand, candNum, sizeof(tIonSeries), IonSeriesSortDescend);
+			candNum = MAX_NODE_SERIES;
+		}
+		/*A series can start here if it can't be started lower down.  If the only ways down 
+		are gaps, it has to have all the gaps it's allowed.*/
+		if(allGapEdges)
+		{
+			gHaggisPools.cand = GrowHaggisPool(gHaggisPools.cand, &gHaggisPools.candLimit, 
+											candNum + 1, sizeof(tIonSeries));
+			gHaggisPools.cand[candNum].prevNode = 0;
+			gHaggisPools.cand[candNum].prevRank = 0;
+			gHaggisPools.cand[candNum].edgeNum = 0;
+			gHaggisPools.cand[candNum].gapNum = 0;
+			gHaggisPools.cand[candNum].fullOfGaps = (gBackwardNum[node] != 0);
+			candNum++;
+		}
+		
+		gHaggisPools.series = GrowHaggisPool(gHaggisPools.series, &gHaggisPools.seriesLimit,
+											seriesNum + candNum, sizeof(tIonSeries));
+		memcpy(&gHaggisPools.series[seriesNum], gHaggisPools.cand, candNum * sizeof(tIonSeries));
+		gHaggisPools.seriesFirst[node] = seriesNum;
+		gHaggisPools.seriesNum[node] = candNum;
+		seriesNum += candNum;
+	}
+	
+/*	Collect the series that end at nodes w/ no connections to higher mass*/
+	endNum = 0;
+	for(node = 1; node < gIonCount; node++)
+	{
+		top = TRUE;
+		for(i = 0; i < gForwardNum[node] && i < gAminoAcidNumber; i++)
+		{
+			if(gForwardNodeConnect[node][i] > 0)
 			{
-				test = NodeStep(&inputIon, mass);
+				top = FALSE;
+				break;
+			}
+		}
+		if(!top)
+		{
+			continue;
+		}
+		for(k = 0; k < gHaggisPools.seriesNum[node]; k++)
+		{
+			seriesPtr = &gHaggisPools.series[gHaggisPools.seriesFirst[node] + k];
+			if(seriesPtr->edgeNum >= minEdgeNum &&
+				(!seriesPtr->fullOfGaps || seriesPtr->gapNum == gParam.maxGapNum))
+			{
+				gHaggisPools.cand = GrowHaggisPool(gHaggisPools.cand, &gHaggisPools.candLimit, 
+												endNum + 1, sizeof(tIonSeries));
+				gHaggisPools.cand[endNum].prevNode = node;
+				gHaggisPools.cand[endNum].prevRank = k;
+				gHaggisPools.cand[endNum].edgeNum = seriesPtr->edgeNum;
+				endNum++;
 			}
 		}
 	}
+	if(endNum > MAX_SEQUENCES)
+	{
+		qsort(gHaggisPools.cand, endNum, sizeof(tIonSeries), IonSeriesSortDescend);
+		endNum = MAX_SEQUENCES;
+	}
+	
+/*	Store them, in order of their nodes*/
+	for(i = 0; i < endNum; i++)
+	{
+		SeriesNodes(gHaggisPools.cand[i].prevNode, gHaggisPools.cand[i].prevRank, 
+					GetSequenceNodes(gSeqCount));
+		gSeqCount++;
+	}
+	qsort(gHaggisPools.sequenceNodes, gSeqCount, gHaggisPools.seqWidth * sizeof(INT_4),
+			NodeSequenceSortAscend);
+	
 	return;
 }
 
 /******************************SetupBackwardAndForwardNodes***************************
 *
+*	Connects ions whose masses differ by a residue, lower mass to higher mass, in 
+*	gForwardNodeConnect.  The same connections, from the higher mass ion, are put in 
+*	gBackwardNodeConnect.
 */
 
 void	SetupBackwardAndForwardNodes(INT_4 *mass)
@@ -1784,17 +2312,9 @@ void	SetupBackwardAndForwardNodes(INT_4 *mass)
 	INT_4 i, j, k, l, massDiff;
 	
 	
-	/*Initialize variables*/
-	for(i = 0; i < MAX_ION_NUM; i++)
-	{
-		gForwardNum[i] 	= 0;
-		gBackwardNum[i] 	= 0;
-		for(j = 0; j < AMINO_ACID_NUMBER; j++)
-		{
-			gForwardNodeConnect[i][j] 	= 0;
-			gBackwardNodeConnect[i][j] 	= 0;
-		}
-	}
+	/*Initialize variables (plus a spare row, since the forward connections are shifted 
+	down from one past the end)*/
+	GetIonPool(gIonCount + 1);
 	
 	/*	First assume fragment ions are all singly charged.*/
 
@@ -1812,8 +2332,6 @@ void	SetupBackwardAndForwardNodes(INT_4 *mass)
 					if(massDiff <= gMonoMass_x100[k] + gParam.fragmentErr &&
 						massDiff>= gMonoMass_x100[k] - gParam.fragmentErr)
 					{
-						gBackwardNodeConnect[j][gBackwardNum[j]] = -i;
-						gBackwardNum[j]++;
 						gForwardNodeConnect[i][gForwardNum[i]] = j;
 						gForwardNum[i]++;
 						break;
@@ -1875,6 +2393,21 @@ void	SetupBackwardAndForwardNodes(INT_4 *mass)
 			}
 		}
 	}
+	
+	/*The backward connections are the forward ones that are left, seen from the other end 
+	(the zero mass ion is not the start of anything).*/
+	for(i = 1; i < gIonCount; i++)
+	{
+		for(j = 0; j < gForwardNum[i] && j < gAminoAcidNumber; j++)
+		{
+			k = gForwardNodeConnect[i][j];
+			if(k > 0)
+			{
+				gBackwardNodeConnect[k][gBackwardNum[k]] = i;
+				gBackwardNum[k]++;
+			}
+		}
+	}
 
 	return;
 }
@@ -1956,323 +2489,3 @@ INT_4	ResidueMass(INT_4 inputMass)
 	}
 	return(outputMass);
 }
-/*****************************NodeStep*************************************************
-*
-*	NodeStep is a recursive function that takes in a node position, and then moves forward
-*	or backward in the graph, all the while counting the number of edges in the path and
-*	keeping track of the longest path.  It returns either a TRUE or FALSE value.  The default
-*	return is a TRUE value, until all paths have been followed from a given starting node.  If
-*	all paths have been followed, then FALSE is returned to signal the end of the path-finding
-*	from a particular starting node.  Given a node position, the function steps forward one edge if
-*	the edge has not previously been followed, the gEdgeNum is incremented up one and compared to gMaxEdgeNum.
-*	The edge forward is used is made impassable (given a negative value), but the backwards edge is made positive and
-*	passable.  If a node position has no forward edges, then it follows a passable backward edge and the
-*	that edge used to travel backwards is made impassable again.  The edge numbering is decremented and the
-*	function calls itself again.  Eventually, the program gets back to the starting node, and no edges are passable 
-*	from that node, and that is when the function returns a FALSE value to signal that its time to move on to
-*	another starting node.
-*/
-
-BOOLEAN	NodeStep(INT_4 *nodeNum, INT_4 *nodeMass)
-{
-	
-	BOOLEAN wayForward = FALSE;	/*assume that there are no edges towards high mass*/
-	BOOLEAN wayBackward = FALSE;	/*assume that there is no edges leading backwards*/
-	BOOLEAN keepGoing = TRUE;			/*becomes FALSE when no more paths to follow*/
-	BOOLEAN failureTest;
-	INT_4 i, j, newNode, oldNode;
-	
-
-	if(gIonCount > MAX_ION_NUM)	/*array boundary*/
-	{
-		printf("gIonCount > MAX_ION_NUM");
-		exit(1);
-	}
-	if(gAminoAcidNumber > AMINO_ACID_NUMBER)
-	{
-		printf("gAminoAcidNumber > AMINO_ACID_NUMBER");
-		exit(1);
-	}
-	
-	/*8/20/03 to allow for using parts of the tree that were used before, but connected via a different node
-	at the bottom; might need to get rid of this if it causes problems later*/
-	
-	for(i = *nodeNum + 1; i < gIonCount/*MAX_ION_NUM*/; i++)
-	{
-		for(j = 0; j < gForwardNum[*nodeNum]; j++)
-		{
-			if(gForwardNodeConnect[i][j] < 0)
-			{
-				gForwardNodeConnect[i][j] *= -1;
-			}
-		}
-	}
-	
-	
-
-/*	Figure out if I can go up in mass or not*/
-
-	if(gForwardNum[*nodeNum] != 0 && *nodeNum < gIonCount)
-	{
-		for(i = 0; i < gForwardNum[*nodeNum]; i++)
-		{
-			if(gForwardNodeConnect[*nodeNum][i] > 0)
-			{
-				wayForward = TRUE;	/*There is an edge available that leads to higher mass nodes*/
-				break;
-			}
-		}
-	}
-	
-/* 	Now that its known if there is an edge to higher mass, or not, we can proceed.*/
-
-	if(wayForward)
-	{
-		
-		for(i = 0; i < gForwardNum[*nodeNum]; i++)
-		{
-			if(gForwardNodeConnect[*nodeNum][i] > 0 && i < gAminoAcidNumber && *nodeNum < gIonCount)
-			{
-				gEdgeNum++;
-				newNode = gForwardNodeConnect[*nodeNum][i];
-				/*if(gEdgeNum > gMaxEdgeNum)
-				{
-					gMaxEdgeNum = gEdgeNum;
-					SaveLongestSequence(*nodeNum, newNode);
-				}*/
-				gForwardNodeConnect[*nodeNum][i] = -1 * gForwardNodeConnect[*nodeNum][i];
-				failureTest = TRUE;
-				for(j = 0; j < gBackwardNum[newNode]; j++)
-				{
-					if(*nodeNum == -1 * gBackwardNodeConnect[newNode][j])
-					{
-						gBackwardNodeConnect[newNode][j] = -1 * gBackwardNodeConnect[newNode][j];
-						failureTest = FALSE;
-						break;
-					}
-				}
-				if(failureTest)
-				{
-					printf("Problem in function NodeStep");
-					exit(1);
-				}
-				break;
-			}
-		}
-		oldNode = *nodeNum;	/*debug*/
-		*nodeNum = newNode;
-		keepGoing = NodeStep(nodeNum, nodeMass);
-		if(!keepGoing)
-		{
-			return(FALSE);
-		}
-	
-	}
-	else	/*need to back-track, if possible*/
-	{
-	
-/*	Store the sequences that cannot be extended (in a global array)*/
-		if(gSeqCount >= MAX_SEQUENCES)
-		{
-			gNotTooManySequences = FALSE;
-			printf("Haggis had to quit early, because there were too many sequences found.\n");
-			return(FALSE);	/*too many sequences, so stop now*/
-		}
-		else
-		{
-			StoreSeq(*nodeNum, nodeMass);	/*there is room for more sequences*/
-		}
-		
-/*	Figure out if I can go down in mass or not*/
-
-		if(gBackwardNum[*nodeNum] != 0)
-		{
-			for(i = 0; i <gBackwardNum[*nodeNum]; i++)
-			{
-				if(gBackwardNodeConnect[*nodeNum][i] > 0)
-				{
-					wayBackward = TRUE;	/*There is an edge available that leads to lower mass nodes*/
-					break;
-				}
-			}
-		}
-		
-		keepGoing = FALSE;	/*will keep going if there is an edge that leads backwards*/
-		if(wayBackward)
-		{
-			for(i = 0; gBackwardNum[*nodeNum]; i++)
-			{
-				if(gBackwardNodeConnect[*nodeNum][i] > 0 && *nodeNum < gIonCount/*MAX_ION_NUM*/ && i < gAminoAcidNumber)
-				{
-					keepGoing = TRUE;
-					gEdgeNum--;
-					newNode = gBackwardNodeConnect[*nodeNum][i];
-					gBackwardNodeConnect[*nodeNum][i] = -1 * gBackwardNodeConnect[*nodeNum][i];
-					*nodeNum = newNode;
-					break;
-				}
-			}
-			keepGoing = NodeStep(nodeNum, nodeMass);
-		}
-		if(!keepGoing)
-		{
-			return(FALSE);
-		}
-		
-	
-	}
-	return(keepGoing);
-}
-
-
-/**********************************StoreSeq************************************************************************
-*
-*	
-*/
-void	StoreSeq(INT_4 nodeNum, INT_4 *nodeMass)
-{
-	INT_4	i, j, k, index, gapNum, minEdgeNum;
-	REAL_4 highMass, lowMass, testMass;
-	BOOLEAN foundBottomNode = FALSE;
-	BOOLEAN keepTheSeq = TRUE;
-	BOOLEAN testForGap;
-	
-	/*Quit before running out of space*/
-	if(gSeqCount >= MAX_SEQUENCES)
-	{
-		printf("Way too many sequences.");
-		exit(1);
-	}
-	
-	if(gEdgeNum >= MAX_ION_NUM)	/*check array boundaries*/
-	{
-		printf("Problem in StoreSeq");
-		exit(1);
-	}
-	
-	testMass = gParam.peptideMW / gMultiplier;	/*peptide mass*/
-	testMass = testMass / AV_RESIDUE_MASS;	/*guess at the number of residues*/
-	if(gLutefiskSequenceCount > 10000)
-	{
-		minEdgeNum = testMass / 2 + 0.5;
-	}
-	else if(gLutefiskSequenceCount > 1000)
-	{
-		minEdgeNum = testMass / 3 + 0.5;	/*need a series that covers a third of the sequence*/
-	}
-	else
-	{
-		minEdgeNum = testMass / 4 + 0.5;
-	}
-	if(minEdgeNum < 4)
-		minEdgeNum = 4;	/*bottom limit*/
-
-	if(gEdgeNum < minEdgeNum)	/*Anything with fewer than 4 edges is a useless sequence*/
-	{
-		return;
-	}
-
-/*	Initialize the gSequenceNodes*/
-	for(i = 0; i < MAX_ION_NUM; i++)
-	{
-		gSequenceNodes[gSeqCount][i] = 0;
-	}
-
-/*	Fill in the sequence*/
-	gSequenceNodes[gSeqCount][gEdgeNum] = nodeNum;
-	i = gEdgeNum;
-	gapNum = 0;
-
-	while(!foundBottomNode && i > 0)
-	{
-		foundBottomNode = TRUE;
-		index = gSequenceNodes[gSeqCount][i];
-		for(j = 0; j < gBackwardNum[index]; j++)
-		{
-			if(gBackwardNodeConnect[index][j] > 0)
-			{
-				foundBottomNode = FALSE;
-				highMass = nodeMass[gSequenceNodes[gSeqCount][i]];
-				i--;
-				gSequenceNodes[gSeqCount][i] = gBackwardNodeConnect[index][j];
-				lowMass = nodeMass[gSequenceNodes[gSeqCount][i]];
-				testMass = highMass - lowMass;
-				testForGap = TRUE;	/*start by assuming its a gap*/
-				for(k = 0; k < gAminoAcidNumber; k++)
-				{
-					if(testMass < gMonoMass_x100[k] + gParam.fragmentErr &&
-						testMass > gMonoMass_x100[k] - gParam.fragmentErr)
-					{
-						testForGap = FALSE;	/*its not a gap*/
-						break;
-					}
-				}
-				if(testForGap)
-				{
-					gapNum++;
-				}
-				break;
-			}
-		}
-	}
-
-/*	Test for too many gaps*/
-	if(gapNum > gParam.maxGapNum)
-	{
-		keepTheSeq = FALSE;
-	}
-	else
-	{
-		keepTheSeq = TRUE;
-	}
-
-/*	Test to see if its a subset of a previous sequence*/
-	if(keepTheSeq)
-	{
-		for(i = 0; i < gSeqCount; i++)
-		{
-			j = 0;
-			while(gSequenceNodes[i][j] != 0 || j == 0)
-			{
-				if(gSequenceNodes[gSeqCount][0] == gSequenceNodes[i][j])
-				{
-					k = 0;
-					while(gSequenceNodes[gSeqCount][k] != 0)
-					{
-						if(gSequenceNodes[gSeqCount][k] != gSequenceNodes[i][j+k])
-						{
-							break;	/*break out if they are not the same, then check below to see if it 
-									reached the end*/
-						}
-						k++;
-					}
-					if(gSequenceNodes[gSeqCount][k] == 0)	/*if the end was reached, then its a subset*/
-					{
-						keepTheSeq = FALSE;
-						break;
-					}
-				}
-				j++;
-			}
-			if(!keepTheSeq)
-			{
-				break;
-			}
-		}
-	}
-	
-	if(keepTheSeq)	/*if the sequence is kept, then the sequence counter is incremented up one*/
-	{
-		gSeqCount++;
-	}
-	else
-	{
-		i = 0;
-		while(gSequenceNodes[gSeqCount][i] != 0)
-		{
-			gSequenceNodes[gSeqCount][i] = 0;	/*reinitialize to zero*/
-			i++;
-		}
-	}
-	return;
-}
\ No newline at end of file
@@ -0,0 +1,289 @@
+/*********************************************************************************************
+Lutefisk is software for de novo sequencing of peptides from tandem mass spectra.
+Copyright (C) 1995  Richard S. Johnson
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+Contact:
+
+Richard S Johnson
+4650 Forest Ave SE
+Mercer Island, WA 98040
+
+jsrichar@alum.mit.edu
+*********************************************************************************************/
+
+
+/*
+	MGF (Mascot generic format) files.  An MGF file holds any number of spectra, each one
+	between a BEGIN IONS line and an END IONS line, with PEPMASS=, CHARGE=, TITLE=, etc. lines 
+	ahead of the peak list.  The file is mapped into memory and NextMGFSpectrum hands back one
+	block at a time, so only the pages for the spectrum being looked at need to be in memory.
+	The block is given to ReadCIDFile via the search context (CID file type 'M'), so nothing is
+	copied out to temporary files.
+*/
+
+/* ANSI headers */
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(__MWERKS__)
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <sys/types.h>
+#endif
+
+/* Lutefisk headers */
+#include "LutefiskPrototypes.h"
+#include "LutefiskDefinitions.h"
+
+static long NextMGFLine(tMGFFile *mgfPtr, long position);
+static BOOLEAN MGFLineStartsWith(tMGFFile *mgfPtr, long position, char *keyword);
+
+
+/******************************IsMGFFileName**********************************************
+*
+*	Returns TRUE if the file name ends in .mgf or .MGF.
+*/
+BOOLEAN IsMGFFileName(char *fileName)
+{
+	INT_4 length;
+
+	length = strlen(fileName);
+	if (length > 4 && (!strcmp(fileName + length - 4, ".mgf") || !strcmp(fileName + length - 4, ".MGF")))
+	{
+		return(TRUE);
+	}
+
+	return(FALSE);
+}
+
+/******************************OpenMGFFile************************************************
+*
+*	Maps the MGF file fileName into memory.  Quits if it can't be opened.
+*/
+tMGFFile *OpenMGFFile(char *fileName)
+{
+	tMGFFile *mgfPtr;
+#if !defined(__MWERKS__)
+	INT_4 fd;
+	struct stat fileInfo;
+#else
+	FILE *fp;
+#endif
+
+	mgfPtr = (tMGFFile *) calloc(1, sizeof(tMGFFile));
+	if (mgfPtr == NULL)
+	{
+		printf("OpenMGFFile:  Out of memory");
+		exit(1);
+	}
+
+#if !defined(__MWERKS__)
+	fd = open(fileName, O_RDONLY);
+	if (fd < 0 || fstat(fd, &fileInfo) != 0)
+	{
+		printf("Cannot open the CID file '%s'.\n", fileName);
+		exit(1);
+	}
+	mgfPtr->size = fileInfo.st_size;
+	if (mgfPtr->size > 0)
+	{
+		mgfPtr->data = (char *) mmap(NULL, mgfPtr->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mgfPtr->data == (char *) MAP_FAILED)
+		{
+			printf("Cannot map the CID file '%s' into memory.\n", fileName);
+			exit(1);
+		}
+		madvise(mgfPtr->data, mgfPtr->size, MADV_SEQUENTIAL);
+		mgfPtr->mapped = TRUE;
+	}
+	close(fd);	/*the mapping stays put*/
+#else
+	fp = fopen(fileName, "rb");
+	if (fp == NULL)
+	{
+		printf("Cannot open the CID file '%s'.\n", fileName);
+		exit(1);
+	}
+	fseek(fp, 0, SEEK_END);
+	mgfPtr->size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	mgfPtr->data = (char *) malloc(mgfPtr->size + 1);
+	if (mgfPtr->data == NULL)
+	{
+		printf("OpenMGFFile:  Out of memory");
+		exit(1);
+	}
+	mgfPtr->size = fread(mgfPtr->data, 1, mgfPtr->size, fp);
+	fclose(fp);
+#endif
+
+	return(mgfPtr);
+}
+
+/******************************NextMGFSpectrum********************************************
+*
+*	Finds the next BEGIN IONS ... END IONS block in the file.  On return *blockPtr points to 
+*	the line after BEGIN IONS and *blockLength is the number of characters up to the END IONS
+*	line.  The block is not null terminated.  Returns FALSE when there are no more spectra.
+*/
+BOOLEAN NextMGFSpectrum(tMGFFile *mgfPtr, char **blockPtr, INT_4 *blockLength)
+{
+	long position, start;
+
+	position = mgfPtr->position;
+	while (position < mgfPtr->size && !MGFLineStartsWith(mgfPtr, position, "BEGIN IONS"))
+	{
+		position = NextMGFLine(mgfPtr, position);
+	}
+	if (position >= mgfPtr->size)
+	{
+		mgfPtr->position = mgfPtr->size;
+		return(FALSE);
+	}
+
+	start = NextMGFLine(mgfPtr, position);
+	position = start;
+	while (position < mgfPtr->size && !MGFLineStartsWith(mgfPtr, position, "END IONS"))
+	{
+		if (MGFLineStartsWith(mgfPtr, position, "BEGIN IONS"))
+		{
+			break;	/*the END IONS line is missing; let the next block start here*/
+		}
+		position = NextMGFLine(mgfPtr, position);
+	}
+
+	mgfPtr->spectrumNum++;
+	*blockPtr = mgfPtr->data + start;
+	*blockLength = position - start;
+
+	if (position < mgfPtr->size && MGFLineStartsWith(mgfPtr, position, "END IONS"))
+	{
+		position = NextMGFLine(mgfPtr, position);
+	}
+	else
+	{
+		printf("Spectrum %d of the MGF file has no END IONS line.\n", mgfPtr->spectrumNum);
+	}
+	mgfPtr->position = position;
+
+	return(TRUE);
+}
+
+/******************************CloseMGFFile***********************************************
+*
+*	Unmaps the file.  Any blocks returned by NextMGFSpectrum go away with it.
+*/
+void CloseMGFFile(tMGFFile *mgfPtr)
+{
+	if (mgfPtr == NULL)
+	{
+		return;
+	}
+#if !defined(__MWERKS__)
+	if (mgfPtr->mapped)
+	{
+		munmap(mgfPtr->data, mgfPtr->size);
+	}
+#else
+	free(mgfPtr->data);
+#endif
+	free(mgfPtr);
+	return;
+}
+
+/******************************RunMGFFile*************************************************
+*
+*	Sequences each spectrum in the MGF file fileName in turn.  Each one gets its own search
+*	context (a copy of configPtr) and its own output file.  A spectrum with no usable data is
+*	reported and skipped, rather than ending the run.
+*/
+void RunMGFFile(tSearchContext *configPtr, char *fileName)
+{
+	tMGFFile *mgfPtr;
+	tSearchContext *searchPtr;
+	char *block;
+	INT_4 blockLength;
+
+	mgfPtr = OpenMGFFile(fileName);
+
+	while (NextMGFSpectrum(mgfPtr, &block, &blockLength))
+	{
+		searchPtr = NewSearchContext(configPtr);
+		strncpy(searchPtr->param.cidFilename, fileName, sizeof(searchPtr->param.cidFilename) - 1);
+		searchPtr->param.CIDfileType = 'M';
+		searchPtr->param.centroidOrProfile = 'C';	/*MGF files are peak lists*/
+		searchPtr->cidBlock = block;
+		searchPtr->cidBlockLength = blockLength;
+		searchPtr->cidBlockNum = mgfPtr->spectrumNum;
+
+		if (!Run(searchPtr))
+		{
+			printf("No data could be read from spectrum %d of %s.\n", mgfPtr->spectrumNum, fileName);
+		}
+		FreeSearchContext(searchPtr);
+	}
+
+	if (mgfPtr->spectrumNum == 0)
+	{
+		printf("There are no BEGIN IONS blocks in %s.\n", fileName);
+	}
+	CloseMGFFile(mgfPtr);
+
+	return;
+}
+
+/******************************NextMGFLine************************************************
+*
+*	Returns the position of the start of the line after the one at position.
+*/
+static long NextMGFLine(tMGFFile *mgfPtr, long position)
+{
+	char *found;
+
+	found = (char *) memchr(mgfPtr->data + position, '\n', mgfPtr->size - position);
+	if (found == NULL)
+	{
+		return(mgfPtr->size);
+	}
+
+	return(found - mgfPtr->data + 1);
+}
+
+/******************************MGFLineStartsWith******************************************
+*
+*	Returns TRUE if the line at position starts with keyword (ignoring leading white space).
+*/
+static BOOLEAN MGFLineStartsWith(tMGFFile *mgfPtr, long position, char *keyword)
+{
+	long length;
+
+	length = strlen(keyword);
+	while (position < mgfPtr->size && (mgfPtr->data[position] == ' ' || mgfPtr->data[position] == '\t'))
+	{
+		position++;
+	}
+	if (mgfPtr->size - position < length)
+	{
+		return(FALSE);
+	}
+
+	return(!strncmp(mgfPtr->data + position, keyword, length));
+}
@@ -53,6 +53,11 @@ jsrichar@alum.mit.edu
 #include <time.h>
 #include <unistd.h>
 
+#if !defined(__MWERKS__)
+    #include <sys/types.h>
+    #include <sys/wait.h>
+#endif
+
 #if(defined(__MWERKS__) && __dest_os == __mac_os)
 /* Some Macintosh specific things */
     #include "getopt.h"
@@ -76,6 +81,7 @@ char prompt[256];
 /* Lutefisk headers */
 #include "LutefiskPrototypes.h"
 #include "LutefiskDefinitions.h"
+#include "ListRoutines.h"
 
 
 char versionString[256] = "LutefiskXP v1.0.7\nCopyright 1996-1906 Richard S. Johnson\n\n";       
@@ -132,6 +138,9 @@ int main(int argc, char **argv)
     INT_4 i;
     const   time_t          theTime = (const time_t)time(NULL);
     extern INT_4 optind;
+    tSearchContext *configPtr, *searchPtr;
+    char **fileList = NULL;
+    INT_4 fileNum;
 
 #if(defined(__MWERKS__) && __dest_os == __mac_os)
     argc = ccommand(&argv);  
@@ -139,6 +148,13 @@ int main(int argc, char **argv)
 
 /*    gParam.startTicks = clock();*/
 
+/*
+*       The params, residues, etc. are read into configPtr, which each search then starts out
+*       with a copy of.
+*/
+    configPtr = NewSearchContext(NULL);
+    BindSearchContext(configPtr);
+
     if (!SystemCheck()) exit(1);
 
     BuildPgmState(argc, argv);      /*Read in any line commands*/
@@ -190,80 +206,97 @@ int main(int argc, char **argv)
     }
 
 
-    /* Total hack because we mess with these values later on. */
-    gParam.peptideMW_orig   = gParam.peptideMW;
-    gParam.peptideErr_orig  = gParam.peptideErr;
-    gParam.fragmentErr_orig = gParam.fragmentErr;
-    gParam.peakWidth_orig   = gParam.peakWidth;
-    gParam.monoToAv_orig    = gParam.monoToAv;
-    gParam.qtofErr_orig     = gParam.qtofErr;
-    gParam.ionOffset_orig   = gParam.ionOffset;
-    gParam.cysMW_orig       = gParam.cysMW;
-    gParam.tagNMass_orig    = gParam.tagNMass;
-    gParam.tagCMass_orig    = gParam.tagCMass; 
-    gParam.maxGapNum_orig   = gParam.maxGapNum; 
-    gParam.modifiedNTerm_orig = gParam.modifiedNTerm;
-    gParam.modifiedCTerm_orig = gParam.modifiedCTerm;
-    gParam.topSeqNum_orig	= gParam.topSeqNum;
-    strcpy(gParam.outputFile_orig, gParam.outputFile);
-
 //	optind = 0;	/*debug*/
 //	argc = 3;	/*debug*/
-    if (optind < argc)
+    if (gParam.fServer)
+    {
+        /* Sequence CID files as they are asked for, w/o reading everything in again each time */
+        RunServer(configPtr);
+    }
+    else if (gParam.fBatch)
     {
+        /* Sequence the files on the command line plus those in the batch file on several threads */
+        fileNum = 0;
         for (i = optind; i < argc; i++)
         {
-            strcpy(gParam.cidFilename, argv[i]);
-            Run();
+            fileList = AddBatchFile(fileList, &fileNum, argv[i]);
+        }
+        if (strlen(gParam.batchFile) > 0)
+        {
+            fileList = ReadBatchList(gParam.batchFile, fileList, &fileNum);
         }
+        RunBatch(configPtr, fileList, fileNum);
+        for (i = 0; i < fileNum; i++)
+        {
+            free(fileList[i]);
+        }
+        free(fileList);
+    }
+    else if (optind < argc)
+    {
+        for (i = optind; i < argc; i++)
+        {
+            if (MultiSpectrumFileType(argv[i], gParam.CIDfileType) == 'M')
+            {
+                RunMGFFile(configPtr, argv[i]);     /*one search per spectrum in the file*/
+                continue;
+            }
+            if (MultiSpectrumFileType(argv[i], gParam.CIDfileType) == 'Z')
+            {
+                RunMzMLFile(configPtr, argv[i]);    /*one search per MS2 scan*/
+                continue;
+            }
+            searchPtr = NewSearchContext(configPtr);
+            strcpy(searchPtr->param.cidFilename, argv[i]);
+            if (!Run(searchPtr)) exit(0);
+            FreeSearchContext(searchPtr);
+        }
+    }
+    else if (strlen(gParam.cidFilename) > 0 && gParam.CIDfileType == 'M')
+    {
+        RunMGFFile(configPtr, gParam.cidFilename);
+    }
+    else if (strlen(gParam.cidFilename) > 0 && gParam.CIDfileType == 'Z')
+    {
+        RunMzMLFile(configPtr, gParam.cidFilename);
     }
     else if (strlen(gParam.cidFilename) > 0)
     {
         /* A filename was specified in the Lutefisk.params file */
        
-        Run();
+        searchPtr = NewSearchContext(configPtr);
+        if (!Run(searchPtr)) exit(0);
+        FreeSearchContext(searchPtr);
         
     }
 
-    sleep(1);   /* Why sleep before quitting? Well, on our 500 MHz alpha some results 
-                   were being lost when calling the program from a child process via a pipe; 
-                   seemingly because the pipe was being terminated before all the data had
-                   gotten through. */
+    fflush(stdout); /* On our 500 MHz alpha some results were being lost when calling the 
+                       program from a child process via a pipe, seemingly because the pipe was
+                       being terminated before all the data had gotten through.  That used to be
+                       handled by sleeping for a second here; flushing does the job w/o the wait. */
     return(0);        /* All done */
 
 }
 /*************************************************************************************************/
-void Run()
+BOOLEAN Run(tSearchContext *searchPtr)
 {
     REAL_4 actualPeptideMW, actualTopSeqNum, actualFinalSeqNum; 
-    INT_4 i, massChange, posNeg;
-    SCHAR *sequenceNode = NULL;
-    SCHAR *sequenceNodeC = NULL;
-    SCHAR *sequenceNodeN = NULL;
-    INT_4 oneEdgeNodesIndex, *oneEdgeNodes = NULL;
+    INT_4 i;
+    tNodeStore *sequenceNode = NULL;
+    tNodeStore *sequenceNodeC = NULL;
+    tNodeStore *sequenceNodeN = NULL;
 
     struct MSData *firstMassPtr = NULL, *firstRawDataPtr = NULL;
-    struct Sequence *firstSequencePtr = NULL;
     const   time_t          theTime = (const time_t)time(NULL);
+    tSearchContext *previousPtr;
 
-	gParam.startTicks = clock();
-    /* Total hack because we mess with these values later on. */
-    gParam.peptideMW   = gParam.peptideMW_orig;
-    gParam.peptideErr  = gParam.peptideErr_orig;
-    gParam.fragmentErr = gParam.fragmentErr_orig;
-    gParam.peakWidth   = gParam.peakWidth_orig;
-    gParam.monoToAv    = gParam.monoToAv_orig;
-    gParam.qtofErr     = gParam.qtofErr_orig;
-    gParam.ionOffset   = gParam.ionOffset_orig;
-    gParam.cysMW       = gParam.cysMW_orig;
-    gParam.tagNMass    = gParam.tagNMass_orig;
-    gParam.tagCMass    = gParam.tagCMass_orig; 
-    gParam.maxGapNum   = gParam.maxGapNum_orig; 
-    gParam.modifiedNTerm = gParam.modifiedNTerm_orig;
-    gParam.modifiedCTerm = gParam.modifiedCTerm_orig;
-    gParam.topSeqNum	= gParam.topSeqNum_orig;
-    strcpy(gParam.outputFile, gParam.outputFile_orig);
+/*
+*       Everything from here on works on searchPtr, which starts out as a copy of the params
+*       and residues that were read in by main (see NewSearchContext).
+*/
+    previousPtr = BindSearchContext(searchPtr);
 
+	gParam.startTicks = SearchTicks();
     gFirstTimeThru = TRUE;
 /*
 *       GetCidData opens an ASCII file containing lists of m/z values and intensities for the 
@@ -281,8 +314,10 @@ void Run()
     firstMassPtr = GetCidData();
     if (NULL == firstMassPtr)
     {
+        ChangeOutputName();
         PrintPartingGiftToFile();
-        exit(0);
+        BindSearchContext(previousPtr);
+        return(FALSE);  /*main quits; batch mode goes on to the next one*/
     }    
 
 /*
@@ -310,33 +345,12 @@ void Run()
     SetupSequenceTag();
 
 
-/*      Assign space to the various arrays.*/
+/*      Assign space to the various node stores.  Space for the node values is only taken
+        for the stretches of mass where there are nodes.*/
 
-    sequenceNode = (SCHAR *) malloc(gGraphLength * sizeof(SCHAR ));    /*Will contain summary of evidence.*/
-    if (sequenceNode == NULL)
-    {
-        printf("main:  Out of memory");
-        exit(1);
-    }
-    sequenceNodeC = (SCHAR *) malloc(gGraphLength * sizeof(char ));   /*Will contain C-terminal evidence.*/
-    if (sequenceNodeC == NULL)
-    {
-        printf("main:  Out of memory");
-        exit(1);
-    }
-    sequenceNodeN = (SCHAR *) malloc(gGraphLength * sizeof(char ));   /*Will contain N-terminal evidence.*/
-    if (sequenceNodeN == NULL)
-    {
-        printf("main:  Out of memory");
-        exit(1);
-    }
-    oneEdgeNodes = (int *) malloc(gGraphLength * sizeof(INT_4 ));   /*Will contain evidence that only
-                                                                      connects w/ the C-terminus.*/
-    if (oneEdgeNodes == NULL)
-    {
-        printf("main:  Out of memory");
-        exit(1);
-    }
+    sequenceNode = CreateNodeStore(sizeof(SCHAR));     /*Will contain summary of evidence.*/
+    sequenceNodeC = CreateNodeStore(sizeof(SCHAR));    /*Will contain C-terminal evidence.*/
+    sequenceNodeN = CreateNodeStore(sizeof(SCHAR));    /*Will contain N-terminal evidence.*/
 
 
 /*      If the gParam.maxGapNum is equal to -1, then assign a value based on gParam.peptideMW.*/
@@ -409,41 +423,88 @@ void Run()
     actualPeptideMW = gParam.peptideMW;     /*save the real peptide mass*/
     actualTopSeqNum = gParam.topSeqNum;     /*save the real max subsequence number*/
     actualFinalSeqNum = gParam.finalSeqNum; /*save the real max final candidate sequence number*/
-    posNeg = 1; /*goes back and forth between +1 and -1, see below*/
 
     /*Here's the loop where i is negative and works towards zero, which represents the correct
       mass.  If i is -10 then -9, massChange becomes -5 and -5.  However, each time thru the 
-      loop posNeg goes back and forth from +1 to -1, so in the end massChange is -5 then +5.  
+      loop the sign goes back and forth from +1 to -1, so in the end massChange is -5 then +5.  
       These are the numbers that get multiplied by a methylene mass and then added to the correct
-      peptide mass.*/
+      peptide mass.  See SequenceOneMass.
+      
+      Until some pass has found and scored sequences, ScoreSequences is still doing its first
+      time thru set up (gFirstTimeThru), and that alters the CID data for the passes that follow.
+      After that the wrong mass passes are independent of each other, and the rest of them are 
+      handed to ScrambleMassesInParallel.  The correct mass (i = 0) is always done here.*/
     for (i = -1 * gParam.wrongSeqNum; i <= 0; i++)
     {
-        if (i != 0)
-        {
-            massChange = (REAL_4)i / 2 - 0.5;   /*since i is neg I need to subtract 0.5 to round
-                                                    down*/
-            massChange = massChange * posNeg;   /*go pos and neg*/
-            posNeg = posNeg * -1;   /*go back and forth -1 +1 -1 +1 on and on*/
-            gCorrectMass = FALSE;
-            /*for wrong masses use a smaller seqNum to speed the processing*/
-            gParam.topSeqNum = 1000;
-            gParam.finalSeqNum = 5000;
-        }
-        else
+        if (i < 0 && !gFirstTimeThru)
         {
-            massChange = 0; /*no mass change when i = 0, cuz thats the loop for the correct MW*/
-            gCorrectMass = TRUE;    /*loop is for correct mass*/
-            gParam.topSeqNum = actualTopSeqNum; /*use correct subseq num for correct mass*/
-            gParam.finalSeqNum = actualFinalSeqNum;/*use correct final sequence num */
+            ScrambleMassesInParallel(i, firstMassPtr, sequenceNode, sequenceNodeC, sequenceNodeN,
+                                     actualPeptideMW, actualTopSeqNum, actualFinalSeqNum);
+            i = 0;
         }
+        SequenceOneMass(i, firstMassPtr, sequenceNode, sequenceNodeC, sequenceNodeN,
+                        actualPeptideMW, actualTopSeqNum, actualFinalSeqNum);
+    }   /*end of gParam.peptideMW looping*/
+
+    /*trash these things*/
+    DisposeNodeStore(sequenceNodeC);    
+    DisposeNodeStore(sequenceNodeN);
+    DisposeNodeStore(sequenceNode);
+
+/*      Free up the linked lists.*/
+/* JAT - Why not free if win32? */
+#if (__dest_os != __win32_os)
+
+    /*List of completed sequences from subsequencing routine*/
+    FreeMassList(firstMassPtr);             /*List of ions and intensities*/
+#endif
+
+    fflush(stdout);
+    BindSearchContext(previousPtr);
+    return(TRUE);
+}
 
-        /*gParam.peptideMW gets changed for the remainder of the loop*/
-        gParam.peptideMW = actualPeptideMW + massChange * 
-                           (/*2 * gElementMass_x100[HYDROGEN]*/ + gElementMass_x100[CARBON]);
-							/*differences of a methylene is debatable; I think it might be bad idea now*/
+/*************************************************************************************************/
+/*
+*   SequenceOneMass does one pass of the mass scramble loop in Run.  The value of i is the loop
+*   index; if i is zero then the correct peptide mass is used, otherwise a wrong mass is made by
+*   adding or subtracting i/2 methylenes.  The sign alternates with each pass, starting with a
+*   positive one for i = -gParam.wrongSeqNum (which is always even).
+*/
+void SequenceOneMass(INT_4 i, struct MSData *firstMassPtr, tNodeStore *sequenceNode, 
+                     tNodeStore *sequenceNodeC, tNodeStore *sequenceNodeN,
+                     REAL_4 actualPeptideMW, REAL_4 actualTopSeqNum, REAL_4 actualFinalSeqNum)
+{
+    INT_4 massChange, posNeg;
+    struct Sequence *firstSequencePtr = NULL;
+    tNodeList *nodeList, *oneEdgeNodes;
+
+    if (i != 0)
+    {
+        posNeg = (i % 2 == 0) ? 1 : -1;     /*go back and forth +1 -1 +1 -1 on and on*/
+        massChange = (REAL_4)i / 2 - 0.5;   /*since i is neg I need to subtract 0.5 to round
+                                                down*/
+        massChange = massChange * posNeg;   /*go pos and neg*/
+        gCorrectMass = FALSE;
+        /*for wrong masses use a smaller seqNum to speed the processing*/
+        gParam.topSeqNum = 1000;
+        gParam.finalSeqNum = 5000;
+    }
+    else
+    {
+        massChange = 0; /*no mass change when i = 0, cuz thats the loop for the correct MW*/
+        gCorrectMass = TRUE;    /*loop is for correct mass*/
+        gParam.topSeqNum = actualTopSeqNum; /*use correct subseq num for correct mass*/
+        gParam.finalSeqNum = actualFinalSeqNum;/*use correct final sequence num */
+    }
 
-        MakeSequenceGraph(firstMassPtr, sequenceNode, sequenceNodeC, sequenceNodeN, 
-                          gIonTypeWeightingTotal);
+    /*gParam.peptideMW gets changed for the remainder of the loop*/
+    gParam.peptideMW = actualPeptideMW + massChange * 
+                       (/*2 * gElementMass_x100[HYDROGEN]*/ + gElementMass_x100[CARBON]);
+						/*differences of a methylene is debatable; I think it might be bad idea now*/
+
+    nodeList = MakeSequenceGraph(firstMassPtr, sequenceNode, sequenceNodeC, sequenceNodeN, 
+                                 gIonTypeWeightingTotal);
 
 /*
 *       SummedNodeScore connects the nodes starting from the C-terminal node(s) that differ by the
@@ -451,11 +512,10 @@ void Run()
 *       mass error is sufficiently large, all of which are used independently of each other.  Those
 *       nodes that can be connected to the C-terminus are given a bonus score to differentiate them
 *       from those nodes that do not.   This is also
-*       where the C-terminal one-edge nodes are found and stored in the array oneEdgeNodes, and
-*       has a maximum of oneEdgeNodesIndex (ie, if oneEdgeNodesIndex is 26, then oneEdgeNodes has values
-*       for [0 to 25]).  The altered node values are held in the array sequenceNode.  The arrays
-*       sequenceNodeN and sequenceNodeC were obtained from the function MakeSequenceGraph and are used
-*       as the input information for SummedNodeScore.  At one time, this function summed the node
+*       where the C-terminal one-edge nodes are found and returned in the list oneEdgeNodes.  The 
+*       altered node values are held in sequenceNode.  sequenceNodeN and sequenceNodeC were obtained 
+*       from the function MakeSequenceGraph, along with nodeList (the nodes that have any evidence),
+*       and are used as the input information for SummedNodeScore.  At one time, this function summed the node
 *       scores that lead up to it, but I found that this tended to overly dominate the subsequencing
 *       scores in a bad way.  What worked best is to add a bonus score to any node that connects to the
 *       C-terminus.  However, the name of the function remains - SummedNodeScore - even though it
@@ -468,8 +528,8 @@ void Run()
 *       SummedNodeScore uses gElementMass_x100 and gMonoMass_x100.
 */
 
-        SummedNodeScore(sequenceNode, sequenceNodeC, sequenceNodeN, oneEdgeNodes,
-                        &oneEdgeNodesIndex, gIonTypeWeightingTotal);
+    oneEdgeNodes = SummedNodeScore(sequenceNode, sequenceNodeC, sequenceNodeN, nodeList,
+                                   gIonTypeWeightingTotal);
 
 
 /*
@@ -485,11 +545,11 @@ void Run()
 *       GetAutoTag uses gElementMass_x100 and gMonoMass_x100.
 */
 
-        if ((gParam.fragmentPattern == 'L' || gParam.fragmentPattern == 'T' || gParam.fragmentPattern == 'Q')
-            && gParam.chargeState > 1 && gParam.autoTag)
-        {
-            GetAutoTag(firstMassPtr, sequenceNode);
-        }
+    if ((gParam.fragmentPattern == 'L' || gParam.fragmentPattern == 'T' || gParam.fragmentPattern == 'Q')
+        && gParam.chargeState > 1 && gParam.autoTag)
+    {
+        GetAutoTag(firstMassPtr, sequenceNode, nodeList);
+    }
 
 
 /*      
@@ -507,8 +567,11 @@ void Run()
 *       SubsequenceMaker uses gElementMass_x100 and gMonoMass_x100.
 */
 
-        firstSequencePtr = SubsequenceMaker(oneEdgeNodes, oneEdgeNodesIndex, sequenceNode);
-        
+    firstSequencePtr = SubsequenceMaker(oneEdgeNodes->node, oneEdgeNodes->numObjects, 
+                                        sequenceNode, nodeList);
+    DisposeList(oneEdgeNodes);
+    DisposeList(nodeList);
+    
 /*
 *		Next add subsequences that do not necessarily connect to either termini (process called Haggis).  
 *		Mass scrambles for statistics has to be turned off, since changes in peptide MW will not alter the 
@@ -538,43 +601,173 @@ void Run()
 */
 
 
-        if (firstSequencePtr != NULL)
+    if (firstSequencePtr != NULL)
+    {
+        firstSequencePtr = ScoreSequences(firstSequencePtr, firstMassPtr);
+        gFirstTimeThru = FALSE; /*forever false after first time thru loop*/
+        SetupGapList(); /*The gGapList can get changed in the scoring, so its returned to the 
+                        original values*/
+        FreeSequence(firstSequencePtr); /*Get rid of the sequences, cuz you'll be getting
+                                        a new set soon*/
+    }
+    else if (gCorrectMass)
+    {
+        PrintPartingGiftToFile();
+    }
+    else
+    {
+        gWrongIndex++; /*No sequences to score, so the best score is zero, which is what
+                 the gScore arrays were normalized to*/
+    }
+
+    ResetSequenceArena();   /*Every Sequence struct from this pass is gone by now*/
+
+    return;
+}
+
+/*************************************************************************************************/
+/*
+*   ScrambleMassesInParallel does the wrong mass passes from firstI up to -1 using up to 
+*   gParam.workerNum child processes (zero means one per processor).  Each child does a single
+*   pass via SequenceOneMass and pipes back what it would have added to the gWrong arrays.
+*   The results are then stored in loop order, so that the statistics come out exactly as if 
+*   the passes had been done one after the other.  Processes are used rather than threads since
+*   the sequencing routines keep their working state in globals.
+*/
+void ScrambleMassesInParallel(INT_4 firstI, struct MSData *firstMassPtr, tNodeStore *sequenceNode, 
+                              tNodeStore *sequenceNodeC, tNodeStore *sequenceNodeN,
+                              REAL_4 actualPeptideMW, REAL_4 actualTopSeqNum, REAL_4 actualFinalSeqNum)
+{
+#if defined(__MWERKS__)
+    INT_4 i;
+
+    for (i = firstI; i < 0; i++)
+    {
+        SequenceOneMass(i, firstMassPtr, sequenceNode, sequenceNodeC, sequenceNodeN,
+                        actualPeptideMW, actualTopSeqNum, actualFinalSeqNum);
+    }
+#else
+    INT_4 i, j, passNum, workerNum, runningNum, nextPass, startIndex, status;
+    INT_4 pipeFD[2], resultFD[WRONG_SEQ_NUM + 1];
+    pid_t pid, workerPID[WRONG_SEQ_NUM + 1];
+    tScrambleResult result[WRONG_SEQ_NUM + 1];
+
+    passNum = -1 * firstI;
+    workerNum = gParam.workerNum;
+    if (workerNum == 0)
+    {
+        workerNum = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (workerNum > passNum)
+    {
+        workerNum = passNum;
+    }
+    if (workerNum <= 1)
+    {
+        for (i = firstI; i < 0; i++)
+        {
+            SequenceOneMass(i, firstMassPtr, sequenceNode, sequenceNodeC, sequenceNodeN,
+                            actualPeptideMW, actualTopSeqNum, actualFinalSeqNum);
+        }
+        return;
+    }
+
+    fflush(NULL);   /*otherwise anything buffered gets printed again by each child*/
+    
+    runningNum = 0;
+    nextPass = 0;
+    while (nextPass < passNum || runningNum > 0)
+    {
+        /*Start passes until all of the workers are busy.*/
+        while (nextPass < passNum && runningNum < workerNum)
+        {
+            if (pipe(pipeFD) != 0)
+            {
+                printf("ScrambleMassesInParallel:  Could not make a pipe.\n");
+                exit(1);
+            }
+            pid = fork();
+            if (pid < 0)
+            {
+                printf("ScrambleMassesInParallel:  Could not start a worker.\n");
+                exit(1);
+            }
+            if (pid == 0)   /*the child does one pass and reports back*/
+            {
+                close(pipeFD[0]);
+                gParam.workerNum = 1;   /*the other workers are busy, so score on one thread*/
+                memset(&result[0], 0, sizeof(tScrambleResult));
+                startIndex = gWrongIndex;
+                SequenceOneMass(firstI + nextPass, firstMassPtr, sequenceNode, sequenceNodeC, 
+                                sequenceNodeN, actualPeptideMW, actualTopSeqNum, 
+                                actualFinalSeqNum);
+                result[0].wrongNum = gWrongIndex - startIndex;
+                if (result[0].wrongNum > 0 && startIndex <= WRONG_SEQ_NUM)
+                {
+                    result[0].stored = TRUE;
+                    result[0].xCorrScore   = gWrongXCorrScore[startIndex];
+                    result[0].intScore     = gWrongIntScore[startIndex];
+                    result[0].probScore    = gWrongProbScore[startIndex];
+                    result[0].qualityScore = gWrongQualityScore[startIndex];
+                    result[0].comboScore   = gWrongComboScore[startIndex];
+                }
+                fflush(NULL);
+                if (write(pipeFD[1], &result[0], sizeof(tScrambleResult)) != sizeof(tScrambleResult))
+                {
+                    _exit(1);
+                }
+                _exit(0);
+            }
+            close(pipeFD[1]);
+            workerPID[nextPass] = pid;
+            resultFD[nextPass] = pipeFD[0];
+            nextPass++;
+            runningNum++;
+        }
+        
+        /*Wait for any one of them to finish, and collect its result.*/
+        pid = wait(&status);
+        if (pid < 0)
         {
-            firstSequencePtr = ScoreSequences(firstSequencePtr, firstMassPtr);
-            gFirstTimeThru = FALSE; /*forever false after first time thru loop*/
-            SetupGapList(); /*The gGapList can get changed in the scoring, so its returned to the 
-                            original values*/
-            FreeSequence(firstSequencePtr); /*Get rid of the sequences, cuz you'll be getting
-                                            a new set soon*/
+            printf("ScrambleMassesInParallel:  Lost track of the workers.\n");
+            exit(1);
         }
-        else if (gCorrectMass)
+        for (j = 0; j < nextPass; j++)
         {
-            PrintPartingGiftToFile();
+            if (workerPID[j] == pid)
+            {
+                break;
+            }
         }
-        else
+        if (j == nextPass)
         {
-            gWrongIndex++; /*No sequences to score, so the best score is zero, which is what
-                     the gScore arrays were normalized to*/
+            continue;   /*not one of ours*/
         }
-
-
-    }   /*end of gParam.peptideMW looping*/
-
-    /*trash these things*/
-    free(sequenceNodeC);    
-    free(sequenceNodeN);
-    free(oneEdgeNodes);
-    free(sequenceNode);
-
-/*      Free up the linked lists.*/
-/* JAT - Why not free if win32? */
-#if (__dest_os != __win32_os)
-
-    /*List of completed sequences from subsequencing routine*/
-    FreeMassList(firstMassPtr);             /*List of ions and intensities*/
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 
+            || read(resultFD[j], &result[j], sizeof(tScrambleResult)) != sizeof(tScrambleResult))
+        {
+            printf("ScrambleMassesInParallel:  A worker failed on a mass scramble.\n");
+            exit(1);
+        }
+        close(resultFD[j]);
+        runningNum--;
+    }
+    
+    /*Store the scores in the same order that the serial loop would have.*/
+    for (j = 0; j < passNum; j++)
+    {
+        if (result[j].stored && gWrongIndex <= WRONG_SEQ_NUM)
+        {
+            gWrongXCorrScore[gWrongIndex]   = result[j].xCorrScore;
+            gWrongIntScore[gWrongIndex]     = result[j].intScore;
+            gWrongProbScore[gWrongIndex]    = result[j].probScore;
+            gWrongQualityScore[gWrongIndex] = result[j].qualityScore;
+            gWrongComboScore[gWrongIndex]   = result[j].comboScore;
+        }
+        gWrongIndex += result[j].wrongNum;
+    }
 #endif
-
-    fflush(stdout);
+    return;
 }
 
 
@@ -611,12 +804,35 @@ static void BuildPgmState(INT_4 argc, CHAR **argv)
 
     /* get command-line parameters */
 
-    while ((c = getopt(argc, argv, "?hqvd:o:m:p:r:s:")) != -1)
+    while ((c = getopt(argc, argv, "?hqvBSb:d:o:m:p:r:s:u:")) != -1)
     {
 
         switch (c)
         {
         
+        case 'b':
+            /* batch mode, w/ a directory or manifest of CID files */
+            gParam.fBatch = TRUE;
+            strncpy(gParam.batchFile, optarg, sizeof(gParam.batchFile));
+            break;
+
+        case 'B':
+            /* batch mode for the CID files on the command line */
+            gParam.fBatch = TRUE;
+            break;
+
+        case 'S':
+            /* server mode, w/ requests on stdin and replies on stdout */
+            gParam.fServer = TRUE;
+            SaveStdoutForReplies();
+            break;
+
+        case 'u':
+            /* server mode, w/ requests over a Unix domain socket */
+            gParam.fServer = TRUE;
+            strncpy(gParam.serverSocket, optarg, sizeof(gParam.serverSocket));
+            break;
+
         case 'o':
             /* output file name */
             strncpy(gParam.outputFile, optarg, sizeof(gParam.outputFile));
@@ -662,6 +878,8 @@ static void BuildPgmState(INT_4 argc, CHAR **argv)
         case 'h':
             /* print usage */
             puts("\nUSAGE:  lutefisk [options] [CID file pathname]\n");
+            puts(  "                -b = batch mode; directory or manifest file of CID files");
+            puts(  "                -B = batch mode for the CID files on the command line");
             puts(  "                -o = output file pathname");
             puts(  "                -q = quiet mode ON (default OFF)");
             puts(  "                -m = precursor ion mass");
@@ -669,6 +887,8 @@ static void BuildPgmState(INT_4 argc, CHAR **argv)
             puts(  "                -p = params file pathname");
             puts(  "                -r = residues file pathname");
             puts(  "                -s = pathnane of file with database sequences to score");
+            puts(  "                -S = server mode; CID file requests on stdin, output on stdout");
+            puts(  "                -u = server mode; socket pathname for CID file requests");
             puts(  "                -v = verbose mode ON (default OFF)");
             puts(  "                -h = print this help text");
             puts(  "" );
@@ -702,6 +922,48 @@ static void BuildPgmState(INT_4 argc, CHAR **argv)
 
 }
 
+/*
+//--------------------------------------------------------------------------------
+//  SearchTicks()
+//--------------------------------------------------------------------------------
+    SearchTicks is used instead of clock() for timing a search (gParam.startTicks).  It
+    counts only the processor time used by the calling thread, so that the time limits in
+    the subsequencing and in Haggis work the same way when several searches share the process
+    in batch mode.
+*/
+
+clock_t SearchTicks(void)
+{
+#if defined(CLOCK_THREAD_CPUTIME_ID)
+    struct timespec now;
+
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) == 0)
+    {
+        return((clock_t)now.tv_sec * CLOCKS_PER_SEC 
+               + (clock_t)((REAL_8)now.tv_nsec * CLOCKS_PER_SEC / 1000000000));
+    }
+#endif
+    return(clock());
+}
+
+/*
+//--------------------------------------------------------------------------------
+//  RunDate()
+//--------------------------------------------------------------------------------
+    RunDate puts the ctime string for theTime into dateString (which needs to hold at least
+    26 characters) and returns it.  Unlike ctime, its safe to call from several threads.
+*/
+
+char *RunDate(time_t theTime, char *dateString)
+{
+#if defined(__MWERKS__)
+    strcpy(dateString, ctime(&theTime));
+#else
+    ctime_r(&theTime, dateString);
+#endif
+    return(dateString);
+}
+
 /*
 //--------------------------------------------------------------------------------
 //  FindTheMultiplier()
@@ -804,16 +1066,26 @@ void ChangeOutputName(void)
                 || !strncmp(outputFile + length - 4, ".dat", 4)
                 || !strncmp(outputFile + length - 4, ".DAT", 4)
                 || !strncmp(outputFile + length - 4, ".txt", 4)
-                || !strncmp(outputFile + length - 4, ".TXT", 4))
+                || !strncmp(outputFile + length - 4, ".TXT", 4)
+                || !strncmp(outputFile + length - 4, ".mgf", 4)
+                || !strncmp(outputFile + length - 4, ".MGF", 4))
            )
         {
-            strcpy(outputFile + length - 4, ".lut");
+            outputFile[length - 4] = 0;
         }
-        else
+        else if (IsMzMLFileName(outputFile))
         {
-            strcat(outputFile, ".lut");
+            *strrchr(outputFile, '.') = 0;
         }
 
+        /* Each spectrum in an MGF file gets its own file, numbered in file order (or by scan
+           number for mzML and mzXML) */
+        if (gSearch->cidBlockNum > 0)
+        {
+            sprintf(outputFile + strlen(outputFile), ".%d", gSearch->cidBlockNum);
+        }
+        strcat(outputFile, ".lut");
+
 
         /* Make sure that the file doesn't already exist. If it does, append a number. */
         strcpy(gParam.outputFile, outputFile);
@@ -1018,7 +1290,7 @@ void FreeSequence(struct Sequence *currPtr)
 
         currPtr = currPtr->next;
 
-        free(freeMePtr);
+        DisposeSequenceStruct(freeMePtr);
 
     }
 
@@ -1396,7 +1668,7 @@ void ReadEdmanFile()
                      "average residue" number is determined from the AV_RESIDUE_MASS value
                      found in Lutefisk.h and peptideMW.
     CIDfileType = F or T, depending on if the file is ASCII generated by the Finnigan TSQ List
-                  program, or a simple tab-delineated list.
+                  program, or a simple tab-delineated list (or D, L, N, Q, or M for MGF).
 */
 void  ReadParamsFile(void)
 {
@@ -1543,6 +1815,15 @@ void  ReadParamsFile(void)
                 goto problem;
             }
         }
+        else if (!strcmp(setting, "Parallel Workers"))
+        {
+            gParam.workerNum = atoi(value);
+            if (gParam.workerNum < 0)
+            {
+                printf("The number of parallel workers is zero or higher.\n");
+                goto problem;
+            }
+        }
         else if (!strcmp(setting, "Number of sequences"))
         {
         	gParam.outputSeqNum = atoi(value);
@@ -1585,12 +1866,22 @@ void  ReadParamsFile(void)
             {
                 gParam.CIDfileType = 'N';
             }
+            else if ((length > 4) && IsMGFFileName(gParam.cidFilename))
+            {
+                gParam.CIDfileType = 'M';
+            }
+            else if ((length > 4) && IsMzMLFileName(gParam.cidFilename))
+            {
+                gParam.CIDfileType = 'Z';
+            }
 
             if (gParam.CIDfileType != 'F'       /* ICIS text file */
                 && gParam.CIDfileType != 'T'    /* tab text file */
                 && gParam.CIDfileType != 'L'    /* LCQ text file */
                 && gParam.CIDfileType != 'N'    /* Finnigan '.dat' file */
                 && gParam.CIDfileType != 'D'    /* Finnigan '.dta' file */
+                && gParam.CIDfileType != 'M'    /* Mascot generic format '.mgf' file */
+                && gParam.CIDfileType != 'Z'    /* '.mzML' or '.mzXML' file */
                 && gParam.CIDfileType != 'Q')   /* Micromass pkl pseudo '.dta' format */
             {
                 printf("Unregnized CID file type '%c'\n", gParam.CIDfileType);
@@ -1599,6 +1890,42 @@ void  ReadParamsFile(void)
 
             if (gParam.fVerbose) printf("CID file type = %c\n", gParam.CIDfileType);
         }
+        else if (!strcmp(setting, "First Scan"))  /*---------------------------*/
+        {
+            gParam.firstScan = atoi(value);
+            if (gParam.firstScan < 0)
+            {
+                printf("The first scan number is zero or higher.\n");
+                goto problem;
+            }
+        }
+        else if (!strcmp(setting, "Last Scan"))  /*----------------------------*/
+        {
+            gParam.lastScan = atoi(value);
+            if (gParam.lastScan < 0)
+            {
+                printf("The last scan number is zero or higher.\n");
+                goto problem;
+            }
+        }
+        else if (!strcmp(setting, "Min. Precursor m/z"))  /*-------------------*/
+        {
+            gParam.minPrecursorMZ = atof(value);
+            if (gParam.minPrecursorMZ < 0)
+            {
+                printf("The minimum precursor m/z is zero or higher.\n");
+                goto problem;
+            }
+        }
+        else if (!strcmp(setting, "Max. Precursor m/z"))  /*-------------------*/
+        {
+            gParam.maxPrecursorMZ = atof(value);
+            if (gParam.maxPrecursorMZ < 0)
+            {
+                printf("The maximum precursor m/z is zero or higher.\n");
+                goto problem;
+            }
+        }
         else if (!strcmp(setting, "Profile/Centroid"))  /*--------------------*/
         {
             gParam.centroidOrProfile = toupper(value[0]);
@@ -1685,6 +2012,51 @@ void  ReadParamsFile(void)
 
             if (gParam.fVerbose) printf("Ions per residue = %.1f\n", gParam.ionsPerResidue);
         }
+        else if (!strcmp(setting, "Fast XCorr"))  /*--------------------------*/
+        {
+            gParam.fastXCorr = toupper(value[0]);
+
+            if (gParam.fastXCorr == 'Y')
+            {
+                gParam.fastXCorr = TRUE;
+            }
+            else
+            {
+                gParam.fastXCorr = FALSE;
+            }
+
+            if (gParam.fVerbose) printf("Fast XCorr = %d\n", gParam.fastXCorr);
+        }
+        else if (!strcmp(setting, "Subsequencing Engine"))  /*----------------*/
+        {
+            gParam.subseqEngine = toupper(value[0]);
+
+            if (gParam.subseqEngine    != 'B' 
+                && gParam.subseqEngine != 'E' 
+                && gParam.subseqEngine != 'C')
+            {
+                printf("Lutefisk.gParam: Subsequencing engine must be specified as:\n"
+                       "beam search (B), exact top paths (E), or compare the two (C).\n");
+                goto problem;
+            }
+
+            if (gParam.fVerbose) printf("Subsequencing engine = %c\n", gParam.subseqEngine);
+        }
+        else if (!strcmp(setting, "Spectrum Cache"))  /*----------------------*/
+        {
+            gParam.spectrumCache = toupper(value[0]);
+
+            if (gParam.spectrumCache == 'Y')
+            {
+                gParam.spectrumCache = TRUE;
+            }
+            else
+            {
+                gParam.spectrumCache = FALSE;
+            }
+
+            if (gParam.fVerbose) printf("Spectrum cache = %d\n", gParam.spectrumCache);
+        }
         else if (!strcmp(setting, "Transition Mass (u)"))  /*-----------------*/
         {
             gParam.monoToAv = atoi(value);
@@ -2039,10 +2411,10 @@ void  ReadParamsFile(void)
     }
 
 
-    if ((gParam.CIDfileType == 'D' || gParam.CIDfileType == 'X')
+    if ((gParam.CIDfileType == 'D' || gParam.CIDfileType == 'X' || gParam.CIDfileType == 'M')
         && gParam.centroidOrProfile != 'C')
     {
-        printf("Forcing .dta file to be read as centroid data.\n");
+        printf("Forcing .dta or .mgf file to be read as centroid data.\n");
         gParam.centroidOrProfile = 'C'; /*force it to read centroid for dta files*/
     }
 
@@ -2095,6 +2467,12 @@ void  ReadParamsFile(void)
     /*For odd numbers, round up*/
     gParam.wrongSeqNum = (REAL_4)gParam.wrongSeqNum / 2 + 0.5;
     gParam.wrongSeqNum = gParam.wrongSeqNum * 2;
+    /*The scramble results are kept in arrays of WRONG_SEQ_NUM + 1*/
+    if (gParam.wrongSeqNum > WRONG_SEQ_NUM)
+    {
+        printf("Using %d mass scrambles, which is the most allowed.\n", (WRONG_SEQ_NUM / 2) * 2);
+        gParam.wrongSeqNum = (WRONG_SEQ_NUM / 2) * 2;
+    }
 
 
     return;
@@ -2180,6 +2558,113 @@ void     ReadResidueFile(void)
 }
 
 
+/*
+//--------------------------------------------------------------------------------
+//  MakeExtensionTable()
+//--------------------------------------------------------------------------------
+    Called at the end of SetupGapList to make gSearch->extensionMass, which has the 
+    EXTENSION_ flags for every mass from zero up to the largest three amino acid
+    extension.  With it, ExtensionMassType can say whether a mass is a one or two amino 
+    acid extension in gGapList, a three amino acid extension, or within gParam.fragmentErr
+    of a single amino acid w/o looking thru gGapList.  The scoring changes gGapList, so
+    the table is only good from SetupGapList until ScoreSequences.
+*/
+static void MakeExtensionTable(void)
+{
+    INT_4 i, j, k, mass, low, high, maxSingle = 0, limit;
+
+    for (i = 0; i < gAminoAcidNumber; i++)
+    {
+        if (gGapList[i] > maxSingle)
+        {
+            maxSingle = gGapList[i];
+        }
+    }
+    limit = 3 * maxSingle;
+    for (i = 0; i <= gGapListIndex; i++)
+    {
+        if (gGapList[i] > limit)
+        {
+            limit = gGapList[i];
+        }
+    }
+    if (maxSingle + gParam.fragmentErr + 1 > limit)
+    {
+        limit = maxSingle + gParam.fragmentErr + 1;
+    }
+    limit++;
+
+    if (limit > gSearch->extensionMassLimit)
+    {
+        free(gSearch->extensionMass);
+        gSearch->extensionMass = (char *) malloc(limit * sizeof(char));
+        if (gSearch->extensionMass == NULL)
+        {
+            printf("MakeExtensionTable:  Out of memory.");
+            exit(1);
+        }
+    }
+    gSearch->extensionMassLimit = limit;
+    memset(gSearch->extensionMass, 0, limit * sizeof(char));
+
+    for (i = 0; i <= gGapListIndex; i++)
+    {
+        if (gGapList[i] > 0)
+        {
+            gSearch->extensionMass[gGapList[i]] |= EXTENSION_GAP_LIST;
+        }
+    }
+
+    for (i = 0; i < gAminoAcidNumber; i++)
+    {
+        if (gGapList[i] <= 0) continue;
+        for (j = 0; j < gAminoAcidNumber; j++)
+        {
+            if (gGapList[j] <= 0) continue;
+            for (k = 0; k < gAminoAcidNumber; k++)
+            {
+                if (gGapList[k] <= 0) continue;
+                gSearch->extensionMass[gGapList[i] + gGapList[j] + gGapList[k]] |= EXTENSION_THREE_AA;
+            }
+        }
+    }
+
+    /*Use the same comparisons as the loops that this replaces, so the edges come out the same*/
+    for (i = 0; i < gAminoAcidNumber; i++)
+    {
+        if (gGapList[i] <= 0) continue;
+        low = gGapList[i] - gParam.fragmentErr - 1;
+        high = gGapList[i] + gParam.fragmentErr + 1;
+        for (mass = low; mass <= high; mass++)
+        {
+            if (mass >= 0 && mass < limit 
+                && mass <= gGapList[i] + gParam.fragmentErr 
+                && mass >= gGapList[i] - gParam.fragmentErr)
+            {
+                gSearch->extensionMass[mass] |= EXTENSION_NEAR_AA;
+            }
+        }
+    }
+
+    return;
+}
+
+/*
+//--------------------------------------------------------------------------------
+//  ExtensionMassType()
+//--------------------------------------------------------------------------------
+    Returns the EXTENSION_ flags for mass (see MakeExtensionTable), or zero if mass is
+    outside of the table.
+*/
+char ExtensionMassType(INT_4 mass)
+{
+    if (mass < 0 || mass >= gSearch->extensionMassLimit)
+    {
+        return(0);
+    }
+    return(gSearch->extensionMass[mass]);
+}
+
 /*
 //--------------------------------------------------------------------------------
 //  SetupGapList()
@@ -2336,6 +2821,8 @@ void SetupGapList()
             gGapList[i] = gGapList[i] * singleAAPresent[i];
         }*/
 
+    MakeExtensionTable();
+
     return;
 }
 
@@ -2576,6 +3063,7 @@ void PrintHeaderToFile()
 	INT_4 i;
 	FILE *fp;
    	const 	time_t		theTime = (const time_t)time(NULL);
+	char	dateString[64];
 	
 
         /* Open a new file.*/
@@ -2587,7 +3075,7 @@ void PrintHeaderToFile()
 	}
 
 	fprintf(fp, versionString);
-	fprintf(fp, "Run Date: %20s", ctime(&theTime));
+	fprintf(fp, "Run Date: %20s", RunDate(theTime, dateString));
 
         /* Print header information from gParam to the console and the file.*/
 	fprintf(fp, " Filename: ");	/*Print the CID data file name.*/
@@ -2597,6 +3085,10 @@ void PrintHeaderToFile()
 		fputc(gParam.cidFilename[i], fp);
 		i++;
 	}
+	if(gSearch->cidBlockNum > 0)
+	{
+		fprintf(fp, "  Spectrum: %d", gSearch->cidBlockNum);
+	}
 	fprintf(fp, "\n Molecular Weight: %7.2f", gParam.peptideMW);
 	fprintf(fp, "  Molecular Weight Tolerance: %5.2f", gParam.peptideErr);
 	fprintf(fp, "  Fragment Ion Tolerance: %5.2f", gParam.fragmentErr);
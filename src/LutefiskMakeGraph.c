@@ -43,6 +43,203 @@ jsrichar@alum.mit.edu
 #include <stdlib.h>
 #include "LutefiskPrototypes.h"
 #include "LutefiskDefinitions.h"
+#include "ListRoutines.h"
+
+static INT_4 gZeroNodePage[NODE_PAGE_SIZE];	/*Stands in for every page w/o a set node.*/
+
+/********************************CreateNodeStore**********************************************
+*
+*	CreateNodeStore makes a store of gGraphLength node values, each of valueSize bytes.  No
+*	values are allocated until SetNodeValue puts a non-zero value on a page of nodes.
+*/
+tNodeStore *CreateNodeStore(INT_4 valueSize)
+{
+	tNodeStore *store;
+	INT_4 i;
+	
+	store = (tNodeStore *) malloc(sizeof(tNodeStore));
+	if(store == NULL)
+	{
+		printf("CreateNodeStore:  Out of memory");
+		exit(1);
+	}
+	store->pageNum = gGraphLength / NODE_PAGE_SIZE + 1;
+	store->valueSize = valueSize;
+	store->page = (char **) malloc(store->pageNum * sizeof(char *));
+	if(store->page == NULL)
+	{
+		printf("CreateNodeStore:  Out of memory");
+		exit(1);
+	}
+	for(i = 0; i < store->pageNum; i++)
+	{
+		store->page[i] = (char *)gZeroNodePage;
+	}
+	
+	return(store);
+}
+
+/********************************ClearNodeStore**********************************************
+*
+*	ClearNodeStore sets every node back to zero by freeing the pages that were set.
+*/
+void ClearNodeStore(tNodeStore *store)
+{
+	INT_4 i;
+	
+	for(i = 0; i < store->pageNum; i++)
+	{
+		if(store->page[i] != (char *)gZeroNodePage)
+		{
+			free(store->page[i]);
+			store->page[i] = (char *)gZeroNodePage;
+		}
+	}
+	
+	return;
+}
+
+/********************************DisposeNodeStore**********************************************
+*
+*	DisposeNodeStore frees the store and any of its pages.
+*/
+void DisposeNodeStore(tNodeStore *store)
+{
+	if(store == NULL)
+	{
+		return;
+	}
+	ClearNodeStore(store);
+	free(store->page);
+	free(store);
+	
+	return;
+}
+
+/********************************NodeStorePage**********************************************
+*
+*	NodeStorePage returns the page holding node, allocating it (as zero's) if need be.
+*/
+static char *NodeStorePage(tNodeStore *store, INT_4 node)
+{
+	char *page = store->page[node >> NODE_PAGE_BITS];
+	
+	if(page == (char *)gZeroNodePage)
+	{
+		page = (char *) calloc(NODE_PAGE_SIZE, store->valueSize);
+		if(page == NULL)
+		{
+			printf("NodeStorePage:  Out of memory");
+			exit(1);
+		}
+		store->page[node >> NODE_PAGE_BITS] = page;
+	}
+	
+	return(page);
+}
+
+/********************************SetNodeValue**********************************************
+*
+*	SetNodeValue and SetNodeIntValue put a value at a node of a SCHAR or INT_4 store.  Setting
+*	a node to zero on a page that was never set leaves the page unallocated.
+*/
+void SetNodeValue(tNodeStore *store, INT_4 node, INT_4 value)
+{
+	if((SCHAR)value == 0 && store->page[node >> NODE_PAGE_BITS] == (char *)gZeroNodePage)
+	{
+		return;
+	}
+	((SCHAR *)NodeStorePage(store, node))[node & (NODE_PAGE_SIZE - 1)] = value;
+	
+	return;
+}
+
+void SetNodeIntValue(tNodeStore *store, INT_4 node, INT_4 value)
+{
+	if(value == 0 && store->page[node >> NODE_PAGE_BITS] == (char *)gZeroNodePage)
+	{
+		return;
+	}
+	((INT_4 *)NodeStorePage(store, node))[node & (NODE_PAGE_SIZE - 1)] = value;
+	
+	return;
+}
+
+/********************************NextStoredNode**********************************************
+*
+*	NextStoredNode returns the first node at or above node that is on a set page, or a node
+*	past the end of the store if there is none.  LastStoredNode returns the last node at or 
+*	below node that is on a set page, or -1.  Every node that is not on a set page is zero, 
+*	so a sweep for non-zero nodes can step thru these instead of every mass.
+*/
+INT_4 NextStoredNode(tNodeStore *store, INT_4 node)
+{
+	INT_4 i;
+	
+	if(node < 0)
+	{
+		node = 0;
+	}
+	i = node >> NODE_PAGE_BITS;
+	if(i < store->pageNum && store->page[i] != (char *)gZeroNodePage)
+	{
+		return(node);
+	}
+	for(i++; i < store->pageNum; i++)
+	{
+		if(store->page[i] != (char *)gZeroNodePage)
+		{
+			return(i << NODE_PAGE_BITS);
+		}
+	}
+	
+	return(store->pageNum << NODE_PAGE_BITS);
+}
+
+INT_4 LastStoredNode(tNodeStore *store, INT_4 node)
+{
+	INT_4 i;
+	
+	if(node < 0)
+	{
+		return(-1);
+	}
+	i = node >> NODE_PAGE_BITS;
+	if(i >= store->pageNum)
+	{
+		i = store->pageNum - 1;
+		node = (store->pageNum << NODE_PAGE_BITS) - 1;
+	}
+	if(store->page[i] != (char *)gZeroNodePage)
+	{
+		return(node);
+	}
+	for(i--; i >= 0; i--)
+	{
+		if(store->page[i] != (char *)gZeroNodePage)
+		{
+			return((i << NODE_PAGE_BITS) + NODE_PAGE_SIZE - 1);
+		}
+	}
+	
+	return(-1);
+}
+
+/********************************NextNodeOfEither**********************************************
+*
+*	NextNodeOfEither is NextStoredNode over two stores at once.
+*/
+static INT_4 NextNodeOfEither(tNodeStore *firstStore, tNodeStore *secondStore, INT_4 node)
+{
+	INT_4 firstNode = NextStoredNode(firstStore, node);
+	INT_4 secondNode = NextStoredNode(secondStore, node);
+	
+	if(secondNode < firstNode)
+	{
+		return(secondNode);
+	}
+	return(firstNode);
+}
 
 /********************************RemoveSillyNodes**********************************************
 *
@@ -51,7 +248,7 @@ jsrichar@alum.mit.edu
 *	good, since the silly nodes are near the N-terminus and won't connect.  Hence, it probably
 *	doesn't matter if there are these silly nodes or not.
 */
-void RemoveSillyNodes(SCHAR *sequenceNodeC, SCHAR *sequenceNodeN)
+void RemoveSillyNodes(tNodeStore *sequenceNodeC, tNodeStore *sequenceNodeN)
 {
 	INT_4 i, j, k, firstNode, testMass;
 	char test;
@@ -67,8 +264,8 @@ void RemoveSillyNodes(SCHAR *sequenceNodeC, SCHAR *sequenceNodeN)
 	{
 		if(i != firstNode)
 		{
-			sequenceNodeC[i] = 0;
-			sequenceNodeN[i] = 0;
+			SetNodeValue(sequenceNodeC, i, 0);
+			SetNodeValue(sequenceNodeN, i, 0);
 		}
 	}
 	
@@ -79,7 +276,7 @@ void RemoveSillyNodes(SCHAR *sequenceNodeC, SCHAR *sequenceNodeN)
 */
 	for(i = firstNode + gMonoMass_x100[G]; i < firstNode + gMonoMass_x100[A] * 2; i++)
 	{
-		if(sequenceNodeC[i] != 0 || sequenceNodeN[i] != 0)
+		if(NodeValue(sequenceNodeC, i) != 0 || NodeValue(sequenceNodeN, i) != 0)
 		{
 			test = TRUE;
 			for(j = 0; j < gAminoAcidNumber; j++)
@@ -95,8 +292,8 @@ void RemoveSillyNodes(SCHAR *sequenceNodeC, SCHAR *sequenceNodeN)
 			}
 			if(test)
 			{
-				sequenceNodeC[i] = 0;
-				sequenceNodeN[i] = 0;
+				SetNodeValue(sequenceNodeC, i, 0);
+				SetNodeValue(sequenceNodeN, i, 0);
 			}
 		}
 	}
@@ -108,7 +305,7 @@ void RemoveSillyNodes(SCHAR *sequenceNodeC, SCHAR *sequenceNodeN)
 */
 	for(i = firstNode + 142 * gMultiplier; i < firstNode + 239 * gMultiplier; i++)
 	{
-		if(sequenceNodeC[i] != 0 || sequenceNodeN[i] != 0)
+		if(NodeValue(sequenceNodeC, i) != 0 || NodeValue(sequenceNodeN, i) != 0)
 		{
 			test = TRUE;
 			for(j = 0; j < gAminoAcidNumber; j++)
@@ -141,8 +338,8 @@ void RemoveSillyNodes(SCHAR *sequenceNodeC, SCHAR *sequenceNodeN)
 			}
 			if(test)
 			{
-				sequenceNodeC[i] = 0;
-				sequenceNodeN[i] = 0;
+				SetNodeValue(sequenceNodeC, i, 0);
+				SetNodeValue(sequenceNodeN, i, 0);
 			}
 		}
 	}
@@ -160,7 +357,7 @@ void RemoveSillyNodes(SCHAR *sequenceNodeC, SCHAR *sequenceNodeN)
 *	corresponding y ion are counted. 
 */
 
-void FindTrypticLCQY17Ions(struct MSData *firstMassPtr, SCHAR *sequenceNodeC)
+void FindTrypticLCQY17Ions(struct MSData *firstMassPtr, tNodeStore *sequenceNodeC)
 {
 	struct MSData *currPtr;
 	INT_4 i, j, testForChar;
@@ -270,9 +467,9 @@ void FindTrypticLCQY17Ions(struct MSData *firstMassPtr, SCHAR *sequenceNodeC)
 				}
 				for(j = y17MassMin; j <= y17MassMax; j++)
 				{
-					if(sequenceNodeC[j] != 0)
+					if(NodeValue(sequenceNodeC, j) != 0)
 					{
-						testForChar = sequenceNodeC[j];
+						testForChar = NodeValue(sequenceNodeC, j);
 						if(i <= mostLikelyFragCharge)
 						{
 							testForChar += (INT_4)gWeightedIonValues.y_minus17or18;
@@ -283,11 +480,11 @@ void FindTrypticLCQY17Ions(struct MSData *firstMassPtr, SCHAR *sequenceNodeC)
 						}
 						if(testForChar < 127 && testForChar > -127)
 						{
-							sequenceNodeC[j] = testForChar;
+							SetNodeValue(sequenceNodeC, j, testForChar);
 						}
 						else
 						{
-							sequenceNodeC[j] = 63;
+							SetNodeValue(sequenceNodeC, j, 63);
 						}
 					}
 				}
@@ -308,7 +505,7 @@ void FindTrypticLCQY17Ions(struct MSData *firstMassPtr, SCHAR *sequenceNodeC)
 *	additional value of gWeightedIonValues.y.  
 */
 
-void FindTrypticLCQYIons(struct MSData *firstMassPtr, SCHAR *sequenceNodeC)
+void FindTrypticLCQYIons(struct MSData *firstMassPtr, tNodeStore *sequenceNodeC)
 {
 	struct MSData *currPtr;
 	INT_4 yMassMin, yMassMax;
@@ -430,7 +627,7 @@ void FindTrypticLCQYIons(struct MSData *firstMassPtr, SCHAR *sequenceNodeC)
 				}
 				for(j = yMassMin; j <= yMassMax; j++)
 				{
-					testForChar = sequenceNodeC[j];	/*make sure value fits in a char*/
+					testForChar = NodeValue(sequenceNodeC, j);	/*make sure value fits in a char*/
 					if(i <= mostLikelyFragCharge || yMass <= 373 * gMultiplier)
 					{
 						testForChar += (INT_4)gWeightedIonValues.y;
@@ -441,11 +638,11 @@ void FindTrypticLCQYIons(struct MSData *firstMassPtr, SCHAR *sequenceNodeC)
 					}
 					if(testForChar < 127 && testForChar > -127)
 					{
-						sequenceNodeC[j] = testForChar;
+						SetNodeValue(sequenceNodeC, j, testForChar);
 					}
 					else
 					{
-						sequenceNodeC[j] = 63;
+						SetNodeValue(sequenceNodeC, j, 63);
 					}
 				}
 			}
@@ -465,11 +662,12 @@ void FindTrypticLCQYIons(struct MSData *firstMassPtr, SCHAR *sequenceNodeC)
 */
 
 
-	for(i = 373 * gMultiplier; i < gGraphLength; i++)	
+	for(i = NextStoredNode(sequenceNodeC, 373 * gMultiplier); i < gGraphLength; 
+		i = NextStoredNode(sequenceNodeC, i + 1))	
 	{
-		if(sequenceNodeC[i] < gWeightedIonValues.y)
+		if(NodeValue(sequenceNodeC, i) < gWeightedIonValues.y)
 		{
-			sequenceNodeC[i] = 0;
+			SetNodeValue(sequenceNodeC, i, 0);
 		}
 	}
 
@@ -486,7 +684,7 @@ void FindTrypticLCQYIons(struct MSData *firstMassPtr, SCHAR *sequenceNodeC)
 *	corresponding a ion are counted. 
 */
 
-void FindTrypticLCQA17Ions(struct MSData *firstMassPtr, SCHAR *sequenceNodeN, char *ionPresent)
+void FindTrypticLCQA17Ions(struct MSData *firstMassPtr, tNodeStore *sequenceNodeN, tNodeStore *ionPresent)
 {
 	struct MSData *currPtr;
 	INT_4 a17MassMin, a17MassMax, i, j, testForChar;
@@ -568,9 +766,9 @@ void FindTrypticLCQA17Ions(struct MSData *firstMassPtr, SCHAR *sequenceNodeN, ch
 				}
 				for(j = a17MassMin; j <= a17MassMax; j++)
 				{
-					if(ionPresent[j - gCO] != 0)
+					if(NodeValue(ionPresent, j - gCO) != 0)
 					{
-						testForChar = sequenceNodeN[j];
+						testForChar = NodeValue(sequenceNodeN, j);
 						if(i <= mostLikelyFragCharge)
 						{
 							if(a17Mass < 350 * gMultiplier)
@@ -595,11 +793,11 @@ void FindTrypticLCQA17Ions(struct MSData *firstMassPtr, SCHAR *sequenceNodeN, ch
 						}
 						if(testForChar < 127 && testForChar > -127)
 						{
-							sequenceNodeN[j] = testForChar;
+							SetNodeValue(sequenceNodeN, j, testForChar);
 						}
 						else
 						{
-							sequenceNodeN[j] = 63;
+							SetNodeValue(sequenceNodeN, j, 63);
 						}
 					}
 				}
@@ -621,7 +819,7 @@ void FindTrypticLCQA17Ions(struct MSData *firstMassPtr, SCHAR *sequenceNodeN, ch
 *	placed in the array ionPresent at the nominal mass of the a ion.
 */
 
-void FindTrypticLCQAIons(struct MSData *firstMassPtr, SCHAR *sequenceNodeN, char *ionPresent)
+void FindTrypticLCQAIons(struct MSData *firstMassPtr, tNodeStore *sequenceNodeN, tNodeStore *ionPresent)
 {
 	struct MSData *currPtr;
 	INT_4 aMassMin, aMassMax, i, j, testForChar;
@@ -709,9 +907,9 @@ when deciding if there are any a-17 ions to be included in the scores for the no
 				}
 				for(j = aMassMin; j <= aMassMax; j++)
 				{
-					if(sequenceNodeN[j] != 0)
+					if(NodeValue(sequenceNodeN, j) != 0)
 					{
-						testForChar = sequenceNodeN[j];	/*make sure value fits in a char*/
+						testForChar = NodeValue(sequenceNodeN, j);	/*make sure value fits in a char*/
 						if(i <= mostLikelyFragCharge)
 						{
 							if(aMass < 350 * gMultiplier)
@@ -736,13 +934,13 @@ when deciding if there are any a-17 ions to be included in the scores for the no
 						}
 						if(testForChar < 127 && testForChar > -127)
 						{
-							sequenceNodeN[j] = testForChar;
+							SetNodeValue(sequenceNodeN, j, testForChar);
 						}
 						else
 						{
-							sequenceNodeN[j] = 63;
+							SetNodeValue(sequenceNodeN, j, 63);
 						}
-						ionPresent[j - 28 * gMultiplier] = 1;	/*The a ion is found.*/
+						SetNodeValue(ionPresent, j - 28 * gMultiplier, 1);	/*The a ion is found.*/
 					}
 				}
 			}
@@ -763,7 +961,7 @@ when deciding if there are any a-17 ions to be included in the scores for the no
 *	corresponding b ion are counted. 
 */
 
-void FindTrypticLCQB17Ions(struct MSData *firstMassPtr, SCHAR *sequenceNodeN)
+void FindTrypticLCQB17Ions(struct MSData *firstMassPtr, tNodeStore *sequenceNodeN)
 {
 	struct MSData *currPtr;
 	INT_4 b17MassMin, b17MassMax, i, j, testForChar;
@@ -845,8 +1043,8 @@ void FindTrypticLCQB17Ions(struct MSData *firstMassPtr, SCHAR *sequenceNodeN)
 				}
 				for(j = b17MassMin; j <= b17MassMax; j++)
 				{
-					testForChar = sequenceNodeN[j];	/*make sure value fits in a char*/
-					if(sequenceNodeN[j] != 0)
+					testForChar = NodeValue(sequenceNodeN, j);	/*make sure value fits in a char*/
+					if(NodeValue(sequenceNodeN, j) != 0)
 					{
 						if(i <= mostLikelyFragCharge)	/*Charge state of the fragment is ok.*/
 						{
@@ -859,11 +1057,11 @@ void FindTrypticLCQB17Ions(struct MSData *firstMassPtr, SCHAR *sequenceNodeN)
 					}
 					if(testForChar < 127 && testForChar > -127)
 					{
-						sequenceNodeN[j] = testForChar;
+						SetNodeValue(sequenceNodeN, j, testForChar);
 					}
 					else
 					{
-						sequenceNodeN[j] = 63;
+						SetNodeValue(sequenceNodeN, j, 63);
 					}
 				}
 			}
@@ -884,7 +1082,7 @@ void FindTrypticLCQB17Ions(struct MSData *firstMassPtr, SCHAR *sequenceNodeN)
 *	an ion trap.
 */
 
-void FindTrypticLCQBIons(struct MSData *firstMassPtr, SCHAR *sequenceNodeN)
+void FindTrypticLCQBIons(struct MSData *firstMassPtr, tNodeStore *sequenceNodeN)
 {
 	struct MSData *currPtr;
 	INT_4 bMassMin, bMassMax, i, j, testForChar;
@@ -967,7 +1165,7 @@ void FindTrypticLCQBIons(struct MSData *firstMassPtr, SCHAR *sequenceNodeN)
 				}
 				for(j = bMassMin; j <= bMassMax; j++)
 				{
-					testForChar = sequenceNodeN[j];	/*test to make sure value fits a char*/
+					testForChar = NodeValue(sequenceNodeN, j);	/*test to make sure value fits a char*/
 					
 					if(i <= mostLikelyFragCharge)
 					{
@@ -982,11 +1180,11 @@ void FindTrypticLCQBIons(struct MSData *firstMassPtr, SCHAR *sequenceNodeN)
 					}
 					if(testForChar < 127 && testForChar > -127)
 					{
-						sequenceNodeN[j] = testForChar;
+						SetNodeValue(sequenceNodeN, j, testForChar);
 					}
 					else
 					{
-						sequenceNodeN[j] = 63;
+						SetNodeValue(sequenceNodeN, j, 63);
 					}
 				}
 			}
@@ -1003,11 +1201,11 @@ void FindTrypticLCQBIons(struct MSData *firstMassPtr, SCHAR *sequenceNodeN)
 *	So far, I've not seen alot of multiply charged b ions in LCQ data of tryptic peptides, where
 *	the lower charge states (primarily +1 fragments of +2 precursors) is totally absent.
 */
-	for(i = 0; i < gGraphLength; i++)	
+	for(i = NextStoredNode(sequenceNodeN, 0); i < gGraphLength; i = NextStoredNode(sequenceNodeN, i + 1))	
 	{
-		if(sequenceNodeN[i] < gWeightedIonValues.b)
+		if(NodeValue(sequenceNodeN, i) < gWeightedIonValues.b)
 		{
-			sequenceNodeN[i] = 0;
+			SetNodeValue(sequenceNodeN, i, 0);
 		}
 	}
 
@@ -1028,24 +1226,12 @@ void FindTrypticLCQBIons(struct MSData *firstMassPtr, SCHAR *sequenceNodeN)
 *	
 */
 
-void TrypticLCQTemplate(struct MSData *firstMassPtr, SCHAR *sequenceNodeC, 
-						SCHAR *sequenceNodeN)
+void TrypticLCQTemplate(struct MSData *firstMassPtr, tNodeStore *sequenceNodeC, 
+						tNodeStore *sequenceNodeN)
 {
-	char *ionPresent;
-	INT_4 i;
+	tNodeStore *ionPresent;
 	
-	ionPresent = (char *) malloc(gGraphLength * sizeof(char ));	/*Will contain C-terminal evidence.*/
-	if(ionPresent == NULL)
-	{
-		printf("TrypticLCQTemplate:  Out of memory");
-		exit(1);
-	}
-
-	for(i = 0; i < gGraphLength; i++)	/*Init this array to zero.  These arrays are used to 
-										keep track of where the a ions are.*/
-	{
-		ionPresent[i] = 0;
-	}
+	ionPresent = CreateNodeStore(sizeof(SCHAR));	/*Used to keep track of where the a ions are.*/
 	
 	if(gWeightedIonValues.b != 0)
 	{
@@ -1077,7 +1263,7 @@ void TrypticLCQTemplate(struct MSData *firstMassPtr, SCHAR *sequenceNodeC,
 		FindTrypticLCQY17Ions(firstMassPtr, sequenceNodeC);
 	}
 	
-	free(ionPresent);
+	DisposeNodeStore(ionPresent);
 	
 	return;
 }
@@ -1142,7 +1328,7 @@ char RatchetIt (INT_4 *aaNum, char cycle, char *sequence, INT_4 seqLength)
 *	existing node value.
 */	
 
-void AddEdmanData(SCHAR *sequenceNodeC, SCHAR *sequenceNodeN, INT_4 totalIonVal)
+void AddEdmanData(tNodeStore *sequenceNodeC, tNodeStore *sequenceNodeN, INT_4 totalIonVal)
 {
 	INT_4 i, j, aaNum[MAX_PEPTIDE_LENGTH], edmanNode, halfTotalIonVal;
 	char sequence[MAX_PEPTIDE_LENGTH], cycle;
@@ -1200,37 +1386,37 @@ void AddEdmanData(SCHAR *sequenceNodeC, SCHAR *sequenceNodeN, INT_4 totalIonVal)
 			
 /*	If that node is non-zero for 'sequenceNodeC', then add the value 'halfTotalIonVal' to it.*/
 
-			if(sequenceNodeC[edmanNode] != 0)
+			if(NodeValue(sequenceNodeC, edmanNode) != 0)
 			{
-				sequenceNodeC[edmanNode] += halfTotalIonVal;
+				SetNodeValue(sequenceNodeC, edmanNode, NodeValue(sequenceNodeC, edmanNode) + halfTotalIonVal);
 			}
 			else
 			{
 				if(i == 0)
 				{
-					sequenceNodeC[edmanNode] = 1;	/*If its one amino acid INT_4 and zero value,
+					SetNodeValue(sequenceNodeC, edmanNode, 1);	/*If its one amino acid INT_4 and zero value,
 													then do this.*/
 				}
 				else
 				{
-					sequenceNodeC[edmanNode] = 0;	/*If its over one amino acid INT_4 and zero 
+					SetNodeValue(sequenceNodeC, edmanNode, 0);	/*If its over one amino acid INT_4 and zero 
 													value, then do this.  Currently it does 
 													nothing.*/
 				}
 			}
-			if(sequenceNodeN[edmanNode] != 0)	/*Same as above, but for sequenceNodeN.*/
+			if(NodeValue(sequenceNodeN, edmanNode) != 0)	/*Same as above, but for sequenceNodeN.*/
 			{
-				sequenceNodeN[edmanNode] += halfTotalIonVal;
+				SetNodeValue(sequenceNodeN, edmanNode, NodeValue(sequenceNodeN, edmanNode) + halfTotalIonVal);
 			}
 			else
 			{
 				if(i == 0)
 				{
-					sequenceNodeN[edmanNode] = 1;
+					SetNodeValue(sequenceNodeN, edmanNode, 1);
 				}
 				else
 				{
-					sequenceNodeN[edmanNode] = 0;
+					SetNodeValue(sequenceNodeN, edmanNode, 0);
 				}
 
 			}
@@ -1247,7 +1433,7 @@ void AddEdmanData(SCHAR *sequenceNodeC, SCHAR *sequenceNodeN, INT_4 totalIonVal)
 *	then a value of one is placed there, so that it might be used for subsequence building.
 */
 
-void AddCTermResidue(SCHAR *sequenceNodeC, SCHAR *sequenceNodeN)
+void AddCTermResidue(tNodeStore *sequenceNodeC, tNodeStore *sequenceNodeN)
 {
 	INT_4 i = gGraphLength - 1;
 	char test = TRUE;
@@ -1262,10 +1448,18 @@ void AddCTermResidue(SCHAR *sequenceNodeC, SCHAR *sequenceNodeN)
 *	adjacent and separate from any other nodes by a string of zero-valued nodes.
 */
 
-	while(i > 0 && (test || sequenceNodeC[i] != 0))
+	while(i > 0 && (test || NodeValue(sequenceNodeC, i) != 0))
 	{
 		i--;
-		if(sequenceNodeC[i] != 0)
+		if(test)
+		{
+			i = LastStoredNode(sequenceNodeC, i);	/*Skip the pages w/o any nodes.*/
+			if(i < 0)
+			{
+				break;
+			}
+		}
+		if(NodeValue(sequenceNodeC, i) != 0)
 		{
 			test = FALSE;
 			if(gParam.proteolysis == 'T')	/*If its a tryptic cleavage.*/
@@ -1273,55 +1467,55 @@ void AddCTermResidue(SCHAR *sequenceNodeC, SCHAR *sequenceNodeN)
 			/*If LCQ data, give boost to b ions w/ loss of K or R*/
 				if(gParam.fragmentPattern == 'L')
 				{
-					sequenceNodeN[i - gMonoMass_x100[K]] = sequenceNodeN[i - gMonoMass_x100[K]] * 4;
-					sequenceNodeN[i - gMonoMass_x100[R]] = sequenceNodeN[i - gMonoMass_x100[R]] * 4;
+					SetNodeValue(sequenceNodeN, i - gMonoMass_x100[K], NodeValue(sequenceNodeN, i - gMonoMass_x100[K]) * 4);
+					SetNodeValue(sequenceNodeN, i - gMonoMass_x100[R], NodeValue(sequenceNodeN, i - gMonoMass_x100[R]) * 4);
 				}
 				else	/*if qtof or triple quad, boost the y2 ions*/
 				{
-					sequenceNodeC[i - gMonoMass_x100[K]] = sequenceNodeC[i - gMonoMass_x100[K]] * 4;
-					sequenceNodeC[i - gMonoMass_x100[R]] = sequenceNodeC[i - gMonoMass_x100[R]] * 4;
+					SetNodeValue(sequenceNodeC, i - gMonoMass_x100[K], NodeValue(sequenceNodeC, i - gMonoMass_x100[K]) * 4);
+					SetNodeValue(sequenceNodeC, i - gMonoMass_x100[R], NodeValue(sequenceNodeC, i - gMonoMass_x100[R]) * 4);
 				}
 				
-				if(sequenceNodeC[i - gMonoMass_x100[K]] == 0 && sequenceNodeN[i - gMonoMass_x100[K]] == 0)	/*Lys*/
+				if(NodeValue(sequenceNodeC, i - gMonoMass_x100[K]) == 0 && NodeValue(sequenceNodeN, i - gMonoMass_x100[K]) == 0)	/*Lys*/
 				{
-					sequenceNodeC[i - gMonoMass_x100[K]] = 10;
-					sequenceNodeN[i - gMonoMass_x100[K]] = 10;
+					SetNodeValue(sequenceNodeC, i - gMonoMass_x100[K], 10);
+					SetNodeValue(sequenceNodeN, i - gMonoMass_x100[K], 10);
 				}
-				if(sequenceNodeC[i - gMonoMass_x100[R]] == 0 && sequenceNodeN[i - gMonoMass_x100[R]] == 0)	/*Arg*/
+				if(NodeValue(sequenceNodeC, i - gMonoMass_x100[R]) == 0 && NodeValue(sequenceNodeN, i - gMonoMass_x100[R]) == 0)	/*Arg*/
 				{
-					sequenceNodeC[i - gMonoMass_x100[R]] = 10;
-					sequenceNodeN[i - gMonoMass_x100[R]] = 10;
+					SetNodeValue(sequenceNodeC, i - gMonoMass_x100[R], 10);
+					SetNodeValue(sequenceNodeN, i - gMonoMass_x100[R], 10);
 				}
 			}
 			if(gParam.proteolysis == 'K')	/*If its a Lys-C cleavage.*/
 			{
-				if(sequenceNodeC[i - gMonoMass_x100[K]] == 0 && sequenceNodeN[i - gMonoMass_x100[K]] == 0)	/*Lys*/
+				if(NodeValue(sequenceNodeC, i - gMonoMass_x100[K]) == 0 && NodeValue(sequenceNodeN, i - gMonoMass_x100[K]) == 0)	/*Lys*/
 				{
-					sequenceNodeC[i - gMonoMass_x100[K]] = 1;
-					sequenceNodeN[i - gMonoMass_x100[K]] = 1;
+					SetNodeValue(sequenceNodeC, i - gMonoMass_x100[K], 1);
+					SetNodeValue(sequenceNodeN, i - gMonoMass_x100[K], 1);
 				}
 			}
 			if(gParam.proteolysis == 'E')	/*If its a Staph v8 cleavage.*/
 			{
-				if(sequenceNodeC[i - gMonoMass_x100[E]] == 0 && sequenceNodeN[i - gMonoMass_x100[E]] == 0)	/*Glu*/
+				if(NodeValue(sequenceNodeC, i - gMonoMass_x100[E]) == 0 && NodeValue(sequenceNodeN, i - gMonoMass_x100[E]) == 0)	/*Glu*/
 				{
-					sequenceNodeC[i - gMonoMass_x100[E]] = 1;
-					sequenceNodeN[i - gMonoMass_x100[E]] = 1;
+					SetNodeValue(sequenceNodeC, i - gMonoMass_x100[E], 1);
+					SetNodeValue(sequenceNodeN, i - gMonoMass_x100[E], 1);
 				}
-				if(sequenceNodeC[i - gMonoMass_x100[D]] == 0 && sequenceNodeN[i - gMonoMass_x100[D]] == 0)	/*Asp*/
+				if(NodeValue(sequenceNodeC, i - gMonoMass_x100[D]) == 0 && NodeValue(sequenceNodeN, i - gMonoMass_x100[D]) == 0)	/*Asp*/
 				{
-					sequenceNodeC[i - gMonoMass_x100[D]] = 1;
-					sequenceNodeN[i - gMonoMass_x100[D]] = 1;
+					SetNodeValue(sequenceNodeC, i - gMonoMass_x100[D], 1);
+					SetNodeValue(sequenceNodeN, i - gMonoMass_x100[D], 1);
 				}
 			}
 		}
 	}
 	if(gParam.proteolysis == 'D')	/*If its an Asp-N cleavage.*/
 	{
-		if(sequenceNodeC[gMonoMass_x100[D] + gElementMass_x100[HYDROGEN]] == 0 && sequenceNodeN[gMonoMass_x100[D] + gElementMass_x100[HYDROGEN]] == 0)
+		if(NodeValue(sequenceNodeC, gMonoMass_x100[D] + gElementMass_x100[HYDROGEN]) == 0 && NodeValue(sequenceNodeN, gMonoMass_x100[D] + gElementMass_x100[HYDROGEN]) == 0)
 		{
-			sequenceNodeC[gMonoMass_x100[D] + gElementMass_x100[HYDROGEN]] = 1;
-			sequenceNodeN[gMonoMass_x100[D] + gElementMass_x100[HYDROGEN]] = 1;
+			SetNodeValue(sequenceNodeC, gMonoMass_x100[D] + gElementMass_x100[HYDROGEN], 1);
+			SetNodeValue(sequenceNodeN, gMonoMass_x100[D] + gElementMass_x100[HYDROGEN], 1);
 		}
 	}
 	return;
@@ -1344,10 +1538,10 @@ void AddCTermResidue(SCHAR *sequenceNodeC, SCHAR *sequenceNodeN)
 *	tag is re-inserted in the appropriate location.
 */
 
-void AddTag(SCHAR *sequenceNodeC, SCHAR *sequenceNodeN)
+void AddTag(tNodeStore *sequenceNodeC, tNodeStore *sequenceNodeN)
 {
 	INT_4 minSuperNode, maxSuperNode, i, j, k, minCTerm, maxCTerm;
-	INT_4 nextNode, oldValue, newValue;
+	INT_4 nextNode, oldValue, newValue, tagMass;
 	REAL_4 superNodeMass, cTermMass;
 	REAL_8 aToMFactor;
 	char test;
@@ -1462,7 +1656,7 @@ void AddTag(SCHAR *sequenceNodeC, SCHAR *sequenceNodeN)
 		test = FALSE;
 		for(j = nextNode + minCTerm; j <= nextNode + maxCTerm; j++)
 		{
-			if(sequenceNodeN[j] != 0)
+			if(NodeValue(sequenceNodeN, j) != 0)
 			{
 				test = TRUE;
 				break;
@@ -1477,15 +1671,16 @@ void AddTag(SCHAR *sequenceNodeC, SCHAR *sequenceNodeN)
 				printf("AddTag:  i >= gGraphLength\n");
 				exit(1);
 			}
-			sequenceNodeN[i] = -1;
-			sequenceNodeC[i] = -1;
+			SetNodeValue(sequenceNodeN, i, -1);
+			SetNodeValue(sequenceNodeC, i, -1);
 		}
 	}
 	
 /*	Now I reassign the node values so that the sequence tag region is cut out.*/
-	for(i = gGraphLength - 1; i > 0; i--)	/*Find the next node above the superNode series*/
+	for(i = LastStoredNode(sequenceNodeN, gGraphLength - 1); i > 0; 
+		i = LastStoredNode(sequenceNodeN, i - 1))	/*Find the next node above the superNode series*/
 	{
-		if(sequenceNodeN[i] == -1)
+		if(NodeValue(sequenceNodeN, i) == -1)
 		{
 			oldValue = i + 1;
 			break;
@@ -1516,18 +1711,28 @@ void AddTag(SCHAR *sequenceNodeC, SCHAR *sequenceNodeN)
 		j++;
 	}
 
-	while(newValue < gGraphLength)
-	{
-		sequenceNodeN[oldValue] = sequenceNodeN[newValue];
-		sequenceNodeC[oldValue] = sequenceNodeC[newValue];
-		newValue++;
-		oldValue++;
-	}
+/*	Shift the nodes above oldValue down by the tag mass.  Only the nodes that are set, or that 
+*	have a set node the tag mass above them, need to be visited.*/
+	tagMass = newValue - oldValue;
 	while(oldValue < gGraphLength)
 	{
-		sequenceNodeN[oldValue] = 0;
-		sequenceNodeC[oldValue] = 0;
-		oldValue++;
+		newValue = oldValue + tagMass;
+		if(newValue < gGraphLength)
+		{
+			SetNodeValue(sequenceNodeN, oldValue, NodeValue(sequenceNodeN, newValue));
+			SetNodeValue(sequenceNodeC, oldValue, NodeValue(sequenceNodeC, newValue));
+		}
+		else
+		{
+			SetNodeValue(sequenceNodeN, oldValue, 0);
+			SetNodeValue(sequenceNodeC, oldValue, 0);
+		}
+		newValue = NextNodeOfEither(sequenceNodeN, sequenceNodeC, newValue + 1);
+		oldValue = NextNodeOfEither(sequenceNodeN, sequenceNodeC, oldValue + 1);
+		if(newValue < gGraphLength && newValue - tagMass < oldValue)
+		{
+			oldValue = newValue - tagMass;
+		}
 	}
 	
 /*	Reset the peptideMW to reflect the removal of the sequence tag mass.*/
@@ -1558,7 +1763,7 @@ void AddTag(SCHAR *sequenceNodeC, SCHAR *sequenceNodeN)
 *	corresponding y ion are counted. 
 */
 
-void FindTrypticY17Ions(struct MSData *firstMassPtr, SCHAR *sequenceNodeC)
+void FindTrypticY17Ions(struct MSData *firstMassPtr, tNodeStore *sequenceNodeC)
 {
 	struct MSData *currPtr;
 	INT_4 i, j, testForChar;
@@ -1669,9 +1874,9 @@ void FindTrypticY17Ions(struct MSData *firstMassPtr, SCHAR *sequenceNodeC)
 				}
 				for(j = y17MassMin; j <= y17MassMax; j++)
 				{
-					if(sequenceNodeC[j] != 0)
+					if(NodeValue(sequenceNodeC, j) != 0)
 					{
-						testForChar = sequenceNodeC[j];
+						testForChar = NodeValue(sequenceNodeC, j);
 						if(i <= mostLikelyFragCharge)
 						{
 							testForChar += (INT_4)gWeightedIonValues.y_minus17or18;
@@ -1682,11 +1887,11 @@ void FindTrypticY17Ions(struct MSData *firstMassPtr, SCHAR *sequenceNodeC)
 						}
 						if(testForChar < 127 && testForChar > -127)
 						{
-							sequenceNodeC[j] = testForChar;
+							SetNodeValue(sequenceNodeC, j, testForChar);
 						}
 						else
 						{
-							sequenceNodeC[j] = 63;
+							SetNodeValue(sequenceNodeC, j, 63);
 						}
 					}
 				}
@@ -1706,7 +1911,7 @@ void FindTrypticY17Ions(struct MSData *firstMassPtr, SCHAR *sequenceNodeC)
 *	additional value of gWeightedIonValues.y.  
 */
 
-void FindTrypticYIons(struct MSData *firstMassPtr, SCHAR *sequenceNodeC)
+void FindTrypticYIons(struct MSData *firstMassPtr, tNodeStore *sequenceNodeC)
 {
 	struct MSData *currPtr;
 	INT_4 yMassMin, yMassMax;
@@ -1815,7 +2020,7 @@ void FindTrypticYIons(struct MSData *firstMassPtr, SCHAR *sequenceNodeC)
 				}
 				for(j = yMassMin; j <= yMassMax; j++)
 				{
-					testForChar = sequenceNodeC[j];	/*make sure value fits in a char*/
+					testForChar = NodeValue(sequenceNodeC, j);	/*make sure value fits in a char*/
 					if(i <= mostLikelyFragCharge)
 					{
 						testForChar += (INT_4)gWeightedIonValues.y;
@@ -1826,11 +2031,11 @@ void FindTrypticYIons(struct MSData *firstMassPtr, SCHAR *sequenceNodeC)
 					}
 					if(testForChar < 127 && testForChar > -127)
 					{
-						sequenceNodeC[j] = testForChar;
+						SetNodeValue(sequenceNodeC, j, testForChar);
 					}
 					else
 					{
-						sequenceNodeC[j] = 63;
+						SetNodeValue(sequenceNodeC, j, 63);
 					}
 				}
 			}
@@ -1845,32 +2050,32 @@ void FindTrypticYIons(struct MSData *firstMassPtr, SCHAR *sequenceNodeC)
 *	for that node would be less than gWeightedIonValues.y.  I remove these from the list here.
 */
 	firstNode = 0;
-	for(i = 0; i < gGraphLength; i++)	
+	for(i = NextStoredNode(sequenceNodeC, 0); i < gGraphLength; i = NextStoredNode(sequenceNodeC, i + 1))	
 	{
 		if(firstNode == 0)
 		{
-			if(sequenceNodeC[i] != 0)
+			if(NodeValue(sequenceNodeC, i) != 0)
 			{
 				firstNode = i;	/*find the N-terminus*/
 			}
 		}
 		/*if +2 y ion present indicating N-terminal amino acid, then it will have
 		a node value less than the max*/
-		if(sequenceNodeC[i] > 0 && sequenceNodeC[i] < gWeightedIonValues.y && i != firstNode)
+		if(NodeValue(sequenceNodeC, i) > 0 && NodeValue(sequenceNodeC, i) < gWeightedIonValues.y && i != firstNode)
 		{
 			massDiff = i - firstNode;
 			for(j = 0; j < gAminoAcidNumber; j++)
 			{
 				if(massDiff == gGapList[j])
 				{
-					sequenceNodeC[i] = gWeightedIonValues.y;	/*give it higher value so that
+					SetNodeValue(sequenceNodeC, i, gWeightedIonValues.y);	/*give it higher value so that
 																it can be retained below*/
 				}
 			}
 		}
-		if(sequenceNodeC[i] < gWeightedIonValues.y)
+		if(NodeValue(sequenceNodeC, i) < gWeightedIonValues.y)
 		{
-			sequenceNodeC[i] = 0;
+			SetNodeValue(sequenceNodeC, i, 0);
 		}
 	}
 
@@ -1885,7 +2090,7 @@ void FindTrypticYIons(struct MSData *firstMassPtr, SCHAR *sequenceNodeC)
 *	corresponding a ion are counted. 
 */
 
-void FindTrypticA17Ions(struct MSData *firstMassPtr, SCHAR *sequenceNodeN, char *ionPresent)
+void FindTrypticA17Ions(struct MSData *firstMassPtr, tNodeStore *sequenceNodeN, tNodeStore *ionPresent)
 {
 	struct MSData *currPtr;
 	INT_4 a17MassMin, a17MassMax, i, j, testForChar;
@@ -1966,9 +2171,9 @@ void FindTrypticA17Ions(struct MSData *firstMassPtr, SCHAR *sequenceNodeN, char
 				}
 				for(j = a17MassMin; j <= a17MassMax; j++)
 				{
-					if(ionPresent[j - 28 * gMultiplier] != 0)
+					if(NodeValue(ionPresent, j - 28 * gMultiplier) != 0)
 					{
-						testForChar = sequenceNodeN[j];
+						testForChar = NodeValue(sequenceNodeN, j);
 						if(i <= mostLikelyFragCharge)
 						{
 							if(a17Mass < 350 * gMultiplier)
@@ -1993,11 +2198,11 @@ void FindTrypticA17Ions(struct MSData *firstMassPtr, SCHAR *sequenceNodeN, char
 						}
 						if(testForChar < 127 && testForChar > -127)
 						{
-							sequenceNodeN[j] = testForChar;
+							SetNodeValue(sequenceNodeN, j, testForChar);
 						}
 						else
 						{
-							sequenceNodeN[j] = 63;
+							SetNodeValue(sequenceNodeN, j, 63);
 						}
 					}
 				}
@@ -2018,7 +2223,7 @@ void FindTrypticA17Ions(struct MSData *firstMassPtr, SCHAR *sequenceNodeN, char
 *	placed in the array ionPresent at the nominal mass of the a ion.
 */
 
-void FindTrypticAIons(struct MSData *firstMassPtr, SCHAR *sequenceNodeN, char *ionPresent)
+void FindTrypticAIons(struct MSData *firstMassPtr, tNodeStore *sequenceNodeN, tNodeStore *ionPresent)
 {
 	struct MSData *currPtr;
 	INT_4 aMassMin, aMassMax, i, j, testForChar;
@@ -2106,9 +2311,9 @@ when deciding if there are any a-17 ions to be included in the scores for the no
 				}
 				for(j = aMassMin; j <= aMassMax; j++)
 				{
-					if(sequenceNodeN[j] != 0)
+					if(NodeValue(sequenceNodeN, j) != 0)
 					{
-						testForChar = sequenceNodeN[j];	/*make sure value fits in a char*/
+						testForChar = NodeValue(sequenceNodeN, j);	/*make sure value fits in a char*/
 						if(i <= mostLikelyFragCharge)
 						{
 							if(aMass < 350 * gMultiplier)
@@ -2133,13 +2338,13 @@ when deciding if there are any a-17 ions to be included in the scores for the no
 						}
 						if(testForChar < 127 && testForChar > -127)
 						{
-							sequenceNodeN[j] = testForChar;
+							SetNodeValue(sequenceNodeN, j, testForChar);
 						}
 						else
 						{
-							sequenceNodeN[j] = 63;
+							SetNodeValue(sequenceNodeN, j, 63);
 						}
-						ionPresent[j - 28 * gMultiplier] = 1;	/*The a ion is found.*/
+						SetNodeValue(ionPresent, j - 28 * gMultiplier, 1);	/*The a ion is found.*/
 					}
 				}
 			}
@@ -2158,7 +2363,7 @@ when deciding if there are any a-17 ions to be included in the scores for the no
 *	corresponding b ion are counted. 
 */
 
-void FindTrypticB17Ions(struct MSData *firstMassPtr, SCHAR *sequenceNodeN)
+void FindTrypticB17Ions(struct MSData *firstMassPtr, tNodeStore *sequenceNodeN)
 {
 	struct MSData *currPtr;
 	INT_4 b17MassMin, b17MassMax, i, j, testForChar;
@@ -2242,8 +2447,8 @@ void FindTrypticB17Ions(struct MSData *firstMassPtr, SCHAR *sequenceNodeN)
 				}
 				for(j = b17MassMin; j <= b17MassMax; j++)
 				{
-					testForChar = sequenceNodeN[j];	/*make sure value fits in a char*/
-					if(sequenceNodeN[j] != 0)
+					testForChar = NodeValue(sequenceNodeN, j);	/*make sure value fits in a char*/
+					if(NodeValue(sequenceNodeN, j) != 0)
 					{
 						if(i <= mostLikelyFragCharge)	/*Charge state of the fragment is ok.*/
 						{
@@ -2269,11 +2474,11 @@ void FindTrypticB17Ions(struct MSData *firstMassPtr, SCHAR *sequenceNodeN)
 						}
 						if(testForChar < 127 && testForChar > -127)
 						{
-							sequenceNodeN[j] = testForChar;
+							SetNodeValue(sequenceNodeN, j, testForChar);
 						}
 						else
 						{
-							sequenceNodeN[j] = 63;
+							SetNodeValue(sequenceNodeN, j, 63);
 						}
 					}
 				}
@@ -2410,7 +2615,7 @@ char IsThisPossible(REAL_4 bMass, INT_4 currentCharge)
 *	additional value of gWeightedIonValues.b.  
 */
 
-void FindTrypticBIons(struct MSData *firstMassPtr, SCHAR *sequenceNodeN)
+void FindTrypticBIons(struct MSData *firstMassPtr, tNodeStore *sequenceNodeN)
 {
 	struct MSData *currPtr;
 	INT_4 bMassMin, bMassMax, i, j, testForChar;
@@ -2502,7 +2707,7 @@ void FindTrypticBIons(struct MSData *firstMassPtr, SCHAR *sequenceNodeN)
 				for(j = bMassMin; j <= bMassMax; j++)
 				{
 				
-					testForChar = sequenceNodeN[j];	/*test to make sure the value fits in a char*/
+					testForChar = NodeValue(sequenceNodeN, j);	/*test to make sure the value fits in a char*/
 					
 					if(i <= mostLikelyFragCharge)
 					{
@@ -2528,11 +2733,11 @@ void FindTrypticBIons(struct MSData *firstMassPtr, SCHAR *sequenceNodeN)
 					}
 					if(testForChar < 127 && testForChar > -127)
 					{
-						sequenceNodeN[j] = testForChar;
+						SetNodeValue(sequenceNodeN, j, testForChar);
 					}
 					else
 					{
-						sequenceNodeN[j] = 63;	/*if 63 is in seqNodeN and C then sum is still <127*/
+						SetNodeValue(sequenceNodeN, j, 63);	/*if 63 is in seqNodeN and C then sum is still <127*/
 					}
 				}
 			}
@@ -2546,11 +2751,11 @@ void FindTrypticBIons(struct MSData *firstMassPtr, SCHAR *sequenceNodeN)
 *	charged fragment, but the corresponding singly charged ion was absent, then the value
 *	for that node would be less than gWeightedIonValues.y.  I remove these from the list here.
 */
-	for(i = 0; i < gGraphLength; i++)	
+	for(i = NextStoredNode(sequenceNodeN, 0); i < gGraphLength; i = NextStoredNode(sequenceNodeN, i + 1))	
 	{
-		if(sequenceNodeN[i] < gWeightedIonValues.b)
+		if(NodeValue(sequenceNodeN, i) < gWeightedIonValues.b)
 		{
-			sequenceNodeN[i] = 0;
+			SetNodeValue(sequenceNodeN, i, 0);
 		}
 	}
 
@@ -2570,27 +2775,12 @@ void FindTrypticBIons(struct MSData *firstMassPtr, SCHAR *sequenceNodeN)
 *	
 */
 
-void TrypticTemplate(struct MSData *firstMassPtr, SCHAR *sequenceNodeC, 
-					SCHAR *sequenceNodeN)
+void TrypticTemplate(struct MSData *firstMassPtr, tNodeStore *sequenceNodeC, 
+					tNodeStore *sequenceNodeN)
 {
-	char *ionPresent;
-	INT_4 i;
+	tNodeStore *ionPresent;
 	
-	ionPresent = (char *) malloc(gGraphLength * sizeof(char));	/*Will contain C-terminal evidence.*/
-	if(ionPresent == NULL)
-	{
-		printf("TrypticTemplate:  Out of memory");
-		exit(1);
-	}
-
-	
-
-	
-	for(i = 0; i < gGraphLength; i++)	/*Init this array to zero.  These arrays are used to 
-										keep track of where the a ions are.*/
-	{
-		ionPresent[i] = 0;
-	}
+	ionPresent = CreateNodeStore(sizeof(SCHAR));	/*Used to keep track of where the a ions are.*/
 	
 	FindTrypticBIons(firstMassPtr, sequenceNodeN);
 				
@@ -2604,7 +2794,7 @@ void TrypticTemplate(struct MSData *firstMassPtr, SCHAR *sequenceNodeC,
 						
 	FindTrypticY17Ions(firstMassPtr, sequenceNodeC);
 	
-	free(ionPresent);
+	DisposeNodeStore(ionPresent);
 	
 	return;
 }
@@ -2618,29 +2808,25 @@ void TrypticTemplate(struct MSData *firstMassPtr, SCHAR *sequenceNodeC,
 *	value.  There may be more than one C-terminal node, depending on the mass and the error.
 */
 
-void SequenceNodeInit(SCHAR *sequenceNode, SCHAR *sequenceNodeC,
-						SCHAR *sequenceNodeN)
+void SequenceNodeInit(tNodeStore *sequenceNode, tNodeStore *sequenceNodeC,
+						tNodeStore *sequenceNodeN)
 {
 	INT_4 i, firstNode;
 	REAL_4 lastNode;
 	REAL_8 aToMFactor;
 	INT_4 lastNodeHigh, lastNodeLow;
 
-	for(i = 0; i < gGraphLength; i++)	/*Initialize sequenceNode to zero's.*/
-	{
-		sequenceNode[i] = 0;
-		sequenceNodeC[i] = 0;
-		sequenceNodeN[i] = 0;
-
-	}
+	ClearNodeStore(sequenceNode);	/*Initialize sequenceNode to zero's.*/
+	ClearNodeStore(sequenceNodeC);
+	ClearNodeStore(sequenceNodeN);
 	
 /*	Find the N-terminal node.  This will equal the nominal mass of the N-terminal group R-NH-.*/
 
 	firstNode = gParam.modifiedNTerm;
 
-	sequenceNodeC[firstNode] = N_NODE_VALUE;	/*Give the N-terminal node an arbitrary value.*/
-	sequenceNodeN[firstNode] = N_NODE_VALUE;
-	sequenceNode[firstNode] = sequenceNodeC[firstNode] + sequenceNodeN[firstNode];
+	SetNodeValue(sequenceNodeC, firstNode, N_NODE_VALUE);	/*Give the N-terminal node an arbitrary value.*/
+	SetNodeValue(sequenceNodeN, firstNode, N_NODE_VALUE);
+	SetNodeValue(sequenceNode, firstNode, NodeValue(sequenceNodeC, firstNode) + NodeValue(sequenceNodeN, firstNode));
 	
 /*Figure out what the C-terminal node(s) are.*/
 
@@ -2677,25 +2863,25 @@ void SequenceNodeInit(SCHAR *sequenceNode, SCHAR *sequenceNodeC,
 		printf("SequenceNodeInit:  lastNodeHigh >= gGraphLength\n");
 		exit(1);
 	}
-	sequenceNodeN[lastNodeHigh] = C_NODE_VALUE;
-	sequenceNodeC[lastNodeHigh] = C_NODE_VALUE;
-	sequenceNode[lastNodeHigh] = sequenceNodeN[lastNodeHigh] + sequenceNodeC[lastNodeHigh];
+	SetNodeValue(sequenceNodeN, lastNodeHigh, C_NODE_VALUE);
+	SetNodeValue(sequenceNodeC, lastNodeHigh, C_NODE_VALUE);
+	SetNodeValue(sequenceNode, lastNodeHigh, NodeValue(sequenceNodeN, lastNodeHigh) + NodeValue(sequenceNodeC, lastNodeHigh));
 
 /*Next I'll find the lowest mass node.*/
 	lastNode = lastNode - gParam.peptideErr - gParam.peptideErr;
 	lastNodeLow = lastNode;	/*Truncate after rounding up.*/
-	sequenceNodeN[lastNodeLow] = C_NODE_VALUE;
-	sequenceNodeC[lastNodeLow] = C_NODE_VALUE;
-	sequenceNode[lastNodeLow] = sequenceNodeN[lastNodeLow] + sequenceNodeC[lastNodeLow];
+	SetNodeValue(sequenceNodeN, lastNodeLow, C_NODE_VALUE);
+	SetNodeValue(sequenceNodeC, lastNodeLow, C_NODE_VALUE);
+	SetNodeValue(sequenceNode, lastNodeLow, NodeValue(sequenceNodeN, lastNodeLow) + NodeValue(sequenceNodeC, lastNodeLow));
 
 /*Now fill in the middle (if there is anything in the middle.*/
 	if((lastNodeHigh - lastNodeLow) > 1)
 	{
 		for(i = lastNodeLow; i <= lastNodeHigh; i++)
 		{
-			sequenceNodeN[i] = C_NODE_VALUE;
-			sequenceNodeC[i] = C_NODE_VALUE;
-			sequenceNode[i] = sequenceNodeC[i] + sequenceNodeN[i];
+			SetNodeValue(sequenceNodeN, i, C_NODE_VALUE);
+			SetNodeValue(sequenceNodeC, i, C_NODE_VALUE);
+			SetNodeValue(sequenceNode, i, NodeValue(sequenceNodeC, i) + NodeValue(sequenceNodeN, i));
 		}
 	}
 
@@ -2703,6 +2889,42 @@ void SequenceNodeInit(SCHAR *sequenceNode, SCHAR *sequenceNodeC,
 }
 
 
+/**********************************OccupiedNodeList******************************************
+*
+*	OccupiedNodeList returns the list of nodes where sequenceNodeC or sequenceNodeN is
+*	non-zero, in increasing order.
+*/
+
+tNodeList *OccupiedNodeList(tNodeStore *sequenceNodeC, tNodeStore *sequenceNodeN)
+{
+	INT_4 i;
+	tNodeList *nodeList;
+	
+	nodeList = (tNodeList *) CreateNewList(sizeof(INT_4), 1000, 1000);
+	if(nodeList == NULL)
+	{
+		printf("OccupiedNodeList:  Out of memory");
+		exit(1);
+	}
+	
+	for(i = NextNodeOfEither(sequenceNodeC, sequenceNodeN, 0); i < gGraphLength; 
+		i = NextNodeOfEither(sequenceNodeC, sequenceNodeN, i + 1))
+	{
+		if(NodeValue(sequenceNodeC, i) == 0 && NodeValue(sequenceNodeN, i) == 0)
+		{
+			continue;
+		}
+		if(!AddToList(&i, nodeList))
+		{
+			printf("OccupiedNodeList:  Out of memory");
+			exit(1);
+		}
+	}
+	
+	return(nodeList);
+}
+
+
 /**********************************MakeSequenceGraph******************************************
 *
 *	The general idea here is to assume that each observed ion in the linked list "firstMassPtr"
@@ -2746,8 +2968,8 @@ void SequenceNodeInit(SCHAR *sequenceNode, SCHAR *sequenceNodeC,
 *	- totalIonVal contains the sum of all of the gWeightedIonValues.
 */
 
-void MakeSequenceGraph(struct MSData *firstMassPtr, SCHAR *sequenceNode, 
-                       SCHAR *sequenceNodeC, SCHAR *sequenceNodeN, INT_4 totalIonVal)
+tNodeList *MakeSequenceGraph(struct MSData *firstMassPtr, tNodeStore *sequenceNode, 
+                       tNodeStore *sequenceNodeC, tNodeStore *sequenceNodeN, INT_4 totalIonVal)
 {
 	
 /*	
@@ -2846,5 +3068,10 @@ void MakeSequenceGraph(struct MSData *firstMassPtr, SCHAR *sequenceNode,
 		AddTag(sequenceNodeC, sequenceNodeN);
 	}
 
-	return;
+/*	
+*	The nodes w/ any evidence are listed in increasing order.  SummedNodeScore, GetAutoTag,
+*	and SubsequenceMaker walk this list rather than every mass up to gGraphLength.
+*/
+
+	return(OccupiedNodeList(sequenceNodeC, sequenceNodeN));
 }
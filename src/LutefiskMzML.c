@@ -0,0 +1,923 @@
+/*********************************************************************************************
+Lutefisk is software for de novo sequencing of peptides from tandem mass spectra.
+Copyright (C) 1995  Richard S. Johnson
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+Contact:
+
+Richard S Johnson
+4650 Forest Ave SE
+Mercer Island, WA 98040
+
+jsrichar@alum.mit.edu
+*********************************************************************************************/
+
+
+/*
+	mzML and mzXML files.  These can be several gigabytes, so they are never read in whole; the 
+	file is read a buffer at a time and picked apart a tag at a time (SAX-style), and only the
+	MS2 spectra are kept.  The base64 peak arrays (zlib compressed or not, 32 or 64 bit, either
+	byte order) are decoded straight into a tMSDataList, which ReadCIDFile takes over (CID file
+	type 'Z').  Spectra can be picked by scan number and precursor m/z (see the First Scan, Last 
+	Scan, Min. Precursor m/z and Max. Precursor m/z params).
+
+	In mzML the binary array types are normally given by cvParams in each binaryDataArray; if 
+	they aren't (eg, they are in a referenceableParamGroup), the first array is taken to be the 
+	m/z values and the second the intensities, as 64 bit uncompressed numbers.
+*/
+
+/* ANSI headers */
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zlib.h>
+
+/* Lutefisk headers */
+#include "LutefiskPrototypes.h"
+#include "LutefiskDefinitions.h"
+#include "ListRoutines.h"
+
+/*Definitions for this file*/
+#define MZML_BUFFER_SIZE	65536	/*Number of bytes read from the file at a time*/
+#define MZML_VALUE_LENGTH	256		/*Longest attribute value that is looked at*/
+
+static BOOLEAN FillMzMLBuffer(tMzMLFile *mzmlPtr);
+static BOOLEAN SkipMzMLText(tMzMLFile *mzmlPtr, BOOLEAN keep);
+static BOOLEAN ReadMzMLText(tMzMLFile *mzmlPtr);
+static BOOLEAN NextMzMLTag(tMzMLFile *mzmlPtr, long *offset);
+static BOOLEAN IsMzMLTag(char *tag, char *name);
+static BOOLEAN MzMLAttribute(char *tag, char *name, char *value);
+static void *GrowMzMLBuffer(void *buffer, INT_4 *size, INT_4 needed, INT_4 itemSize);
+static BOOLEAN DecodeMzMLArray(tMzMLFile *mzmlPtr, INT_4 precision, BOOLEAN bigEndian, 
+						BOOLEAN zlib, INT_4 valueNum, REAL_8 **values, INT_4 *valueSize, INT_4 *decodedNum);
+static BOOLEAN WantMzMLSpectrum(tMzMLFile *mzmlPtr, INT_4 msLevel, tMzMLSpectrum *spectrumPtr);
+static tMSDataList *MakeMzMLPeakList(tMzMLFile *mzmlPtr);
+
+
+/******************************IsMzMLFileName*********************************************
+*
+*	Returns TRUE if the file name ends in .mzML or .mzXML (in any case).
+*/
+BOOLEAN IsMzMLFileName(char *fileName)
+{
+	char *extension;
+
+	extension = strrchr(fileName, '.');
+	if (extension == NULL || extension == fileName)
+	{
+		return(FALSE);
+	}
+	if (!strcmp(extension, ".mzML") || !strcmp(extension, ".mzml") || !strcmp(extension, ".MZML")
+		|| !strcmp(extension, ".mzXML") || !strcmp(extension, ".mzxml") || !strcmp(extension, ".MZXML"))
+	{
+		return(TRUE);
+	}
+
+	return(FALSE);
+}
+
+/******************************OpenMzMLFile***********************************************
+*
+*	Opens an mzML or mzXML file, and reads far enough to tell which it is.  The scan number
+*	and precursor m/z filters are taken from paramPtr.  Quits if the file can't be read.
+*/
+tMzMLFile *OpenMzMLFile(char *fileName, tParam *paramPtr)
+{
+	tMzMLFile *mzmlPtr;
+	long offset;
+
+	mzmlPtr = (tMzMLFile *) calloc(1, sizeof(tMzMLFile));
+	if (mzmlPtr == NULL)
+	{
+		printf("OpenMzMLFile:  Out of memory");
+		exit(1);
+	}
+	mzmlPtr->buffer = (char *) malloc(MZML_BUFFER_SIZE);
+	if (mzmlPtr->buffer == NULL)
+	{
+		printf("OpenMzMLFile:  Out of memory");
+		exit(1);
+	}
+	mzmlPtr->firstScan = paramPtr->firstScan;
+	mzmlPtr->lastScan = paramPtr->lastScan;
+	mzmlPtr->minPrecursorMZ = paramPtr->minPrecursorMZ;
+	mzmlPtr->maxPrecursorMZ = paramPtr->maxPrecursorMZ;
+
+	mzmlPtr->fp = fopen(fileName, "rb");
+	if (mzmlPtr->fp == NULL)
+	{
+		printf("Cannot open the CID file '%s'.\n", fileName);
+		exit(1);
+	}
+
+	while (mzmlPtr->format == 0 && NextMzMLTag(mzmlPtr, &offset))
+	{
+		if (IsMzMLTag(mzmlPtr->tag, "mzML"))
+		{
+			mzmlPtr->format = 'L';
+		}
+		else if (IsMzMLTag(mzmlPtr->tag, "mzXML") || IsMzMLTag(mzmlPtr->tag, "msRun"))
+		{
+			mzmlPtr->format = 'X';
+		}
+	}
+	if (mzmlPtr->format == 0)
+	{
+		printf("The CID file '%s' does not look like an mzML or mzXML file.\n", fileName);
+		exit(1);
+	}
+
+	return(mzmlPtr);
+}
+
+/******************************NextMzMLSpectrum*******************************************
+*
+*	Reads on to the end of the next MS2 spectrum that gets past the filters, and fills in 
+*	*spectrumPtr.  If wantPeaks is TRUE, spectrumPtr->peakList is a new list of its peaks 
+*	(which the caller then owns); otherwise the peak arrays are skipped over without being 
+*	decoded, which is much quicker.  Returns FALSE at the end of the file.
+*/
+BOOLEAN NextMzMLSpectrum(tMzMLFile *mzmlPtr, tMzMLSpectrum *spectrumPtr, BOOLEAN wantPeaks)
+{
+	char value[MZML_VALUE_LENGTH], *scanPtr, *tag;
+	long offset;
+	BOOLEAN inSpectrum, found, zlib, bigEndian, decoded, unsupported;
+	INT_4 msLevel, valueNum, arrayNum, precision, i;
+	char arrayType;
+
+	inSpectrum = FALSE;
+	found = FALSE;
+	decoded = TRUE;
+	msLevel = 0;
+	valueNum = 0;
+	arrayNum = 0;
+	precision = 64;
+	zlib = FALSE;
+	bigEndian = FALSE;
+	unsupported = FALSE;
+	arrayType = 0;
+
+	while (NextMzMLTag(mzmlPtr, &offset))
+	{
+		tag = mzmlPtr->tag;
+
+		if ((mzmlPtr->format == 'L' && IsMzMLTag(tag, "spectrum"))
+			|| (mzmlPtr->format == 'X' && IsMzMLTag(tag, "scan")))
+		{
+			/*A new spectrum (in mzXML, an MS2 scan can be inside of the MS1 scan).*/
+			mzmlPtr->spectrumNum++;
+			inSpectrum = (tag[mzmlPtr->tagLength - 1] != '/');
+			decoded = TRUE;
+			msLevel = 0;
+			arrayNum = 0;
+			mzmlPtr->mzValueNum = 0;
+			mzmlPtr->intValueNum = 0;
+			spectrumPtr->scanNum = mzmlPtr->spectrumNum;
+			spectrumPtr->precursorMZ = 0;
+			spectrumPtr->precursorCharge = 0;
+			spectrumPtr->centroided = FALSE;
+			spectrumPtr->offset = offset;
+			spectrumPtr->peakList = NULL;
+
+			if (mzmlPtr->format == 'L')
+			{
+				valueNum = MzMLAttribute(tag, "defaultArrayLength", value) ? atoi(value) : 0;
+				if (MzMLAttribute(tag, "id", value) && (scanPtr = strstr(value, "scan=")) != NULL)
+				{
+					spectrumPtr->scanNum = atoi(scanPtr + 5);
+				}
+				else if (MzMLAttribute(tag, "index", value))
+				{
+					spectrumPtr->scanNum = atoi(value) + 1;
+				}
+			}
+			else
+			{
+				valueNum = MzMLAttribute(tag, "peaksCount", value) ? atoi(value) : 0;
+				if (MzMLAttribute(tag, "num", value))
+				{
+					spectrumPtr->scanNum = atoi(value);
+				}
+				if (MzMLAttribute(tag, "msLevel", value))
+				{
+					msLevel = atoi(value);
+				}
+				if (MzMLAttribute(tag, "centroided", value))
+				{
+					spectrumPtr->centroided = (value[0] == '1');
+				}
+			}
+		}
+		else if (!inSpectrum)
+		{
+			continue;
+		}
+		else if (mzmlPtr->format == 'L')	/*---------------------------- mzML ----*/
+		{
+			if (IsMzMLTag(tag, "cvParam"))
+			{
+				if (!MzMLAttribute(tag, "accession", value))
+				{
+					continue;
+				}
+				if (!strcmp(value, "MS:1000511"))			/*ms level*/
+				{
+					msLevel = MzMLAttribute(tag, "value", value) ? atoi(value) : 0;
+				}
+				else if (!strcmp(value, "MS:1000744"))		/*selected ion m/z*/
+				{
+					spectrumPtr->precursorMZ = MzMLAttribute(tag, "value", value) ? atof(value) : 0;
+				}
+				else if (!strcmp(value, "MS:1000041"))		/*charge state*/
+				{
+					spectrumPtr->precursorCharge = MzMLAttribute(tag, "value", value) ? atoi(value) : 0;
+				}
+				else if (!strcmp(value, "MS:1000127"))		/*centroid spectrum*/
+				{
+					spectrumPtr->centroided = TRUE;
+				}
+				else if (!strcmp(value, "MS:1000521"))		/*32-bit float*/
+				{
+					precision = 32;
+				}
+				else if (!strcmp(value, "MS:1000523"))		/*64-bit float*/
+				{
+					precision = 64;
+				}
+				else if (!strcmp(value, "MS:1000574"))		/*zlib compression*/
+				{
+					zlib = TRUE;
+				}
+				else if (!strcmp(value, "MS:1000576"))		/*no compression*/
+				{
+					zlib = FALSE;
+				}
+				else if (!strcmp(value, "MS:1000514"))		/*m/z array*/
+				{
+					arrayType = 'M';
+				}
+				else if (!strcmp(value, "MS:1000515"))		/*intensity array*/
+				{
+					arrayType = 'I';
+				}
+				else if (!strncmp(value, "MS:10023", 8) || !strncmp(value, "MS:10027", 8))
+				{
+					unsupported = TRUE;	/*MS-Numpress and friends*/
+				}
+			}
+			else if (IsMzMLTag(tag, "binaryDataArray"))
+			{
+				precision = 64;
+				zlib = FALSE;
+				unsupported = FALSE;
+				arrayType = 0;
+				if (MzMLAttribute(tag, "arrayLength", value))
+				{
+					valueNum = atoi(value);
+				}
+			}
+			else if (IsMzMLTag(tag, "binary"))
+			{
+				arrayNum++;
+				if (arrayType == 0)
+				{
+					arrayType = (arrayNum == 1) ? 'M' : 'I';
+				}
+				if (!wantPeaks || !WantMzMLSpectrum(mzmlPtr, msLevel, spectrumPtr)
+					|| (arrayType != 'M' && arrayType != 'I'))
+				{
+					continue;	/*NextMzMLTag skips the base64 text*/
+				}
+				if (unsupported)
+				{
+					printf("Scan %d uses a compression scheme that can't be read.\n", spectrumPtr->scanNum);
+					decoded = FALSE;
+					continue;
+				}
+				if (tag[mzmlPtr->tagLength - 1] == '/')
+				{
+					mzmlPtr->textLength = 0;	/*<binary/> is an empty array*/
+				}
+				else
+				{
+					ReadMzMLText(mzmlPtr);
+				}
+				if (arrayType == 'M')
+				{
+					decoded = DecodeMzMLArray(mzmlPtr, precision, FALSE, zlib, valueNum, 
+									&mzmlPtr->mzValues, &mzmlPtr->mzValueSize, &mzmlPtr->mzValueNum)
+								&& decoded;
+				}
+				else
+				{
+					decoded = DecodeMzMLArray(mzmlPtr, precision, FALSE, zlib, valueNum, 
+									&mzmlPtr->intValues, &mzmlPtr->intValueSize, &mzmlPtr->intValueNum)
+								&& decoded;
+				}
+			}
+			else if (tag[0] == '/' && IsMzMLTag(tag + 1, "spectrum"))
+			{
+				inSpectrum = FALSE;
+				if (WantMzMLSpectrum(mzmlPtr, msLevel, spectrumPtr))
+				{
+					found = TRUE;
+					break;
+				}
+			}
+		}
+		else	/*------------------------------------------------------------- mzXML ----*/
+		{
+			if (IsMzMLTag(tag, "precursorMz"))
+			{
+				if (MzMLAttribute(tag, "precursorCharge", value))
+				{
+					spectrumPtr->precursorCharge = atoi(value);
+				}
+				ReadMzMLText(mzmlPtr);
+				spectrumPtr->precursorMZ = atof(mzmlPtr->text);
+			}
+			else if (IsMzMLTag(tag, "peaks"))
+			{
+				if (!wantPeaks || !WantMzMLSpectrum(mzmlPtr, msLevel, spectrumPtr))
+				{
+					continue;
+				}
+				precision = MzMLAttribute(tag, "precision", value) ? atoi(value) : 32;
+				bigEndian = !(MzMLAttribute(tag, "byteOrder", value) && !strcmp(value, "little"));
+				zlib = MzMLAttribute(tag, "compressionType", value) && !strcmp(value, "zlib");
+				if ((MzMLAttribute(tag, "contentType", value) || MzMLAttribute(tag, "pairOrder", value))
+					&& strcmp(value, "m/z-int"))
+				{
+					printf("Scan %d has %s peaks, which can't be read.\n", spectrumPtr->scanNum, value);
+					decoded = FALSE;
+					continue;
+				}
+				if (tag[mzmlPtr->tagLength - 1] == '/')
+				{
+					mzmlPtr->textLength = 0;
+				}
+				else
+				{
+					ReadMzMLText(mzmlPtr);
+				}
+
+				/*The m/z and intensity values alternate; split them up.*/
+				decoded = DecodeMzMLArray(mzmlPtr, precision, bigEndian, zlib, 2 * valueNum, 
+								&mzmlPtr->intValues, &mzmlPtr->intValueSize, &mzmlPtr->intValueNum);
+				mzmlPtr->mzValues = (REAL_8 *) GrowMzMLBuffer(mzmlPtr->mzValues, &mzmlPtr->mzValueSize,
+										mzmlPtr->intValueNum / 2, sizeof(REAL_8));
+				mzmlPtr->mzValueNum = mzmlPtr->intValueNum / 2;
+				for (i = 0; i < mzmlPtr->mzValueNum; i++)
+				{
+					mzmlPtr->mzValues[i] = mzmlPtr->intValues[2 * i];
+					mzmlPtr->intValues[i] = mzmlPtr->intValues[2 * i + 1];
+				}
+				mzmlPtr->intValueNum = mzmlPtr->mzValueNum;
+			}
+			else if (tag[0] == '/' && IsMzMLTag(tag + 1, "scan"))
+			{
+				inSpectrum = FALSE;
+				if (WantMzMLSpectrum(mzmlPtr, msLevel, spectrumPtr))
+				{
+					found = TRUE;
+					break;
+				}
+			}
+		}
+	}
+
+	if (!found)
+	{
+		return(FALSE);	/*ran off the end of the file*/
+	}
+
+	if (wantPeaks)
+	{
+		if (decoded)
+		{
+			spectrumPtr->peakList = MakeMzMLPeakList(mzmlPtr);
+		}
+		else
+		{
+			spectrumPtr->peakList = (tMSDataList *) CreateNewList(sizeof(tMSData), 1, 1);
+			if (spectrumPtr->peakList == NULL)
+			{
+				printf("NextMzMLSpectrum:  Out of memory");
+				exit(1);
+			}
+		}
+	}
+
+	return(TRUE);
+}
+
+/******************************SeekMzMLSpectrum*******************************************
+*
+*	Moves to the spectrum whose start tag is at offset (from tMzMLSpectrum.offset), so that
+*	NextMzMLSpectrum reads it next.
+*/
+void SeekMzMLSpectrum(tMzMLFile *mzmlPtr, long offset)
+{
+	if (fseek(mzmlPtr->fp, offset, SEEK_SET) != 0)
+	{
+		printf("SeekMzMLSpectrum:  Cannot move to %ld in the CID file.\n", offset);
+		exit(1);
+	}
+	mzmlPtr->bufferOffset = offset;
+	mzmlPtr->bufferLength = 0;
+	mzmlPtr->bufferPosition = 0;
+
+	return;
+}
+
+/******************************CloseMzMLFile**********************************************
+*
+*	Closes the file and frees the buffers.
+*/
+void CloseMzMLFile(tMzMLFile *mzmlPtr)
+{
+	if (mzmlPtr == NULL)
+	{
+		return;
+	}
+	fclose(mzmlPtr->fp);
+	free(mzmlPtr->buffer);
+	free(mzmlPtr->tag);
+	free(mzmlPtr->text);
+	free(mzmlPtr->bytes);
+	free(mzmlPtr->inflated);
+	free(mzmlPtr->mzValues);
+	free(mzmlPtr->intValues);
+	free(mzmlPtr);
+
+	return;
+}
+
+/******************************RunMzMLFile************************************************
+*
+*	Sequences each MS2 spectrum in the mzML or mzXML file fileName in turn, as it is read.  
+*	Each one gets its own search context (a copy of configPtr) and its own output file.  A 
+*	spectrum with no usable data is reported and skipped, rather than ending the run.
+*/
+void RunMzMLFile(tSearchContext *configPtr, char *fileName)
+{
+	tMzMLFile *mzmlPtr;
+	tMzMLSpectrum spectrum;
+	tSearchContext *searchPtr;
+	INT_4 spectrumNum;
+
+	mzmlPtr = OpenMzMLFile(fileName, &configPtr->param);
+
+	spectrumNum = 0;
+	while (NextMzMLSpectrum(mzmlPtr, &spectrum, TRUE))
+	{
+		spectrumNum++;
+		searchPtr = NewSearchContext(configPtr);
+		strncpy(searchPtr->param.cidFilename, fileName, sizeof(searchPtr->param.cidFilename) - 1);
+		searchPtr->param.CIDfileType = 'Z';
+		if (spectrum.centroided)
+		{
+			searchPtr->param.centroidOrProfile = 'C';
+		}
+		searchPtr->cidPeakList = spectrum.peakList;
+		searchPtr->cidPrecursorMZ = spectrum.precursorMZ;
+		searchPtr->cidPrecursorCharge = spectrum.precursorCharge;
+		searchPtr->cidBlockNum = spectrum.scanNum;
+
+		if (!Run(searchPtr))
+		{
+			printf("No data could be read from scan %d of %s.\n", spectrum.scanNum, fileName);
+		}
+		FreeSearchContext(searchPtr);
+	}
+
+	if (spectrumNum == 0)
+	{
+		printf("There are no MS2 scans to sequence in %s.\n", fileName);
+	}
+	CloseMzMLFile(mzmlPtr);
+
+	return;
+}
+
+/******************************FillMzMLBuffer*********************************************
+*
+*	Reads the next piece of the file into the buffer.  Returns FALSE at the end of the file.
+*/
+static BOOLEAN FillMzMLBuffer(tMzMLFile *mzmlPtr)
+{
+	mzmlPtr->bufferOffset += mzmlPtr->bufferLength;
+	mzmlPtr->bufferLength = fread(mzmlPtr->buffer, 1, MZML_BUFFER_SIZE, mzmlPtr->fp);
+	mzmlPtr->bufferPosition = 0;
+
+	return(mzmlPtr->bufferLength > 0);
+}
+
+/******************************SkipMzMLText***********************************************
+*
+*	Moves up to the next '<'.  If keep is TRUE, the text passed over is added to the end of
+*	mzmlPtr->text.  Returns FALSE if the end of the file comes first.
+*/
+static BOOLEAN SkipMzMLText(tMzMLFile *mzmlPtr, BOOLEAN keep)
+{
+	char *start, *found;
+	INT_4 length;
+
+	while (1)
+	{
+		if (mzmlPtr->bufferPosition >= mzmlPtr->bufferLength && !FillMzMLBuffer(mzmlPtr))
+		{
+			return(FALSE);
+		}
+		start = mzmlPtr->buffer + mzmlPtr->bufferPosition;
+		length = mzmlPtr->bufferLength - mzmlPtr->bufferPosition;
+		found = (char *) memchr(start, '<', length);
+		if (found != NULL)
+		{
+			length = found - start;
+		}
+		if (keep)
+		{
+			mzmlPtr->text = (char *) GrowMzMLBuffer(mzmlPtr->text, &mzmlPtr->textSize, 
+										mzmlPtr->textLength + length + 1, sizeof(char));
+			memcpy(mzmlPtr->text + mzmlPtr->textLength, start, length);
+			mzmlPtr->textLength += length;
+			mzmlPtr->text[mzmlPtr->textLength] = 0;
+		}
+		mzmlPtr->bufferPosition += length;
+		if (found != NULL)
+		{
+			return(TRUE);
+		}
+	}
+}
+
+/******************************ReadMzMLText***********************************************
+*
+*	Reads the text after the last tag into mzmlPtr->text.
+*/
+static BOOLEAN ReadMzMLText(tMzMLFile *mzmlPtr)
+{
+	mzmlPtr->textLength = 0;
+	mzmlPtr->text = (char *) GrowMzMLBuffer(mzmlPtr->text, &mzmlPtr->textSize, 1, sizeof(char));
+	mzmlPtr->text[0] = 0;
+
+	return(SkipMzMLText(mzmlPtr, TRUE));
+}
+
+/******************************NextMzMLTag************************************************
+*
+*	Skips to the next tag, and puts what is between the < and > into mzmlPtr->tag.  The 
+*	position of the < in the file is put in *offset.  Comments, processing instructions, and 
+*	declarations are passed over.  Returns FALSE at the end of the file.
+*/
+static BOOLEAN NextMzMLTag(tMzMLFile *mzmlPtr, long *offset)
+{
+	INT_4 c, quote;
+	BOOLEAN comment;
+
+	while (1)
+	{
+		if (!SkipMzMLText(mzmlPtr, FALSE))
+		{
+			return(FALSE);
+		}
+		*offset = mzmlPtr->bufferOffset + mzmlPtr->bufferPosition;
+		mzmlPtr->bufferPosition++;	/*the '<'*/
+
+		mzmlPtr->tagLength = 0;
+		quote = 0;
+		comment = FALSE;
+		while (1)
+		{
+			if (mzmlPtr->bufferPosition >= mzmlPtr->bufferLength && !FillMzMLBuffer(mzmlPtr))
+			{
+				return(FALSE);
+			}
+			c = mzmlPtr->buffer[mzmlPtr->bufferPosition++];
+
+			if (comment)
+			{
+				/*Comments end with -->, and can have anything in them.*/
+				if (c == '>' && mzmlPtr->tagLength >= 5 
+					&& !strncmp(mzmlPtr->tag + mzmlPtr->tagLength - 2, "--", 2))
+				{
+					break;
+				}
+			}
+			else if (quote != 0)
+			{
+				if (c == quote)
+				{
+					quote = 0;
+				}
+			}
+			else if (c == '"' || c == '\'')
+			{
+				quote = c;
+			}
+			else if (c == '>')
+			{
+				break;
+			}
+
+			mzmlPtr->tag = (char *) GrowMzMLBuffer(mzmlPtr->tag, &mzmlPtr->tagSize, 
+										mzmlPtr->tagLength + 2, sizeof(char));
+			mzmlPtr->tag[mzmlPtr->tagLength++] = c;
+			if (mzmlPtr->tagLength == 3 && !strncmp(mzmlPtr->tag, "!--", 3))
+			{
+				comment = TRUE;
+			}
+		}
+		mzmlPtr->tag[mzmlPtr->tagLength] = 0;
+
+		if (mzmlPtr->tagLength > 0 && mzmlPtr->tag[0] != '?' && mzmlPtr->tag[0] != '!')
+		{
+			return(TRUE);
+		}
+	}
+}
+
+/******************************IsMzMLTag**************************************************
+*
+*	Returns TRUE if tag is a start (or empty) tag called name.
+*/
+static BOOLEAN IsMzMLTag(char *tag, char *name)
+{
+	INT_4 length;
+
+	length = strlen(name);
+	if (strncmp(tag, name, length))
+	{
+		return(FALSE);
+	}
+
+	return(tag[length] == 0 || tag[length] == '/' || isspace((unsigned char) tag[length]));
+}
+
+/******************************MzMLAttribute**********************************************
+*
+*	Copies the value of the attribute called name in tag into value (which is at least
+*	MZML_VALUE_LENGTH long).  Returns FALSE if tag hasn't got one.
+*/
+static BOOLEAN MzMLAttribute(char *tag, char *name, char *value)
+{
+	char *found, *start;
+	char quote;
+	INT_4 i, length;
+
+	length = strlen(name);
+	found = tag;
+	while ((found = strstr(found, name)) != NULL)
+	{
+		start = found + length;
+		if (found > tag && isspace((unsigned char) *(found - 1)))
+		{
+			while (isspace((unsigned char) *start))
+			{
+				start++;
+			}
+			if (*start == '=')
+			{
+				start++;
+				while (isspace((unsigned char) *start))
+				{
+					start++;
+				}
+				quote = *start;
+				if (quote == '"' || quote == '\'')
+				{
+					start++;
+					for (i = 0; i < MZML_VALUE_LENGTH - 1 && start[i] != quote && start[i] != 0; i++)
+					{
+						value[i] = start[i];
+					}
+					value[i] = 0;
+					return(TRUE);
+				}
+			}
+		}
+		found = start;
+	}
+
+	return(FALSE);
+}
+
+/******************************GrowMzMLBuffer*********************************************
+*
+*	Makes sure that buffer (currently *size items of itemSize bytes) can hold needed items,
+*	and returns it (it may have moved).
+*/
+static void *GrowMzMLBuffer(void *buffer, INT_4 *size, INT_4 needed, INT_4 itemSize)
+{
+	if (needed <= *size && buffer != NULL)
+	{
+		return(buffer);
+	}
+	if (needed < 2 * *size)
+	{
+		needed = 2 * *size;
+	}
+	if (needed < 256)
+	{
+		needed = 256;
+	}
+	buffer = realloc(buffer, (size_t) needed * itemSize);
+	if (buffer == NULL)
+	{
+		printf("GrowMzMLBuffer:  Out of memory");
+		exit(1);
+	}
+	*size = needed;
+
+	return(buffer);
+}
+
+/******************************DecodeMzMLArray********************************************
+*
+*	Decodes the base64 text in mzmlPtr->text into *decodedNum numbers in *values.  The numbers
+*	are precision (32 or 64) bit floats, in big or little endian order, and may be zlib 
+*	compressed, in which case valueNum says how many numbers there should be.  Returns FALSE
+*	if the array can't be read.
+*/
+static BOOLEAN DecodeMzMLArray(tMzMLFile *mzmlPtr, INT_4 precision, BOOLEAN bigEndian, 
+						BOOLEAN zlib, INT_4 valueNum, REAL_8 **values, INT_4 *valueSize, INT_4 *decodedNum)
+{
+	static const char base64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	const char *found;
+	unsigned char *data, swapped[8];
+	uLongf inflatedLength;
+	INT_4 i, j, byteNum, width, bits, accumulator;
+	BOOLEAN swap;
+	union
+	{
+		INT_4 i;
+		char c[4];
+	}endianTest;
+	float value32;
+	double value64;
+
+	*decodedNum = 0;
+	if (precision != 32 && precision != 64)
+	{
+		printf("Peak arrays with %d bit numbers can't be read.\n", precision);
+		return(FALSE);
+	}
+	width = precision / 8;
+
+	/*base64 to bytes; anything that isn't base64 (eg, line breaks) is skipped.*/
+	mzmlPtr->bytes = (unsigned char *) GrowMzMLBuffer(mzmlPtr->bytes, &mzmlPtr->bytesSize, 
+										mzmlPtr->textLength * 3 / 4 + 4, sizeof(unsigned char));
+	byteNum = 0;
+	bits = 0;
+	accumulator = 0;
+	for (i = 0; i < mzmlPtr->textLength && mzmlPtr->text[i] != '='; i++)
+	{
+		found = (mzmlPtr->text[i] != 0) ? strchr(base64, mzmlPtr->text[i]) : NULL;
+		if (found == NULL)
+		{
+			continue;
+		}
+		accumulator = ((accumulator << 6) | (found - base64)) & 0xFFFFFF;
+		bits += 6;
+		if (bits >= 8)
+		{
+			bits -= 8;
+			mzmlPtr->bytes[byteNum++] = (accumulator >> bits) & 0xFF;
+		}
+	}
+	data = mzmlPtr->bytes;
+
+	if (zlib && byteNum > 0)
+	{
+		if (valueNum <= 0)
+		{
+			printf("A compressed peak array doesn't say how long it is.\n");
+			return(FALSE);
+		}
+		mzmlPtr->inflated = (unsigned char *) GrowMzMLBuffer(mzmlPtr->inflated, &mzmlPtr->inflatedSize, 
+												valueNum * width, sizeof(unsigned char));
+		inflatedLength = valueNum * width;
+		if (uncompress(mzmlPtr->inflated, &inflatedLength, mzmlPtr->bytes, byteNum) != Z_OK)
+		{
+			printf("A compressed peak array could not be uncompressed.\n");
+			return(FALSE);
+		}
+		data = mzmlPtr->inflated;
+		byteNum = inflatedLength;
+	}
+
+	/*bytes to numbers*/
+	endianTest.i = 1;
+	swap = (bigEndian == (endianTest.c[0] == 1));
+	*decodedNum = byteNum / width;
+	*values = (REAL_8 *) GrowMzMLBuffer(*values, valueSize, *decodedNum, sizeof(REAL_8));
+	for (i = 0; i < *decodedNum; i++)
+	{
+		for (j = 0; j < width; j++)
+		{
+			swapped[j] = swap ? data[i * width + width - 1 - j] : data[i * width + j];
+		}
+		if (width == 4)
+		{
+			memcpy(&value32, swapped, 4);
+			(*values)[i] = value32;
+		}
+		else
+		{
+			memcpy(&value64, swapped, 8);
+			(*values)[i] = value64;
+		}
+	}
+
+	return(TRUE);
+}
+
+/******************************WantMzMLSpectrum*******************************************
+*
+*	Returns TRUE if the spectrum is an MS2 spectrum that gets past the scan number and 
+*	precursor m/z filters.
+*/
+static BOOLEAN WantMzMLSpectrum(tMzMLFile *mzmlPtr, INT_4 msLevel, tMzMLSpectrum *spectrumPtr)
+{
+	if (msLevel != 2)
+	{
+		return(FALSE);
+	}
+	if ((mzmlPtr->firstScan > 0 && spectrumPtr->scanNum < mzmlPtr->firstScan)
+		|| (mzmlPtr->lastScan > 0 && spectrumPtr->scanNum > mzmlPtr->lastScan))
+	{
+		return(FALSE);
+	}
+	if ((mzmlPtr->minPrecursorMZ > 0 && spectrumPtr->precursorMZ < mzmlPtr->minPrecursorMZ)
+		|| (mzmlPtr->maxPrecursorMZ > 0 && spectrumPtr->precursorMZ > mzmlPtr->maxPrecursorMZ))
+	{
+		return(FALSE);
+	}
+
+	return(TRUE);
+}
+
+/******************************MakeMzMLPeakList*******************************************
+*
+*	Puts the decoded m/z and intensity values into a new tMSDataList.  As in ReadCIDFile, if 
+*	two peaks end up with the same m/z, only the more intense one is kept.
+*/
+static tMSDataList *MakeMzMLPeakList(tMzMLFile *mzmlPtr)
+{
+	tMSDataList *peakList;
+	tMSData massToAdd;
+	INT_4 i, peakNum;
+
+	peakNum = mzmlPtr->mzValueNum;
+	if (mzmlPtr->intValueNum < peakNum)
+	{
+		peakNum = mzmlPtr->intValueNum;
+	}
+
+	peakList = (tMSDataList *) CreateNewList(sizeof(tMSData), (peakNum > 0) ? peakNum : 1, 500);
+	if (peakList == NULL)
+	{
+		printf("MakeMzMLPeakList:  Out of memory");
+		exit(1);
+	}
+
+	for (i = 0; i < peakNum; i++)
+	{
+		massToAdd.index = 0;
+		massToAdd.mOverZ = mzmlPtr->mzValues[i];
+		massToAdd.intensity = (INT_4) mzmlPtr->intValues[i];
+		massToAdd.normIntensity = 0;
+		if (peakList->numObjects > 0 
+			&& peakList->mass[peakList->numObjects - 1].mOverZ == massToAdd.mOverZ)
+		{
+			if (massToAdd.intensity >= peakList->mass[peakList->numObjects - 1].intensity)
+			{
+				peakList->mass[peakList->numObjects - 1] = massToAdd;
+			}
+			continue;
+		}
+		if (!AddToList(&massToAdd, peakList))
+		{
+			printf("MakeMzMLPeakList:  Out of memory");
+			exit(1);
+		}
+	}
+
+	return(peakList);
+}
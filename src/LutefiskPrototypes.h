@@ -31,11 +31,47 @@ jsrichar@alum.mit.edu
 #include "LutefiskDefinitions.h"
 
 
+/*	Prototypes for LutefiskGlobalDeclarations.	*/
+tSearchContext	*NewSearchContext(tSearchContext *templatePtr);
+void			FreeSearchContext(tSearchContext *searchPtr);
+tSearchContext	*BindSearchContext(tSearchContext *searchPtr);
+
+/*	Prototypes for LutefiskBatch.	*/
+char			**AddBatchFile(char **fileList, INT_4 *fileNum, char *fileName);
+BOOLEAN			IsCIDFileName(char *fileName);
+char			MultiSpectrumFileType(char *fileName, char CIDfileType);
+char			**ReadBatchList(char *batchFile, char **fileList, INT_4 *fileNum);
+void			RunBatch(tSearchContext *configPtr, char **fileList, INT_4 fileNum);
+
+/*	Prototypes for LutefiskMGF.	*/
+BOOLEAN			IsMGFFileName(char *fileName);
+tMGFFile		*OpenMGFFile(char *fileName);
+BOOLEAN			NextMGFSpectrum(tMGFFile *mgfPtr, char **blockPtr, INT_4 *blockLength);
+void			CloseMGFFile(tMGFFile *mgfPtr);
+void			RunMGFFile(tSearchContext *configPtr, char *fileName);
+
+/*	Prototypes for LutefiskMzML.	*/
+BOOLEAN			IsMzMLFileName(char *fileName);
+tMzMLFile		*OpenMzMLFile(char *fileName, tParam *paramPtr);
+BOOLEAN			NextMzMLSpectrum(tMzMLFile *mzmlPtr, tMzMLSpectrum *spectrumPtr, BOOLEAN wantPeaks);
+void			SeekMzMLSpectrum(tMzMLFile *mzmlPtr, long offset);
+void			CloseMzMLFile(tMzMLFile *mzmlPtr);
+void			RunMzMLFile(tSearchContext *configPtr, char *fileName);
+
 /*	Prototypes for LutefiskMain.	*/
-void 			Run(void);
+BOOLEAN			Run(tSearchContext *searchPtr);
+clock_t			SearchTicks(void);
+char			*RunDate(time_t theTime, char *dateString);
+void			SequenceOneMass(INT_4 i, struct MSData *firstMassPtr, tNodeStore *sequenceNode, 
+						tNodeStore *sequenceNodeC, tNodeStore *sequenceNodeN,
+						REAL_4 actualPeptideMW, REAL_4 actualTopSeqNum, REAL_4 actualFinalSeqNum);
+void			ScrambleMassesInParallel(INT_4 firstI, struct MSData *firstMassPtr, tNodeStore *sequenceNode, 
+						tNodeStore *sequenceNodeC, tNodeStore *sequenceNodeN,
+						REAL_4 actualPeptideMW, REAL_4 actualTopSeqNum, REAL_4 actualFinalSeqNum);
 void 			ReadParamsFile(void);
 INT_4 			ReadDetailsFile(void);
 void 			SetupGapList();
+char 			ExtensionMassType(INT_4 mass);
 void 			ReadEdmanFile();
 void 			FreeSequenceScore(struct SequenceScore *currPtr);
 void 			FreeMassList(struct MSData *currPtr);
@@ -52,22 +88,21 @@ void 			PrintHeaderToFile(void);
 void			AdjustPeptideMW(struct MSData *firstMassPtr);
 
 /*Prototypes for Haggis*/
+void			FreeHaggisState(struct HaggisState *haggisPtr);
+void			FreeHaggisPools(void);
 struct Sequence *Haggis(struct Sequence *firstSequencePtr , struct MSData *firstMassPtr);
-BOOLEAN			NodeStep(INT_4 *nodeNum, INT_4 *nodeMass);
-void			StoreSeq(INT_4 nodeNum, INT_4 *nodeMass);
 INT_4			ResidueMass(INT_4 inputMass);
 INT_4			*LoadMassArrays(INT_4 *mass, struct MSData *firstMassPtr, INT_4 charge);
 void			SetupBackwardAndForwardNodes(INT_4 *mass);
 void			FindNodeSequences(INT_4 *mass);
 void			GetSequenceOfResidues(INT_4 *mass);
-struct Sequence	*LinkHaggisSubsequenceList(struct Sequence *firstPtr, struct Sequence *newPtr);
 struct Sequence *LoadHaggisSequenceStruct(INT_4 *peptide, INT_4 peptideLength, 
 						INT_4 score, INT_4 nodeValue, INT_4 gapNum, INT_2 nodeCorrection);
 void 			FleshOutSequenceEnds(struct MSData *firstMassPtr);
 void			GetCTermMasses(INT_4 *cTermMassNum, INT_4 *cTermMasses);
 void			GetNTermMasses(INT_4 *nTermMassNum, INT_4 *nTermMasses);
 void			GetBestNtermSeq(INT_4 *sequenceToAdd, INT_4 mass, struct MSData *firstMassPtr);
-INT_4			RatchetHaggis(INT_4 *sequence, INT_4 residueNum, INT_4 position, INT_4 ratchetMass, INT_4 correctMass);
+BOOLEAN			NextHaggisSequence(INT_4 *sequence, INT_4 residueNum, INT_4 correctMass);
 void			AppendSequences(void);
 void			MakeAAArray(void);
 REAL_4			NSequenceScore(INT_4 mass, INT_4 *sequence, INT_4 residueNum, struct MSData *firstMassPtr);
@@ -79,6 +114,15 @@ BOOLEAN			FindBIon(INT_4 sequenceIndex,INT_4 residueIndex, struct MSData *firstM
 BOOLEAN			FindYIon(INT_4 sequenceIndex,INT_4 residueIndex, struct MSData *firstMassPtr);
 
 
+/*	Prototypes for LutefiskCache.	*/
+unsigned long long	SpectrumCacheKey(tMSDataList *rawList);
+tMSDataList		*ReadSpectrumCache(unsigned long long key);
+void			WriteSpectrumCache(unsigned long long key, tMSDataList *peakList);
+
+/*	Prototypes for LutefiskServer.	*/
+void			SaveStdoutForReplies(void);
+void			RunServer(tSearchContext *configPtr);
+
 /*	Prototypes for LutefiskGetCID.*/
 tMSDataList		*ReadCIDFile(char *inFilename);
 void 			AddTheIonOffset(tMSDataList *inMSDataList);
@@ -109,8 +153,10 @@ struct MSData 	*LoadMSDataStruct(REAL_4 massValue, INT_4 ionIntensity);
 struct MSData 	*AddToCIDList(struct MSData *firstPtr, struct MSData *currPtr);
 void 			ModifyList(struct MSData *firstPtr, struct MSData *currPtr);
 INT_4 			FindMedian(struct MSData *firstPtr);
-char 			*my_fgets(char *s, INT_4 n, FILE *fp);						 
+char 			*my_fgets(char *s, INT_4 n, FILE *fp);
+char 			*my_bgets(char *s, INT_4 n, char **blockPtr, char *blockEnd);						 
 struct MSData 	*GetCidData(void);
+struct MSData 	*FinishCidData(tMSDataList *peakList);
 struct MSData 	*AddToListNoNull(struct MSData *firstPtr, struct MSData *currPtr);
 void 			SortByMass(struct MSData *firstAvMassPtr);
 INT_4 			countIons(struct MSData *firstAvMassPtr);
@@ -129,77 +175,98 @@ void 			DumpMSData(tMSDataList *inList);
 #endif
 					
 /*Prototypes for LutefiskMakeGraph.*/
-void 			MakeSequenceGraph(struct MSData *firstMassPtr, SCHAR *sequenceNode, 
-						SCHAR *sequenceNodeC, SCHAR *sequenceNodeN, INT_4 totalIonVal);
-void 			SequenceNodeInit(SCHAR *sequenceNode, SCHAR *sequenceNodeC, 
-									SCHAR *sequenceNodeN);
-void 			TrypticTemplate(struct MSData *firstMassPtr, SCHAR *sequenceNodeC, 
-						SCHAR *sequenceNodeN);
-void 			FindTrypticBIons(struct MSData *firstMassPtr, SCHAR *sequenceNodeN);
+tNodeList		*MakeSequenceGraph(struct MSData *firstMassPtr, tNodeStore *sequenceNode, 
+						tNodeStore *sequenceNodeC, tNodeStore *sequenceNodeN, INT_4 totalIonVal);
+void 			SequenceNodeInit(tNodeStore *sequenceNode, tNodeStore *sequenceNodeC, 
+									tNodeStore *sequenceNodeN);
+void 			TrypticTemplate(struct MSData *firstMassPtr, tNodeStore *sequenceNodeC, 
+						tNodeStore *sequenceNodeN);
+void 			FindTrypticBIons(struct MSData *firstMassPtr, tNodeStore *sequenceNodeN);
 char 			IsThisPossible(REAL_4 bMass, INT_4 currentCharge);
-void 			FindTrypticB17Ions(struct MSData *firstMassPtr, SCHAR *sequenceNodeN);
-void 			FindTrypticAIons(struct MSData *firstMassPtr, SCHAR *sequenceNodeN, char *ionPresent);
-void 			FindTrypticA17Ions(struct MSData *firstMassPtr, SCHAR *sequenceNodeN, char *ionPresent);
-void 			FindTrypticYIons(struct MSData *firstMassPtr, SCHAR *sequenceNodeC);
-void 			FindTrypticY17Ions(struct MSData *firstMassPtr, SCHAR *sequenceNodeC);
-void 			AddTag(SCHAR *sequenceNodeC, SCHAR *sequenceNodeN);
-void 			AddCTermResidue(SCHAR *sequenceNodeC, SCHAR *sequenceNodeN);
+void 			FindTrypticB17Ions(struct MSData *firstMassPtr, tNodeStore *sequenceNodeN);
+void 			FindTrypticAIons(struct MSData *firstMassPtr, tNodeStore *sequenceNodeN, tNodeStore *ionPresent);
+void 			FindTrypticA17Ions(struct MSData *firstMassPtr, tNodeStore *sequenceNodeN, tNodeStore *ionPresent);
+void 			FindTrypticYIons(struct MSData *firstMassPtr, tNodeStore *sequenceNodeC);
+void 			FindTrypticY17Ions(struct MSData *firstMassPtr, tNodeStore *sequenceNodeC);
+void 			AddTag(tNodeStore *sequenceNodeC, tNodeStore *sequenceNodeN);
+void 			AddCTermResidue(tNodeStore *sequenceNodeC, tNodeStore *sequenceNodeN);
 char 			RatchetIt(INT_4 *aaNum, char cycle, char *sequence, INT_4 seqLength);
-void 			AddEdmanData(SCHAR *sequenceNodeC, SCHAR *sequenceNodeN, INT_4 totalIonVal);
+void 			AddEdmanData(tNodeStore *sequenceNodeC, tNodeStore *sequenceNodeN, INT_4 totalIonVal);
 char 			IsThisStillPossible(REAL_4 bMass, INT_4 currentCharge, struct MSData *firstMassPtr);
-void 			TrypticLCQTemplate(struct MSData *firstMassPtr, SCHAR *sequenceNodeC, 
-						SCHAR *sequenceNodeN);
-void 			FindTrypticLCQBIons(struct MSData *firstMassPtr, SCHAR *sequenceNodeN);
-void 			FindTrypticLCQB17Ions(struct MSData *firstMassPtr, SCHAR *sequenceNodeN);
-void 			FindTrypticLCQAIons(struct MSData *firstMassPtr, SCHAR *sequenceNodeN, char *ionPresent);
-void 			FindTrypticLCQA17Ions(struct MSData *firstMassPtr, SCHAR *sequenceNodeN, char *ionPresent);
-void 			FindTrypticLCQYIons(struct MSData *firstMassPtr, SCHAR *sequenceNodeC);
-void 			FindTrypticLCQY17Ions(struct MSData *firstMassPtr, SCHAR *sequenceNodeC);
-void 			RemoveSillyNodes(SCHAR *sequenceNodeC, SCHAR *sequenceNodeN);
+void 			TrypticLCQTemplate(struct MSData *firstMassPtr, tNodeStore *sequenceNodeC, 
+						tNodeStore *sequenceNodeN);
+void 			FindTrypticLCQBIons(struct MSData *firstMassPtr, tNodeStore *sequenceNodeN);
+void 			FindTrypticLCQB17Ions(struct MSData *firstMassPtr, tNodeStore *sequenceNodeN);
+void 			FindTrypticLCQAIons(struct MSData *firstMassPtr, tNodeStore *sequenceNodeN, tNodeStore *ionPresent);
+void 			FindTrypticLCQA17Ions(struct MSData *firstMassPtr, tNodeStore *sequenceNodeN, tNodeStore *ionPresent);
+void 			FindTrypticLCQYIons(struct MSData *firstMassPtr, tNodeStore *sequenceNodeC);
+void 			FindTrypticLCQY17Ions(struct MSData *firstMassPtr, tNodeStore *sequenceNodeC);
+void 			RemoveSillyNodes(tNodeStore *sequenceNodeC, tNodeStore *sequenceNodeN);
+tNodeList		*OccupiedNodeList(tNodeStore *sequenceNodeC, tNodeStore *sequenceNodeN);
+tNodeStore		*CreateNodeStore(INT_4 valueSize);
+void 			ClearNodeStore(tNodeStore *store);
+void 			DisposeNodeStore(tNodeStore *store);
+void 			SetNodeValue(tNodeStore *store, INT_4 node, INT_4 value);
+void 			SetNodeIntValue(tNodeStore *store, INT_4 node, INT_4 value);
+INT_4 			NextStoredNode(tNodeStore *store, INT_4 node);
+INT_4 			LastStoredNode(tNodeStore *store, INT_4 node);
 
 						
 /*Prototypes for LutefiskSummedNode.*/
-void 			SummedNodeScore(SCHAR *sequenceNode, SCHAR *sequenceNodeC, 
-						SCHAR *sequenceNodeN, INT_4 *oneEdgeNodes, INT_4 *oneEdgeNodesIndex, INT_4 totalIonVal);
-void 			InitSummedNodeArrays(SCHAR *sequenceNode, SCHAR *sequenceNodeC, 
-						SCHAR *sequenceNodeN, INT_4 *oneEdgeNodes, char *evidence);
-void 			AssignNodeValue(INT_4 nextNode, INT_4 currentNode, char *evidence, 
-						SCHAR *sequenceNode, SCHAR *sequenceNodeC, SCHAR *sequenceNodeN, INT_4 totalIonVal);
-INT_4 			FindCurrentNode(SCHAR *sequenceNode, INT_4 currentNode);
+tNodeList		*SummedNodeScore(tNodeStore *sequenceNode, tNodeStore *sequenceNodeC, 
+						tNodeStore *sequenceNodeN, tNodeList *nodeList, INT_4 totalIonVal);
+void 			InitSummedNodeArrays(tNodeStore *sequenceNode, tNodeStore *sequenceNodeC, 
+						tNodeStore *sequenceNodeN, tNodeStore *evidence, tNodeList *nodeList);
+void 			AssignNodeValue(INT_4 nextNode, INT_4 currentNode, tNodeStore *evidence, 
+						tNodeStore *sequenceNode, tNodeStore *sequenceNodeC, tNodeStore *sequenceNodeN, INT_4 totalIonVal);
+INT_4 			FindCurrentNode(tNodeStore *sequenceNode, INT_4 currentNode, INT_4 *node, INT_4 *nodePos);
 void 			SortOneEdgeNodes(INT_4 *oneEdgeNodes, INT_4 *oneEdgeNodesIndex);
-void 			AddExtraNodes(SCHAR *sequenceNode, SCHAR *sequenceNodeN, SCHAR *sequenceNodeC, char *evidence);
-void 			AssignProNodeValue(INT_4 nextNode, INT_4 currentNode, char *evidence, SCHAR *sequenceNode, 
-						SCHAR *sequenceNodeC, SCHAR *sequenceNodeN, INT_4 totalIonVal);
+int 			NodeAscendSortFunc(const void *n1, const void *n2);
+void 			AddExtraNodes(tNodeStore *sequenceNode, tNodeStore *sequenceNodeN, tNodeStore *sequenceNodeC, tNodeList *nodeList);
+void 			AssignProNodeValue(INT_4 nextNode, INT_4 currentNode, tNodeStore *evidence, tNodeStore *sequenceNode, 
+						tNodeStore *sequenceNodeC, tNodeStore *sequenceNodeN, INT_4 totalIonVal);
 
 /*Prototypes for SubsequenceMaker.*/
 struct Sequence *SubsequenceMaker(INT_4 *oneEdgeNodes, INT_4 oneEdgeNodesIndex, 
-						SCHAR *sequenceNode);
-struct Sequence *NterminalSubsequences(SCHAR *sequenceNode, INT_4 maxLastNode, INT_4 lowSuperNode,
+						tNodeStore *sequenceNode, tNodeList *nodeList);
+struct Sequence *NterminalSubsequences(tNodeStore *sequenceNode, INT_4 maxLastNode, INT_4 lowSuperNode,
 						INT_4 highSuperNode);
 struct Sequence *LoadSequenceStruct(INT_4 *peptide, INT_4 peptideLength, 
 						INT_4 score, INT_4 nodeValue, INT_4 gapNum, INT_2 nodeCorrection);
 struct Sequence *LoadFinalSequenceStruct(INT_4 *peptide, INT_4 peptideLength, 
 						INT_4 score, INT_4 nodeValue, INT_4 gapNum, INT_2 nodeCorrection);
 struct Sequence *LinkSubsequenceList(struct Sequence *firstPtr, struct Sequence *newPtr);
-struct Sequence *StoreSubsequences(struct Sequence *newSubsequencePtr, struct extension *extensionList,
+struct Sequence *NewSequenceStruct(void);
+void 			DisposeSequenceStruct(struct Sequence *currPtr);
+void 			ResetSequenceArena(void);
+void 			FreeSequenceArena(void);
+void 			StoreSubsequences(struct extension *extensionList,
 						struct Sequence *currentSubsequence,INT_4 *lastNode, INT_4 lastNodeNum,
 						INT_4 maxLastNode, INT_4 minLastNode, INT_4 *aaPresentMass, INT_4 *seqNum, 
-						INT_4 *subseqNum, SCHAR *sequenceNode);
+						INT_4 *subseqNum, tNodeStore *sequenceNode);
 int 			ExtensionsSortDescend(const void *n1, const void *n2);
 struct extension	*SortExtensions(struct extension *inExtensionList);
 struct extension 	Score2aaExtension(struct extension io2aaExtension, INT_4 startingNodeMass, 
 						INT_4 *oneEdgeNodes, INT_4 oneEdgeNodesIndex,
 						BOOLEAN oneEdgeNNode, char	sequenceNodeValue);
-struct Sequence *AddExtensions(struct Sequence *subsequencePtr, SCHAR *sequenceNode, 
+struct Sequence *AddExtensions(struct Sequence *subsequencePtr, tNodeStore *sequenceNode, 
 						INT_4 *oneEdgeNodes, INT_4 oneEdgeNodesIndex, 
 						INT_4 *aaPresentMass, INT_4 topSeqNum, INT_4 *lastNode, INT_4 lastNodeNum, 
 						INT_4 *seqNum, INT_4 maxLastNode, INT_4 minLastNode, INT_4 lowSuperNode, 
 						INT_4 highSuperNode);
+INT_4 			FindExtensions(struct extension *extensionList, INT_4 nodeValue, 
+						tNodeStore *sequenceNode, INT_4 *oneEdgeNodes, INT_4 oneEdgeNodesIndex, 
+						INT_4 maxLastNode, INT_4 lowSuperNode, INT_4 highSuperNode);
+INT_4 			AddCterminalResidues(INT_4 *nodeValue, INT_4 *residue, INT_4 *residueNum, 
+						INT_4 endNodeScore);
+INT_4 			TopPathSequences(struct Sequence *startPtr, tNodeStore *sequenceNode, 
+						INT_4 *oneEdgeNodes, INT_4 oneEdgeNodesIndex, INT_4 *aaPresentMass, 
+						INT_4 *lastNode, INT_4 lastNodeNum, INT_4 maxLastNode, INT_4 minLastNode,
+						INT_4 lowSuperNode, INT_4 highSuperNode);
 void 			FreeSequenceStructs(struct Sequence *s);
-struct Sequence *AlterSubsequenceList(struct Sequence *firstPtr, struct Sequence *newPtr);
 char 			CorrectMass(INT_4 *peptide, INT_4 peptideLength, INT_4 *aaPresentMass);
 void 			amIHere(INT_4 correctPeptideLength, struct Sequence *subsequencePtr);
-struct Sequence *LCQNterminalSubsequences(SCHAR *sequenceNode, INT_4 maxLastNode, INT_4 lowSuperNode,
+struct Sequence *LCQNterminalSubsequences(tNodeStore *sequenceNode, INT_4 maxLastNode, INT_4 lowSuperNode,
 						INT_4 highSuperNode);
 void 			ClearLowestScore(struct Sequence *newSubsequencePtr, INT_4 *subseqNum, 
 						INT_4 maxLastNode, INT_4 minLastNode);
@@ -209,6 +276,12 @@ struct Sequence *ScoreSequences(struct Sequence *finalSequencePtr,
 						struct MSData *firstMassPtr);
 void 			LoadTheIonArrays(struct MSData *firstMassPtr, INT_4 *fragNum, 
 						INT_4 *fragMOverZ, INT_4 *fragIntensity);
+void 			BuildIonIndex(INT_4 *fragMOverZ, INT_4 fragNum);
+INT_4 			IonIndexBucket(REAL_8 mass);
+INT_4 			IonIndexLow(INT_4 *fragMOverZ, INT_4 fragNum, REAL_8 mass);
+INT_4 			IonIndexHigh(INT_4 *fragMOverZ, INT_4 fragNum, REAL_8 mass);
+void 			FreeScoringTables(void);
+void 			FreePreparedSpectrum(struct PreparedSpectrum *preparedPtr);
 INT_4 			TotalIntensity(INT_4 fragNum, INT_4 *fragMOverZ, 
 						INT_4 *fragIntensity);
 void 			WaterLoss(REAL_4 *ionFound, INT_4 fragNum, INT_4 *fragMOverZ, INT_4 *fragIntensity);
@@ -230,6 +303,7 @@ REAL_4 			IntensityScorer(INT_4 *fragIntensity, REAL_4 *ionFound, INT_4 cleavage
 void 			FreeAllSequence(struct Sequence *currPtr);
 void 			SeqIntensityRanker(struct SequenceScore *firstScorePtr);
 void 			SeqComboScoreRanker(struct SequenceScore *firstScorePtr);
+struct SequenceScore **SeqScoreRanks(struct SequenceScore *firstScorePtr, INT_4 rankNum);
 struct Sequence *AddTagBack(struct Sequence *firstSequencePtr);
 void 			PrintToConsole(struct SequenceScore *firstScorePtr);
 REAL_4			CalcIonFound(REAL_4 currentIonFound, INT_4 massDiff);
@@ -252,9 +326,12 @@ void 			TossTheLosers(struct Sequence *firstSequencePtr, REAL_4 *ionFoundTemplat
 						REAL_4 *ionFound, INT_4 *countTheSeqs, INT_4 *sequence);
 INT_4 			FindNCharge(INT_4 *sequence, INT_4 seqLength);
 char 			TwoAAExtFinder(INT_4 *sequence, INT_4 i);
-INT_4 			BCalculator(INT_4 i, INT_4 *sequence, INT_4 bCalStart, INT_4 bCalCorrection);
-INT_4 			YCalculator(INT_4 i, INT_4 *sequence, INT_4 seqLength, INT_4 yCalStart, 
-						INT_4 yCalCorrection);
+char 			ResidueCorrection(INT_4 residue, INT_4 *correction, INT_4 *firstCorrection);
+void 			BuildFragLadder(INT_4 *sequence, INT_4 seqLength);
+tFragLadder 	*FragLadder(INT_4 *sequence, INT_4 seqLength);
+INT_4 			CorrectIonMass(INT_4 ionCal, INT_4 nodeCorrection);
+INT_4 			BCalculator(INT_4 i, tFragLadder *ladder, INT_4 bCalStart, INT_4 bCalCorrection);
+INT_4 			YCalculator(INT_4 i, tFragLadder *ladder, INT_4 yCalStart, INT_4 yCalCorrection);
 BOOLEAN 		CheckItOut(struct Sequence *firstSequencePtr);
 INT_4 			AlterIonFound(REAL_4 *ionFound, INT_4 fragNum, INT_4 *fragMOverZ,
 				    	 INT_4 *sequence, INT_4 seqLength, REAL_4 *yFound, 
@@ -280,11 +357,7 @@ INT_4			SequenceLengthCalc(INT_4 *sequence, INT_4 seqLength);
 void 			MakeNewgGapList(void);
 void			ExpandSequences(struct Sequence *firstSequencePtr);
 char 			Ratchet(INT_4 *aaNum, INT_4 cycle, INT_4 *sequence, INT_4 seqLength);
-char			GoodSequence(struct Sequence *firstSequencePtr, INT_4 *peptide, INT_4 *peptideCorrection, 
-						INT_4 peptideLength);
 void			AddToGapList(struct Sequence *firstSequencePtr);
-char 			IsThisADuplicate(struct SequenceScore *firstScorePtr, INT_4 *sequence, 
-						REAL_4 intOnlyScore, REAL_4 intScore, INT_4 seqLength);
 REAL_4			Recalibrate(INT_4 fragNum, INT_4 *fragMOverZ, INT_4 *sequence, INT_4 seqLength,
 						INT_4 *fragIntensity);
 void 			ProlineInternalFrag(REAL_4 *ionFound, INT_4 *fragMOverZ, 
@@ -306,6 +379,8 @@ REAL_4			MassBasedQuality(INT_4 *sequence, INT_4 seqLength, INT_4 fragNum, INT_4
 BOOLEAN			KeepSequence(struct SequenceScore *currPtr, REAL_4 intscrKeep, REAL_4 xcorrKeep, 
 						REAL_4 qualityKeep, REAL_4 probscrKeep);
 REAL_4			ComboScore(struct SequenceScore *currPtr);
+REAL_4			ComboScoreAt(struct SequenceScore *currPtr, REAL_4 xcorr);
+REAL_4			ComboScoreBound(struct SequenceScore *currPtr, REAL_4 xcorrLow);
 
 struct SequenceScore *LoadSeqScoreStruct(REAL_4 intScore, REAL_4 intOnlyScore,
 						INT_4 *sequence, INT_4 *charSequence, INT_4 seqLength,
@@ -314,7 +389,6 @@ struct SequenceScore *LoadSeqScoreStruct(REAL_4 intScore, REAL_4 intOnlyScore,
 						REAL_4 length, REAL_4 probScore, REAL_4 comboScore);
 struct SequenceScore *AddToSeqScoreList(struct SequenceScore *firstPtr, 
 											struct SequenceScore *currPtr);
-struct SequenceScore *FindLowestScore(struct SequenceScore *currPtr);
 struct SequenceScore *MassageScores(struct SequenceScore *firstScorePtr);
 INT_4 ScoreC1(REAL_4 *ionFound, INT_4 fragNum, INT_4 *fragMOverZ, 
 				 INT_4 *sequence, INT_4 seqLength);
@@ -332,17 +406,21 @@ void 			AddPeakToSpectrum( REAL_4 *spectrum, REAL_4 mass, REAL_4 intensity);
 void 			CalcNormalizedExptPeaks(struct MSData *firstMassPtr);
 void 			FillInSpectrum1(struct MSData *firstMassPtr);
 void 			SetupCrossCorrelation(void);
+REAL_4 			SetupFastXCorr(void);
+void 			TransformSpectrum1(void);
+void 			CrossCorrelateSpectrum1(REAL_4 *array1, REAL_4 *result);
+void 			FreeFourierPlan(void);
 
 /*Prototypes for LutefiskGetAutoTag.*/
-void 			MaskSequenceNodeWithTags(SCHAR *sequenceNode, char *tagNode);
-INT_4 			TagExtensions(char *tagNode, INT_4 topSeqNum, INT_4 *tagNodeIntensity,
+void 			MaskSequenceNodeWithTags(tNodeStore *sequenceNode, tNodeStore *tagNode, tNodeList *nodeList);
+INT_4 			TagExtensions(tNodeStore *tagNode, INT_4 topSeqNum, tNodeStore *tagNodeIntensity,
 						INT_4 totalIonIntensity);
-INT_4 			NterminalTags(char *tagNode, INT_4 *tagNodeIntensity);
-void 			TagMaker(char *tagNode, INT_4 *tagNodeIntensity,
+INT_4 			NterminalTags(tNodeStore *tagNode, tNodeStore *tagNodeIntensity);
+void 			TagMaker(tNodeStore *tagNode, tNodeStore *tagNodeIntensity,
 						INT_4 totalIonIntensity);
-void 			FindTagYIons(char *tagNode, INT_4 charge, INT_4 *tagNodeIntensity);
-void 			TagNodeInit(char *tagNode, INT_4 *tagNodeIntensity);
-void 			GetAutoTag(struct MSData *firstMassPtr, SCHAR *sequenceNode);
+void 			FindTagYIons(tNodeStore *tagNode, INT_4 charge, tNodeStore *tagNodeIntensity);
+void 			TagNodeInit(tNodeStore *tagNode, tNodeStore *tagNodeIntensity);
+void 			GetAutoTag(struct MSData *firstMassPtr, tNodeStore *sequenceNode, tNodeList *nodeList);
 struct Sequence *AlterTagList(struct Sequence *firstPtr, struct Sequence *newPtr);
 void 			FreeTagStructs(struct Sequence *currPtr);
 struct Sequence *LoadFinalTagStruct(INT_4 *peptide, INT_4 peptideLength, 
@@ -354,11 +432,11 @@ void 			FreeMSData(struct MSData *currPtr);
 struct MSData 	*LoadMSData(REAL_4 massValue, INT_4 ionIntensity);
 struct MSData 	*AddCIDList(struct MSData *firstPtr, struct MSData *currPtr);
 void 			FindTagB2Ions(struct MSData *firstMassPtr, INT_4 *totalIntensity, 
-						char *tagNode, INT_4 *tagNodeIntensity);
+						tNodeStore *tagNode, tNodeStore *tagNodeIntensity);
 void 			FindMoreB2Ions(struct MSData *firstMassPtr, INT_4 *totalIntensity, 
-						char *tagNode, INT_4 *tagNodeIntensity);
-INT_4 			AlternateNterminalTags(char *tagNode, INT_4 *tagNodeIntensity);
-void 			AlternateTagMaker(char *tagNode, INT_4 *tagNodeIntensity,
+						tNodeStore *tagNode, tNodeStore *tagNodeIntensity);
+INT_4 			AlternateNterminalTags(tNodeStore *tagNode, tNodeStore *tagNodeIntensity);
+void 			AlternateTagMaker(tNodeStore *tagNode, tNodeStore *tagNodeIntensity,
 						INT_4 totalIonIntensity);
 void 			FilterTagMasses(INT_4 charge);
 int 			SequenceScoreDescendSortFunc(const void *n1, const void *n2);
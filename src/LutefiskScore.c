@@ -50,9 +50,133 @@ ScoreSequences.
 #include <time.h>
 #include <string.h>
 
+#if !defined(__MWERKS__)
+	#include <pthread.h>
+	#include <unistd.h>
+#endif
+
 #include "LutefiskPrototypes.h"
 #include "LutefiskDefinitions.h"
 
+/*Definitions for this file*/
+#define SCORE_CHUNK_SIZE			1024	/*Number of sequences scored before their scores are stored*/
+#define MIN_SEQUENCES_PER_THREAD	16		/*Fewer than this per thread is not worth starting threads*/
+#define SEQUENCE_HASH_MIN_SIZE		256		/*Starting number of slots in a tSequenceHash (a power of two)*/
+#define COMBO_BOUND_SLACK			0.0001	/*Padding for the REAL_4 round off in ComboScoreBound*/
+
+typedef struct	/*What the giant while loop in ScoreSequences keeps from scoring one sequence*/
+{
+	REAL_4	intScore;
+	REAL_4	intOnlyScore;
+	REAL_4	stDevErr;
+	REAL_4	calFactor;
+	REAL_4	quality;
+	REAL_4	probScore;
+	REAL_8	probScoreMax;		/*gProbScoreMax after normalizing*/
+	INT_4	cleavageSites;
+	char	databaseSeq;
+	INT_4	seqLength;
+	INT_4	sequence[MAX_PEPTIDE_LENGTH];	/*As changed by ScoreC1*/
+}tCandidateScore;
+
+typedef struct	/*Arrays that are written while scoring a sequence*/
+{
+	INT_4	*sequence;
+	INT_4	*fragMOverZ;		/*Recalibrate changes these, and they are put back afterwards*/
+	INT_4	*saveFragMOverZ;
+	INT_4	*ionType;
+	REAL_4	*ionFound;
+	REAL_4	*yFound;
+	REAL_4	*bFound;
+	REAL_8	*byError;
+}tScoreScratch;
+
+typedef struct	/*A chunk of sequences to score, and the spectrum they are scored against*/
+{
+	struct Sequence	**candidate;
+	tCandidateScore	*score;			/*score[i] is for candidate[i]*/
+	INT_4			candidateNum;
+	
+	INT_4			fragNum;		/*The spectrum, which is only read*/
+	INT_4			*fragMOverZ;
+	INT_4			*fragIntensity;
+	REAL_4			*ionFoundTemplate;
+	INT_4			intensityTotal;
+	INT_4			(*lowMassIons)[3];
+	char			cysPE;
+	REAL_4			minQuality;
+#if !defined(__MWERKS__)
+	INT_4			nextCandidate;	/*Next one for a thread to take*/
+	pthread_mutex_t	lock;			/*Guards nextCandidate*/
+	tSearchContext	*searchPtr;		/*Context of the thread that started the scoring threads...*/
+	REAL_4			toleranceNarrow;	/*...and its thread local globals, which they copy*/
+	REAL_4			toleranceWide;
+	char			trypticCterm;
+	INT_4			gapListDipeptideIndex;
+	INT_4			*cysPlus, *argPlus, *hisPlus, *lysPlus, *proPlus, *glnPlus, *gluPlus;
+#endif
+}tScoreJob;
+
+typedef struct	/*A sequence in RemoveRedundantSequences, indexed by its first residue*/
+{
+	INT_4			mass;
+	INT_4			order;			/*Where it is in the list*/
+	struct Sequence	*seqPtr;
+}tRedundancyIndex;
+
+typedef struct	/*An open addressing hash set of sequences (struct Sequence or struct SequenceScore)*/
+{
+	void	**entry;		/*NULL for an empty slot, or &gRemovedHashEntry*/
+	UINT_4	*hash;			/*hash[i] is the hash value of entry[i]*/
+	INT_4	size;			/*Number of slots, a power of two*/
+	INT_4	num;			/*Number of entries*/
+	INT_4	used;			/*Number of slots that are not empty, including removed entries*/
+	char	lengthFound[MAX_PEPTIDE_LENGTH + 1];	/*Sequence lengths in the set (struct Sequence only)*/
+}tSequenceHash;
+
+typedef struct	/*A SequenceScore struct and where it is in its linked list*/
+{
+	struct SequenceScore	*scorePtr;
+	INT_4					order;
+}tScoreOrder;
+
+struct PreparedSpectrum	/*The ion arrays that every mass pass starts from (gSearch->preparedSpectrum)*/
+{
+	INT_4	fragNum;
+	INT_4	*fragMOverZ;		/*From LoadTheIonArrays...*/
+	INT_4	*fragIntensity;		/*...after AdjustIonIntensity*/
+};
+
+static void PrepareSpectrum(struct MSData *firstMassPtr);
+static void ScoreOneSequence(tScoreJob *jobPtr, tScoreScratch *scratchPtr, struct Sequence *currSeqPtr,
+						tCandidateScore *scorePtr);
+static void ScoreCandidates(tScoreJob *jobPtr, tScoreScratch *scratchPtr);
+static void NewScoreScratch(tScoreScratch *scratchPtr);
+static void FreeScoreScratch(tScoreScratch *scratchPtr);
+static void NewSequenceHash(tSequenceHash *hashPtr);
+static void FreeSequenceHash(tSequenceHash *hashPtr);
+static void AddToSequenceHash(tSequenceHash *hashPtr, void *entry, UINT_4 hash);
+static void RemoveFromSequenceHash(tSequenceHash *hashPtr, void *entry, UINT_4 hash);
+static UINT_4 MixHash(UINT_4 hash, INT_4 value);
+static INT_4 RoundedScore(REAL_4 score);
+static UINT_4 SequenceScoreHash(struct SequenceScore *currPtr);
+static UINT_4 SequenceHash(struct Sequence *currPtr);
+static char IsThisADuplicate(tSequenceHash *hashPtr, INT_4 *sequence, 
+						REAL_4 intOnlyScore, REAL_4 intScore, INT_4 seqLength);
+static char GoodSequence(tSequenceHash *hashPtr, INT_4 *peptide, INT_4 *aaCorrection, 
+					INT_4 peptideLength);
+static tScoreOrder *SeqScoreArray(struct SequenceScore *firstScorePtr, INT_4 *seqNum);
+static int IntensityScoreSortDescend(const void *n1, const void *n2);
+static int ComboScoreSortDescend(const void *n1, const void *n2);
+static BOOLEAN LowerStoredScore(tScoreOrder *score1, tScoreOrder *score2);
+static void LowScoreHeapDown(tScoreOrder *heap, INT_4 heapNum, INT_4 i);
+static void ComboScoreModel(REAL_4 *pevScrWt, REAL_4 *qualScrWt, REAL_4 *intScrWt, REAL_4 *xcorrScrWt,
+						REAL_4 *aConstant, REAL_4 *bConstant, REAL_4 *cConstant);
+#if !defined(__MWERKS__)
+static void *ScoringThread(void *arg);
+#endif
+
+static char gRemovedHashEntry;	/*Its address marks a removed entry in a tSequenceHash*/
 
 
 /*
@@ -60,54 +184,54 @@ ScoreSequences.
 *	times 10000 for Cys, Arg, His, and Lys.  These get modified at the start of the ScoreSequences
 *	function in order to accomodate different alkyl groups on cysteine.
 */
-INT_4 gCysPlus[AMINO_ACID_NUMBER] = {
+THREAD_LOCAL INT_4 gCysPlus[AMINO_ACID_NUMBER] = {
 		1740463, 2591103, 2170521, 2180361, 2060184, 2320518, 2310678, 1600307, 2400681, 2160933,
 		2160933, 2311042, 2340497, 2500776, 2000620, 1900412, 2040569, 2890885, 2660725, 2020776,
 		0, 0, 0, 0, 0
 	};
 
-INT_4 gArgPlus[AMINO_ACID_NUMBER] = {
+THREAD_LOCAL INT_4 gArgPlus[AMINO_ACID_NUMBER] = {
 	2271382, 3122022, 2701441, 2711281, 2591103, 2851437, 2841597, 2131226, 2931600, 2691852,
 	2691852, 2841961, 2871416, 3031695, 2531539, 2431332, 2571488, 3421804, 3191645, 2551695,
 	0, 0, 0, 0, 0
 };
 
-INT_4 gHisPlus[AMINO_ACID_NUMBER] = {
+THREAD_LOCAL INT_4 gHisPlus[AMINO_ACID_NUMBER] = {
 	2080960, 2931600, 2511018, 2520859, 2400681, 2661015, 2651175, 1940804, 2741178, 2501430,
 	2501430, 2651539, 2680994, 2841273, 2341117, 2240909, 2381066, 3231382, 3001222, 2361273,
 	0, 0, 0, 0, 0
 };
 
-INT_4 gLysPlus[AMINO_ACID_NUMBER] = {
+THREAD_LOCAL INT_4 gLysPlus[AMINO_ACID_NUMBER] = {
 	1991321, 2841961, 2421379, 2431219, 2311042, 2571376, 2561536, 1851164, 2651539, 2411790,
 	2411790, 2561899, 2591355, 2751634, 2251477, 2151270, 2291427, 3141743, 2911583, 2271634,
 	0, 0, 0, 0, 0
 };
 
-INT_4 gProPlus[AMINO_ACID_NUMBER] = {
+THREAD_LOCAL INT_4 gProPlus[AMINO_ACID_NUMBER] = {
 	1680899, 2531539, 2110957, 2120797, 2000620, 2260954, 2251114, 1540742, 2341117, 2101368,
 	2101368, 2251477, 2280933, 2441212, 1941055, 1840848, 1981005, 2831321, 2601161, 1961212,
 	0, 0, 0, 0, 0
 };
 
-INT_4 gGlnPlus[AMINO_ACID_NUMBER] = {
+THREAD_LOCAL INT_4 gGlnPlus[AMINO_ACID_NUMBER] = {
 	1990957, 2841597, 2421015, 2430855, 2310678, 2571012, 2561172, 1850801, 2651175, 2411427,
 	2411427, 2561536, 2590991, 2751270, 2251114, 2150906, 2291063, 3141379, 2911219, 2271270,
 	0, 0, 0, 0, 0
 };
 
-INT_4 gGluPlus[AMINO_ACID_NUMBER] = {
+THREAD_LOCAL INT_4 gGluPlus[AMINO_ACID_NUMBER] = {
 	2000797, 2851437, 2430855, 2440696, 2320518, 2580852, 2571012, 1860641, 2661015, 2421267, 
 	2421267, 2571376, 2600831, 2761110, 2260954, 2160746, 2300903, 3151219, 2921059, 2281110,
 	0, 0, 0, 0, 0
 };
 
-REAL_4 gToleranceNarrow, gToleranceWide;	/*This is used in the "fuzzy logic" of matching calculated and
+THREAD_LOCAL REAL_4 gToleranceNarrow, gToleranceWide;	/*This is used in the "fuzzy logic" of matching calculated and
 						observed ion m/z values.*/
 						
-char gTrypticCterm = FALSE;	/*TRUE if tryptic or lys-c proteolysis with an ion at 147 or 175.*/
+THREAD_LOCAL char gTrypticCterm = FALSE;	/*TRUE if tryptic or lys-c proteolysis with an ion at 147 or 175.*/
 
-INT_4	gCleavageSiteStringent;  /*used for determining quality of spectrum*/
+THREAD_LOCAL INT_4	gCleavageSiteStringent;  /*used for determining quality of spectrum*/
 						
 char gAmIHere = FALSE;	/*TRUE if tryptic or lys-c proteolysis with an ion at 147 or 175.*/
 
@@ -119,11 +243,13 @@ INT_4 gRightSequence[50] = {	/*Used for checking if the correct sequence is rema
 	0, 0, 0, 0, 0, 0, 0
 };
 
-char 	gDatabaseSeq[MAX_DATABASE_SEQ_NUM][MAX_PEPTIDE_LENGTH];
-INT_4 	gPeptideLength[MAX_DATABASE_SEQ_NUM];
-INT_4 	gSeqNum = 0;
-REAL_8 	gProbScoreMax;
-INT_4 	gGapListDipeptideIndex;
+THREAD_LOCAL char 	gDatabaseSeq[MAX_DATABASE_SEQ_NUM][MAX_PEPTIDE_LENGTH];
+THREAD_LOCAL INT_4 	gPeptideLength[MAX_DATABASE_SEQ_NUM];
+THREAD_LOCAL INT_4 	gSeqNum = 0;
+THREAD_LOCAL REAL_8 	gProbScoreMax;
+THREAD_LOCAL tIonIndex	gIonIndex;	/*Mass buckets over fragMOverZ, built in ScoreSequences.*/
+THREAD_LOCAL tFragLadder	gFragLadder;	/*Fragment masses of the last sequence, built in LoadSequence.*/
+THREAD_LOCAL INT_4 	gGapListDipeptideIndex;
 
 /*INT_4 gRightSequence[50] = {	
 	1131, 971, 1471, 971, 870, 991, 570, 570, 1010, 570, 570,
@@ -618,12 +744,7 @@ void AddDatabaseSequences(struct Sequence *firstSequencePtr)
 				currPtr = currPtr->next;
 			}
 			
-			newPtr = (struct Sequence *) malloc(sizeof(struct Sequence));
-			if(newPtr == NULL)
-			{
-				printf("newPtr == NULL");
-				exit(1);
-			}
+			newPtr = NewSequenceStruct();
 		
 			currPtr->next = newPtr;
 			newPtr->next = NULL;
@@ -708,9 +829,9 @@ void ProlineInternalFrag(REAL_4 *ionFound, INT_4 *fragMOverZ,
 														the internal frag mass is less 
 														than the precursor m/z value.*/
 						{
-							k = 0;
+							k = IonIndexLow(fragMOverZ, fragNum, intFragMinErr);
 							/*Look for this ion.*/
-							while(fragMOverZ[k] <= intFragPlusErr && k < fragNum)
+							while(k < fragNum && fragMOverZ[k] <= intFragPlusErr)
 							{
 								if(fragMOverZ[k] >= intFragMinErr)
 								{
@@ -748,6 +869,7 @@ void ProlineInternalFrag(REAL_4 *ionFound, INT_4 *fragMOverZ,
 REAL_4	Recalibrate(INT_4 fragNum, INT_4 *fragMOverZ, INT_4 *sequence, INT_4 seqLength,
 					INT_4 *fragIntensity)
 {
+	tFragLadder *ladder;
 	INT_4 i, j, k, bCal, yCal, errNum;
 	INT_4 bCalStart, yCalStart;
 	INT_4 bIonMass, bIonMassMinErr, bIonMassPlusErr;
@@ -825,17 +947,19 @@ REAL_4	Recalibrate(INT_4 fragNum, INT_4 *fragMOverZ, INT_4 *sequence, INT_4 seqL
 	yCalCorrection = i - yCalStart * 10;
 	
 
+	ladder = FragLadder(sequence, seqLength);	/*Cumulative b and y masses.*/
+	
 	for(i = (seqLength - 1); i > 0; i--)	/*Don't do this loop for i = 0 (doesnt make sense).*/
 	{
 /*
 	Calculate the singly charged y ion mass.
 */
-		yCal = YCalculator(i, sequence, seqLength, yCalStart, yCalCorrection);	
+		yCal = YCalculator(i, ladder, yCalStart, yCalCorrection);	
 			
 /*
 	Calculate the singly charged b ion mass.
 */
-		bCal = BCalculator(i, sequence, bCalStart, bCalCorrection);		
+		bCal = BCalculator(i, ladder, bCalStart, bCalCorrection);		
 		
 		for(j = 1; j <= chargeLimit; j++)
 		{
@@ -854,8 +978,8 @@ REAL_4	Recalibrate(INT_4 fragNum, INT_4 *fragMOverZ, INT_4 *sequence, INT_4 seqL
 /*	Search for b ions.*/
 			if(j == 1) /*Only look for +1 b ions*/
 			{
-				k = fragNum - 1;
-				while(fragMOverZ[k] >= bIonMassMinErr && k >= 0)
+				k = IonIndexHigh(fragMOverZ, fragNum, bIonMassPlusErr);
+				while(k >= 0 && fragMOverZ[k] >= bIonMassMinErr)
 				{
 					if(fragMOverZ[k] <= bIonMassPlusErr)
 					{
@@ -883,8 +1007,8 @@ REAL_4	Recalibrate(INT_4 fragNum, INT_4 *fragMOverZ, INT_4 *sequence, INT_4 seqL
 			}
 			if(test)
 			{
-				k = fragNum - 1;
-				while(fragMOverZ[k] >= yIonMassMinErr && k >= 0)
+				k = IonIndexHigh(fragMOverZ, fragNum, yIonMassPlusErr);
+				while(k >= 0 && fragMOverZ[k] >= yIonMassMinErr)
 				{
 					if(fragMOverZ[k] <= yIonMassPlusErr)
 					{
@@ -1051,28 +1175,214 @@ REAL_4	Recalibrate(INT_4 fragNum, INT_4 *fragMOverZ, INT_4 *sequence, INT_4 seqL
 	return(avCorrectionFactor);
 }
 
+/**********************************NewSequenceHash************************************
+*
+*	Get an empty hash set of sequences.  The set only holds pointers; the sequences 
+*	themselves belong to their linked list.
+*/
+static void NewSequenceHash(tSequenceHash *hashPtr)
+{
+	INT_4 i;
+	
+	hashPtr->size = SEQUENCE_HASH_MIN_SIZE;
+	hashPtr->num = 0;
+	hashPtr->used = 0;
+	hashPtr->entry = (void **) calloc(hashPtr->size, sizeof(void *));
+	hashPtr->hash = (UINT_4 *) malloc(hashPtr->size * sizeof(UINT_4));
+	if(hashPtr->entry == NULL || hashPtr->hash == NULL)
+	{
+		printf("NewSequenceHash:  Out of memory.");
+		exit(1);
+	}
+	for(i = 0; i <= MAX_PEPTIDE_LENGTH; i++)
+	{
+		hashPtr->lengthFound[i] = FALSE;
+	}
+	return;
+}
+
+/**********************************FreeSequenceHash************************************
+*
+*	Free the slots of a hash set made by NewSequenceHash.
+*/
+static void FreeSequenceHash(tSequenceHash *hashPtr)
+{
+	free(hashPtr->entry);
+	free(hashPtr->hash);
+	hashPtr->entry = NULL;
+	hashPtr->hash = NULL;
+	return;
+}
+
+/**********************************AddToSequenceHash************************************
+*
+*	Put entry in the hash set using linear probing from slot "hash".  Entries with the same
+*	hash value are all kept, since it is up to the caller to decide which are the same.  
+*	The slots are doubled (or just cleared of removed entries) when half of them are used.
+*/
+static void AddToSequenceHash(tSequenceHash *hashPtr, void *entry, UINT_4 hash)
+{
+	void **oldEntry;
+	UINT_4 *oldHash, slot;
+	INT_4 i, oldSize;
+	
+	if((hashPtr->used + 1) * 2 > hashPtr->size)
+	{
+		oldEntry = hashPtr->entry;
+		oldHash = hashPtr->hash;
+		oldSize = hashPtr->size;
+		if((hashPtr->num + 1) * 4 > hashPtr->size)
+		{
+			hashPtr->size *= 2;
+		}
+		hashPtr->entry = (void **) calloc(hashPtr->size, sizeof(void *));
+		hashPtr->hash = (UINT_4 *) malloc(hashPtr->size * sizeof(UINT_4));
+		if(hashPtr->entry == NULL || hashPtr->hash == NULL)
+		{
+			printf("AddToSequenceHash:  Out of memory.");
+			exit(1);
+		}
+		hashPtr->used = hashPtr->num;
+		for(i = 0; i < oldSize; i++)
+		{
+			if(oldEntry[i] != NULL && oldEntry[i] != &gRemovedHashEntry)
+			{
+				slot = oldHash[i] & (hashPtr->size - 1);
+				while(hashPtr->entry[slot] != NULL)
+				{
+					slot = (slot + 1) & (hashPtr->size - 1);
+				}
+				hashPtr->entry[slot] = oldEntry[i];
+				hashPtr->hash[slot] = oldHash[i];
+			}
+		}
+		free(oldEntry);
+		free(oldHash);
+	}
+	
+	slot = hash & (hashPtr->size - 1);
+	while(hashPtr->entry[slot] != NULL)
+	{
+		slot = (slot + 1) & (hashPtr->size - 1);
+	}
+	hashPtr->entry[slot] = entry;
+	hashPtr->hash[slot] = hash;
+	hashPtr->num++;
+	hashPtr->used++;
+	return;
+}
+
+/**********************************RemoveFromSequenceHash************************************
+*
+*	Take entry (which was added with this hash value) out of the hash set.  Its slot is 
+*	marked as removed rather than emptied, so that the entries after it can still be found.
+*/
+static void RemoveFromSequenceHash(tSequenceHash *hashPtr, void *entry, UINT_4 hash)
+{
+	UINT_4 slot;
+	
+	slot = hash & (hashPtr->size - 1);
+	while(hashPtr->entry[slot] != NULL)
+	{
+		if(hashPtr->entry[slot] == entry)
+		{
+			hashPtr->entry[slot] = &gRemovedHashEntry;
+			hashPtr->num--;
+			return;
+		}
+		slot = (slot + 1) & (hashPtr->size - 1);
+	}
+	return;
+}
+
+/**********************************MixHash************************************
+*
+*	Add value to a hash value (FNV-1a style, one INT_4 at a time, with the high bits 
+*	folded down since only the low bits pick the slot).  Start with hash = 2166136261.
+*/
+static UINT_4 MixHash(UINT_4 hash, INT_4 value)
+{
+	hash = (hash ^ (UINT_4)value) * 16777619;
+	return(hash ^ (hash >> 15));
+}
+
+/**********************************RoundedScore************************************
+*
+*	Scores are taken to be the same by IsThisADuplicate if they are the same to three 
+*	decimal places.
+*/
+static INT_4 RoundedScore(REAL_4 score)
+{
+	INT_4 rounded;
+	
+	rounded = score * 1000 + 0.5;
+	return(rounded);
+}
+
+/**********************************SequenceScoreHash************************************
+*
+*	The hash value of a stored sequence, which is made from what IsThisADuplicate requires
+*	to be exactly the same (the rounded scores and the length).
+*/
+static UINT_4 SequenceScoreHash(struct SequenceScore *currPtr)
+{
+	INT_4 i;
+	UINT_4 hash = 2166136261U;
+	
+	i = 0;
+	while(currPtr->peptide[i] != 0)
+	{
+		i++;
+	}
+	hash = MixHash(hash, RoundedScore(currPtr->intensityOnlyScore));
+	hash = MixHash(hash, RoundedScore(currPtr->intensityScore));
+	hash = MixHash(hash, i);
+	return(hash);
+}
+
+/**********************************SequenceHash************************************
+*
+*	The hash value of a sequence in the linked list of Sequence structs, made from its 
+*	residue masses.
+*/
+static UINT_4 SequenceHash(struct Sequence *currPtr)
+{
+	INT_4 i;
+	UINT_4 hash = 2166136261U;
+	
+	for(i = 0; i < currPtr->peptideLength; i++)
+	{
+		hash = MixHash(hash, currPtr->peptide[i]);
+	}
+	return(hash);
+}
+
 /**********************************IsThisADuplicate************************************
 *
 *	Find out if this sequence is similar to existing sequences that have been scored
 *	and stored (ie, same intOnlyScore and where elements of the sequence are identical
-*	or within tolerance).
+*	or within tolerance).  The stored sequences are in hashPtr (see SequenceScoreHash), 
+*	so only those with the same scores and length are looked at.
 */
-char IsThisADuplicate(struct SequenceScore *firstScorePtr, INT_4 *sequence, 
+static char IsThisADuplicate(tSequenceHash *hashPtr, INT_4 *sequence, 
 						REAL_4 intOnlyScore, REAL_4 intScore, INT_4 seqLength)
 {
 	struct SequenceScore *currPtr;
-	INT_4 i, j, k, m, n;
+	INT_4 i, j, m;
+	UINT_4 hash, slot;
 	char test = TRUE;
 	
-	currPtr = firstScorePtr;
-	while(currPtr != NULL)
+	j = RoundedScore(intOnlyScore);
+	m = RoundedScore(intScore);
+	hash = MixHash(MixHash(MixHash(2166136261U, j), m), seqLength);
+	
+	slot = hash & (hashPtr->size - 1);
+	while(hashPtr->entry[slot] != NULL)
 	{
-		test = TRUE;
-		j = intOnlyScore * 1000 + 0.5;
-		k = (currPtr->intensityOnlyScore) * 1000 + 0.5;
-		m = intScore * 1000 + 0.5;
-		n = (currPtr->intensityScore) * 1000 + 0.5;
-		if(j == k && m == n)
+		currPtr = (struct SequenceScore *) hashPtr->entry[slot];
+		if(hashPtr->entry[slot] != &gRemovedHashEntry && hashPtr->hash[slot] == hash &&
+			RoundedScore(currPtr->intensityOnlyScore) == j && 
+			RoundedScore(currPtr->intensityScore) == m)
 		{
 			i = 0;
 			while(currPtr->peptide[i] != 0)
@@ -1081,58 +1391,74 @@ char IsThisADuplicate(struct SequenceScore *firstScorePtr, INT_4 *sequence,
 			}
 			if(i == seqLength)
 			{
+				test = TRUE;
 				for(i = 0; i < seqLength; i++)
 				{
 					if(sequence[i] < currPtr->peptide[i] - gToleranceNarrow ||
 						sequence[i] > currPtr->peptide[i] + gToleranceNarrow)
 					{
 						test = FALSE;
+						break;
 					}
-					
 				}
 				if(test)
 				{
 					test = FALSE;
 					return(test);
 				}
-				
 			}
-		
 		}
-	
-		currPtr = currPtr->next;
+		slot = (slot + 1) & (hashPtr->size - 1);
 	}
 
-
 	test = TRUE;	/*if it made it this far, then its not a duplicate*/
 	return(test);
 }
 /***********************************GoodSequence***************************************
 *
 *	This function determines if the "new" sequence is just a repeat of an old sequence,
-*	and it also makes sure that the mass of the sequence equals the peptide mass.
+*	and it also makes sure that the mass of the sequence equals the peptide mass.  The old
+*	sequences are in hashPtr (see SequenceHash); as before, an old sequence that is the
+*	same as the start of the new one counts as a repeat.
 */
 
-char	GoodSequence(struct Sequence *firstSequencePtr, INT_4 *peptide, INT_4 *aaCorrection, 
+static char	GoodSequence(tSequenceHash *hashPtr, INT_4 *peptide, INT_4 *aaCorrection, 
 					INT_4 peptideLength)
 {
-	INT_4 peptideMass, peptideMassCorrection, i, j;
+	INT_4 peptideMass, peptideMassCorrection, i, j, length;
+	UINT_4 hash, slot;
 	char test = TRUE;	/*test is assumed to be true, unless proven otherwise, and this is the returned value*/
 	struct Sequence *checkPtr;
 	
-
-	checkPtr = firstSequencePtr;
-	while(checkPtr != NULL && test)
+	hash = 2166136261U;
+	for(length = 0; length <= peptideLength && test; length++)
 	{
-		test = FALSE;
-		for(i = 0; i < checkPtr->peptideLength; i++)
+		if(hashPtr->lengthFound[length])
 		{
-			if(peptide[i] != checkPtr->peptide[i])
+			slot = hash & (hashPtr->size - 1);
+			while(hashPtr->entry[slot] != NULL && test)
 			{
-				test = TRUE;
+				checkPtr = (struct Sequence *) hashPtr->entry[slot];
+				if(hashPtr->entry[slot] != &gRemovedHashEntry && hashPtr->hash[slot] == hash &&
+					checkPtr->peptideLength == length)
+				{
+					test = FALSE;
+					for(i = 0; i < length; i++)
+					{
+						if(peptide[i] != checkPtr->peptide[i])
+						{
+							test = TRUE;
+							break;
+						}
+					}
+				}
+				slot = (slot + 1) & (hashPtr->size - 1);
 			}
 		}
-		checkPtr = checkPtr->next;
+		if(length < peptideLength)
+		{
+			hash = MixHash(hash, peptide[length]);
+		}
 	}
 	if(test)	/*verify that the sequences matches the peptide molecular weight.*/
 	{
@@ -1201,6 +1527,7 @@ void	ExpandSequences(struct Sequence *firstSequencePtr)
 	INT_4 peptide[MAX_PEPTIDE_LENGTH], aaCorrection[MAX_PEPTIDE_LENGTH];
 	INT_4 peptideLength, score, nodeValue, gapNum;
 	INT_2 nodeCorrection;
+	tSequenceHash sequenceHash;
 	
 	currPtr = firstSequencePtr;
 	if(currPtr == NULL)
@@ -1209,9 +1536,15 @@ void	ExpandSequences(struct Sequence *firstSequencePtr)
 		exit(1);
 	}
 
+	/*Put the sequences in a hash set, for GoodSequence*/
+	NewSequenceHash(&sequenceHash);
+	AddToSequenceHash(&sequenceHash, currPtr, SequenceHash(currPtr));
+	sequenceHash.lengthFound[currPtr->peptideLength] = TRUE;
 	while(currPtr->next != NULL)
 	{
 		currPtr = currPtr->next;
+		AddToSequenceHash(&sequenceHash, currPtr, SequenceHash(currPtr));
+		sequenceHash.lengthFound[currPtr->peptideLength] = TRUE;
 	}
 	stopPtr = currPtr;
 	lastPtr = currPtr;
@@ -1377,7 +1710,7 @@ void	ExpandSequences(struct Sequence *firstSequencePtr)
 			nodeCorrection = currPtr->nodeCorrection;
 			gapNum = currPtr->gapNum;
 			
-			test = GoodSequence(firstSequencePtr, peptide, aaCorrection, peptideLength);
+			test = GoodSequence(&sequenceHash, peptide, aaCorrection, peptideLength);
 			
 			if(test)	/*if different from the original, then store it as a new addition*/
 			{
@@ -1400,10 +1733,13 @@ void	ExpandSequences(struct Sequence *firstSequencePtr)
 					}*/
 				lastPtr->next = newPtr;
 				lastPtr = newPtr;
+				AddToSequenceHash(&sequenceHash, newPtr, SequenceHash(newPtr));
+				sequenceHash.lengthFound[peptideLength] = TRUE;
 			}
 		}
 		currPtr = currPtr->next;
 	}
+	FreeSequenceHash(&sequenceHash);
 	
 /*	
 	Count the sequences in the list again.
@@ -2303,173 +2639,341 @@ char SingleAA(INT_4 aminoAcidMass)
 	return(test);
 }
 
-/************************** RemoveRedundantSequences ***********************************
-*
+/************************** SimilarSequence ***********************************
 *
+*	Returns TRUE if checkThisPtr could be a version of currPtr w/ some of the residues 
+*	combined, as used by RemoveRedundantSequences.
 */
-
-struct Sequence *RemoveRedundantSequences(struct Sequence *firstSequencePtr)
+static char SimilarSequence(struct Sequence *currPtr, struct Sequence *checkThisPtr, INT_4 error)
 {
-	struct Sequence *currPtr, *checkThisPtr, *freeMePtr, *previousPtr;
-	
-	INT_4 i, j, testMass, countTheSeqs;
-	INT_4 error = 0.4 * gMultiplier;	/*if error is big, then many unrelated seqs are removed*/
+	INT_4 i, j, testMass;
 	char test;
-
 	
-	currPtr = firstSequencePtr;
-	while(currPtr != NULL)
+	test = TRUE;	/*is TRUE if the two sequences are similar*/
+	j = 0;
+	for(i = 0; i < checkThisPtr->peptideLength; i++)
 	{
-		if(currPtr->score != 0)
+		if(j < currPtr->peptideLength)
 		{
-			checkThisPtr = firstSequencePtr->next;
-			while(checkThisPtr != NULL)
+			if(currPtr->peptide[j] <= checkThisPtr->peptide[i] + error
+				&& currPtr->peptide[j] >= checkThisPtr->peptide[i] - error)
+			{
+				j++;
+			}
+			else
 			{
-				if(checkThisPtr->peptideLength <= currPtr->peptideLength && 
-					checkThisPtr->score != 0 && checkThisPtr != currPtr)
+				if(checkThisPtr->peptide[i] < currPtr->peptide[j])
 				{
-					test = TRUE;	/*is TRUE if the two sequences are similar*/
-					j = 0;
-					for(i = 0; i < checkThisPtr->peptideLength; i++)
-					{
-						if(j < currPtr->peptideLength)
+					test = FALSE;
+					break;
+				}
+				testMass = currPtr->peptide[j];
+				test = SingleAA(currPtr->peptide[j]);
+				while(j < currPtr->peptideLength && 
+					testMass < checkThisPtr->peptide[i] - error)
+				{
+					j++;
+					testMass += currPtr->peptide[j];
+					test = SingleAA(currPtr->peptide[j]);
+					if(testMass <= checkThisPtr->peptide[i] + error
+						&& testMass >= checkThisPtr->peptide[i] - error)
+					{
+						/*make sure this is not a K = AG situation*/
+						if((testMass <= gMonoMass_x100[K] + error 
+							&& testMass >= gMonoMass_x100[K] - error) ||
+							
+							(testMass <= gMonoMass_x100[Q] + error 
+							&& testMass >= gMonoMass_x100[Q] - error) ||
+							
+							(testMass <= gMonoMass_x100[R] + error 
+							&& testMass >= gMonoMass_x100[R] - error) ||
+							
+							(testMass <= gMonoMass_x100[W] + error 
+							&& testMass >= gMonoMass_x100[W] - error) ||
+							
+							(testMass <= gMonoMass_x100[N] + error 
+							&& testMass >= gMonoMass_x100[N] - error))
 						{
-							if(currPtr->peptide[j] <= checkThisPtr->peptide[i] + error
-								&& currPtr->peptide[j] >= checkThisPtr->peptide[i] - error)
-							{
-								j++;
-							}
-							else
-							{
-								if(checkThisPtr->peptide[i] < currPtr->peptide[j])
-								{
-									test = FALSE;
-									break;
-								}
-								testMass = currPtr->peptide[j];
-								test = SingleAA(currPtr->peptide[j]);
-								while(j < currPtr->peptideLength && 
-									testMass < checkThisPtr->peptide[i] - error)
-								{
-									j++;
-									testMass += currPtr->peptide[j];
-									test = SingleAA(currPtr->peptide[j]);
-									if(testMass <= checkThisPtr->peptide[i] + error
-										&& testMass >= checkThisPtr->peptide[i] - error)
-									{
-										/*make sure this is not a K = AG situation*/
-										if((testMass <= gMonoMass_x100[K] + error 
-											&& testMass >= gMonoMass_x100[K] - error) ||
-											
-											(testMass <= gMonoMass_x100[Q] + error 
-											&& testMass >= gMonoMass_x100[Q] - error) ||
-											
-											(testMass <= gMonoMass_x100[R] + error 
-											&& testMass >= gMonoMass_x100[R] - error) ||
-											
-											(testMass <= gMonoMass_x100[W] + error 
-											&& testMass >= gMonoMass_x100[W] - error) ||
-											
-											(testMass <= gMonoMass_x100[N] + error 
-											&& testMass >= gMonoMass_x100[N] - error))
-										{
-											test = FALSE;
-										}
-										j++;
-										break;
-									}
-									if(testMass > checkThisPtr->peptide[i] + error)
-									{
-										test = FALSE;
-										break;
-									}
-								}
-								if(test == FALSE)
-								{
-									break;
-								}
-							}
+							test = FALSE;
 						}
+						j++;
+						break;
 					}
-					if(test)
+					if(testMass > checkThisPtr->peptide[i] + error)
 					{
-						if(checkThisPtr->gapNum == -100)	/*this is signal that sequence 
-														was from database*/
-						{
-							currPtr->score = 0;
-						}
-						else
-						{
-							checkThisPtr->score = 0;
-						}
+						test = FALSE;
+						break;
 					}
 				}
-				checkThisPtr = checkThisPtr->next;
+				if(test == FALSE)
+				{
+					break;
+				}
 			}
-		
 		}
-	
-		currPtr = currPtr->next;
 	}
 	
+	return(test);
+}
+
+/************************** IntSortAscend ***********************************
+*
+*	For qsort of INT_4's.
+*/
+static int IntSortAscend(const void *n1, const void *n2)
+{
+	INT_4 a = *(const INT_4 *)n1;
+	INT_4 b = *(const INT_4 *)n2;
+	
+	return(a < b ? -1 : (a > b));
+}
+
+/************************** RedundancyIndexSortAscend ***********************************
+*
+*	For qsort of tRedundancyIndex by first residue mass, and then by list position.
+*/
+static int RedundancyIndexSortAscend(const void *n1, const void *n2)
+{
+	const tRedundancyIndex *a = (const tRedundancyIndex *)n1;
+	const tRedundancyIndex *b = (const tRedundancyIndex *)n2;
 	
+	if(a->mass != b->mass)
+	{
+		return(a->mass < b->mass ? -1 : 1);
+	}
+	return(a->order < b->order ? -1 : (a->order > b->order));
+}
+
+/************************** RedundancyIndexLow ***********************************
+*
+*	Returns the first entry of the sorted index (of num entries) w/ a mass of at least mass,
+*	or num if there is none.
+*/
+static INT_4 RedundancyIndexLow(tRedundancyIndex *redundancyIndex, INT_4 num, INT_4 mass)
+{
+	INT_4 low = 0, high = num, middle;
 	
-	/*Free the pointers with scores of zero*/
-	while(firstSequencePtr != NULL)
+	while(low < high)
 	{
-		if(firstSequencePtr->score == 0)
+		middle = (low + high) / 2;
+		if(redundancyIndex[middle].mass < mass)
 		{
-			freeMePtr = firstSequencePtr;
-			firstSequencePtr = firstSequencePtr->next;
-			free(freeMePtr);
+			low = middle + 1;
 		}
 		else
 		{
-			break;
+			high = middle;
 		}
 	}
-	
-	if(firstSequencePtr != NULL)
+	return(low);
+}
+
+/************************** CheckRedundantSequence ***********************************
+*
+*	Compares currPtr w/ checkThisPtr, and if they are similar gives the one that is 
+*	redundant a score of zero.
+*/
+static void CheckRedundantSequence(struct Sequence *currPtr, struct Sequence *checkThisPtr, 
+									INT_4 error)
+{
+	if(checkThisPtr->peptideLength <= currPtr->peptideLength && 
+		checkThisPtr->score != 0 && checkThisPtr != currPtr)
 	{
-		previousPtr = firstSequencePtr;
-		currPtr = firstSequencePtr->next;
-		while(currPtr != NULL)
+		if(SimilarSequence(currPtr, checkThisPtr, error))
 		{
-			if(currPtr->score == 0)
+			if(checkThisPtr->gapNum == -100)	/*this is signal that sequence 
+											was from database*/
 			{
-				freeMePtr = currPtr;
-				previousPtr->next = currPtr->next;
-				currPtr = currPtr->next;
-				free(freeMePtr);
+				currPtr->score = 0;
 			}
 			else
 			{
-				currPtr = currPtr->next;
-				previousPtr = previousPtr->next;
+				checkThisPtr->score = 0;
 			}
 		}
 	}
 	
+	return;
+}
+
+/************************** RemoveRedundantSequences ***********************************
+*
+*	Removes the sequences that are just another sequence w/ some of its residues combined
+*	(see SimilarSequence).  A sequence can only be similar to currPtr if its first residue
+*	matches the sum of the first few residues of currPtr (or is more than all of them), so 
+*	the sequences are indexed by their first residue mass, and only those are compared.  
+*	Sequences w/ no residues are always compared.  The order that sequences are compared 
+*	with currPtr makes no difference, since each comparison only changes the score of one
+*	of the two.
+*/
+
+struct Sequence *RemoveRedundantSequences(struct Sequence *firstSequencePtr)
+{
+	struct Sequence *currPtr, *freeMePtr, *previousPtr;
+	tRedundancyIndex *redundancyIndex;
+	struct Sequence **emptyPtr;
+	INT_4 i, j, k, countTheSeqs, indexNum, emptyNum, prefixNum, low, high;
+	INT_4 prefixMass[MAX_PEPTIDE_LENGTH];
+	INT_4 error = 0.4 * gMultiplier;	/*if error is big, then many unrelated seqs are removed*/
+
+	/*Index all but the first sequence (which is never checked against the others)*/
 	countTheSeqs = 0;
-	currPtr = firstSequencePtr;
-	while(currPtr != NULL)
+	for(currPtr = firstSequencePtr; currPtr != NULL; currPtr = currPtr->next)
 	{
 		countTheSeqs++;
-		currPtr = currPtr->next;
-	}
-	if(gParam.fMonitor && gCorrectMass)
-	{
-		printf("Scoring %4ld remaining after removing redundant sequences.\n", countTheSeqs);
 	}
-	if(countTheSeqs == 0)
+	redundancyIndex = (tRedundancyIndex *) malloc((countTheSeqs + 1) * sizeof(tRedundancyIndex));
+	emptyPtr = (struct Sequence **) malloc((countTheSeqs + 1) * sizeof(struct Sequence *));
+	if(redundancyIndex == NULL || emptyPtr == NULL)
 	{
-		printf("RemoveRedundantSequences:  countTheSeqs = 0\n");
+		printf("RemoveRedundantSequences:  Out of memory");
 		exit(1);
 	}
-
-	return(firstSequencePtr);
-}
-/***************************RevertBackToReals*****************************************
+	indexNum = 0;
+	emptyNum = 0;
+	if(firstSequencePtr != NULL)
+	{
+		i = 0;
+		for(currPtr = firstSequencePtr->next; currPtr != NULL; currPtr = currPtr->next)
+		{
+			if(currPtr->peptideLength > 0)
+			{
+				redundancyIndex[indexNum].mass = currPtr->peptide[0];
+				redundancyIndex[indexNum].order = i;
+				redundancyIndex[indexNum].seqPtr = currPtr;
+				indexNum++;
+			}
+			else
+			{
+				emptyPtr[emptyNum++] = currPtr;
+			}
+			i++;
+		}
+	}
+	qsort(redundancyIndex, indexNum, sizeof(tRedundancyIndex), RedundancyIndexSortAscend);
+	
+	currPtr = firstSequencePtr;
+	while(currPtr != NULL)
+	{
+		if(currPtr->score != 0)
+		{
+			/*The sums of the first few residues (SimilarSequence can go one past the end)*/
+			prefixNum = currPtr->peptideLength;
+			if(prefixNum < MAX_PEPTIDE_LENGTH)
+			{
+				prefixNum++;
+			}
+			for(i = 0; i < prefixNum; i++)
+			{
+				prefixMass[i] = currPtr->peptide[i];
+				if(i > 0)
+				{
+					prefixMass[i] += prefixMass[i - 1];
+				}
+			}
+			qsort(prefixMass, prefixNum, sizeof(INT_4), IntSortAscend);
+			
+			if(currPtr->peptideLength == 0 || currPtr->peptideLength == MAX_PEPTIDE_LENGTH)
+			{
+				for(k = 0; k < indexNum; k++)	/*compare them all*/
+				{
+					CheckRedundantSequence(currPtr, redundancyIndex[k].seqPtr, error);
+				}
+			}
+			else
+			{
+				/*Compare the sequences w/ a first residue within error of one of these sums,
+				or more than all of them*/
+				high = 0;
+				for(k = 0; k < prefixNum; k++)
+				{
+					low = RedundancyIndexLow(redundancyIndex, indexNum, prefixMass[k] - error);
+					if(low < high)
+					{
+						low = high;	/*this one overlaps the last one*/
+					}
+					for(high = low; high < indexNum && 
+						redundancyIndex[high].mass <= prefixMass[k] + error; high++)
+					{
+						CheckRedundantSequence(currPtr, redundancyIndex[high].seqPtr, error);
+					}
+				}
+				for(k = RedundancyIndexLow(redundancyIndex, indexNum, 
+											prefixMass[prefixNum - 1] + error + 1); 
+					k < indexNum; k++)
+				{
+					CheckRedundantSequence(currPtr, redundancyIndex[k].seqPtr, error);
+				}
+			}
+			for(j = 0; j < emptyNum; j++)
+			{
+				CheckRedundantSequence(currPtr, emptyPtr[j], error);
+			}
+		}
+	
+		currPtr = currPtr->next;
+	}
+	free(redundancyIndex);
+	free(emptyPtr);
+	
+	
+	
+	/*Free the pointers with scores of zero*/
+	while(firstSequencePtr != NULL)
+	{
+		if(firstSequencePtr->score == 0)
+		{
+			freeMePtr = firstSequencePtr;
+			firstSequencePtr = firstSequencePtr->next;
+			DisposeSequenceStruct(freeMePtr);
+		}
+		else
+		{
+			break;
+		}
+	}
+	
+	if(firstSequencePtr != NULL)
+	{
+		previousPtr = firstSequencePtr;
+		currPtr = firstSequencePtr->next;
+		while(currPtr != NULL)
+		{
+			if(currPtr->score == 0)
+			{
+				freeMePtr = currPtr;
+				previousPtr->next = currPtr->next;
+				currPtr = currPtr->next;
+				DisposeSequenceStruct(freeMePtr);
+			}
+			else
+			{
+				currPtr = currPtr->next;
+				previousPtr = previousPtr->next;
+			}
+		}
+	}
+	
+	countTheSeqs = 0;
+	currPtr = firstSequencePtr;
+	while(currPtr != NULL)
+	{
+		countTheSeqs++;
+		currPtr = currPtr->next;
+	}
+	if(gParam.fMonitor && gCorrectMass)
+	{
+		printf("Scoring %4ld remaining after removing redundant sequences.\n", countTheSeqs);
+	}
+	if(countTheSeqs == 0)
+	{
+		printf("RemoveRedundantSequences:  countTheSeqs = 0\n");
+		exit(1);
+	}
+
+	return(firstSequencePtr);
+}
+/***************************RevertBackToReals*****************************************
 *
 *	Divide all of the mass-related gParams values by gMultiplier.  Revert the peak masses
 *	back to floats.
@@ -3053,257 +3557,234 @@ BOOLEAN CheckItOut(struct Sequence *firstSequencePtr)
 
 
 
-/******************************BCalculator********************************************
+/******************************ResidueCorrection*******************************************
 *
-*	This function calculates singly charged b ion masses. It applies the appropriate
-*	average mass correction factor, and returns a INT_4.
-*
-*/
-INT_4 BCalculator(INT_4 i, INT_4 *sequence, INT_4 bCalStart, INT_4 bCalCorrection)
+*	Works out the high accuracy node correction contributed by one residue mass, the same
+*	way for b and y ions.  Single amino acids add their gNodeCorrection (summed over all
+*	amino acids of that mass).  Two amino acid residues add the rounded average of the
+*	corrections for the pairs of that mass, if these agree to within 5.  Returns 'A' for a
+*	single amino acid, 'D' for a two amino acid residue (and sets "firstCorrection" to the
+*	correction of the first matching pair), or 0 if the mass is not in gGapList.
+*/
+char ResidueCorrection(INT_4 residue, INT_4 *correction, INT_4 *firstCorrection)
 {
-	INT_4 bCal = bCalStart;
-	INT_4 j, corrections[10], residueCount, k, maxCorrection, minCorrection, correctionSpread, avCorrection;
-	INT_4 nodeCorrection = bCalCorrection;
-	REAL_8 mToAFactor;
-	char test;
+	INT_4 k, corrections[10], residueCount, maxCorrection, minCorrection, correctionSpread;
+	INT_4 avCorrection;
+	char test = TRUE;
 	
-	for(j = 0; j < 10; j++)
+	*correction = 0;
+	for(k = 0; k < gAminoAcidNumber; k++)
 	{
-		corrections[j] = 0;
+		if(residue == gGapList[k])
+		{
+			*correction += gNodeCorrection[k];
+			test = FALSE;
+		}
 	}
-
-	for(j = 0 ; j < i; j++)
+	if(!test)
 	{
-		bCal += sequence[j];
+		return('A');
 	}
 	
-	for(j = 0; j < i; j++)	/*determine the correction*/
+	residueCount = 0;	/*this is a dipeptide*/
+	for(k = gAminoAcidNumber; k <= gGapListIndex; k++)
 	{
-		test = TRUE;
-		for(k = 0; k < gAminoAcidNumber; k++)
+		if(residue == gGapList[k])
 		{
-			if(sequence[j] == gGapList[k])
+			corrections[residueCount] = gNodeCorrection[k];
+			residueCount++;
+			if(residueCount >= 10)
 			{
-				nodeCorrection += gNodeCorrection[k];
-				test = FALSE;
+				printf("LutefiskScore: residueCount exceeds 10.\n");
+				exit(1);
 			}
 		}
-		if(test)	/*test is true if this is a dipeptide*/
+	}
+	if(residueCount == 0)
+	{
+		return(0);
+	}
+	*firstCorrection = corrections[0];
+	if(residueCount == 1)
+	{
+		*correction = corrections[0];
+	}
+	else
+	{
+		maxCorrection = corrections[0];
+		minCorrection = corrections[0];
+		for(k = 1; k < residueCount; k++)
 		{
-			residueCount = 0;
-			for(k = gAminoAcidNumber; k <= gGapListIndex; k++)
+			if(corrections[k] > maxCorrection)
 			{
-				if(sequence[j] == gGapList[k])
-				{
-					corrections[residueCount] = gNodeCorrection[k];
-					residueCount++;
-					if(residueCount >= 10)
-					{
-						printf("LutefiskScore: residueCount exceeds 10.\n");
-						exit(1);
-					}
-				}
+				maxCorrection = corrections[k];
+			}
+			if(corrections[k] < minCorrection)
+			{
+				minCorrection = corrections[k];
+			}
+		}
+		correctionSpread = maxCorrection - minCorrection;
+		if(correctionSpread <= 5)
+		{
+			avCorrection = 0;
+			for(k = 0; k < residueCount; k++)
+			{
+				avCorrection += corrections[k];
 			}
-			if(residueCount <= 1)	/*if not in gGapList, then no correction is added, cuz
-									corrections array initialized to zero.*/
+			if(avCorrection > 0)
 			{
-				nodeCorrection += corrections[0];
+				avCorrection = ((REAL_4)avCorrection / residueCount) + 0.5;
 			}
 			else
 			{
-				maxCorrection = corrections[0];
-				minCorrection = corrections[0];
-				for(k = 1; k < residueCount; k++)
-				{
-					if(corrections[k] > maxCorrection)
-					{
-						maxCorrection = corrections[k];
-					}
-					if(corrections[k] < minCorrection)
-					{
-						minCorrection = corrections[k];
-					}
-				}
-				correctionSpread = maxCorrection - minCorrection;
-				if(correctionSpread <= 5)
-				{
-					avCorrection = 0;
-					for(k = 0; k < residueCount; k++)
-					{
-						avCorrection += corrections[k];
-					}
-					if(avCorrection > 0)
-					{
-						avCorrection = ((REAL_4)avCorrection / residueCount) + 0.5;
-					}
-					else
-					{
-						avCorrection = ((REAL_4)avCorrection / residueCount) - 0.5;
-					}
-					nodeCorrection += avCorrection;
-				}
+				avCorrection = ((REAL_4)avCorrection / residueCount) - 0.5;
 			}
+			*correction = avCorrection;
 		}
 	}
 	
-	
-	
-	if(nodeCorrection >= 5)
-	{
-		nodeCorrection = ((REAL_4)nodeCorrection / 10) + 0.5;
-		bCal += nodeCorrection;
-	}
-	else if(nodeCorrection <= -5)
-	{
-		nodeCorrection = ((REAL_4)nodeCorrection / 10) - 0.5;
-		bCal += nodeCorrection;
-	}
+	return('D');
+}
 
-	
-	
-	
-	
-	
-	
-	if(bCal > gParam.monoToAv)
-	{
-		mToAFactor = 0;
+/******************************BuildFragLadder*********************************************
+*
+*	BuildFragLadder fills gFragLadder for a sequence of residue masses: the summed residue
+*	mass and node correction of every N-terminal fragment (bMass[i] and bCorrection[i] are 
+*	for residues 0 thru i-1), and the node correction of every C-terminal fragment 
+*	(yCorrection[i] is for residues i thru seqLength-1).  BCalculator and YCalculator then 
+*	look up each ion in constant time, instead of adding up the residues again for every
+*	position.
+*
+*	As in the old per-ion sums, a residue mass that is not in gGapList picks up the first
+*	correction of the nearest two amino acid residue before it in the same fragment, or 
+*	nothing if there is none.  The y ladder is built from the C-terminus, so "yOpen" counts
+*	the residues of that kind that are still waiting for such a two amino acid residue.
+*/
+void BuildFragLadder(INT_4 *sequence, INT_4 seqLength)
+{
+	INT_4 i, correction, firstCorrection, lastFirstCorrection, yOpen;
+	char residueType;
+	
+	if(gFragLadder.limit < seqLength + 1)
+	{
+		free(gFragLadder.residue);
+		free(gFragLadder.bMass);
+		free(gFragLadder.bCorrection);
+		free(gFragLadder.yCorrection);
+		gFragLadder.limit = seqLength + 1;
+		gFragLadder.residue = (INT_4 *) malloc(gFragLadder.limit * sizeof(INT_4));
+		gFragLadder.bMass = (INT_4 *) malloc(gFragLadder.limit * sizeof(INT_4));
+		gFragLadder.bCorrection = (INT_4 *) malloc(gFragLadder.limit * sizeof(INT_4));
+		gFragLadder.yCorrection = (INT_4 *) malloc(gFragLadder.limit * sizeof(INT_4));
+		if(gFragLadder.residue == NULL || gFragLadder.bMass == NULL 
+			|| gFragLadder.bCorrection == NULL || gFragLadder.yCorrection == NULL)
+		{
+			printf("BuildFragLadder:  Out of memory.");
+			exit(1);
+		}
 	}
-	else
+	gFragLadder.seqLength = seqLength;
+	
+/*	N-terminal fragments.*/
+	gFragLadder.bMass[0] = 0;
+	gFragLadder.bCorrection[0] = 0;
+	lastFirstCorrection = 0;
+	for(i = 0; i < seqLength; i++)
 	{
-		if(bCal >= (gParam.monoToAv - gAvMonoTransition))
+		gFragLadder.residue[i] = sequence[i];
+		residueType = ResidueCorrection(sequence[i], &correction, &firstCorrection);
+		if(residueType == 'D')
 		{
-			mToAFactor = (gParam.monoToAv - bCal) / gAvMonoTransition;
+			lastFirstCorrection = firstCorrection;
 		}
-		else
+		else if(residueType == 0)
 		{
-			mToAFactor = 1;
+			correction = lastFirstCorrection;
 		}
+		gFragLadder.bMass[i + 1] = gFragLadder.bMass[i] + sequence[i];
+		gFragLadder.bCorrection[i + 1] = gFragLadder.bCorrection[i] + correction;
 	}
-	mToAFactor = MONO_TO_AV - ((MONO_TO_AV - 1) * mToAFactor);
-	if(bCal >= (gParam.monoToAv - gAvMonoTransition))
+	
+/*	C-terminal fragments.*/
+	gFragLadder.yCorrection[seqLength] = 0;
+	yOpen = 0;
+	for(i = seqLength - 1; i >= 0; i--)
 	{
-		bCal = bCal * mToAFactor;
+		residueType = ResidueCorrection(sequence[i], &correction, &firstCorrection);
+		gFragLadder.yCorrection[i] = correction + gFragLadder.yCorrection[i + 1];
+		if(residueType == 'D')
+		{
+			gFragLadder.yCorrection[i] += yOpen * firstCorrection;
+			yOpen = 0;
+		}
+		else if(residueType == 0)
+		{
+			yOpen++;
+		}
 	}
-
 	
-
-	return(bCal);
+	return;
 }
 
-/******************************YCalculator********************************************
-*
-*	This function calculates singly charged y ion masses.  It applies the appropriate
-*	average mass correction factor, and returns a INT_4.
+/******************************FragLadder**************************************************
 *
+*	Returns gFragLadder for this sequence.  LoadSequence normally has built it already; it
+*	is rebuilt here if the sequence has been changed since then (ScoreC1 can add a residue
+*	to the N-terminus, for example).
 */
-INT_4 YCalculator(INT_4 i, INT_4 *sequence, INT_4 seqLength, INT_4 yCalStart, INT_4 yCalCorrection)
+tFragLadder *FragLadder(INT_4 *sequence, INT_4 seqLength)
 {
-	INT_4 yCal = yCalStart;
-	INT_4 j, k, nodeCorrection = yCalCorrection;
-	INT_4 residueCount, correctionSpread, corrections[10], maxCorrection, minCorrection;
-	INT_4 avCorrection;
-	REAL_8 mToAFactor;
-	char test;
+	INT_4 i;
 	
-	for(j = 0; j < 10; j++)
-	{
-		corrections[j] = 0;
-	}
-	for(j = i; j < seqLength; j++)
+	if(gFragLadder.seqLength == seqLength && gFragLadder.residue != NULL)
 	{
-		yCal += sequence[j];
-	}
-	for(j = i; j < seqLength; j++)
-	{
-		test = TRUE;
-		for(k = 0; k < gAminoAcidNumber; k++)
+		for(i = 0; i < seqLength; i++)
 		{
-			if(sequence[j] == gGapList[k])
+			if(gFragLadder.residue[i] != sequence[i])
 			{
-				nodeCorrection += gNodeCorrection[k];
-				test = FALSE;
+				break;
 			}
 		}
-		if(test)	/*test is true if this is a dipeptide*/
+		if(i == seqLength)
 		{
-			residueCount = 0;
-			for(k = gAminoAcidNumber; k <= gGapListIndex; k++)
-			{
-				if(sequence[j] == gGapList[k])
-				{
-					corrections[residueCount] = gNodeCorrection[k];
-					residueCount++;
-					if(residueCount >= 10)
-					{
-						printf("LutefiskScore: residueCount exceeds 10.\n");
-						exit(1);
-					}
-				}
-			}
-			if(residueCount <= 1)	/*if not in gGapList, then nothing is added to 
-									nodecorrection, since corrections array initialized
-									to zero*/
-			{
-				nodeCorrection += corrections[0];
-			}
-			else
-			{
-				maxCorrection = corrections[0];
-				minCorrection = corrections[0];
-				for(k = 1; k < residueCount; k++)
-				{
-					if(corrections[k] > maxCorrection)
-					{
-						maxCorrection = corrections[k];
-					}
-					if(corrections[k] < minCorrection)
-					{
-						minCorrection = corrections[k];
-					}
-				}
-				correctionSpread = maxCorrection - minCorrection;
-				if(correctionSpread <= 5)
-				{
-					avCorrection = 0;
-					for(k = 0; k < residueCount; k++)
-					{
-						avCorrection += corrections[k];
-					}
-					if(avCorrection > 0)
-					{
-						avCorrection = ((REAL_4)avCorrection / residueCount) + 0.5;
-					}
-					else
-					{
-						avCorrection = ((REAL_4)avCorrection / residueCount) - 0.5;
-					}
-					nodeCorrection += avCorrection;
-				}
-			}
+			return(&gFragLadder);
 		}
 	}
+	BuildFragLadder(sequence, seqLength);
+	
+	return(&gFragLadder);
+}
+
+/******************************CorrectIonMass**********************************************
+*
+*	Adds the rounded node correction to a singly charged b or y ion mass, and then applies 
+*	the appropriate average mass correction factor.
+*/
+INT_4 CorrectIonMass(INT_4 ionCal, INT_4 nodeCorrection)
+{
+	REAL_8 mToAFactor;
+	
 	if(nodeCorrection >= 5)
 	{
 		nodeCorrection = ((REAL_4)nodeCorrection / 10) + 0.5;
-		yCal += nodeCorrection;
+		ionCal += nodeCorrection;
 	}
 	else if(nodeCorrection <= -5)
 	{
 		nodeCorrection = ((REAL_4)nodeCorrection / 10) - 0.5;
-		yCal += nodeCorrection;
+		ionCal += nodeCorrection;
 	}
-		
 	
-	if(yCal > gParam.monoToAv)
+	if(ionCal > gParam.monoToAv)
 	{
 		mToAFactor = 0;
 	}
 	else
 	{
-		if(yCal >= (gParam.monoToAv - gAvMonoTransition))
+		if(ionCal >= (gParam.monoToAv - gAvMonoTransition))
 		{
-			mToAFactor = (gParam.monoToAv - yCal) / gAvMonoTransition;
+			mToAFactor = (gParam.monoToAv - ionCal) / gAvMonoTransition;
 		}
 		else
 		{
@@ -3311,30 +3792,56 @@ INT_4 YCalculator(INT_4 i, INT_4 *sequence, INT_4 seqLength, INT_4 yCalStart, IN
 		}
 	}
 	mToAFactor = MONO_TO_AV - ((MONO_TO_AV - 1) * mToAFactor);
-	if(yCal >= (gParam.monoToAv - gAvMonoTransition))
+	if(ionCal >= (gParam.monoToAv - gAvMonoTransition))
 	{
-		yCal = yCal * mToAFactor;
+		ionCal = ionCal * mToAFactor;
 	}
 	
-	return(yCal);
+	return(ionCal);
 }
 
-/***************************TwoAAExtFinder*********************************
+/******************************BCalculator********************************************
 *
-*	Returns a char value of TRUE or FALSE depending on if the extension contains two
-*	amino acids (TRUE) or not (FALSE).
+*	This function calculates singly charged b ion masses, for the b ion containing the 
+*	first i residues of the ladder. It applies the appropriate average mass correction 
+*	factor, and returns a INT_4.
 *
 */
-char TwoAAExtFinder(INT_4 *sequence, INT_4 i)
+INT_4 BCalculator(INT_4 i, tFragLadder *ladder, INT_4 bCalStart, INT_4 bCalCorrection)
 {
-	INT_4 j;
-	char twoAAExtension;
-	
-	twoAAExtension = TRUE;
-	j = 0;
-	while(twoAAExtension && j < gAminoAcidNumber)
-	{
-		if((sequence[i] <= (gMonoMass_x100[j] + gToleranceNarrow)) 
+	return(CorrectIonMass(bCalStart + ladder->bMass[i], 
+				bCalCorrection + ladder->bCorrection[i]));
+}
+
+/******************************YCalculator********************************************
+*
+*	This function calculates singly charged y ion masses, for the y ion made of residues
+*	i thru the end of the ladder.  It applies the appropriate average mass correction 
+*	factor, and returns a INT_4.
+*
+*/
+INT_4 YCalculator(INT_4 i, tFragLadder *ladder, INT_4 yCalStart, INT_4 yCalCorrection)
+{
+	return(CorrectIonMass(yCalStart + ladder->bMass[ladder->seqLength] - ladder->bMass[i], 
+				yCalCorrection + ladder->yCorrection[i]));
+}
+
+/***************************TwoAAExtFinder*********************************
+*
+*	Returns a char value of TRUE or FALSE depending on if the extension contains two
+*	amino acids (TRUE) or not (FALSE).
+*
+*/
+char TwoAAExtFinder(INT_4 *sequence, INT_4 i)
+{
+	INT_4 j;
+	char twoAAExtension;
+	
+	twoAAExtension = TRUE;
+	j = 0;
+	while(twoAAExtension && j < gAminoAcidNumber)
+	{
+		if((sequence[i] <= (gMonoMass_x100[j] + gToleranceNarrow)) 
 			&& (sequence[i] >= (gMonoMass_x100[j] - gToleranceNarrow)))
 		{
 			twoAAExtension = FALSE;
@@ -3531,6 +4038,7 @@ struct Sequence *InitLutefiskScore(INT_4 *sequence, INT_4 *fragMOverZ, INT_4 *fr
 	Check to see if there is an ion at 147 or 175, indicating a tryptic C-terminus.
 	If gTrypticCterm is TRUE then something is done in "MassageScores".
 */
+	gTrypticCterm = FALSE;
 	if(gParam.proteolysis == 'T')
 	{
 		if(gParam.fragmentPattern == 'Q' || gParam.fragmentPattern == 'T')
@@ -3899,7 +4407,7 @@ void HighMOverZFilter(struct Sequence *firstSequencePtr, INT_4 *fragMOverZ,
 		if(currSeqPtr->score == 0)
 		{
 			previousSeqPtr->next = currSeqPtr->next;
-			free(currSeqPtr);
+			DisposeSequenceStruct(currSeqPtr);
 			currSeqPtr = previousSeqPtr->next;
 		}
 		else
@@ -4022,7 +4530,7 @@ void TossTheLosers(struct Sequence *firstSequencePtr, REAL_4 *ionFoundTemplate,
 		if(currSeqPtr->score == 0)
 		{
 			previousSeqPtr->next = currSeqPtr->next;
-			free(currSeqPtr);
+			DisposeSequenceStruct(currSeqPtr);
 			currSeqPtr = previousSeqPtr->next;
 		}
 		else
@@ -4169,6 +4677,7 @@ REAL_4 BYIntensityScorer(INT_4 *fragIntensity, REAL_4 *ionFound, INT_4 cleavageS
 INT_4 FindBYIons(REAL_4 *ionFound, INT_4 fragNum, INT_4 *fragMOverZ,
 				     INT_4 *sequence, INT_4 seqLength)
 {
+	tFragLadder *ladder;
 	INT_4 i, j, nChargeCount, cChargeCount, bCal, yCal, cleavageSites;
 	INT_4 bOrYIon, k, bCalStart, yCalStart;
 	INT_4 bIonMass, bIonMassMinErr, bIonMassPlusErr;
@@ -4230,6 +4739,8 @@ INT_4 FindBYIons(REAL_4 *ionFound, INT_4 fragNum, INT_4 *fragMOverZ,
 /*
 	Here's the big loop, where I step through each position in the sequence.
 */
+	ladder = FragLadder(sequence, seqLength);	/*Cumulative b and y masses.*/
+	
 	for(i = (seqLength - 1); i > 0; i--)	/*Don't do this loop for i = 0 (doesnt make sense).*/
 	{
 		
@@ -4249,12 +4760,12 @@ INT_4 FindBYIons(REAL_4 *ionFound, INT_4 fragNum, INT_4 *fragMOverZ,
 /*	
 	Calculate the singly charged y ion mass.
 */
-	yCal = YCalculator(i, sequence, seqLength, yCalStart, yCalCorrection);
+	yCal = YCalculator(i, ladder, yCalStart, yCalCorrection);
 	
 /*
 	Calculate the singly charged b ion mass.
 */
-	bCal = BCalculator(i, sequence, bCalStart, bCalCorrection);
+	bCal = BCalculator(i, ladder, bCalStart, bCalCorrection);
 		
 /*	
 	Readjust the number of charges in the C- and N-terminii.
@@ -4304,8 +4815,8 @@ INT_4 FindBYIons(REAL_4 *ionFound, INT_4 fragNum, INT_4 *fragMOverZ,
 			if((bIonMass * j) > ((j-1) * 400 * gMultiplier)) /*Make sure there is enough mass to hold 
 													the charge.*/
 			{
-				k = fragNum - 1;
-				while(fragMOverZ[k] >= bIonMassMinErr && k >= 0)
+				k = IonIndexHigh(fragMOverZ, fragNum, bIonMassPlusErr);
+				while(k >= 0 && fragMOverZ[k] >= bIonMassMinErr)
 				{
 					if(fragMOverZ[k] <= bIonMassPlusErr)
 					{
@@ -4353,8 +4864,8 @@ INT_4 FindBYIons(REAL_4 *ionFound, INT_4 fragNum, INT_4 *fragMOverZ,
 													the charge.*/
 			{
 				test = FALSE;
-				k = fragNum - 1;
-				while(fragMOverZ[k] >= yIonMassMinErr && k >= 0)
+				k = IonIndexHigh(fragMOverZ, fragNum, yIonMassPlusErr);
+				while(k >= 0 && fragMOverZ[k] >= yIonMassMinErr)
 				{
 					if(fragMOverZ[k] <= yIonMassPlusErr)
 					{
@@ -4473,7 +4984,7 @@ void	PrintToConsoleAndFile(struct SequenceScore *firstScorePtr, REAL_4 quality,
 	char *peptideString = NULL;
 	INT_4 peptide[MAX_PEPTIDE_LENGTH];
 	INT_4 peptideLength = 0;
-	struct SequenceScore *maxPtr;
+	struct SequenceScore *maxPtr, **rankPtr;
 	FILE *fp;
    	const 	time_t		theTime = (const time_t)time(NULL);
 	
@@ -4584,74 +5095,69 @@ void	PrintToConsoleAndFile(struct SequenceScore *firstScorePtr, REAL_4 quality,
 		}
 	}
 	
+	rankPtr = SeqScoreRanks(firstScorePtr, 50);
 	for(i = 1; i <= 50; i ++)	/*List the top 50 sequences.*/
 	{
 		if(i > seqNum)	/*Break out if there are less than 50 sequences in the entire list.*/
 		{
 			break;
 		}
-		maxPtr = firstScorePtr;
-		while(maxPtr != NULL)
-		{	
-			if(maxPtr->rank == i && maxPtr->databaseSeq != 2)	
+		maxPtr = rankPtr[i];
+		if(maxPtr != NULL && maxPtr->databaseSeq != 2)
+		{
+		 	/*Change peptide[j] to single letter code.*/
+			peptideString = NULL;
+			peptideLength = 0;
+			
+			j = 0;
+			while(maxPtr->peptide[j] != 0)
+			{
+				peptide[j] = maxPtr->peptideSequence[j];
+				peptideLength++;
+				j++;
+			}
+			
+			if(maxPtr->databaseSeq)
+			{
+				peptideString = GetDatabaseSeq(peptide, peptideLength);
+			}
+			else
+			{
+				peptideString = PeptideString(peptide, peptideLength);
+			}
+			
+			
+							
+			
+			if(peptideString) 
 			{
-			 	/*Change peptide[j] to single letter code.*/
-				peptideString = NULL;
-				peptideLength = 0;
-				
-				j = 0;
-				while(maxPtr->peptide[j] != 0)
-				{
-					peptide[j] = maxPtr->peptideSequence[j];
-					peptideLength++;
-					j++;
-				}
-				
 				if(maxPtr->databaseSeq)
 				{
-					peptideString = GetDatabaseSeq(peptide, peptideLength);
+					strcat(peptideString, "  DB");
 				}
-				else
+					 
+				if(gParam.fMonitor)
 				{
-					peptideString = PeptideString(peptide, peptideLength);
+					printf("%-55.55s %2ld   %5.3f   %5.3f    %5.3f   %5.3f  %5.3f\n", 
+				  		 peptideString, i - skippedOver, maxPtr->comboScore, 
+						 maxPtr->probScore, maxPtr->quality, maxPtr->intensityScore, 
+						 maxPtr->crossDressingScore);
 				}
-				
-				
-								
-				
-				if(peptideString) 
-				{
-					if(maxPtr->databaseSeq)
-					{
-						strcat(peptideString, "  DB");
-					}
-						 
-					if(gParam.fMonitor)
-					{
-						printf("%-55.55s %2ld   %5.3f   %5.3f    %5.3f   %5.3f  %5.3f\n", 
-					  		 peptideString, i - skippedOver, maxPtr->comboScore, 
-							 maxPtr->probScore, maxPtr->quality, maxPtr->intensityScore, 
-							 maxPtr->crossDressingScore);
-					}
 
-					fprintf(fp, "%-55.55s %2ld   %5.3f   %5.3f    %5.3f   %5.3f  %5.3f\n", 
-					  		 peptideString, i - skippedOver, maxPtr->comboScore, 
-							 maxPtr->probScore, maxPtr->quality, maxPtr->intensityScore, 
-							 maxPtr->crossDressingScore);
-							 	 
-					free(peptideString);
-				}
-				else
-				{
-					skippedOver++;
-				}
-				
-				break;
+				fprintf(fp, "%-55.55s %2ld   %5.3f   %5.3f    %5.3f   %5.3f  %5.3f\n", 
+				  		 peptideString, i - skippedOver, maxPtr->comboScore, 
+						 maxPtr->probScore, maxPtr->quality, maxPtr->intensityScore, 
+						 maxPtr->crossDressingScore);
+						 	 
+				free(peptideString);
+			}
+			else
+			{
+				skippedOver++;
 			}
-			
-			maxPtr = maxPtr->next;
 		}
 	}
+	free(rankPtr);
 	
 	
 	
@@ -5070,27 +5576,7 @@ REAL_4	ComboScore(struct SequenceScore *currPtr)
 
 	
 	/*Initialize*/
-	if(gParam.fragmentPattern == 'Q')
-	{
-		pevScrWt	= 1;
-		qualScrWt	= 1.8;
-		intScrWt	= 2;
-		xcorrScrWt	= 1;
-	}
-	else if(gParam.fragmentPattern == 'L')
-	{
-		pevScrWt	= 1.25;
-		qualScrWt	= 0.75;
-		intScrWt	= 2;
-		xcorrScrWt	= 1.5;
-	}
-	else
-	{
-		pevScrWt	= 1;
-		qualScrWt	= 1;
-		intScrWt	= 1;
-		xcorrScrWt	= 1;
-	}
+	ComboScoreModel(&pevScrWt, &qualScrWt, &intScrWt, &xcorrScrWt, &aConstant, &bConstant, &cConstant);
 	
 	summedWt = pevScrWt + qualScrWt + intScrWt + xcorrScrWt;
 	if(summedWt == 0)
@@ -5110,26 +5596,6 @@ REAL_4	ComboScore(struct SequenceScore *currPtr)
 	upperLimit			= 0.99;
 	lowerLimit			= 0.01;
 	
-	/*Pr(wrong) = Ax2 + Bx + C*/
-	if(gParam.fragmentPattern == 'Q')
-	{
-		aConstant	= 2.667;	/*Qtof model derived from data set*/
-		bConstant	= -4.9901;
-		cConstant	= 2.293;
-	}
-	else if(gParam.fragmentPattern == 'L')
-	{
-		aConstant	= -1.106;	/*LCQ model derived from data set*/
-		bConstant	= -0.607;
-		cConstant	= 1.467;
-	}
-	else
-	{
-		aConstant	= 0;	/*For other data use an average of the two constants, since no modeling has been done*/
-		bConstant	= -2.8;	/*Use a linear model, too*/
-		cConstant	= 1.9;
-	}
-	
 	/*Calculate probability of being wrong*/
 	probWrong	= aConstant * averageScore * averageScore + bConstant * averageScore + cConstant;
 	
@@ -5151,6 +5617,162 @@ REAL_4	ComboScore(struct SequenceScore *currPtr)
 	
 	return(probRight);
 }
+/*****************************ComboScoreModel***********************************************************
+*
+*	Fills in the score weights and the Pr(wrong) = Ax2 + Bx + C constants that ComboScore uses for
+*	the current fragmentation pattern.
+*/
+static void ComboScoreModel(REAL_4 *pevScrWt, REAL_4 *qualScrWt, REAL_4 *intScrWt, REAL_4 *xcorrScrWt,
+						REAL_4 *aConstant, REAL_4 *bConstant, REAL_4 *cConstant)
+{
+	if(gParam.fragmentPattern == 'Q')
+	{
+		*pevScrWt	= 1;
+		*qualScrWt	= 1.8;
+		*intScrWt	= 2;
+		*xcorrScrWt	= 1;
+		
+		*aConstant	= 2.667;	/*Qtof model derived from data set*/
+		*bConstant	= -4.9901;
+		*cConstant	= 2.293;
+	}
+	else if(gParam.fragmentPattern == 'L')
+	{
+		*pevScrWt	= 1.25;
+		*qualScrWt	= 0.75;
+		*intScrWt	= 2;
+		*xcorrScrWt	= 1.5;
+		
+		*aConstant	= -1.106;	/*LCQ model derived from data set*/
+		*bConstant	= -0.607;
+		*cConstant	= 1.467;
+	}
+	else
+	{
+		*pevScrWt	= 1;
+		*qualScrWt	= 1;
+		*intScrWt	= 1;
+		*xcorrScrWt	= 1;
+		
+		*aConstant	= 0;	/*For other data use an average of the two constants, since no modeling has been done*/
+		*bConstant	= -2.8;	/*Use a linear model, too*/
+		*cConstant	= 1.9;
+	}
+	return;
+}
+/*****************************ComboScoreAt**************************************************************
+*
+*	Returns the comboScore that DetermineBestCandidates will give currPtr if its normalized x-corr 
+*	score is xcorr.  The xcorr, intscr, and quality values are clipped at one, just like they are
+*	there, but currPtr itself is not changed.
+*/
+REAL_4	ComboScoreAt(struct SequenceScore *currPtr, REAL_4 xcorr)
+{
+	struct SequenceScore clippedScore;
+	
+	clippedScore = *currPtr;
+	clippedScore.crossDressingScore = xcorr;
+	if(clippedScore.crossDressingScore > 1)
+	{
+		clippedScore.crossDressingScore = 1;
+	}
+	if(clippedScore.intensityScore > 1)
+	{
+		clippedScore.intensityScore = 1;
+	}
+	if(clippedScore.quality > 1)
+	{
+		clippedScore.quality = 1;
+	}
+	
+	return(ComboScore(&clippedScore));
+}
+/*****************************ComboScoreBound***********************************************************
+*
+*	Returns a comboScore that ComboScoreAt(currPtr, xcorr) can not beat for any x-corr score from
+*	xcorrLow up to one (higher ones are clipped to one anyway).  Only the cheap intscr, quality, and 
+*	probscr values are needed, so the cross-correlation can be skipped for sequences whose bound 
+*	is too low to make the final list.  Since Pr(wrong) is a parabola in the weighted average score,
+*	its smallest value over the range of averages is at one of the ends or at the bottom of the 
+*	parabola.  The range and the result are padded by COMBO_BOUND_SLACK to cover the REAL_4 round 
+*	off in ComboScore.
+*/
+REAL_4	ComboScoreBound(struct SequenceScore *currPtr, REAL_4 xcorrLow)
+{
+	REAL_4	pevScrWt, qualScrWt, intScrWt, xcorrScrWt;
+	REAL_4	aConstant, bConstant, cConstant;
+	REAL_4	intScore, quality, upperLimit, lowerLimit, probRight;
+	REAL_8	summedWt, knownScore, lowAverage, highAverage, vertex, slack;
+	REAL_8	probWrong, testProbWrong;
+	
+	ComboScoreModel(&pevScrWt, &qualScrWt, &intScrWt, &xcorrScrWt, &aConstant, &bConstant, &cConstant);
+	summedWt = (REAL_8)pevScrWt + qualScrWt + intScrWt + xcorrScrWt;
+	if(summedWt == 0)
+	{
+		printf("Divide by zero in ComboScoreBound");
+		exit(1);
+	}
+	
+	intScore = currPtr->intensityScore;
+	if(intScore > 1)
+	{
+		intScore = 1;
+	}
+	quality = currPtr->quality;
+	if(quality > 1)
+	{
+		quality = 1;
+	}
+	if(xcorrLow > 1)
+	{
+		xcorrLow = 1;
+	}
+	
+	/*The range of weighted average scores*/
+	knownScore = (REAL_8)currPtr->probScore * pevScrWt + (REAL_8)intScore * intScrWt + 
+					(REAL_8)quality * qualScrWt;
+	lowAverage = (knownScore + (REAL_8)xcorrLow * xcorrScrWt) / summedWt;
+	highAverage = (knownScore + xcorrScrWt) / summedWt;
+	slack = COMBO_BOUND_SLACK * (1 + fabs(lowAverage) + fabs(highAverage));
+	lowAverage -= slack;
+	highAverage += slack;
+	
+	/*Find the lowest Pr(wrong) = Ax2 + Bx + C over the range*/
+	probWrong = aConstant * lowAverage * lowAverage + bConstant * lowAverage + cConstant;
+	testProbWrong = aConstant * highAverage * highAverage + bConstant * highAverage + cConstant;
+	if(testProbWrong < probWrong)
+	{
+		probWrong = testProbWrong;
+	}
+	if(aConstant > 0)
+	{
+		vertex = -bConstant / (2 * aConstant);
+		if(vertex > lowAverage && vertex < highAverage)
+		{
+			testProbWrong = aConstant * vertex * vertex + bConstant * vertex + cConstant;
+			if(testProbWrong < probWrong)
+			{
+				probWrong = testProbWrong;
+			}
+		}
+	}
+	
+	/*Same extreme ends of probability as ComboScore, and the same REAL_4 values for them*/
+	upperLimit			= 0.99;
+	lowerLimit			= 0.01;
+	if(probWrong - COMBO_BOUND_SLACK > upperLimit)
+	{
+		probRight = 1 - upperLimit;
+		return(probRight);
+	}
+	else if(probWrong < lowerLimit)
+	{
+		probRight = 1 - lowerLimit;
+		return(probRight);
+	}
+	
+	return((REAL_4)(1 - probWrong + COMBO_BOUND_SLACK));
+}
 /*****************************DetermineBestCandidates***************************************************
 *
 *	Sequences derived from databases are deemed to be correct if either the xcorr, intscr, or probscr
@@ -5715,7 +6337,7 @@ void	PrintToConsole(struct SequenceScore *firstScorePtr)
 {
 	INT_4 i, j, seqNum;
 	REAL_4 xcorrNormalizer;
-	struct SequenceScore *maxPtr, *currPtr;
+	struct SequenceScore *maxPtr, *currPtr, **rankPtr;
 	
 /*	Find the xcorr normalizer.*/
 	xcorrNormalizer = 0;
@@ -5742,51 +6364,46 @@ void	PrintToConsole(struct SequenceScore *firstScorePtr)
 		maxPtr = maxPtr->next;
 	}
 		
+	rankPtr = SeqScoreRanks(firstScorePtr, 50);
 	for(i = 1; i <= 50 && i <= seqNum; i++)	/*List the top 50 sequences.*/
 	{
-		maxPtr = firstScorePtr;
-		while(maxPtr != NULL)
-		{	
-			if(maxPtr->rank == i)
-			{
-				/*Change peptide[j] to single letter code.*/
-				char *peptideString;
-				INT_4 peptide[MAX_PEPTIDE_LENGTH];
-				INT_4 peptideLength = 0;
-				
-				j = 0;
-				while(maxPtr->peptide[j] != 0)
-				{
-					peptide[j] = maxPtr->peptideSequence[j];
-					peptideLength++;
-					j++;
-				}
-				peptideString = PeptideString(peptide, peptideLength);
-				if(maxPtr->databaseSeq)
-				{
-					strcat(peptideString, " ");	/*used to denote this was database sequence*/
-				}
-				if(peptideString) 
-				{
-					/*printf(" %3ld   %5.3f   %5.3f   %5.3f      %5.3f    %5.3f  %6.4f  %2ld   %8.6f %s\n", i,
-						 maxPtr->crossDressingScore / xcorrNormalizer, maxPtr->intensityScore,
-						 maxPtr->intensityOnlyScore, maxPtr->quality, maxPtr->probScore, 
-						 maxPtr->stDevErr, maxPtr->cleavageSites, 
-						 maxPtr->calFactor, peptideString);*/
-					printf(" %3ld   %5.3f   %5.3f    %5.3f    %5.3f  %6.4f  %2ld   %8.6f %s\n", i,
-						 maxPtr->crossDressingScore / xcorrNormalizer, maxPtr->intensityScore,
-						 maxPtr->quality, maxPtr->probScore, 
-						 maxPtr->stDevErr, maxPtr->cleavageSites, 
-						 maxPtr->calFactor, peptideString);
-					free(peptideString);
-				}
+		maxPtr = rankPtr[i];
+		if(maxPtr != NULL)
+		{
+			/*Change peptide[j] to single letter code.*/
+			char *peptideString;
+			INT_4 peptide[MAX_PEPTIDE_LENGTH];
+			INT_4 peptideLength = 0;
 			
-				break;
+			j = 0;
+			while(maxPtr->peptide[j] != 0)
+			{
+				peptide[j] = maxPtr->peptideSequence[j];
+				peptideLength++;
+				j++;
+			}
+			peptideString = PeptideString(peptide, peptideLength);
+			if(maxPtr->databaseSeq)
+			{
+				strcat(peptideString, " ");	/*used to denote this was database sequence*/
+			}
+			if(peptideString) 
+			{
+				/*printf(" %3ld   %5.3f   %5.3f   %5.3f      %5.3f    %5.3f  %6.4f  %2ld   %8.6f %s\n", i,
+					 maxPtr->crossDressingScore / xcorrNormalizer, maxPtr->intensityScore,
+					 maxPtr->intensityOnlyScore, maxPtr->quality, maxPtr->probScore, 
+					 maxPtr->stDevErr, maxPtr->cleavageSites, 
+					 maxPtr->calFactor, peptideString);*/
+				printf(" %3ld   %5.3f   %5.3f    %5.3f    %5.3f  %6.4f  %2ld   %8.6f %s\n", i,
+					 maxPtr->crossDressingScore / xcorrNormalizer, maxPtr->intensityScore,
+					 maxPtr->quality, maxPtr->probScore, 
+					 maxPtr->stDevErr, maxPtr->cleavageSites, 
+					 maxPtr->calFactor, peptideString);
+				free(peptideString);
 			}
-			
-			maxPtr = maxPtr->next;
 		}
 	}
+	free(rankPtr);
 		
 	/*	Print out the sequences w/ x-corr greater than 0.9 that were not already listed above.*/
 
@@ -5981,7 +6598,7 @@ struct Sequence *AddTagBack(struct Sequence *firstSequencePtr)
 		}
 		discardPtr = firstSequencePtr;
 		firstSequencePtr = firstSequencePtr->next;
-		free(discardPtr);
+		DisposeSequenceStruct(discardPtr);
 	}
 	if(firstSequencePtr != NULL)
 	{
@@ -5994,7 +6611,7 @@ struct Sequence *AddTagBack(struct Sequence *firstSequencePtr)
 				previousPtr->next = currSeqPtr->next;
 				discardPtr = currSeqPtr;
 				currSeqPtr = currSeqPtr->next;
-				free(discardPtr);
+				DisposeSequenceStruct(discardPtr);
 			}
 			else
 			{
@@ -6017,20 +6634,11 @@ struct Sequence *AddTagBack(struct Sequence *firstSequencePtr)
 */
 void SeqIntensityRanker(struct SequenceScore *firstScorePtr)
 {
-	struct SequenceScore *currPtr, *maxPtr;
+	struct SequenceScore *currPtr;
+	tScoreOrder *scoreArray;
 	INT_4 i, j, k, seqNum;
-	REAL_4 maxScore;
 	BOOLEAN test;
 	
-/*	Count the sequences.*/
-	currPtr = firstScorePtr;
-	seqNum = 0;
-	while(currPtr != NULL)
-	{
-		seqNum += 1;
-		currPtr = currPtr->next;
-	}
-	
 /*	Eliminate any poser database sequences that crept in due to K/Q and the like.*/
 	
 	currPtr = firstScorePtr;	
@@ -6086,26 +6694,15 @@ void SeqIntensityRanker(struct SequenceScore *firstScorePtr)
 	}
 	
 	
-/*	Rank the MAX_X_CORR_NUM or seqNum highest scoring sequences (which ever is smaller).*/
-	i = 1;
-	while(i <= MAX_X_CORR_NUM && i <= seqNum)
+/*	Rank the MAX_X_CORR_NUM or seqNum highest scoring sequences (which ever is smaller).  
+	Sequences with the same score are ranked in list order.*/
+	scoreArray = SeqScoreArray(firstScorePtr, &seqNum);
+	qsort(scoreArray, seqNum, sizeof(tScoreOrder), IntensityScoreSortDescend);
+	for(i = 0; i < MAX_X_CORR_NUM && i < seqNum; i++)
 	{
-		maxPtr = firstScorePtr;
-		maxScore = -1000000;
-		currPtr = firstScorePtr;
-		while(currPtr != NULL)
-		{
-			if(currPtr->intensityScore > maxScore && currPtr->rank == 0)
-			{
-				maxPtr = currPtr;
-				maxScore = currPtr->intensityScore;
-			}
-			currPtr = currPtr->next;
-		}
-		
-		maxPtr->rank = i;
-		i++;
+		scoreArray[i].scorePtr->rank = i + 1;
 	}
+	free(scoreArray);
 	
 /*	Now that they've been ranked, restore the original intensityScore value.*/
 	
@@ -6130,107 +6727,196 @@ void SeqIntensityRanker(struct SequenceScore *firstScorePtr)
 */
 void SeqComboScoreRanker(struct SequenceScore *firstScorePtr)
 {
-	struct SequenceScore *currPtr, *maxPtr;
+	tScoreOrder *scoreArray;
 	INT_4 i, seqNum;
-	REAL_4 maxScore, maxIntScore, maxProbScore;
-	
-/*	Count the sequences.*/
-	currPtr = firstScorePtr;
-	seqNum = 0;
-	while(currPtr != NULL)
-	{
-		seqNum += 1;
-		currPtr = currPtr->next;
-	}
 		
-/*	Rank the MAX_X_CORR_NUM or seqNum highest scoring sequences (which ever is smaller).*/
-	i = 1;
-	while(i <= MAX_X_CORR_NUM && i <= seqNum)
+/*	Rank the MAX_X_CORR_NUM or seqNum highest scoring sequences (which ever is smaller).  Ties 
+	in comboScore are broken by probScore and then by intensityScore, and then by list order.*/
+	scoreArray = SeqScoreArray(firstScorePtr, &seqNum);
+	qsort(scoreArray, seqNum, sizeof(tScoreOrder), ComboScoreSortDescend);
+	for(i = 0; i < MAX_X_CORR_NUM && i < seqNum; i++)
 	{
-		maxPtr 			= firstScorePtr;
-		maxScore 		= -1000000;
-		maxIntScore 	= -1000000;
-		maxProbScore 	= -1000000;
-		currPtr 		= firstScorePtr;
-		while(currPtr != NULL)
-		{
-			if(currPtr->comboScore > maxScore && currPtr->rank == 0)	/*rank by comboscore*/
-			{
-				maxPtr 			= currPtr;
-				maxScore 		= currPtr->comboScore;
-				maxIntScore		= currPtr->intensityScore;
-				maxProbScore 	= currPtr->probScore;
-			}
-			else if(currPtr->comboScore == maxScore && currPtr->rank == 0)
-			{
-				if(currPtr->probScore > maxProbScore && currPtr->rank == 0)	/*2nd rank by probScore*/
-				{
-					maxPtr 			= currPtr;
-					maxScore 		= currPtr->comboScore;
-					maxIntScore 	= currPtr->intensityScore;
-					maxProbScore 	= currPtr->probScore;
-				}
-				else if(currPtr->probScore == maxProbScore && currPtr->rank == 0)
-				{
-					if(currPtr->intensityScore > maxIntScore && currPtr->rank == 0)	/*3rd by intScore*/
-					{
-						maxPtr 			= currPtr;
-						maxScore 		= currPtr->comboScore;
-						maxIntScore 	= currPtr->intensityScore;
-						maxProbScore 	= currPtr->probScore;
-					}
-				}
-			}
-			currPtr = currPtr->next;
-		}
-		
-		maxPtr->rank = i;
-		i++;
+		scoreArray[i].scorePtr->rank = i + 1;
 	}
+	free(scoreArray);
 	
 	return;
 }
 
-
-/**********************FreeAllSequence************************************
+/*****************************SeqScoreArray****************************************************
 *
-* 	Used for freeing memory in a linked list.  
+*	Puts the linked list of SequenceScore structs that starts w/ firstScorePtr into an array, 
+*	in list order, for the rankers to sort.  The number of structs is returned in seqNum.
 */
-void FreeAllSequence(struct Sequence *currPtr)
+static tScoreOrder *SeqScoreArray(struct SequenceScore *firstScorePtr, INT_4 *seqNum)
 {
-	struct Sequence *freeMePtr;
+	struct SequenceScore *currPtr;
+	tScoreOrder *scoreArray;
+	INT_4 i;
+	
+	i = 0;
+	currPtr = firstScorePtr;
 	while(currPtr != NULL)
 	{
-		freeMePtr = currPtr;
+		i++;
 		currPtr = currPtr->next;
-		free(freeMePtr);
 	}
-	return;
+	
+	scoreArray = (tScoreOrder *) malloc((i + 1) * sizeof(tScoreOrder));
+	if(scoreArray == NULL)
+	{
+		printf("SeqScoreArray:  Out of memory.");
+		exit(1);
+	}
+	
+	*seqNum = i;
+	i = 0;
+	currPtr = firstScorePtr;
+	while(currPtr != NULL)
+	{
+		scoreArray[i].scorePtr = currPtr;
+		scoreArray[i].order = i;
+		i++;
+		currPtr = currPtr->next;
+	}
+	
+	return(scoreArray);
+}
+
+/*****************************IntensityScoreSortDescend*****************************************
+*
+*	For qsort; highest intensityScore first, and list order for the same intensityScore.
+*/
+static int IntensityScoreSortDescend(const void *n1, const void *n2)
+{
+	tScoreOrder *n3, *n4;
+	
+	n3 = (tScoreOrder *)n1;
+	n4 = (tScoreOrder *)n2;
+	
+	if(n3->scorePtr->intensityScore != n4->scorePtr->intensityScore)
+	{
+		return(n3->scorePtr->intensityScore < n4->scorePtr->intensityScore ? 1 : -1);
+	}
+	return(n3->order < n4->order ? -1 : 1);
 }
 
-/****************************** FindLowestScore**********************************************
+/*****************************ComboScoreSortDescend*****************************************
 *
-*	FindLowestScore is a function that inputs a pointer to a struct of type SequenceScore 
-*	that is the first in a linked list of such structs.  It searches through the 
-*	intensityScore fields of this list of structs and finds the one with the lowest intensity 
-*	score.  It returns a pointer to this struct.
+*	For qsort; highest comboScore first, then highest probScore, then highest intensityScore,
+*	and then list order.
 */
-struct SequenceScore *FindLowestScore(struct SequenceScore *currPtr)
+static int ComboScoreSortDescend(const void *n1, const void *n2)
 {
-	struct SequenceScore *lowestPtr;
+	tScoreOrder *n3, *n4;
 	
-	lowestPtr = currPtr;
+	n3 = (tScoreOrder *)n1;
+	n4 = (tScoreOrder *)n2;
 	
+	if(n3->scorePtr->comboScore != n4->scorePtr->comboScore)
+	{
+		return(n3->scorePtr->comboScore < n4->scorePtr->comboScore ? 1 : -1);
+	}
+	if(n3->scorePtr->probScore != n4->scorePtr->probScore)
+	{
+		return(n3->scorePtr->probScore < n4->scorePtr->probScore ? 1 : -1);
+	}
+	if(n3->scorePtr->intensityScore != n4->scorePtr->intensityScore)
+	{
+		return(n3->scorePtr->intensityScore < n4->scorePtr->intensityScore ? 1 : -1);
+	}
+	return(n3->order < n4->order ? -1 : 1);
+}
+
+/*****************************SeqScoreRanks*****************************************
+*
+*	Returns an array where rankPtr[i] points to the struct in the list that starts w/ 
+*	firstScorePtr that has rank i (1 <= i <= rankNum), or is NULL if none of them do.  
+*	This is so that the sequences can be gone through in rank order without looking 
+*	through the list for each rank.  The array should be freed by the caller.
+*/
+struct SequenceScore **SeqScoreRanks(struct SequenceScore *firstScorePtr, INT_4 rankNum)
+{
+	struct SequenceScore **rankPtr, *currPtr;
+	
+	rankPtr = (struct SequenceScore **) calloc(rankNum + 1, sizeof(struct SequenceScore *));
+	if(rankPtr == NULL)
+	{
+		printf("SeqScoreRanks:  Out of memory.");
+		exit(1);
+	}
+	
+	currPtr = firstScorePtr;
 	while(currPtr != NULL)
 	{
-		if(currPtr->intensityScore < lowestPtr->intensityScore)
+		if(currPtr->rank > 0 && currPtr->rank <= rankNum && rankPtr[currPtr->rank] == NULL)
 		{
-			lowestPtr = currPtr;
+			rankPtr[currPtr->rank] = currPtr;
 		}
 		currPtr = currPtr->next;
 	}
 	
-	return(lowestPtr);	
+	return(rankPtr);
+}
+
+/**********************FreeAllSequence************************************
+*
+* 	Used for freeing memory in a linked list.  
+*/
+void FreeAllSequence(struct Sequence *currPtr)
+{
+	struct Sequence *freeMePtr;
+	while(currPtr != NULL)
+	{
+		freeMePtr = currPtr;
+		currPtr = currPtr->next;
+		DisposeSequenceStruct(freeMePtr);
+	}
+	return;
+}
+
+/****************************** LowerStoredScore**********************************************
+*
+*	For the heap of stored sequences in ScoreSequences.  TRUE if score1 has the lower
+*	intensityScore, or if they are the same and score1 is earlier in the list.
+*/
+static BOOLEAN LowerStoredScore(tScoreOrder *score1, tScoreOrder *score2)
+{
+	if(score1->scorePtr->intensityScore != score2->scorePtr->intensityScore)
+	{
+		return(score1->scorePtr->intensityScore < score2->scorePtr->intensityScore);
+	}
+	return(score1->order < score2->order);
+}
+
+/****************************** LowScoreHeapDown**********************************************
+*
+*	Moves heap[i] down the heap of heapNum stored sequences until neither of its children 
+*	is lower (see LowerStoredScore).  heap[0] is then the stored sequence w/ the lowest 
+*	intensityScore, and the first such one in the list if there is a tie.
+*/
+static void LowScoreHeapDown(tScoreOrder *heap, INT_4 heapNum, INT_4 i)
+{
+	tScoreOrder temp;
+	INT_4 child;
+	
+	while(2 * i + 1 < heapNum)
+	{
+		child = 2 * i + 1;
+		if(child + 1 < heapNum && LowerStoredScore(&heap[child + 1], &heap[child]))
+		{
+			child++;
+		}
+		if(!LowerStoredScore(&heap[child], &heap[i]))
+		{
+			break;
+		}
+		temp = heap[i];
+		heap[i] = heap[child];
+		heap[child] = temp;
+		i = child;
+	}
+	return;
 }
 
 /******************************AddToSeqScoreList*********************************
@@ -6246,7 +6932,7 @@ struct SequenceScore *FindLowestScore(struct SequenceScore *currPtr)
 struct SequenceScore *AddToSeqScoreList(struct SequenceScore *firstPtr, 
 											struct SequenceScore *currPtr)
 {
-	static struct SequenceScore *lastPtr;
+	static THREAD_LOCAL struct SequenceScore *lastPtr;
 	
 	if(firstPtr == NULL)
 	{
@@ -6825,6 +7511,7 @@ REAL_4 ProInThirdPosition(REAL_4 oldScore, INT_4 *sequence, INT_4 seqLength)
 REAL_4 AssignHighMZScore(INT_4 highMZNum, INT_4 *highMZFrags, INT_4 *highMZInts, 
 						REAL_4 totalIntensity, INT_4 *sequence, INT_4 seqLength)
 {
+	tFragLadder *ladder;
 	INT_4 bCalStart, yCalStart, nChargeCount, cChargeCount;
 	INT_4 i, j, k, m, bIonMass, bIonMassMinErr, bIonMassPlusErr;
 	INT_4 bMinW, bMinWMinErr, bMinA, bMinAPlusErr;
@@ -6877,18 +7564,20 @@ REAL_4 AssignHighMZScore(INT_4 highMZNum, INT_4 *highMZFrags, INT_4 *highMZInts,
 	cChargeCount = 1;
 	
 	/*Step through the sequence.*/
+	ladder = FragLadder(sequence, seqLength);	/*Cumulative b and y masses.*/
+	
 	for(i = (seqLength - 1); i > 0; i--)	/*Don't do this loop for i = 0 (doesnt make sense).*/
 	{
 
 /*
 	Calculate the singly charged y ion mass.
 */
-		yCal = YCalculator(i, sequence, seqLength, yCalStart, yCalCorrection);	
+		yCal = YCalculator(i, ladder, yCalStart, yCalCorrection);	
 			
 /*
 	Calculate the singly charged b ion mass.
 */
-		bCal = BCalculator(i, sequence, bCalStart, bCalCorrection);		
+		bCal = BCalculator(i, ladder, bCalStart, bCalCorrection);		
 		
 /*	
 	Readjust the number of charges in the C- and N-terminii.
@@ -7148,6 +7837,7 @@ INT_4 FindABYIons(REAL_4 *ionFound, INT_4 fragNum, INT_4 *fragMOverZ,
 				     REAL_4 *yFound, REAL_4 *bFound, REAL_8 *byError, INT_4 *ionType)
 
 {
+	tFragLadder *ladder;
 	INT_4 i, j, nChargeCount, cChargeCount, bCal, yCal, cleavageSites;
 	INT_4 bOrYIon, k, aIonMass, aIonMassMinErr, aIonMassPlusErr;
 	INT_4 aMinW, aMinWMinErr, aMinA, aMinAPlusErr, bCalStart, yCalStart;
@@ -7235,6 +7925,8 @@ INT_4 FindABYIons(REAL_4 *ionFound, INT_4 fragNum, INT_4 *fragMOverZ,
 */
 	twoAANTerm = TwoAAExtFinder(sequence, 0);
 
+	ladder = FragLadder(sequence, seqLength);	/*Cumulative b and y masses.*/
+	
 	for(i = (seqLength - 1); i > 0; i--)	/*Don't do this loop for i = 0 (doesnt make sense).*/
 	{
 		
@@ -7254,12 +7946,12 @@ INT_4 FindABYIons(REAL_4 *ionFound, INT_4 fragNum, INT_4 *fragMOverZ,
 /*
 	Calculate the singly charged y ion mass.
 */
-		yCal = YCalculator(i, sequence, seqLength, yCalStart, yCalCorrection);	
+		yCal = YCalculator(i, ladder, yCalStart, yCalCorrection);	
 			
 /*
 	Calculate the singly charged b ion mass.
 */
-		bCal = BCalculator(i, sequence, bCalStart, bCalCorrection);
+		bCal = BCalculator(i, ladder, bCalStart, bCalCorrection);
 				
 /*
 	If the N-terminus is not a two amino acid extension, its unlikely that one can find
@@ -7371,8 +8063,8 @@ INT_4 FindABYIons(REAL_4 *ionFound, INT_4 fragNum, INT_4 *fragMOverZ,
 			if((bIonMass * j) > ((j-1) * 400 * gMultiplier)) /*Make sure there is enough mass to hold 
 													the charge.*/
 			{
-				k = fragNum - 1;
-				while(fragMOverZ[k] >= bIonMassMinErr && k >= 0)
+				k = IonIndexHigh(fragMOverZ, fragNum, bIonMassPlusErr);
+				while(k >= 0 && fragMOverZ[k] >= bIonMassMinErr)
 				{
 					if(fragMOverZ[k] <= bIonMassPlusErr)
 					{
@@ -7709,8 +8401,8 @@ INT_4 FindABYIons(REAL_4 *ionFound, INT_4 fragNum, INT_4 *fragMOverZ,
 													the charge.*/
 			{
 				test = FALSE;
-				k = fragNum - 1;
-				while(fragMOverZ[k] >= yIonMassMinErr && k >= 0)
+				k = IonIndexHigh(fragMOverZ, fragNum, yIonMassPlusErr);
+				while(k >= 0 && fragMOverZ[k] >= yIonMassMinErr)
 				{
 					if(fragMOverZ[k] <= yIonMassPlusErr)
 					{
@@ -8054,8 +8746,8 @@ void InternalFrag(REAL_4 *ionFound, INT_4 *fragMOverZ,
 				if(intFragMinErr < precursor)	/*Only count those matches where the internal frag
 												mass is less than the precursor m/z value.*/
 				{
-					k = 0;
-					while(fragMOverZ[k] <= intFragPlusErr && k < fragNum)	/*Look for this ion.*/
+					k = IonIndexLow(fragMOverZ, fragNum, intFragMinErr);
+					while(k < fragNum && fragMOverZ[k] <= intFragPlusErr)	/*Look for this ion.*/
 					{
 						if(fragMOverZ[k] >= intFragMinErr)
 						{
@@ -8223,8 +8915,8 @@ char ArgIons(REAL_4 *ionFound, INT_4 fragNum, INT_4 *fragMOverZ,
 		bOHMinErr = bOH - gToleranceWide;
 		bOHPlusErr = bOH + gToleranceWide;
 		
-		i = fragNum - 1;
-		while(fragMOverZ[i] >= bOHMinErr && i >= 0)
+		i = IonIndexHigh(fragMOverZ, fragNum, bOHPlusErr);
+		while(i >= 0 && fragMOverZ[i] >= bOHMinErr)
 		{
 			if(fragMOverZ[i] <= bOHPlusErr)
 			{
@@ -8240,8 +8932,8 @@ char ArgIons(REAL_4 *ionFound, INT_4 fragNum, INT_4 *fragMOverZ,
 			bOHMinAmmMinErr = bOHMinAmm - gToleranceWide;
 			bOHMinAmmPlusErr = bOHMinAmm + gToleranceWide;
 			
-			i = fragNum - 1;
-			while(fragMOverZ[i] >= bOHMinAmmMinErr && i >= 0)
+			i = IonIndexHigh(fragMOverZ, fragNum, bOHMinAmmPlusErr);
+			while(i >= 0 && fragMOverZ[i] >= bOHMinAmmMinErr)
 			{
 				if(fragMOverZ[i] <= bOHMinAmmPlusErr)
 				{
@@ -8295,6 +8987,7 @@ void LoadSequence(INT_4 *sequence, INT_4 *seqLength, struct Sequence *currSeqPtr
 		}
 	}
 	
+	BuildFragLadder(sequence, *seqLength);
 		
 	return;
 }
@@ -8720,6 +9413,144 @@ void LoadTheIonArrays(struct MSData *firstMassPtr, INT_4 *fragNum,
 
 	return;
 }
+
+/******************************BuildIonIndex************************************************
+*
+*	BuildIonIndex divides the m/z range of the sorted fragMOverZ array into fragNum equal
+*	width buckets, and records the index of the first ion at or above the bottom of each
+*	bucket.  IonIndexLow and IonIndexHigh use this to find where a matching loop should
+*	start without walking the whole array.  If the array is not in increasing order, then
+*	no index is made and the lookups fall back to the ends of the array.
+*/
+
+void BuildIonIndex(INT_4 *fragMOverZ, INT_4 fragNum)
+{
+	INT_4 i, k, bucketBottom;
+	
+	gIonIndex.fragMOverZ = NULL;
+	if(fragNum <= 0)
+	{
+		return;
+	}
+	for(i = 1; i < fragNum; i++)
+	{
+		if(fragMOverZ[i] < fragMOverZ[i-1])
+		{
+			return;
+		}
+	}
+	
+	if(gIonIndex.bucketLimit < fragNum + 1)
+	{
+		free(gIonIndex.firstIon);
+		gIonIndex.firstIon = (INT_4 *) malloc((fragNum + 1) * sizeof(INT_4));
+		if(gIonIndex.firstIon == NULL)
+		{
+			printf("BuildIonIndex:  Out of memory.");
+			exit(1);
+		}
+		gIonIndex.bucketLimit = fragNum + 1;
+	}
+	
+	gIonIndex.fragNum = fragNum;
+	gIonIndex.lowMass = fragMOverZ[0];
+	gIonIndex.bucketWidth = (fragMOverZ[fragNum - 1] - fragMOverZ[0]) / fragNum + 1;
+	gIonIndex.bucketNum = fragNum;
+	
+	k = 0;
+	for(i = 0; i <= gIonIndex.bucketNum; i++)
+	{
+		bucketBottom = gIonIndex.lowMass + i * gIonIndex.bucketWidth;
+		while(k < fragNum && fragMOverZ[k] < bucketBottom)
+		{
+			k++;
+		}
+		gIonIndex.firstIon[i] = k;
+	}
+	gIonIndex.fragMOverZ = fragMOverZ;
+	
+	return;
+}
+
+/******************************IonIndexBucket***********************************************
+*
+*	Returns the first ion index of the bucket holding the m/z value "mass".
+*/
+
+INT_4 IonIndexBucket(REAL_8 mass)
+{
+	INT_4 bucket;
+	
+	if(mass <= gIonIndex.lowMass)
+	{
+		return(0);
+	}
+	if(mass >= gIonIndex.lowMass + (REAL_8)gIonIndex.bucketNum * gIonIndex.bucketWidth)
+	{
+		return(gIonIndex.firstIon[gIonIndex.bucketNum]);
+	}
+	bucket = (mass - gIonIndex.lowMass) / gIonIndex.bucketWidth;
+	
+	return(gIonIndex.firstIon[bucket]);
+}
+
+/******************************IonIndexLow**************************************************
+*
+*	Returns the lowest index k such that fragMOverZ[k] >= mass, or fragNum if there is
+*	none.  The bucket only supplies a starting guess, which is then checked against the
+*	current values in fragMOverZ; this keeps the answer exact after Recalibrate has shifted
+*	the array.  Without a matching index, zero is returned so that callers scan the whole 
+*	array as before.
+*/
+
+INT_4 IonIndexLow(INT_4 *fragMOverZ, INT_4 fragNum, REAL_8 mass)
+{
+	INT_4 k;
+	
+	if(gIonIndex.fragMOverZ != fragMOverZ || gIonIndex.fragNum != fragNum)
+	{
+		return(0);
+	}
+	k = IonIndexBucket(mass);
+	while(k > 0 && fragMOverZ[k-1] >= mass)
+	{
+		k--;
+	}
+	while(k < fragNum && fragMOverZ[k] < mass)
+	{
+		k++;
+	}
+	
+	return(k);
+}
+
+/******************************IonIndexHigh*************************************************
+*
+*	Returns the highest index k such that fragMOverZ[k] <= mass, or -1 if there is none.
+*	Without a matching index, fragNum - 1 is returned so that callers scan the whole array
+*	as before.
+*/
+
+INT_4 IonIndexHigh(INT_4 *fragMOverZ, INT_4 fragNum, REAL_8 mass)
+{
+	INT_4 k;
+	
+	if(gIonIndex.fragMOverZ != fragMOverZ || gIonIndex.fragNum != fragNum)
+	{
+		return(fragNum - 1);
+	}
+	k = IonIndexBucket(mass) - 1;
+	while(k + 1 < fragNum && fragMOverZ[k+1] <= mass)
+	{
+		k++;
+	}
+	while(k >= 0 && fragMOverZ[k] > mass)
+	{
+		k--;
+	}
+	
+	return(k);
+}
 		
 /***************************ScoreSequences************************************
 *
@@ -8740,25 +9571,29 @@ void LoadTheIonArrays(struct MSData *firstMassPtr, INT_4 *fragNum,
 struct Sequence *ScoreSequences(struct Sequence *firstSequencePtr, 
 						struct MSData *firstMassPtr)
 {
-	char cysPE, addSequence, databaseSeq;
+	char cysPE, addSequence;
 	char argPresent = 0;
 	INT_4 *sequence, *charSequence, *ionType;
 	INT_4 precursor, averageBYScore = 0, highestBYScore = 0;
 	INT_4 *fragMOverZ, *fragIntensity, *saveFragMOverZ;
-	INT_4 i, j, fragNum, intensityTotal, seqLength = 0, storedSeqNum, countTheSeqs;
+	INT_4 i, j, k, fragNum, intensityTotal, seqLength = 0, storedSeqNum, countTheSeqs;
 	INT_4 cleavageSites = 0, length = 0;
-	REAL_4 realSeqLengthNoFudgingAtAll = 0;
-	REAL_4 intScore, intOnlyScore, *ionFound, *ionFoundTemplate, *yFound, *bFound;
+	REAL_4 *ionFound, *ionFoundTemplate, *yFound, *bFound;
 	REAL_4 lowMassIonConversion, lowMassCys, residueNumGuess = 0, minQuality = 0;
 	REAL_8 *byError, perfectProbScore = 0;
-	REAL_4 stDevErr, realSeqLength, calFactor = 1, quality = 0;
-	REAL_4 probScore = 0;
+	REAL_4 quality = 0;
+	tScoreJob job;
+	tScoreScratch scratch;
+	tCandidateScore *scorePtr;
+	tSequenceHash scoreHash;	/*The stored sequences, for IsThisADuplicate*/
+	tScoreOrder *storedScore;	/*The stored sequences in list order, and then a heap w/ the lowest first*/
+	BOOLEAN lowScoreHeap = FALSE;
 	/*INT_4 m;*/	/*debug*/
 	BOOLEAN aSequenceFound = FALSE; /*debugging*/
 	BOOLEAN test; /*debugging*/
 	INT_4 z = 0; /*debugging*/
 	
-	struct SequenceScore *firstScorePtr, *lowScorePtr;
+	struct SequenceScore *firstScorePtr, *lowScorePtr, *newScorePtr;
 	struct SequenceScore *massagedSeqListPtr = NULL, *currMassagePtr = NULL;
 	struct Sequence *currSeqPtr;
 	
@@ -8916,16 +9751,26 @@ struct Sequence *ScoreSequences(struct Sequence *firstSequencePtr,
 		printf("Most distressing!  There seems to be no CID data.");
 		exit(1);
 	}
-	LoadTheIonArrays(firstMassPtr, &fragNum, fragMOverZ, fragIntensity);
 	
 /*
-*	Find the average ion intensity and the standard deviation of the ion intensity,
-*	and if any ions have exceed a 1.64 x stDev these intensities are adjusted
-*	up or down.
+*	The ion arrays only depend on the CID data, which stops changing once the first time 
+*	thru set up is over, so they are made once (see PrepareSpectrum) and each peptide MW 
+*	pass starts from a copy of them.  The exception is when there are more ions than 
+*	MAX_ION_NUM; LoadTheIonArrays then zeroes the intensities of the ions it picks, so 
+*	each pass picks from the ions that the passes before it left over.
 */
-	
-	AdjustIonIntensity(fragNum, fragIntensity);	/*since this is not affecting firstMassPtr, this can be done
-												repeatedly w/o worrying about getting weird effects*/
+	if(gFirstTimeThru || gSearch->preparedSpectrum == NULL || 
+		gSearch->preparedSpectrum->fragNum == MAX_ION_NUM)
+	{
+		PrepareSpectrum(firstMassPtr);
+	}
+	fragNum = gSearch->preparedSpectrum->fragNum;
+	for(i = 0; i < fragNum; i++)
+	{
+		fragMOverZ[i] = gSearch->preparedSpectrum->fragMOverZ[i];
+		fragIntensity[i] = gSearch->preparedSpectrum->fragIntensity[i];
+	}
+	BuildIonIndex(fragMOverZ, fragNum);
 	
 	
 /*	
@@ -9077,451 +9922,758 @@ struct Sequence *ScoreSequences(struct Sequence *firstSequencePtr,
 
 /*=====================================================================================
 *	Here's the giant while loop, that scores each sequence in the linked list of 
-*	SequenceData structs.
+*	SequenceData structs.  The sequences are scored a chunk at a time by ScoreCandidates, 
+*	which uses several threads if gParam.workerNum allows it; the arrays allocated above
+*	are the scratch arrays when it does not.
 */
-	/*m = 0;*/	/*debug*/
+	job.candidate = (struct Sequence **) malloc(SCORE_CHUNK_SIZE * sizeof(struct Sequence *));
+	job.score = (tCandidateScore *) malloc(SCORE_CHUNK_SIZE * sizeof(tCandidateScore));
+	if(job.candidate == NULL || job.score == NULL)
+	{
+		printf("ScoreSequences:  Out of memory.");
+		exit(1);
+	}
+	job.fragNum = fragNum;
+	job.fragMOverZ = fragMOverZ;
+	job.fragIntensity = fragIntensity;
+	job.ionFoundTemplate = ionFoundTemplate;
+	job.intensityTotal = intensityTotal;
+	job.lowMassIons = lowMassIons;
+	job.cysPE = cysPE;
+	job.minQuality = minQuality;
+	scratch.sequence = sequence;
+	scratch.fragMOverZ = fragMOverZ;
+	scratch.saveFragMOverZ = saveFragMOverZ;
+	scratch.ionType = ionType;
+	scratch.ionFound = ionFound;
+	scratch.yFound = yFound;
+	scratch.bFound = bFound;
+	scratch.byError = byError;
+	NewSequenceHash(&scoreHash);
+	storedScore = (tScoreOrder *) malloc((MAX_X_CORR_NUM + 1) * sizeof(tScoreOrder));
+	if(storedScore == NULL)
+	{
+		printf("ScoreSequences:  Out of memory.");
+		exit(1);
+	}
+	
 	currSeqPtr = firstSequencePtr;
 	while(currSeqPtr != NULL)
 	{
-		/*m++;*/	/*debug*/
-		/*if(z == 347) /*debugging*/
-		/*{
-			z++;
-		}*/
+/*
+*	Score the next chunk of sequences (see ScoreOneSequence), possibly on several threads.
+*/
+		job.candidateNum = 0;
+		while(currSeqPtr != NULL && job.candidateNum < SCORE_CHUNK_SIZE)
+		{
+			job.candidate[job.candidateNum] = currSeqPtr;
+			job.candidateNum++;
+			currSeqPtr = currSeqPtr->next;
+		}
+		ScoreCandidates(&job, &scratch);
 		
-/*	
-*	Write the sequence to the INT_4 array "sequence", and count the number of amino acids 
-*	("seqLength").  Actually, its not the sequence that is in "sequence", rather its the 
-*	nominal mass of a single amino acid or a pair of amino acids times 100 (all mass values
-*	are 100 x actual value in this file).
+/*
+*	Store the scores in the same order as the sequences are in the linked list, so that
+*	what is kept does not depend on which thread finished first.
 */
+		for(k = 0; k < job.candidateNum; k++)
+		{
+			scorePtr = &job.score[k];
+			if(scorePtr->probScoreMax > perfectProbScore)
+			{
+				perfectProbScore = scorePtr->probScoreMax;
+			}
 		
-		LoadSequence(sequence, &seqLength, currSeqPtr);
+/*	Store the sequence, intensity score, actual peptide length, and quality.*/
+
+			addSequence = IsThisADuplicate(&scoreHash, scorePtr->sequence, scorePtr->intOnlyScore, 
+										scorePtr->intScore, scorePtr->seqLength);
 		
-		/*debugging*/
-		/*test = TRUE;	
-		if(seqLength == 12)
-		{
-			for(i = 0; i < seqLength; i++)
+			if(addSequence || job.candidate[k]->gapNum == -100)	/*-100 flag for database seq*/
 			{
-				if(gRightSequence[i] <= sequence[i] - gToleranceWide ||
-					gRightSequence[i] >= sequence[i] + gToleranceWide)
+				if(storedSeqNum <= MAX_X_CORR_NUM) 
 				{
-					test = FALSE;
+	
+					newScorePtr = LoadSeqScoreStruct(scorePtr->intScore,
+									scorePtr->intOnlyScore, scorePtr->sequence, charSequence, 
+									scorePtr->seqLength, scorePtr->stDevErr, scorePtr->cleavageSites, 
+									scorePtr->calFactor, scorePtr->databaseSeq, scorePtr->intOnlyScore, 
+									scorePtr->quality, length, scorePtr->probScore, 0.0);
+					firstScorePtr = AddToSeqScoreList(firstScorePtr, newScorePtr);
+					AddToSequenceHash(&scoreHash, newScorePtr, SequenceScoreHash(newScorePtr));
+					storedScore[storedSeqNum].scorePtr = newScorePtr;
+					storedScore[storedSeqNum].order = storedSeqNum;
+					storedSeqNum++;
+	
+				}
+				else
+				{
+					if(lowScorePtr == NULL)  /*Find the lowest intensity-based score out of all 
+											stored sequences.*/
+					{
+						if(!lowScoreHeap)	/*no more are stored, so make the heap once*/
+						{
+							for(i = storedSeqNum / 2 - 1; i >= 0; i--)
+							{
+								LowScoreHeapDown(storedScore, storedSeqNum, i);
+							}
+							lowScoreHeap = TRUE;
+						}
+						lowScorePtr = storedScore[0].scorePtr;
+					}
+					if(scorePtr->intScore > lowScorePtr->intensityScore)
+					{
+						RemoveFromSequenceHash(&scoreHash, lowScorePtr, SequenceScoreHash(lowScorePtr));
+						lowScorePtr->intensityScore = scorePtr->intScore;
+						for(i = 0; i < scorePtr->seqLength; i++)
+						{
+							lowScorePtr->peptide[i] = scorePtr->sequence[i];
+							lowScorePtr->peptideSequence[i] = charSequence[i];
+						}
+						lowScorePtr->peptide[scorePtr->seqLength] = 0;
+						lowScorePtr->intensityOnlyScore = scorePtr->intOnlyScore;
+						lowScorePtr->stDevErr = scorePtr->stDevErr;
+						lowScorePtr->crossDressingScore = scorePtr->intScore;
+						lowScorePtr->calFactor = scorePtr->calFactor;
+						lowScorePtr->quality = scorePtr->quality;
+						lowScorePtr->length = length;
+						lowScorePtr->probScore = scorePtr->probScore;
+						lowScorePtr->cleavageSites = scorePtr->cleavageSites;
+						lowScorePtr->databaseSeq = scorePtr->databaseSeq;
+						lowScorePtr->rank = 0;
+						AddToSequenceHash(&scoreHash, lowScorePtr, SequenceScoreHash(lowScorePtr));
+						LowScoreHeapDown(storedScore, storedSeqNum, 0);
+						lowScorePtr = NULL;	/*If this is not NULL, then that means it found the lowScorePtr
+											earlier, but the sequence that was previously under consideration
+											had a lower score.  This means keeps the program from searching
+											for the same lowScorePtr, unless its been NULLed.*/
+					}
 				}
 			}
-			if(test)
-			{
-				i++;
-			}
-		}*/
 		
-/*	Note if this is a database sequence (used to flag such sequences in the output)*/
-		
-		if(currSeqPtr->gapNum == -100)
-		{
-			databaseSeq = TRUE;
+			/*debugging*/
+			if(gAmIHere)
+			{
+				aSequenceFound = CheckItOutSequenceScore(firstScorePtr);
+				if(!aSequenceFound)
+				{
+					z++;	/*stop in debugger*/
+				}
+				else
+				{
+					z++;
+				}
+			}/*end debugging*/
 		}
-		else
+	}	/*End of the giant while loop.*/
+	
+	free(job.candidate);
+	free(job.score);
+	FreeSequenceHash(&scoreHash);
+	free(storedScore);
+	
+	if(gAmIHere)
+	{
+		aSequenceFound = CheckItOutSequenceScore(firstScorePtr);
+	}
+
+/*
+*	Convert relevant mass values back to the real masses (not the * gMultiplier values).  Convert
+*	the mass-based peptide sequence to a character-based sequence and place in the peptideSequence 
+*	field of firstScorePtr.
+*/
+
+	RevertBackToReals(firstMassPtr, firstScorePtr);
+
+	if(gAmIHere)
+	{
+		aSequenceFound = CheckItOutSequenceScore(firstScorePtr);
+	}
+
+/*	
+*	Here's where a rank is assigned based on the intensity-based score.
+*/
+
+	SeqIntensityRanker(firstScorePtr);
+	
+	if(gAmIHere)
+	{
+		aSequenceFound = CheckItOutSequenceScore(firstScorePtr);
+	}
+	
+/*	
+*	Here's where the cross-correlation scoring would be done - after the giant while loop.
+*	This is where the top rankedSeqNum number of scores are found, and the rest are discarded.  
+*	Cross-correlation scores are normalized to the auto-correlation of the actual spectrum.  The
+*	background associated with tau = 0 is determined by adding the symetrical differences around tau = 0.
+*	This takes advantage of the fact that a real match is going to be symetrical, and bogus matches are not.
+*/
+	if (gParam.fMonitor && gCorrectMass)
+	{
+		printf("Cross-dressing.\n");
+		fflush(stdout);
+	}
+	
+	DoCrossCorrelationScoring(firstScorePtr, firstMassPtr);
+	
+/*
+*	Figure out a theoretically perfect probScore for comparison with actual probScores.
+*/
+	
+	/*perfectProbScore = CalcPerfectProbScore(fragNum, fragMOverZ);*/
+	
+	if(gAmIHere)
+	{
+		aSequenceFound = CheckItOutSequenceScore(firstScorePtr);
+	}
+	
+	if(gParam.fMonitor && gCorrectMass)
+	{
+		PrintToConsole(firstScorePtr);
+				
+/*		PrintScoreDetailsToXLFile(firstScorePtr, perfectProbScore);*/	/*debugging output*/
+	}
+	
+	
+/*	Massage the scores to come up with a short list of most likely sequences. */
+
+/*	massagedSeqListPtr = MassageScores(firstScorePtr);*/
+	
+	massagedSeqListPtr = DetermineBestCandidates(firstScorePtr);
+	
+/*
+	Find max quality and length values from the final list in the output.
+*/
+	currMassagePtr = massagedSeqListPtr;
+	quality = 0;
+	length = 0;
+	while(currMassagePtr != NULL)
+	{
+		if(currMassagePtr->quality > quality)
 		{
-			databaseSeq = FALSE;
+			quality = currMassagePtr->quality;
+			length = currMassagePtr->length;
 		}
+		currMassagePtr = currMassagePtr->next;
+	}
+
+/*  Stop the clock */
+	if(gCorrectMass)
+	{
+		gParam.searchTime = (SearchTicks() - gParam.startTicks)/ CLOCKS_PER_SEC;
+	}
+
+/*	Output is printed to the console and to a file.*/
+	if(gCorrectMass)
+	{
+		PrintToConsoleAndFile(massagedSeqListPtr, quality, length, perfectProbScore);
+		
+	}
+	
+/*	Free some linked lists*/
+	FreeAllSequenceScore(firstScorePtr);
+	FreeAllSequenceScore(massagedSeqListPtr);
+	
+	RevertTheRevertBackToReals(firstMassPtr);
+	
+/*	Free the arrays, before I forget.*/
+	free(sequence);
+	free(fragMOverZ);
+	free(fragIntensity);
+	free(ionFound);	
+	free(ionFoundTemplate);	
+	free(yFound);
+	free(bFound);
+	free(byError);
+	free(charSequence);
+	free(saveFragMOverZ);
+	gIonIndex.fragMOverZ = NULL;	/*The index pointed into the array freed above.*/
+
+	return(firstSequencePtr);		/*Return a pointer to the massaged list of sequences and scores.*/
+}
+					
+/***************************ScoreOneSequence**********************************
+*
+*	Scores the sequence in currSeqPtr against the spectrum described by jobPtr, using the 
+*	scratch arrays in scratchPtr, and puts the scores in scorePtr.  This is the body of 
+*	the giant while loop in ScoreSequences; it only reads the spectrum data in jobPtr, so 
+*	that several of these can run at once on different threads, each with its own scratch
+*	arrays.
+*/
+static void ScoreOneSequence(tScoreJob *jobPtr, tScoreScratch *scratchPtr, struct Sequence *currSeqPtr,
+						tCandidateScore *scorePtr)
+{
+	char argPresent, databaseSeq;
+	INT_4 i, seqLength, cleavageSites, fragNum = jobPtr->fragNum;
+	INT_4 *sequence = scratchPtr->sequence;
+	INT_4 *fragMOverZ = scratchPtr->fragMOverZ;
+	INT_4 *saveFragMOverZ = scratchPtr->saveFragMOverZ;
+	INT_4 *ionType = scratchPtr->ionType;
+	REAL_4 *ionFound = scratchPtr->ionFound;
+	REAL_4 *yFound = scratchPtr->yFound;
+	REAL_4 *bFound = scratchPtr->bFound;
+	REAL_8 *byError = scratchPtr->byError;
+	REAL_4 realSeqLength, realSeqLengthNoFudgingAtAll, intScore, intOnlyScore, stDevErr;
+	REAL_4 calFactor = 1, quality, probScore;
+	
+/*	
+*	Write the sequence to the INT_4 array "sequence", and count the number of amino acids 
+*	("seqLength").  Actually, its not the sequence that is in "sequence", rather its the 
+*	nominal mass of a single amino acid or a pair of amino acids times 100 (all mass values
+*	are 100 x actual value in this file).
+*/
 		
+	LoadSequence(sequence, &seqLength, currSeqPtr);
+		
+/*	Note if this is a database sequence (used to flag such sequences in the output)*/
+		
+	if(currSeqPtr->gapNum == -100)
+	{
+		databaseSeq = TRUE;
+	}
+	else
+	{
+		databaseSeq = FALSE;
+	}
 		
 /*
 	Qtof data is recalibrated for each sequence using y ions greater than m/z 500.  The original fragMOverZ
 	values are saved in saveFragMOverZ, and restored after the sequence has been scored.  Once the data has been
 	recalibrated the tolerances are narrowed to the scorerror values from the .param file.
 */
-		if(gParam.fragmentPattern == 'Q' && gParam.qtofErr != 0 && gParam.chargeState <= 3)
+	if(gParam.fragmentPattern == 'Q' && gParam.qtofErr != 0 && gParam.chargeState <= 3)
+	{
+		for(i = 0; i < fragNum; i++)	/*save the original data*/
 		{
-			for(i = 0; i < fragNum; i++)	/*save the original data*/
-			{
-				saveFragMOverZ[i] = fragMOverZ[i];
-			}
-			/*printf("%d Before Recalibrate\n", m);*/
-			calFactor = Recalibrate(fragNum, fragMOverZ, sequence, seqLength, 
-									fragIntensity);
-			/*printf("%d After Recalibrate\n", m);*/
+			saveFragMOverZ[i] = fragMOverZ[i];
 		}
+		calFactor = Recalibrate(fragNum, fragMOverZ, sequence, seqLength, 
+								jobPtr->fragIntensity);
+	}
 		
 /*	
 	Initialize this variable each time around.
 */
 	
-		for(i = 0; i < fragNum; i++)
+	for(i = 0; i < fragNum; i++)
+	{
+		ionFound[i] = jobPtr->ionFoundTemplate[i];	/*ionFoundTemplate contains identifications 
+											of ions that do not change from sequence to sequence.  
+											Therefore, these identifications were taken 
+											out of the giant while loop, and instead of initializing 
+											"ionFound" to zero, its initialized to ionFoundTemplate.*/
+		yFound[i] = 0;	/*yFound and bFound are used to cut the scores for sequences that
+						utilze the same ions for y and b's.*/
+		bFound[i] = 0;
+		
+		byError[i] = 100;	/*Errors in b and y ions are placed in this array, where index
+							matches the fragNum indexing*/
+							
+		if(jobPtr->ionFoundTemplate[i] != 0)
 		{
-			ionFound[i] = ionFoundTemplate[i];	/*ionFoundTemplate contains identifications 
-												of ions
-												that do not change from sequence to sequence.  
-												Therefore, these identifications were taken 
-												out of the
-												giant while loop, and instead of initializing 
-												"ionFound"
-												to zero, its initialized to ionFoundTemplate.*/
-			yFound[i] = 0;	/*yFound and bFound are used to cut the scores for sequences that
-							utilze the same ions for y and b's.*/
-			bFound[i] = 0;
-			
-			byError[i] = 100;	/*Errors in b and y ions are placed in this array, where index
-								matches the fragNum indexing*/
-								
-			if(ionFoundTemplate[i] != 0)
-			{
-				ionType[i] = 1;	/*Precursor ions are of type 1*/
-			}
-			else
-			{
-				ionType[i] = 0;	/*Initialize all other positions as 0 (random) ion types*/
-			}
-		} 
+			ionType[i] = 1;	/*Precursor ions are of type 1*/
+		}
+		else
+		{
+			ionType[i] = 0;	/*Initialize all other positions as 0 (random) ion types*/
+		}
+	} 
 /*	
 	Identify Arg-related ions, if the precursor is singly-charged and arginine is present 
 	in the sequence.  Also checks if arg is present (TRUE or FALSE).
 */
 
-		argPresent = ArgIons(ionFound, fragNum, fragMOverZ, sequence, seqLength);
+	argPresent = ArgIons(ionFound, fragNum, fragMOverZ, sequence, seqLength);
 
-		
 /* 	
 	Identify a, b, and y ions.  "cleavageSites" is used in assigning the intensity based 
 	score later on.  It is the number
 	of times a peptide bond was cleaved or delineated by a b or y type ion.
 */
-		cleavageSites = FindABYIons(ionFound, fragNum, fragMOverZ, sequence, 
-		                            seqLength, argPresent, yFound, bFound, byError, ionType);
+	cleavageSites = FindABYIons(ionFound, fragNum, fragMOverZ, sequence, 
+	                            seqLength, argPresent, yFound, bFound, byError, ionType);
 /*
 	Fool with the cleavageSites value and the ionFound values for sequences that used the
 	same series of ions for both y and b.
 */
-		cleavageSites = AlterIonFound(ionFound, fragNum, fragMOverZ, sequence, 
-		                            seqLength, yFound, bFound, cleavageSites); 
-		                            
-		/*if gapNum = -100, this signals that the sequence is from the database*/
-		if(currSeqPtr->gapNum == -100)
-		{
-			cleavageSites = (currSeqPtr->peptideLength) - 1;
-		}
+	cleavageSites = AlterIonFound(ionFound, fragNum, fragMOverZ, sequence, 
+	                            seqLength, yFound, bFound, cleavageSites); 
+	                            
+	/*if gapNum = -100, this signals that the sequence is from the database*/
+	if(currSeqPtr->gapNum == -100)
+	{
+		cleavageSites = (currSeqPtr->peptideLength) - 1;
+	}
 		
 /*
 	Find any c1 ions when Q is at the second position from the N-terminus.
 */
 
-		seqLength = ScoreC1(ionFound, fragNum, fragMOverZ, sequence, seqLength);
-		                            
+	seqLength = ScoreC1(ionFound, fragNum, fragMOverZ, sequence, seqLength);
 		
 /*	Identify pyridylethylated cysteine fragments, but only if PE'ed cysteine is in 
 	sequence.	*/
 
-		if(cysPE)
-		{
-			PEFragments(ionFound, fragNum, fragMOverZ, sequence, seqLength);
-		}
+	if(jobPtr->cysPE)
+	{
+		PEFragments(ionFound, fragNum, fragMOverZ, sequence, seqLength);
+	}
 				
 /*	Identify internal fragment ions. */
 
-		InternalFrag(ionFound, fragMOverZ, sequence, seqLength, fragNum, ionType);
+	InternalFrag(ionFound, fragMOverZ, sequence, seqLength, fragNum, ionType);
 
 /*	Identify low mass amino acid - specific ions. */
-		ScoreLowMassIons(ionFound, fragMOverZ, sequence, seqLength, lowMassIons, ionType);
+	ScoreLowMassIons(ionFound, fragMOverZ, sequence, seqLength, jobPtr->lowMassIons, ionType);
 	
 /*	For ions that are one dalton higher than another that has been identified as b or y,
 	assign this as being partially found, too.*/
-		if(gParam.peakWidth < 0.7 * gMultiplier && !gParam.maxent3)
-		{
-			ScoreBYIsotopes(ionFound, fragMOverZ, fragNum, ionType);
-		}
+	if(gParam.peakWidth < 0.7 * gMultiplier && !gParam.maxent3)
+	{
+		ScoreBYIsotopes(ionFound, fragMOverZ, fragNum, ionType);
+	}
 /*
 	Calculate the actual number of amino acids in the sequence where gaps are counted as two amino acids.
 */
 
-		realSeqLength = SequenceLengthCalc(sequence, seqLength);
+	realSeqLength = SequenceLengthCalc(sequence, seqLength);
 		
 /*
 *	Calculate the number of amino acids, not accounting for Pro mis-cleavages and N-terminal dipeptides.
 */
 
-		realSeqLengthNoFudgingAtAll = SequenceLengthCalcNoFudge(sequence, seqLength);
+	realSeqLengthNoFudgingAtAll = SequenceLengthCalcNoFudge(sequence, seqLength);
 								
 /*	Assign the intensity-based score for the sequence.*/
-		if(databaseSeq)
-		{
-			cleavageSites = realSeqLength - 1;	/*don't penalize database-derived sequences in the score*/
-		}
-		intScore = IntensityScorer(fragIntensity, ionFound, cleavageSites, fragNum, 
-						realSeqLength, intensityTotal);
-						
-/*	For qtof data, the intScore is modified so that larger correction factors to the
-	calibration will attenuate the score.*/
-	/*	if(gParam.fragmentPattern == 'Q' && gParam.qtofErr != 0 && gParam.chargeState <= 2)
-		{
-			intScore = ScoreAttenuationFromCalfactor(calFactor, intScore);
-		}		*/
+	if(databaseSeq)
+	{
+		cleavageSites = realSeqLength - 1;	/*don't penalize database-derived sequences in the score*/
+	}
+	intScore = IntensityScorer(jobPtr->fragIntensity, ionFound, cleavageSites, fragNum, 
+					realSeqLength, jobPtr->intensityTotal);
 						
 /*	Determine the standard deviation of the average error.*/
-		stDevErr = StandardDeviationOfTheBYErrors(byError, fragNum);
+	stDevErr = StandardDeviationOfTheBYErrors(byError, fragNum);
 		
 /*	Recalculate the intensity-based score w/o attenuation and other tricks.*/
-		intOnlyScore = IntensityOnlyScorer(fragIntensity, ionFound, fragNum, intensityTotal);
+	intOnlyScore = IntensityOnlyScorer(jobPtr->fragIntensity, ionFound, fragNum, 
+					jobPtr->intensityTotal);
 /*
 *	Calculate quality as mass of amino acids defined by contiguous series divided by total residue mass
 */
-		quality = MassBasedQuality(sequence, seqLength, fragNum, fragMOverZ, argPresent);
+	quality = MassBasedQuality(sequence, seqLength, fragNum, fragMOverZ, argPresent);
 		
 /*
 *	Determine Pavel probability score.
 */
-	if(sequence[0] == 2029)
-	{
-		i++;
-	}
-		probScore = LutefiskProbScorer(sequence, seqLength, fragNum, fragMOverZ, argPresent);
-		
-		/*normalize the score by using the sequence length*/
-		probScore = probScore / (2 * realSeqLengthNoFudgingAtAll);
-		gProbScoreMax = gProbScoreMax / (2 * realSeqLengthNoFudgingAtAll);
+	probScore = LutefiskProbScorer(sequence, seqLength, fragNum, fragMOverZ, argPresent);
 		
-		if(gProbScoreMax > perfectProbScore)
-		{
-			perfectProbScore = gProbScoreMax;
-		}
+	/*normalize the score by using the sequence length*/
+	probScore = probScore / (2 * realSeqLengthNoFudgingAtAll);
+	gProbScoreMax = gProbScoreMax / (2 * realSeqLengthNoFudgingAtAll);
 		
-/*	Qtof data is recalibrated for each sequence using y ions greater than m/z 500.  The original fragMOverZ
-	values are saved in saveFragMOverZ, and restored after the sequence has been scored.  Once the data has been
-	recalibrated the tolerances are narrowed to the scorerror values from the .param file.
-*/
-		if(gParam.fragmentPattern == 'Q' && gParam.qtofErr != 0 && gParam.chargeState <= 3)
-		{
-			for(i = 0; i < fragNum; i++)	/*save the original data*/
-			{
-				fragMOverZ[i] = saveFragMOverZ[i];
-			}
-		}
-
-/*	
-	Check for quality of spectrum.  gCleavageSiteStringent is the longest contiguous series of b or y ions
-	but it counts two aa residues the same as one aa residues.  realSeqLength is the actual lenght of the
-	sequence where two aa residues are counted as two amino acids rather than a single residue. 
-	gSingleAACleavageSites is the number of contiguous b or y ions that define a sequence made up entirely
-	of single amino acid residues -- no gaps are included.  The realSeqLengthNoFudgingAtAll value represents
-	the best guess at the number of amino acids in the sequence; in contrast, realSeqLength makes allowances
-	for gaps that might include a proline, as well as an N-terminal gap -- those are counted as single residues.
-*/
-		/*avoid divide by zero*/
-		/*if(realSeqLengthNoFudgingAtAll > 1)	
+/*	Put back the fragMOverZ values from before Recalibrate.*/
+	if(gParam.fragmentPattern == 'Q' && gParam.qtofErr != 0 && gParam.chargeState <= 3)
+	{
+		for(i = 0; i < fragNum; i++)
 		{
-				quality = gSingleAACleavageSites / (realSeqLengthNoFudgingAtAll - 1);
-				length = gSingleAACleavageSites;
+			fragMOverZ[i] = saveFragMOverZ[i];
 		}
-		else
-		{
-			quality = 0;
-			length = 0;
-		}		This is the length based quality, which is not valid unless unsequenced regions are dipeptides*/
-		
-		
+	}
 		
 /*
 *	Adjust quality value higher if its zero and a sequence tag was found
 */	
 
-		if(quality == 0)
+	if(quality == 0)
+	{
+		if(jobPtr->minQuality > 0)
 		{
-			if(minQuality > 0)
-			{
-				quality = minQuality;	/*minQuality is derived from the fraction of sequence covered
-										by a sequence tag*/
-			}
+			quality = jobPtr->minQuality;	/*minQuality is derived from the fraction of sequence covered
+											by a sequence tag*/
 		}
-		
-/*	Store the sequence, intensity score, actual peptide length, and quality.*/
-
-		addSequence = IsThisADuplicate(firstScorePtr, sequence, intOnlyScore, 
-									intScore, seqLength);
-		
-		if(addSequence || currSeqPtr->gapNum == -100)	/*-100 flag for database seq*/
-		{
-			if(storedSeqNum <= MAX_X_CORR_NUM) 
-			{
-	
-				firstScorePtr = AddToSeqScoreList(firstScorePtr, LoadSeqScoreStruct(intScore,
-								intOnlyScore, sequence, charSequence, seqLength, stDevErr, 
-								cleavageSites, calFactor, databaseSeq, intOnlyScore, quality, length,
-								probScore, 0.0));
-				storedSeqNum++;
-	
-			}
-			else
-			{
-				if(lowScorePtr == NULL)  /*Find the lowest intensity-based score out of all 
-										stored sequences.*/
-				{
-					lowScorePtr = FindLowestScore(firstScorePtr);
-				}
-				if(intScore > lowScorePtr->intensityScore)
-				{
-					lowScorePtr->intensityScore = intScore;
-					for(i = 0; i < seqLength; i++)
-					{
-						lowScorePtr->peptide[i] = sequence[i];
-						lowScorePtr->peptideSequence[i] = charSequence[i];
-					}
-					lowScorePtr->peptide[seqLength] = 0;
-					lowScorePtr->intensityOnlyScore = intOnlyScore;
-					lowScorePtr->stDevErr = stDevErr;
-					lowScorePtr->crossDressingScore = intScore;
-					lowScorePtr->calFactor = calFactor;
-					lowScorePtr->quality = quality;
-					lowScorePtr->length = length;
-					lowScorePtr->probScore = probScore;
-					lowScorePtr->cleavageSites = cleavageSites;
-					lowScorePtr->databaseSeq = databaseSeq;
-					lowScorePtr->rank = 0;
-					lowScorePtr = NULL;	/*If this is not NULL, then that means it found the lowScorePtr
-										earlier, but the sequence that was previously under consideration
-										had a lower score.  This means keeps the program from searching
-										for the same lowScorePtr, unless its been NULLed.*/
-				}
-			}
-		}
-		
-		/*debugging*/
-		if(gAmIHere)
-		{
-			aSequenceFound = CheckItOutSequenceScore(firstScorePtr);
-			if(!aSequenceFound)
-			{
-				z++;	/*stop in debugger*/
-			}
-			else
-			{
-				z++;
-			}
-		}/*end debugging*/
-				
-		currSeqPtr = currSeqPtr->next;	/*Point to the next struct in the linked list to 
-										continue the giant while loop.*/
-	}	/*End of the giant while loop.*/
+	}
 	
-	if(gAmIHere)
+	scorePtr->intScore = intScore;
+	scorePtr->intOnlyScore = intOnlyScore;
+	scorePtr->stDevErr = stDevErr;
+	scorePtr->calFactor = calFactor;
+	scorePtr->quality = quality;
+	scorePtr->probScore = probScore;
+	scorePtr->probScoreMax = gProbScoreMax;
+	scorePtr->cleavageSites = cleavageSites;
+	scorePtr->databaseSeq = databaseSeq;
+	scorePtr->seqLength = seqLength;
+	for(i = 0; i < seqLength; i++)
 	{
-		aSequenceFound = CheckItOutSequenceScore(firstScorePtr);
+		scorePtr->sequence[i] = sequence[i];
 	}
+	
+	return;
+}
 
-/*
-*	Convert relevant mass values back to the real masses (not the * gMultiplier values).  Convert
-*	the mass-based peptide sequence to a character-based sequence and place in the peptideSequence 
-*	field of firstScorePtr.
+/***************************ScoreCandidates***********************************
+*
+*	Scores the jobPtr->candidateNum sequences in jobPtr->candidate, putting the scores in
+*	the same positions of jobPtr->score.  Up to gParam.workerNum threads are used (zero
+*	means one per processor); each one takes the next sequence that has not been scored
+*	yet.  With a single thread, the sequences are scored on the calling thread using the 
+*	scratch arrays in scratchPtr.
 */
+static void ScoreCandidates(tScoreJob *jobPtr, tScoreScratch *scratchPtr)
+{
+	INT_4 i, threadNum;
+#if !defined(__MWERKS__)
+	pthread_t *threadID;
+#endif
 
-	RevertBackToReals(firstMassPtr, firstScorePtr);
-
-	if(gAmIHere)
+	threadNum = gParam.workerNum;
+#if !defined(__MWERKS__)
+	if(threadNum == 0)
 	{
-		aSequenceFound = CheckItOutSequenceScore(firstScorePtr);
+		threadNum = sysconf(_SC_NPROCESSORS_ONLN);
 	}
-
-/*	
-*	Here's where a rank is assigned based on the intensity-based score.
-*/
-
-	SeqIntensityRanker(firstScorePtr);
-	
-	if(gAmIHere)
+#else
+	threadNum = 1;
+#endif
+	if(threadNum > jobPtr->candidateNum / MIN_SEQUENCES_PER_THREAD)
 	{
-		aSequenceFound = CheckItOutSequenceScore(firstScorePtr);
+		threadNum = jobPtr->candidateNum / MIN_SEQUENCES_PER_THREAD;
 	}
 	
-/*	
-*	Here's where the cross-correlation scoring would be done - after the giant while loop.
-*	This is where the top rankedSeqNum number of scores are found, and the rest are discarded.  
-*	Cross-correlation scores are normalized to the auto-correlation of the actual spectrum.  The
-*	background associated with tau = 0 is determined by adding the symetrical differences around tau = 0.
-*	This takes advantage of the fact that a real match is going to be symetrical, and bogus matches are not.
-*/
-	if (gParam.fMonitor && gCorrectMass)
+	if(threadNum <= 1)
 	{
-		printf("Cross-dressing.\n");
-		fflush(stdout);
+		for(i = 0; i < jobPtr->candidateNum; i++)
+		{
+			ScoreOneSequence(jobPtr, scratchPtr, jobPtr->candidate[i], &jobPtr->score[i]);
+		}
+		return;
+	}
+
+#if !defined(__MWERKS__)
+	jobPtr->nextCandidate = 0;
+	jobPtr->searchPtr = gSearch;
+	jobPtr->toleranceNarrow = gToleranceNarrow;
+	jobPtr->toleranceWide = gToleranceWide;
+	jobPtr->trypticCterm = gTrypticCterm;
+	jobPtr->gapListDipeptideIndex = gGapListDipeptideIndex;
+	jobPtr->cysPlus = gCysPlus;
+	jobPtr->argPlus = gArgPlus;
+	jobPtr->hisPlus = gHisPlus;
+	jobPtr->lysPlus = gLysPlus;
+	jobPtr->proPlus = gProPlus;
+	jobPtr->glnPlus = gGlnPlus;
+	jobPtr->gluPlus = gGluPlus;
+	pthread_mutex_init(&jobPtr->lock, NULL);
+	
+	threadID = (pthread_t *) malloc(threadNum * sizeof(pthread_t));
+	if(threadID == NULL)
+	{
+		printf("ScoreCandidates:  Out of memory.");
+		exit(1);
+	}
+	for(i = 0; i < threadNum; i++)
+	{
+		if(pthread_create(&threadID[i], NULL, ScoringThread, jobPtr) != 0)
+		{
+			printf("ScoreCandidates:  Could not start a thread.\n");
+			exit(1);
+		}
+	}
+	for(i = 0; i < threadNum; i++)
+	{
+		pthread_join(threadID[i], NULL);
 	}
 	
-	DoCrossCorrelationScoring(firstScorePtr, firstMassPtr);
-	
-/*
-*	Figure out a theoretically perfect probScore for comparison with actual probScores.
+	pthread_mutex_destroy(&jobPtr->lock);
+	free(threadID);
+#endif
+	return;
+}
+
+#if !defined(__MWERKS__)
+/***************************ScoringThread*************************************
+*
+*	Each scoring thread gets its own copy of the search context, of the thread local 
+*	scoring globals of the thread that started it, of the fragment ion m/z values (which
+*	Recalibrate changes), and of the scratch arrays.  It then scores sequences until there 
+*	are none left.
 */
+static void *ScoringThread(void *arg)
+{
+	tScoreJob *jobPtr = (tScoreJob *)arg;
+	tSearchContext *searchPtr;
+	tScoreScratch scratch;
+	INT_4 i;
 	
-	/*perfectProbScore = CalcPerfectProbScore(fragNum, fragMOverZ);*/
+	searchPtr = NewSearchContext(jobPtr->searchPtr);
+	BindSearchContext(searchPtr);
+	gToleranceNarrow = jobPtr->toleranceNarrow;
+	gToleranceWide = jobPtr->toleranceWide;
+	gTrypticCterm = jobPtr->trypticCterm;
+	gGapListDipeptideIndex = jobPtr->gapListDipeptideIndex;
+	memcpy(gCysPlus, jobPtr->cysPlus, sizeof(gCysPlus));
+	memcpy(gArgPlus, jobPtr->argPlus, sizeof(gArgPlus));
+	memcpy(gHisPlus, jobPtr->hisPlus, sizeof(gHisPlus));
+	memcpy(gLysPlus, jobPtr->lysPlus, sizeof(gLysPlus));
+	memcpy(gProPlus, jobPtr->proPlus, sizeof(gProPlus));
+	memcpy(gGlnPlus, jobPtr->glnPlus, sizeof(gGlnPlus));
+	memcpy(gGluPlus, jobPtr->gluPlus, sizeof(gGluPlus));
 	
-	if(gAmIHere)
+	NewScoreScratch(&scratch);
+	for(i = 0; i < jobPtr->fragNum; i++)
 	{
-		aSequenceFound = CheckItOutSequenceScore(firstScorePtr);
+		scratch.fragMOverZ[i] = jobPtr->fragMOverZ[i];
 	}
+	BuildIonIndex(scratch.fragMOverZ, jobPtr->fragNum);
 	
-	if(gParam.fMonitor && gCorrectMass)
+	while(TRUE)
 	{
-		PrintToConsole(firstScorePtr);
-				
-/*		PrintScoreDetailsToXLFile(firstScorePtr, perfectProbScore);*/	/*debugging output*/
+		pthread_mutex_lock(&jobPtr->lock);
+		i = jobPtr->nextCandidate;
+		jobPtr->nextCandidate++;
+		pthread_mutex_unlock(&jobPtr->lock);
+		if(i >= jobPtr->candidateNum)
+		{
+			break;
+		}
+		ScoreOneSequence(jobPtr, &scratch, jobPtr->candidate[i], &jobPtr->score[i]);
 	}
 	
+	FreeScoreScratch(&scratch);
+	FreeScoringTables();
+	FreeSearchContext(searchPtr);
+	return(NULL);
+}
+#endif
+
+/***************************NewScoreScratch***********************************
+*
+*	Allocates the scratch arrays used to score one sequence at a time.
+*/
+static void NewScoreScratch(tScoreScratch *scratchPtr)
+{
+	scratchPtr->sequence 		= (int *) malloc(MAX_PEPTIDE_LENGTH * sizeof(INT_4));
+	scratchPtr->fragMOverZ 		= (int *) malloc(MAX_ION_NUM * sizeof(INT_4));
+	scratchPtr->saveFragMOverZ 	= (int *) malloc(MAX_ION_NUM * sizeof(INT_4));
+	scratchPtr->ionType 		= (int *) malloc(MAX_ION_NUM * sizeof(INT_4));
+	scratchPtr->ionFound 		= (float *) malloc(MAX_ION_NUM * sizeof(REAL_4));
+	scratchPtr->yFound 			= (float *) malloc(MAX_ION_NUM * sizeof(REAL_4));
+	scratchPtr->bFound 			= (float *) malloc(MAX_ION_NUM * sizeof(REAL_4));
+	scratchPtr->byError 		= (double *) malloc(MAX_ION_NUM * sizeof(REAL_8));
+	if(scratchPtr->sequence == NULL || scratchPtr->fragMOverZ == NULL 
+		|| scratchPtr->saveFragMOverZ == NULL || scratchPtr->ionType == NULL
+		|| scratchPtr->ionFound == NULL || scratchPtr->yFound == NULL 
+		|| scratchPtr->bFound == NULL || scratchPtr->byError == NULL)
+	{
+		printf("NewScoreScratch:  Out of memory.");
+		exit(1);
+	}
 	
-/*	Massage the scores to come up with a short list of most likely sequences. */
+	return;
+}
 
-/*	massagedSeqListPtr = MassageScores(firstScorePtr);*/
+/***************************FreeScoreScratch**********************************
+*
+*	Frees the arrays allocated by NewScoreScratch.
+*/
+static void FreeScoreScratch(tScoreScratch *scratchPtr)
+{
+	free(scratchPtr->sequence);
+	free(scratchPtr->fragMOverZ);
+	free(scratchPtr->saveFragMOverZ);
+	free(scratchPtr->ionType);
+	free(scratchPtr->ionFound);
+	free(scratchPtr->yFound);
+	free(scratchPtr->bFound);
+	free(scratchPtr->byError);
 	
-	massagedSeqListPtr = DetermineBestCandidates(firstScorePtr);
+	return;
+}
+
+/***************************FreeScoringTables*********************************
+*
+*	Frees the calling thread's fragment ion index and fragment ladder.  A thread that has
+*	done some scoring calls this before it finishes.
+*/
+void FreeScoringTables(void)
+{
+	free(gIonIndex.firstIon);
+	gIonIndex.firstIon = NULL;
+	gIonIndex.bucketLimit = 0;
+	gIonIndex.fragMOverZ = NULL;
+	
+	free(gFragLadder.residue);
+	free(gFragLadder.bMass);
+	free(gFragLadder.bCorrection);
+	free(gFragLadder.yCorrection);
+	gFragLadder.residue = NULL;
+	gFragLadder.bMass = NULL;
+	gFragLadder.bCorrection = NULL;
+	gFragLadder.yCorrection = NULL;
+	gFragLadder.limit = 0;
+	gFragLadder.seqLength = 0;
 	
-/*
-	Find max quality and length values from the final list in the output.
+	return;
+}
+
+/******************************PrepareSpectrum*********************************************
+*
+*	PrepareSpectrum loads the ion arrays from the CID data (LoadTheIonArrays) and finds the 
+*	average ion intensity and the standard deviation of the ion intensity, so that ions that 
+*	exceed 1.64 x stDev have their intensities adjusted down (AdjustIonIntensity).  The
+*	result is kept in gSearch->preparedSpectrum, replacing any that was there before.
 */
-	currMassagePtr = massagedSeqListPtr;
-	quality = 0;
-	length = 0;
-	while(currMassagePtr != NULL)
+static void PrepareSpectrum(struct MSData *firstMassPtr)
+{
+	struct PreparedSpectrum *preparedPtr;
+	
+	if(gSearch->preparedSpectrum != NULL)
 	{
-		if(currMassagePtr->quality > quality)
-		{
-			quality = currMassagePtr->quality;
-			length = currMassagePtr->length;
-		}
-		currMassagePtr = currMassagePtr->next;
+		FreePreparedSpectrum(gSearch->preparedSpectrum);
+		gSearch->preparedSpectrum = NULL;
 	}
-
-/*  Stop the clock */
-	if(gCorrectMass)
+	
+	preparedPtr = (struct PreparedSpectrum *) malloc(sizeof(struct PreparedSpectrum));
+	if(preparedPtr == NULL)
 	{
-		gParam.searchTime = (clock() - gParam.startTicks)/ CLOCKS_PER_SEC;
+		printf("PrepareSpectrum:  Out of memory.");
+		exit(1);
 	}
-
-/*	Output is printed to the console and to a file.*/
-	if(gCorrectMass)
+	preparedPtr->fragMOverZ = (int *) malloc(MAX_ION_NUM * sizeof(INT_4));
+	preparedPtr->fragIntensity = (int *) malloc(MAX_ION_NUM * sizeof(INT_4));
+	if(preparedPtr->fragMOverZ == NULL || preparedPtr->fragIntensity == NULL)
 	{
-		PrintToConsoleAndFile(massagedSeqListPtr, quality, length, perfectProbScore);
-		
+		printf("PrepareSpectrum:  Out of memory.");
+		exit(1);
 	}
 	
-/*	Free some linked lists*/
-	FreeAllSequenceScore(firstScorePtr);
-	FreeAllSequenceScore(massagedSeqListPtr);
+	LoadTheIonArrays(firstMassPtr, &preparedPtr->fragNum, preparedPtr->fragMOverZ, 
+						preparedPtr->fragIntensity);
+	AdjustIonIntensity(preparedPtr->fragNum, preparedPtr->fragIntensity);
 	
-	RevertTheRevertBackToReals(firstMassPtr);
+	gSearch->preparedSpectrum = preparedPtr;
 	
-/*	Free the arrays, before I forget.*/
-	free(sequence);
-	free(fragMOverZ);
-	free(fragIntensity);
-	free(ionFound);	
-	free(ionFoundTemplate);	
-	free(yFound);
-	free(bFound);
-	free(byError);
-	free(charSequence);
-	free(saveFragMOverZ);
+	return;
+}
 
-	return(firstSequencePtr);		/*Return a pointer to the massaged list of sequences and scores.*/
+/******************************FreePreparedSpectrum****************************************
+*
+*	Frees the ion arrays made by PrepareSpectrum.
+*/
+void FreePreparedSpectrum(struct PreparedSpectrum *preparedPtr)
+{
+	if(preparedPtr == NULL)
+	{
+		return;
+	}
+	free(preparedPtr->fragMOverZ);
+	free(preparedPtr->fragIntensity);
+	free(preparedPtr);
+	
+	return;
 }
-					
+
 /***************************MassBasedQuality**********************************
 *
 *	Calculates quality as the mass of amino acids defined by a contiguous ion
@@ -9920,7 +11072,7 @@ while(currSeqPtr != NULL)
 			if(currSeqPtr->score < maxScore * maxScoreFraction)
 			{
 				previousPtr->next = currSeqPtr->next;
-				free(currSeqPtr);
+				DisposeSequenceStruct(currSeqPtr);
 				currSeqPtr = previousPtr->next;
 			}
 			else
@@ -10679,7 +11831,7 @@ REAL_8 FindBIons(INT_4 *mass, INT_4 ionCount, REAL_8 probScore,
 				/*Don't mess with the score unless b ion is less than precursor, or its LCQ data*/
 				if((bIonTemplate < precursor && gParam.fragmentPattern) || gParam.fragmentPattern == 'L')
 				{
-					for(k = 0; k < ionCount; k++)
+					for(k = IonIndexLow(mass, ionCount, bIon - gToleranceWide); k < ionCount; k++)
 					{
 						if(mass[k] > bIon + gToleranceWide)
 						{
@@ -10695,7 +11847,9 @@ REAL_8 FindBIons(INT_4 *mass, INT_4 ionCount, REAL_8 probScore,
 					
 					if(bIonTest || nTerminalQ || nTerminalE || argPresent)	/*there's a b ion, so look for the b-17 and b-18*/
 					{
-						for(k = 0; k < ionCount; k++)
+						/*b-64 is the lowest of these ions, and b-17 the highest*/
+						for(k = IonIndexLow(mass, ionCount, bMin64 - gToleranceWide); 
+							k < ionCount && mass[k] < bIonMin17 + gToleranceWide; k++)
 						{
 							if(bIonTest || nTerminalQ || argPresent)
 							{
@@ -10744,7 +11898,7 @@ REAL_8 FindBIons(INT_4 *mass, INT_4 ionCount, REAL_8 probScore,
 					
 					/*Calculate the probability scores*/
 					/*but first find the approximate index value for the b ion (to get correct randomProb)*/
-					for(k = 0; k < ionCount; k++)
+					for(k = IonIndexLow(mass, ionCount, bIon + gToleranceWide); k < ionCount; k++)
 					{
 						if(mass[k] > bIon + gToleranceWide)
 						{
@@ -11196,7 +12350,7 @@ REAL_8 FindYIons(INT_4 *mass, INT_4 ionCount, REAL_8 probScore,
 			/*apply constraints to charge and mass*/
 			if(yIon * j > (j-1) * 400 * gMultiplier && posResidues >= j)
 			{
-				for(k = 0; k < ionCount; k++)
+				for(k = IonIndexLow(mass, ionCount, yIon - gToleranceWide); k < ionCount; k++)
 				{
 					if(mass[k] > yIon + gToleranceWide)
 					{
@@ -11212,7 +12366,9 @@ REAL_8 FindYIons(INT_4 *mass, INT_4 ionCount, REAL_8 probScore,
 				if(yIonTest || argPresent)	/*there's a y ion, so look for the y-17 and y-18, or for non-mobile
 											proton fragmentation*/
 				{
-					for(k = 0; k < ionCount; k++)
+					/*y-64 is the lowest of these ions, and y-17 the highest*/
+					for(k = IonIndexLow(mass, ionCount, yMin64 - gToleranceWide); 
+						k < ionCount && mass[k] < yIonMin17 + gToleranceWide; k++)
 					{
 						if(mass[k] > yIonMin17 - gToleranceWide &&
 							mass[k] < yIonMin17 + gToleranceWide)
@@ -11543,8 +12699,9 @@ void PrintScoreDetailsToXLFile(struct SequenceScore *firstScorePtr, REAL_4 perfe
 	FILE *fp;
 	INT_4 i, j, seqNum;
 	REAL_4 xcorrNormalizer;
-	struct SequenceScore *maxPtr, *currPtr;
+	struct SequenceScore *maxPtr, *currPtr, **rankPtr;
    	const 	time_t		theTime = (const time_t)time(NULL);
+	char	dateString[64];
 	char  outputFile[256], fileName[256];
     INT_4 length;
     INT_4 fileCount;
@@ -11601,7 +12758,7 @@ void PrintScoreDetailsToXLFile(struct SequenceScore *firstScorePtr, REAL_4 perfe
 		exit(1);
 	}
 
-	fprintf(fp, "Run Date: %20s", ctime(&theTime));
+	fprintf(fp, "Run Date: %20s", RunDate(theTime, dateString));
 
         /* Print header information from gParam to the console and the file.*/
 	fprintf(fp, " Filename: ");	/*Print the CID data file name.*/
@@ -11743,46 +12900,41 @@ void PrintScoreDetailsToXLFile(struct SequenceScore *firstScorePtr, REAL_4 perfe
 		maxPtr = maxPtr->next;
 	}
 		
+	rankPtr = SeqScoreRanks(firstScorePtr, 500);
 	for(i = 1; i <= 500 && i <= seqNum; i++)	/*List the top 500 sequences.*/
 	{
-		maxPtr = firstScorePtr;
-		while(maxPtr != NULL)
-		{	
-			if(maxPtr->rank == i)
-			{
-				/*Change peptide[j] to single letter code.*/
-				char *peptideString;
-				INT_4 peptide[MAX_PEPTIDE_LENGTH];
-				INT_4 peptideLength = 0;
-				
-				j = 0;
-				while(maxPtr->peptide[j] != 0)
-				{
-					peptide[j] = maxPtr->peptideSequence[j];
-					peptideLength++;
-					j++;
-				}
-				peptideString = PeptideString(peptide, peptideLength);
-				if(maxPtr->databaseSeq)
-				{
-					strcat(peptideString, " ");	/*used to denote this was database sequence*/
-				}
-				if(peptideString) 
-				{
-					fprintf(fp, " %3ld   %5.3f   %5.3f   %5.3f      %5.3f    %5.3f  %6.4f  %2ld   %8.6f %s\n", i,
-						 maxPtr->crossDressingScore / xcorrNormalizer, maxPtr->intensityScore,
-						 maxPtr->intensityOnlyScore, maxPtr->quality, maxPtr->probScore, 
-						 maxPtr->stDevErr, maxPtr->cleavageSites, 
-						 maxPtr->calFactor, peptideString);
-					free(peptideString);
-				}
+		maxPtr = rankPtr[i];
+		if(maxPtr != NULL)
+		{
+			/*Change peptide[j] to single letter code.*/
+			char *peptideString;
+			INT_4 peptide[MAX_PEPTIDE_LENGTH];
+			INT_4 peptideLength = 0;
 			
-				break;
+			j = 0;
+			while(maxPtr->peptide[j] != 0)
+			{
+				peptide[j] = maxPtr->peptideSequence[j];
+				peptideLength++;
+				j++;
+			}
+			peptideString = PeptideString(peptide, peptideLength);
+			if(maxPtr->databaseSeq)
+			{
+				strcat(peptideString, " ");	/*used to denote this was database sequence*/
+			}
+			if(peptideString) 
+			{
+				fprintf(fp, " %3ld   %5.3f   %5.3f   %5.3f      %5.3f    %5.3f  %6.4f  %2ld   %8.6f %s\n", i,
+					 maxPtr->crossDressingScore / xcorrNormalizer, maxPtr->intensityScore,
+					 maxPtr->intensityOnlyScore, maxPtr->quality, maxPtr->probScore, 
+					 maxPtr->stDevErr, maxPtr->cleavageSites, 
+					 maxPtr->calFactor, peptideString);
+				free(peptideString);
 			}
-			
-			maxPtr = maxPtr->next;
 		}
 	}
+	free(rankPtr);
 
 
 	fclose(fp);
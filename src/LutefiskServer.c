@@ -0,0 +1,418 @@
+/*********************************************************************************************
+Lutefisk is software for de novo sequencing of peptides from tandem mass spectra.
+Copyright (C) 1995  Richard S. Johnson
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+Contact:
+
+Richard S Johnson
+4650 Forest Ave SE
+Mercer Island, WA 98040
+
+jsrichar@alum.mit.edu
+*********************************************************************************************/
+
+
+
+/*
+	Server mode.  Rather than starting lutefisk over for each spectrum (and reading the params,
+	details and residues files and building all of the tables each time), "lutefisk -S" reads 
+	them once and then sequences one CID file for each line it reads from stdin, and "lutefisk 
+	-u path" does the same for each line sent over a connection to the Unix domain socket path.
+	
+	A request is a line with the CID file pathname, which may be preceded by "-o output file"
+	and/or "-m precursor mass", as on the command line.  Blank lines and lines starting with '#'
+	are ignored, "quit" ends the session (and with -S, the server) and "shutdown" stops the
+	server.  The reply to each request is either
+	
+		BEGIN <number of bytes> <CID file>
+		<that many bytes of output, ie, what would have gone to the .lut file>
+		END OK		(or END FAILED if the spectrum could not be sequenced)
+	
+	or a single line "ERROR <CID file>: <reason>".  Without -o, the output goes to a temporary
+	file that is removed once it has been sent.  With -S the replies are the only thing written
+	to stdout; what lutefisk normally prints to the console goes to stderr instead.
+	
+	Each request is sequenced in a child process made by fork, so the server carries on even 
+	when something in the search gives up with exit(), and nothing is left over from one 
+	request to the next.  The child starts out with the tables that were set up at start up, 
+	so fork is all that is added to the time it takes to do the search.
+*/
+
+/* ANSI headers */
+#include <ctype.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if !defined(__MWERKS__)
+	#include <sys/types.h>
+	#include <sys/socket.h>
+	#include <sys/un.h>
+	#include <sys/wait.h>
+#endif
+
+/* Lutefisk headers */
+#include "LutefiskPrototypes.h"
+#include "LutefiskDefinitions.h"
+
+#define SERVER_SEARCHED		0	/*Exit status of a child that finished its search*/
+#define SERVER_NOT_SEQUENCED	3	/*Exit status of a child whose spectrum couldn't be sequenced*/
+#define SERVER_LINE_LENGTH	1024
+
+static INT_4 gReplyFd = -1;		/*stdout, from before SaveStdoutForReplies moved it*/
+
+static BOOLEAN ServeRequests(tSearchContext *configPtr, FILE *inFile, FILE *replyFile);
+static void ServeOneRequest(tSearchContext *configPtr, char *request, FILE *replyFile);
+static INT_4 SearchOneFile(tSearchContext *configPtr, char *cidFile, char *outputFile, 
+							REAL_4 peptideMW);
+static void SendServerReply(FILE *replyFile, char *cidFile, char *outputFile, INT_4 status);
+
+
+/******************************SaveStdoutForReplies****************************************
+*
+*	With -S, the replies go to stdout and nothing else may.  Lutefisk's own stdout is pointed
+*	at stderr from here on, and the real stdout is kept in gReplyFd for RunServer.
+*/
+void SaveStdoutForReplies(void)
+{
+	fflush(stdout);
+	gReplyFd = dup(STDOUT_FILENO);
+	if (gReplyFd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0)
+	{
+		printf("Cannot set up stdout for server mode.\n");
+		exit(1);
+	}
+}
+
+/******************************RunServer***************************************************
+*
+*	Takes requests from stdin (-S) or from connections to gParam.serverSocket (-u) until
+*	told to stop.  configPtr has the params, residues, etc. that every search starts with.
+*/
+void RunServer(tSearchContext *configPtr)
+{
+	FILE *replyFile;
+#if !defined(__MWERKS__)
+	INT_4 listenFd, connectionFd, replyFd;
+	struct sockaddr_un address;
+	FILE *inFile;
+	BOOLEAN keepGoing;
+
+	signal(SIGPIPE, SIG_IGN);	/*a client that hangs up early shouldn't kill the server*/
+#endif
+
+	if (strlen(configPtr->param.outputFile) > 0)
+	{
+		printf("In server mode the output file is given with each request; ignoring %s.\n",
+				configPtr->param.outputFile);
+		configPtr->param.outputFile[0] = '\0';
+	}
+
+	if (strlen(configPtr->param.serverSocket) == 0)
+	{
+		replyFile = fdopen(gReplyFd >= 0 ? gReplyFd : dup(STDOUT_FILENO), "w");
+		if (replyFile == NULL)
+		{
+			printf("Cannot open stdout for the server replies.\n");
+			exit(1);
+		}
+		setvbuf(stdin, NULL, _IONBF, 0);	/*so a child that quits can't move stdin past a request
+											that has been read ahead*/
+		ServeRequests(configPtr, stdin, replyFile);
+		fclose(replyFile);
+		return;
+	}
+
+#if !defined(__MWERKS__)
+	if (strlen(configPtr->param.serverSocket) >= sizeof(address.sun_path))
+	{
+		printf("The socket pathname %s is too long.\n", configPtr->param.serverSocket);
+		exit(1);
+	}
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, configPtr->param.serverSocket);
+
+	listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	unlink(configPtr->param.serverSocket);	/*left over from a server that was killed*/
+	if (listenFd < 0 || bind(listenFd, (struct sockaddr *) &address, sizeof(address)) != 0
+		|| listen(listenFd, 8) != 0)
+	{
+		printf("Cannot listen on the socket %s.\n", configPtr->param.serverSocket);
+		exit(1);
+	}
+	if (configPtr->param.fMonitor)
+	{
+		printf("Waiting for requests on %s\n", configPtr->param.serverSocket);
+		fflush(stdout);
+	}
+
+	keepGoing = TRUE;
+	while (keepGoing)
+	{
+		connectionFd = accept(listenFd, NULL, NULL);
+		if (connectionFd < 0)
+		{
+			if (errno == EINTR) continue;
+			printf("Cannot accept a connection on the socket %s.\n", configPtr->param.serverSocket);
+			break;
+		}
+		replyFd = dup(connectionFd);
+		inFile = fdopen(connectionFd, "r");
+		replyFile = (replyFd >= 0) ? fdopen(replyFd, "w") : NULL;
+		if (inFile == NULL || replyFile == NULL)
+		{
+			printf("RunServer:  Out of memory");
+			exit(1);
+		}
+		keepGoing = ServeRequests(configPtr, inFile, replyFile);
+		fclose(replyFile);
+		fclose(inFile);
+	}
+
+	close(listenFd);
+	unlink(configPtr->param.serverSocket);
+#else
+	printf("Unix domain sockets are not available here; use -S instead.\n");
+#endif
+}
+
+/******************************ServeRequests***********************************************
+*
+*	Reads request lines from inFile and answers each one on replyFile until the end of inFile
+*	or a "quit" or "shutdown" line.  Returns FALSE if the server should stop.
+*/
+static BOOLEAN ServeRequests(tSearchContext *configPtr, FILE *inFile, FILE *replyFile)
+{
+	char line[SERVER_LINE_LENGTH], *request, *end;
+
+	while (fgets(line, SERVER_LINE_LENGTH, inFile) != NULL)
+	{
+		request = line;
+		while (isspace(*request)) request++;
+		end = request + strlen(request);
+		while (end > request && isspace(*(end - 1))) end--;
+		*end = '\0';
+
+		if (*request == '\0' || *request == '#')
+		{
+			continue;
+		}
+		if (!strcmp(request, "quit"))
+		{
+			return(TRUE);
+		}
+		if (!strcmp(request, "shutdown"))
+		{
+			return(FALSE);
+		}
+
+		ServeOneRequest(configPtr, request, replyFile);
+	}
+
+	return(TRUE);
+}
+
+/******************************ServeOneRequest*********************************************
+*
+*	Picks the -o and -m options off the front of the request, sequences the CID file that
+*	follows them, and sends back the output.
+*/
+static void ServeOneRequest(tSearchContext *configPtr, char *request, FILE *replyFile)
+{
+	char outputFile[256], *cidFile, *value;
+	char option;
+	REAL_4 peptideMW = 0;
+	BOOLEAN tempOutput;
+	INT_4 status, length;
+#if !defined(__MWERKS__)
+	INT_4 tempFd;
+	char *tempDir;
+#endif
+
+	outputFile[0] = '\0';
+	cidFile = request;
+	while (cidFile[0] == '-' && (cidFile[1] == 'o' || cidFile[1] == 'm') && isspace(cidFile[2]))
+	{
+		option = cidFile[1];
+		value = cidFile + 2;
+		while (isspace(*value)) value++;
+		length = 0;
+		while (value[length] != '\0' && !isspace(value[length])) length++;
+		if (option == 'o')
+		{
+			if (length >= sizeof(outputFile)) length = sizeof(outputFile) - 1;
+			strncpy(outputFile, value, length);
+			outputFile[length] = '\0';
+		}
+		else
+		{
+			peptideMW = atof(value);
+		}
+		cidFile = value + length;
+		while (isspace(*cidFile)) cidFile++;
+	}
+
+	if (*cidFile == '\0')
+	{
+		fprintf(replyFile, "ERROR %s: no CID file was given\n", request);
+		fflush(replyFile);
+		return;
+	}
+	if (strlen(cidFile) >= sizeof(configPtr->param.cidFilename))
+	{
+		fprintf(replyFile, "ERROR %s: the pathname is too long\n", cidFile);
+		fflush(replyFile);
+		return;
+	}
+	if (MultiSpectrumFileType(cidFile, configPtr->param.CIDfileType) != 0)
+	{
+		fprintf(replyFile, "ERROR %s: MGF, mzML and mzXML files are sequenced in batch mode\n", 
+				cidFile);
+		fflush(replyFile);
+		return;
+	}
+
+	tempOutput = (outputFile[0] == '\0');
+	if (tempOutput)
+	{
+#if !defined(__MWERKS__)
+		tempDir = getenv("TMPDIR");
+		if (tempDir == NULL || strlen(tempDir) == 0 || strlen(tempDir) > 200)
+		{
+			tempDir = "/tmp";
+		}
+		sprintf(outputFile, "%s/lutefiskXXXXXX", tempDir);
+		tempFd = mkstemp(outputFile);
+		if (tempFd < 0)
+		{
+			fprintf(replyFile, "ERROR %s: cannot make a temporary output file\n", cidFile);
+			fflush(replyFile);
+			return;
+		}
+		close(tempFd);
+#else
+		tmpnam(outputFile);
+#endif
+	}
+
+	status = SearchOneFile(configPtr, cidFile, outputFile, peptideMW);
+	SendServerReply(replyFile, cidFile, outputFile, status);
+
+	if (tempOutput)
+	{
+		remove(outputFile);
+	}
+}
+
+/******************************SearchOneFile***********************************************
+*
+*	Sequences cidFile with its output going to outputFile, and returns SERVER_SEARCHED,
+*	SERVER_NOT_SEQUENCED, or something else if lutefisk gave up on it.
+*/
+static INT_4 SearchOneFile(tSearchContext *configPtr, char *cidFile, char *outputFile, 
+							REAL_4 peptideMW)
+{
+	tSearchContext *searchPtr;
+	INT_4 status;
+#if !defined(__MWERKS__)
+	pid_t pid;
+	INT_4 childStatus;
+
+	fflush(NULL);	/*so that the child doesn't write out a copy of what's buffered*/
+	pid = fork();
+	if (pid < 0)
+	{
+		return(-1);
+	}
+	if (pid > 0)
+	{
+		while (waitpid(pid, &childStatus, 0) < 0)
+		{
+			if (errno != EINTR) return(-1);
+		}
+		if (WIFEXITED(childStatus))
+		{
+			return(WEXITSTATUS(childStatus));
+		}
+		return(-1);
+	}
+#endif
+
+	searchPtr = NewSearchContext(configPtr);
+	strcpy(searchPtr->param.cidFilename, cidFile);
+	strcpy(searchPtr->param.outputFile, outputFile);
+	if (peptideMW > 0)
+	{
+		searchPtr->param.peptideMW = peptideMW;
+	}
+	status = Run(searchPtr) ? SERVER_SEARCHED : SERVER_NOT_SEQUENCED;
+
+#if !defined(__MWERKS__)
+	fflush(stdout);
+	_exit(status);	/*not exit, which could disturb the parent's stdin*/
+#endif
+	FreeSearchContext(searchPtr);
+	return(status);
+}
+
+/******************************SendServerReply*********************************************
+*
+*	Sends the contents of outputFile back as the reply to the request for cidFile.
+*/
+static void SendServerReply(FILE *replyFile, char *cidFile, char *outputFile, INT_4 status)
+{
+	FILE *fp;
+	long size;
+	char buffer[4096];
+	size_t count;
+
+	fp = NULL;
+	if (status == SERVER_SEARCHED || status == SERVER_NOT_SEQUENCED)
+	{
+		fp = fopen(outputFile, "rb");
+	}
+	if (fp == NULL)
+	{
+		fprintf(replyFile, "ERROR %s: lutefisk quit without finishing (see its console output)\n",
+				cidFile);
+		fflush(replyFile);
+		return;
+	}
+
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	fprintf(replyFile, "BEGIN %ld %s\n", size, cidFile);
+	while (size > 0 && (count = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+	{
+		if (count > size) count = size;
+		fwrite(buffer, 1, count, replyFile);
+		size -= count;
+	}
+	while (size-- > 0)
+	{
+		fputc('\n', replyFile);	/*the file got shorter, but the byte count has been sent*/
+	}
+	fclose(fp);
+
+	fprintf(replyFile, "END %s\n", status == SERVER_SEARCHED ? "OK" : "FAILED");
+	fflush(replyFile);
+}
@@ -40,13 +40,120 @@ jsrichar@alum.mit.edu
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "LutefiskPrototypes.h"
 #include "LutefiskDefinitions.h"
 
 /*Globals for this file only.*/
-struct Sequence *gFinalSequencePtr;
-INT_4 gSubseqNum = 0;
-INT_4 gAA1Max, gAA1Min, gAA2Max, gAA2Min, gAA1, gAA2;
+THREAD_LOCAL struct Sequence *gFinalSequencePtr;
+THREAD_LOCAL INT_4 gSubseqNum = 0;
+THREAD_LOCAL INT_4 gAA1Max, gAA1Min, gAA2Max, gAA2Min, gAA1, gAA2;
+
+/*
+*	The Sequence structs made during one pass of the mass scramble loop come from slabs of 
+*	SEQUENCE_SLAB_SIZE structs (see NewSequenceStruct), rather than from one malloc apiece.
+*/
+#define SEQUENCE_SLAB_SIZE	4096
+
+typedef struct SequenceSlab
+{
+	struct SequenceSlab	*next;
+	struct Sequence		sequence[SEQUENCE_SLAB_SIZE];
+}tSequenceSlab;
+
+static THREAD_LOCAL struct
+{
+	tSequenceSlab	*firstSlab;
+	tSequenceSlab	*currSlab;		/*The slab that structs are being taken from...*/
+	INT_4			slabUsed;		/*...and how many of its structs have been taken*/
+	struct Sequence	*freePtr;		/*Structs given back by DisposeSequenceStruct, linked by next*/
+} gSequenceArena;
+
+/*
+*	The best gParam.topSeqNum new subsequences of an AddExtensions round, and the best 
+*	gParam.finalSeqNum completed sequences, are kept in heaps with the worst one on top (see
+*	AddToSubsequenceHeap).  Among equal scores the one that was stored first ranks higher, which
+*	is the order that the sorted linked lists used to keep.
+*/
+typedef struct
+{
+	struct Sequence	*seqPtr;
+	INT_4			order;		/*When it was stored*/
+}tHeapEntry;
+
+typedef struct
+{
+	tHeapEntry	*entry;
+	INT_4		num;
+	INT_4		size;			/*How many entries have been allocated*/
+	INT_4		nextOrder;
+}tSubsequenceHeap;
+
+static THREAD_LOCAL tSubsequenceHeap gSubsequenceHeap;	/*Used for newSubsequencePtr in AddExtensions*/
+static THREAD_LOCAL tSubsequenceHeap gFinalSequenceHeap;	/*Becomes gFinalSequencePtr*/
+
+static BOOLEAN HeapKeepsScore(tSubsequenceHeap *heapPtr, INT_4 score, INT_4 limit);
+static void AddToSubsequenceHeap(tSubsequenceHeap *heapPtr, struct Sequence *newPtr, INT_4 limit);
+static struct Sequence *SubsequenceHeapToList(tSubsequenceHeap *heapPtr);
+static void FreeSubsequenceHeap(tSubsequenceHeap *heapPtr);
+
+/*
+*	TopPathSequences (Subsequencing engine = E) works on a graph whose states are the 
+*	subsequence ends - node, node correction, and number of gaps - that AddExtensions would
+*	reach.  State 0 is where all of the completed sequences go.  The paths into each state are 
+*	found best first, as they are needed (see FindPath).  Only the states that are reached are
+*	made; they are looked up in a hash table, and taken in order of mass from a heap.
+*/
+#define PATH_CORRECTION_NUM		19		/*Node corrections go from -9 to 9*/
+#define MAX_REJECTED_PATHS		10000	/*Completed paths that can fail CorrectMass before I quit*/
+
+typedef struct
+{
+	INT_4	edge;		/*The last edge of the path...*/
+	INT_4	rank;		/*...and which path into the start of that edge comes before it*/
+	INT_4	score;
+	INT_4	order;		/*Breaks ties, so that the first one found ranks higher*/
+}tPathRank;
+
+typedef struct
+{
+	INT_4	from;		/*Index of the state it starts at, or -1 - n for N-terminal subsequence n*/
+	INT_4	nextIn;		/*The next edge into the same state*/
+	INT_4	score;
+	INT_4	mass[3];	/*The extension plus any C-terminal residues from AddCterminalResidues*/
+	INT_4	massNum;
+	INT_4	nodeValue;	/*Where it ends up, before being mapped to a state*/
+	INT_4	gapNum;
+	INT_2	nodeCorrection;
+}tPathEdge;
+
+typedef struct
+{
+	INT_4		nodeValue;
+	INT_4		gapNum;
+	INT_2		nodeCorrection;
+	INT_4		firstIn;	/*The first edge into this state*/
+	tPathRank	*path;		/*The paths found so far, best first*/
+	INT_4		pathNum, pathLimit;
+	tPathRank	*cand;		/*Heap of candidates for the next path, best on top*/
+	INT_4		candNum, candLimit;
+	BOOLEAN		noMorePaths;
+}tPathState;
+
+typedef struct
+{
+	tPathState	*state;
+	INT_4		stateNum, stateLimit;
+	tPathEdge	*edge;
+	INT_4		edgeNum, edgeLimit;
+	INT_4		*stateHash;		/*State indices hashed by PathStateKey, or -1 if empty*/
+	INT_4		hashLimit;		/*Size of stateHash, a power of 2*/
+	INT_4		*stateQueue;	/*Heap of states whose extensions are still to be added, lowest key on top*/
+	INT_4		queueNum, queueLimit;
+	INT_4		gapLimit;
+	struct Sequence **start;	/*The N-terminal subsequences*/
+	INT_4		order;
+}tPathGraph;
 
 
 char gCheckItOut = FALSE;	/*Equals TRUE if I want to follow the subsequence buildup,
@@ -101,7 +208,7 @@ void ClearLowestScore(struct Sequence *newSubsequencePtr, INT_4 *subseqNum,
 			currPtr = currPtr->next;
 		}
 		previousPtr->next = NULL;
-		free(currPtr);	/*Free one subsequence so that the new one can be added on.*/
+		DisposeSequenceStruct(currPtr);	/*Free one subsequence so that the new one can be added on.*/
 		*subseqNum = *subseqNum - 1;
 	}
 	/*If the first subsequence has a higher score than the low score, get rid of all
@@ -153,7 +260,7 @@ void ClearLowestScore(struct Sequence *newSubsequencePtr, INT_4 *subseqNum,
 				{
 					trashPtr = currPtr;
 					currPtr = currPtr->next;
-					free(trashPtr);
+					DisposeSequenceStruct(trashPtr);
 				}
 			}
 		}		
@@ -186,21 +293,19 @@ void ClearLowestScore(struct Sequence *newSubsequencePtr, INT_4 *subseqNum,
 *	struct in the list has the lowest score. 
 */
 
-struct Sequence *LCQNterminalSubsequences(SCHAR *sequenceNode, INT_4 maxLastNode, INT_4 lowSuperNode,
+struct Sequence *LCQNterminalSubsequences(tNodeStore *sequenceNode, INT_4 maxLastNode, INT_4 lowSuperNode,
 											INT_4 highSuperNode)
 {
 	struct Sequence *subsequencePtr;
-	INT_4 i, j, k, m, testValue, nTerminus;
+	INT_4 i, j, k, testValue, nTerminus;
 	INT_4 *extensions, *extScore, extNum;
 	INT_4 *bestExtensions, *bestExtScore, bestExtNum;
 	INT_4 highestExtensionScore;
 	INT_4 threshold;
-	INT_4 threeAALimit = gAminoAcidNumber*gAminoAcidNumber*gAminoAcidNumber;
 	INT_4 score, *peptide, peptideLength, nodeValue, gapNum;
-	INT_4 *threeAA, threeAANum, sum;
 	INT_4 sameNum, averageExtension, *sameExtension;
 	INT_2 nodeCorrection;
-	char nTerminusPossible, duplicateFlag;
+	char nTerminusPossible;
 	char sameTest, doIt;
 	
 	sameExtension = (int *) malloc(gParam.fragmentErr * 20 * sizeof(INT_4));
@@ -209,13 +314,6 @@ struct Sequence *LCQNterminalSubsequences(SCHAR *sequenceNode, INT_4 maxLastNode
 		printf("LCQNterminalSubsequences:  Out of memory.");
 		exit(1);
 	}
-
-	threeAA = (int *) malloc(threeAALimit * sizeof(INT_4));
-	if(threeAA == NULL)
-	{
-		printf("LCQNterminalSubsequences:  Out of memory.");
-		exit(1);
-	}
 	
 	extensions = (int *) malloc(MAX_GAPLIST * sizeof(INT_4 ));
 	if(extensions == NULL)
@@ -249,50 +347,6 @@ struct Sequence *LCQNterminalSubsequences(SCHAR *sequenceNode, INT_4 maxLastNode
 		printf("LCQNterminalSubsequences:  Out of memory.");
 		exit(1);
 	}
-	
-/*	Fill in the masses for three amino acids.*/
-
-	threeAANum = 0;
-	for(i = 0; i < gAminoAcidNumber; i++)	/*Fill in the masses of the 3 AA extensions.*/
-	{
-		for(j = 0; j < gAminoAcidNumber; j++)
-		{
-			for(k = 0; k < gAminoAcidNumber; k++)
-			{
-				if(gGapList[i] != 0 && gGapList[j] != 0 && gGapList[k] != 0)
-				{
-					sum = gGapList[i] + gGapList[j] + gGapList[k];
-					duplicateFlag = FALSE;
-					for(m = 0; m < threeAANum; m++)
-					{
-						if(threeAA[m] == sum)
-						{
-							/* We already have this mass in threeAA so don't add it to the list. */
-							duplicateFlag = TRUE;
-							break;
-						}
-					}
-					if(duplicateFlag == FALSE)
-					{
-						for(m = 0; m <= gGapListIndex; m++)
-						{
-							if(gGapList[m] == sum)
-							{
-							/* We already have this mass  so don't add it to the list. */
-							duplicateFlag = TRUE;
-							break;
-							}
-						}
-					}
-					if(!duplicateFlag && threeAANum < threeAALimit - 1)
-					{
-						threeAA[threeAANum] = sum;
-						threeAANum++;
-					}
-				}
-			}
-		}
-	}
 
 
 /*	Now start finding the N-terminal pieces.*/
@@ -303,40 +357,15 @@ struct Sequence *LCQNterminalSubsequences(SCHAR *sequenceNode, INT_4 maxLastNode
 	nTerminus = gParam.modifiedNTerm;
 												
 	
-/*	Find the one, two, and three amino acid jumps from gGapList and threeAA.*/
+/*	Find the one, two, and three amino acid jumps (see ExtensionMassType).*/
 
 	for(i = nTerminus + gMonoMass_x100[G]; i < gMonoMass_x100[W] * 3; i++)	/*step thru each node*/
 	{
-		if(sequenceNode[i] != 0 && i < gGraphLength)	/*ignore the nodes w/ zero evidence*/
+		if(i < gGraphLength && NodeValue(sequenceNode, i) != 0)	/*ignore the nodes w/ zero evidence*/
 		{
-			nTerminusPossible = FALSE;	/*start assuming that this is not an extension*/
-/*	Check for one and two amino acid extensions using the gGapList array.*/
-			for(j = 0; j <= gGapListIndex; j++)	
-			{
-				if(gGapList[j] != 0)
-				{
-					if(i - nTerminus == gGapList[j])
-					{
-						nTerminusPossible = TRUE;	/*its a possible extension*/
-						break;
-					}
-				}
-			}
-/*	Now check for three amino acid extensions if it wasn't a one or two aa extension.*/
-			if(nTerminusPossible == FALSE)
-			{
-				for(j = 0; j < threeAANum; j++)
-				{
-					if(threeAA[j] != 0)
-					{
-					 	if(i - nTerminus == threeAA[j])
-					 	{
-					 		nTerminusPossible = TRUE;
-					 		break;
-					 	}
-					}
-				}
-			}
+			/*Is it a one, two, or three amino acid extension?*/
+			nTerminusPossible = (ExtensionMassType(i - nTerminus) 
+								& (EXTENSION_GAP_LIST | EXTENSION_THREE_AA)) != 0;
 			doIt = TRUE;	/*check for superNodes when sequencetag specified*/
 			if(nTerminus < lowSuperNode && i > highSuperNode)
 			{
@@ -345,7 +374,7 @@ struct Sequence *LCQNterminalSubsequences(SCHAR *sequenceNode, INT_4 maxLastNode
 			if(nTerminusPossible && i <= maxLastNode && doIt)	/*save as an extension?*/
 			{
 				extensions[extNum] = i - nTerminus;
-				extScore[extNum] = sequenceNode[i];
+				extScore[extNum] = NodeValue(sequenceNode, i);
 				extNum++;
 				if(extNum >= MAX_GAPLIST)
 				{
@@ -437,16 +466,9 @@ struct Sequence *LCQNterminalSubsequences(SCHAR *sequenceNode, INT_4 maxLastNode
 			for(j = i + 1; j < extNum; j++)
 			{
 				testValue = extensions[j] - extensions[i];
-				for(k = 0; k < gAminoAcidNumber; k++)
+				if(ExtensionMassType(testValue) & EXTENSION_NEAR_AA)
 				{
-					if(gGapList[k] != 0)
-					{
-						if(testValue <= gGapList[k] + gParam.fragmentErr &&
-							testValue >= gGapList[k] - gParam.fragmentErr)
-						{
-							extScore[j] = 0;
-						}
-					}
+					extScore[j] = 0;
 				}
 			}
 		}
@@ -532,7 +554,6 @@ struct Sequence *LCQNterminalSubsequences(SCHAR *sequenceNode, INT_4 maxLastNode
 	free(bestExtScore);
 	free(peptide);
 	free(sameExtension);
-	free(threeAA);
 	
 	return(subsequencePtr);
 }
@@ -770,17 +791,9 @@ char CorrectMass(INT_4 *peptide, INT_4 peptideLength, INT_4 *aaPresentMass)
 							if(peptideChar[j])
 							{
 								diff = peptide[j] - aaPresentMass[i];
-								for(k = 0; k < gAminoAcidNumber; k++)
+								if(ExtensionMassType(diff) & EXTENSION_NEAR_AA)
 								{
-									if(gGapList[k] != 0)
-									{
-										if(diff >= gGapList[k] - gParam.fragmentErr
-											&& diff <= gGapList[k] + gParam.fragmentErr)
-										{
-											test = FALSE;
-											break;
-										}
-									}
+									test = FALSE;
 								}
 							}
 						}
@@ -825,103 +838,207 @@ char CorrectMass(INT_4 *peptide, INT_4 peptideLength, INT_4 *aaPresentMass)
 	return(correct);
 }
 
-/****************************AlterSubsequenceList**********************************************
-*
-* 	This function adds a subsequence onto the existing linked list of structs of type Sequence.
-*	It adds structs in order of their score fields, so that the first in the list has the
-*	highest score and the last in the list has the lowest score.
+/****************************HeapEntryIsWorse**********************************************
 *
+*	Returns TRUE if entry a ranks below entry b:  it has the lower score, or the same score
+*	and it was stored later.
 */
-
-struct Sequence *AlterSubsequenceList(struct Sequence *firstPtr, struct Sequence *newPtr)
+static BOOLEAN HeapEntryIsWorse(tHeapEntry *a, tHeapEntry *b)
 {
-	struct Sequence *currPtr, *previousPtr;
-	char test = TRUE;
-	INT_4 i = 0;
-	
-	
-	previousPtr = firstPtr;	/*This is to make sure currPtr and previousPtr are initialized, 
-						so that in the end I can find the last element in the list to free.*/
-						
-						
-	if(firstPtr->next != NULL)	/*Take care of situations where there is only one subsequence.*/
+	if(a->seqPtr->score != b->seqPtr->score)
 	{
-		currPtr = firstPtr->next;
+		return(a->seqPtr->score < b->seqPtr->score);
 	}
-	else
+	return(a->order > b->order);
+}
+
+/****************************SiftHeapEntry**********************************************
+*
+*	Moves the entry at index down the heap until neither of its children is worse than it.
+*/
+static void SiftHeapEntry(tSubsequenceHeap *heapPtr, INT_4 index)
+{
+	tHeapEntry temp;
+	INT_4 child;
+	
+	while(TRUE)
 	{
-		if(newPtr->score > firstPtr->score)
+		child = 2 * index + 1;
+		if(child >= heapPtr->num)
 		{
-			free(firstPtr);
-			firstPtr = newPtr;
-			return(firstPtr);
+			break;
 		}
-		else
+		if(child + 1 < heapPtr->num && 
+			HeapEntryIsWorse(&heapPtr->entry[child + 1], &heapPtr->entry[child]))
+		{
+			child++;
+		}
+		if(!HeapEntryIsWorse(&heapPtr->entry[child], &heapPtr->entry[index]))
 		{
-			free(newPtr);
-			return(firstPtr);
+			break;
 		}
+		temp = heapPtr->entry[index];
+		heapPtr->entry[index] = heapPtr->entry[child];
+		heapPtr->entry[child] = temp;
+		index = child;
 	}
 	
-/*Much of this is the same as from LinkSubsequenceList.*/
+	return;
+}
 
-	if(firstPtr == NULL) 	/*If this is the first struct of the list then do this.*/
+/****************************HeapKeepsScore**********************************************
+*
+*	Returns TRUE if a sequence with this score would be kept by AddToSubsequenceHeap.  Once
+*	the heap holds limit sequences, a new one has to beat the next to last one in the ranking,
+*	which is the worse of the two children of the top of the heap.  (The sorted lists 
+*	compared the new score with every one but the last, so this is what they did, too.)
+*/
+static BOOLEAN HeapKeepsScore(tSubsequenceHeap *heapPtr, INT_4 score, INT_4 limit)
+{
+	tHeapEntry *nextToLastPtr;
+	
+	if(heapPtr->num < limit)
 	{
-		firstPtr = newPtr;
-		return(firstPtr);
-	}	
+		return(TRUE);
+	}
+	if(heapPtr->num == 0)
+	{
+		return(FALSE);
+	}
+	if(heapPtr->num == 1)
+	{
+		nextToLastPtr = &heapPtr->entry[0];
+	}
 	else
 	{
-		if(newPtr->score > firstPtr->score)	/*If the struct to be added has the best score then*/
+		nextToLastPtr = &heapPtr->entry[1];
+		if(heapPtr->num > 2 && HeapEntryIsWorse(&heapPtr->entry[2], nextToLastPtr))
 		{
-			newPtr->next = firstPtr;
-			firstPtr = newPtr;
+			nextToLastPtr = &heapPtr->entry[2];
 		}
-		else	/*Otherwise, go find the position for the new struct (based on its score field.*/
+	}
+	
+	return(score > nextToLastPtr->seqPtr->score);
+}
+
+/****************************AddToSubsequenceHeap**********************************************
+*
+* 	Stores newPtr in the heap if there are fewer than limit sequences in it.  Otherwise newPtr
+*	replaces the lowest ranked sequence if HeapKeepsScore says so, or else it is disposed of.
+*/
+static void AddToSubsequenceHeap(tSubsequenceHeap *heapPtr, struct Sequence *newPtr, INT_4 limit)
+{
+	tHeapEntry newEntry, temp;
+	INT_4 index, parent;
+	
+	newEntry.seqPtr = newPtr;
+	newEntry.order = heapPtr->nextOrder;
+	heapPtr->nextOrder++;
+	
+	if(heapPtr->num < limit)
+	{
+		if(heapPtr->num >= heapPtr->size)
 		{
-			while(currPtr->next != NULL)
+			heapPtr->size = (heapPtr->size < 64) ? 64 : 2 * heapPtr->size;
+			heapPtr->entry = (tHeapEntry *) realloc(heapPtr->entry, 
+											heapPtr->size * sizeof(tHeapEntry));
+			if(heapPtr->entry == NULL)
 			{
-				if(newPtr->score > currPtr->score)	/*I found the place.*/
-				{
-					previousPtr->next = newPtr;
-					newPtr->next = currPtr;
-					test = FALSE;
-					break;
-				}
-				previousPtr = currPtr;
-				currPtr = currPtr->next;
+				printf("AddToSubsequenceHeap:  Out of memory");
+				exit(1);
 			}
-			if(test)	/*Ok, I didn't find the place, and I'm at the end of the linked list,
-						so this must have the lowest score of all.  I'll leave the list alone
-						and return.	This is different from LinkSubsequenceList, which added
-						the new struct on to the end of the list.*/
+		}
+		index = heapPtr->num;
+		heapPtr->entry[index] = newEntry;
+		heapPtr->num++;
+		while(index > 0)	/*move it up past any better ones*/
+		{
+			parent = (index - 1) / 2;
+			if(!HeapEntryIsWorse(&heapPtr->entry[index], &heapPtr->entry[parent]))
 			{
-				free(newPtr);
-				return(firstPtr);
+				break;
 			}
+			temp = heapPtr->entry[index];
+			heapPtr->entry[index] = heapPtr->entry[parent];
+			heapPtr->entry[parent] = temp;
+			index = parent;
 		}
 	}
+	else if(HeapKeepsScore(heapPtr, newPtr->score, limit))
+	{
+		DisposeSequenceStruct(heapPtr->entry[0].seqPtr);
+		heapPtr->entry[0] = newEntry;
+		SiftHeapEntry(heapPtr, 0);
+	}
+	else
+	{
+		DisposeSequenceStruct(newPtr);
+	}
 	
-/*	Here's what's different from LinkSubsequenceList - I find the lowest score (or last in the
-*	list) and I eliminate it.  I set the previousPtr's next field to NULL to make it the new
-*	last element in the list, and I free the currPtr.
+	return;
+}
+
+/****************************HeapEntrySortDescend**********************************************
+*
+*	qsort function that puts the best ranked entries first.
 */
-	while(currPtr->next != NULL)
+static int HeapEntrySortDescend(const void *n1, const void *n2)
+{
+	tHeapEntry *a = (tHeapEntry *)n1;
+	tHeapEntry *b = (tHeapEntry *)n2;
+	
+	if(HeapEntryIsWorse(a, b))
 	{
-		previousPtr = currPtr;
-		currPtr = currPtr->next;
+		return(1);
 	}
-	previousPtr->next = NULL;
-	/*if(currPtr->nodeValue == 13322 && currPtr->score == 236)
+	if(HeapEntryIsWorse(b, a))
 	{
-		i++;
-		i++;
-	} for debugging*/
-		
-	free(currPtr);
+		return(-1);
+	}
+	return(0);
+}
+
+/****************************SubsequenceHeapToList**********************************************
+*
+* 	Empties the heap into a linked list of Sequence structs, with the highest score first, and
+*	returns the first element of the list (or NULL).
+*/
+static struct Sequence *SubsequenceHeapToList(tSubsequenceHeap *heapPtr)
+{
+	struct Sequence *firstPtr = NULL;
+	INT_4 i;
+	
+	if(heapPtr->num > 0)
+	{
+		qsort(heapPtr->entry, heapPtr->num, sizeof(tHeapEntry), HeapEntrySortDescend);
+		for(i = heapPtr->num - 1; i >= 0; i--)
+		{
+			heapPtr->entry[i].seqPtr->next = firstPtr;
+			firstPtr = heapPtr->entry[i].seqPtr;
+		}
+	}
+	heapPtr->num = 0;
+	heapPtr->nextOrder = 0;
 	
 	return(firstPtr);
 }
+
+/****************************FreeSubsequenceHeap**********************************************
+*
+* 	Frees the entries of a heap (but not the Sequence structs, which SubsequenceHeapToList 
+*	has already handed on).
+*/
+static void FreeSubsequenceHeap(tSubsequenceHeap *heapPtr)
+{
+	free(heapPtr->entry);
+	heapPtr->entry = NULL;
+	heapPtr->num = 0;
+	heapPtr->size = 0;
+	heapPtr->nextOrder = 0;
+	
+	return;
+}
+
 /**********************FreeSequenceStructs****************************************
 *
 * Used for freeing memory in a linked list.  Bob DuBose tells me its best to free 
@@ -938,23 +1055,52 @@ void FreeSequenceStructs(struct Sequence *s)
      while(currPtr != NULL)
      {
      	nextPtr = currPtr->next;
-     	free(currPtr);
+     	DisposeSequenceStruct(currPtr);
      	currPtr = nextPtr;
      }
 
     return;                             /* now unwind the recursion*/
 }
 
+/************************************* AddCterminalResidues ****************************************
+*
+*	If the node nodeValue can be finished off w/ the known C-terminal amino acids (gAA1 and then
+*	gAA2, see SubsequenceMaker), they are put in residue, residueNum is set to how many, and 
+*	nodeValue is moved past them.  Returns the score for them, which is endNodeScore apiece.
+*/
+INT_4 AddCterminalResidues(INT_4 *nodeValue, INT_4 *residue, INT_4 *residueNum, INT_4 endNodeScore)
+{
+	INT_4 score = 0;
+	
+	*residueNum = 0;
+	if(*nodeValue >= gAA1Min && *nodeValue <= gAA1Max)
+	{
+		score += endNodeScore;
+		residue[*residueNum] = gAA1;
+		*residueNum += 1;
+		*nodeValue += gAA1;
+	}
+	if(*nodeValue >= gAA2Min && *nodeValue <= gAA2Max)
+	{
+		score += endNodeScore;
+		residue[*residueNum] = gAA2;
+		*residueNum += 1;
+		*nodeValue += gAA2;
+	}
+	
+	return(score);
+}
+
 /************************************* StoreSubsequences ********************************************
 *
-*  Store this information in the linked list of Sequence structs.  The values placed in the
+*  Store this information in the heaps of Sequence structs.  The values placed in the
 *   extensionList are used to determine
 *	values for the variables peptide[], score, peptideLength, gapNum, and nodeValue.  These
-*	variables are passed to a few functions that are used to set up the linked list of structs
-*	of type Sequence, which contain the next set of subsequences (newSubsequencePtr	
+*	variables are passed to a few functions that are used to set up the structs
+*	of type Sequence, which go in gSubsequenceHeap (the next set of subsequences) or
+*	gFinalSequenceHeap (the completed sequences).
 */
-struct Sequence *StoreSubsequences(
-	struct Sequence *newSubsequencePtr,
+void StoreSubsequences(
 	struct extension *extensionList,
 	struct Sequence *currentSubsequence,
 	INT_4 *lastNode, 
@@ -964,13 +1110,14 @@ struct Sequence *StoreSubsequences(
 	INT_4 *aaPresentMass, 
 	INT_4 *seqNum,
 	INT_4 *subseqNum, 
-	SCHAR *sequenceNode)
+	tNodeStore *sequenceNode)
 
 {
 
 	INT_4	i, j;				/* Loop index */
 	BOOLEAN test;
 	INT_4 *peptide, score, peptideLength, nodeValue, gapNum;	
+	INT_4 cTermResidue[2], cTermResidueNum;
 	INT_2 nodeCorrection;
 	
 	
@@ -1017,35 +1164,18 @@ struct Sequence *StoreSubsequences(
 			nodeValue = nodeValue - 1;
 		}
 		
-		if(nodeValue >= gAA1Min)	/*can be terminated by known C-terminal aa*/
-		{
-			if(nodeValue <= gAA1Max)
-			{
-				score = score + sequenceNode[maxLastNode];
-				peptideLength++;
-				if(peptideLength > MAX_PEPTIDE_LENGTH)
-				{
-					printf("StoreSubsequences: peptideLength > MAX_PEPTIDE_LENGTH\n");
-					exit(1);
-				}
-				peptide[peptideLength - 1] = gAA1;
-				nodeValue = nodeValue + gAA1;
-			}
-		}
-		if(nodeValue >= gAA2Min)	/*can be terminated by known C-terminal aa*/
+		/*can be terminated by known C-terminal aa?*/
+		score = score + AddCterminalResidues(&nodeValue, cTermResidue, &cTermResidueNum, 
+											NodeValue(sequenceNode, maxLastNode));
+		for(j = 0; j < cTermResidueNum; j++)
 		{
-			if(nodeValue <= gAA2Max)
+			peptideLength++;
+			if(peptideLength > MAX_PEPTIDE_LENGTH)
 			{
-				score = score + sequenceNode[maxLastNode];
-				peptideLength++;
-				if(peptideLength > MAX_PEPTIDE_LENGTH)
-				{
-					printf("StoreSubsequences: peptideLength > MAX_PEPTIDE_LENGTH\n");
-					exit(1);
-				}
-				peptide[peptideLength - 1] = gAA2;
-				nodeValue = nodeValue + gAA2;
+				printf("StoreSubsequences: peptideLength > MAX_PEPTIDE_LENGTH\n");
+				exit(1);
 			}
+			peptide[peptideLength - 1] = cTermResidue[j];
 		}
 				
 	
@@ -1061,25 +1191,12 @@ struct Sequence *StoreSubsequences(
 					if((gapNum <= gParam.maxGapNum) &&
 							CorrectMass(peptide, peptideLength, aaPresentMass))
 					{
-						if(*seqNum < gParam.finalSeqNum)
-						{
-							gFinalSequencePtr = 
-								LinkSubsequenceList(gFinalSequencePtr,
-													LoadFinalSequenceStruct(peptide,
-																	peptideLength,
-																	score, nodeValue, 
-																	gapNum, nodeCorrection));
-							*seqNum = *seqNum + 1;
-						}
-						else
-						{
-							gFinalSequencePtr =
-								AlterSubsequenceList(gFinalSequencePtr,
-													LoadFinalSequenceStruct(peptide,
-																	peptideLength,
+						AddToSubsequenceHeap(&gFinalSequenceHeap, 
+											LoadFinalSequenceStruct(peptide, peptideLength,
 																	score, nodeValue, 
-																	gapNum, nodeCorrection));
-						}
+																	gapNum, nodeCorrection),
+											gParam.finalSeqNum);
+						*seqNum = gFinalSequenceHeap.num;
 					}
 				}
 			}
@@ -1089,42 +1206,17 @@ struct Sequence *StoreSubsequences(
 		{
 			if(gapNum <= gParam.maxGapNum)	/*Don't store if there are too many gaps.*/
 			{
-				if(*subseqNum < gParam.topSeqNum)	/*If there are not too many subsequences 
-													  stored, then do this.*/
-				{
-					newSubsequencePtr = 
-						LinkSubsequenceList(newSubsequencePtr, 
-											LoadSequenceStruct(peptide, 
-															peptideLength, 
-															score, nodeValue, gapNum,
-															nodeCorrection));
-					*subseqNum = *subseqNum + 1;
-				}
-				else	/*If I have the max allowed number of subsequence, 
-							then do this.*/
+				/*Once there are gParam.topSeqNum subsequences, a new one replaces the lowest
+				scoring one if it does better*/
+				if(HeapKeepsScore(&gSubsequenceHeap, score, gParam.topSeqNum))
 				{
-					/*This is the new way, which removes all subsequences with the
-					same low score*/
-					/*ClearLowestScore(newSubsequencePtr, subseqNum, maxLastNode, 
-									minLastNode);
-					
-					newSubsequencePtr = 
-						LinkSubsequenceList(newSubsequencePtr, 
-											LoadSequenceStruct(peptide, 
-															peptideLength, 
-															score, nodeValue, gapNum,
-															nodeCorrection));
-					*subseqNum = *subseqNum + 1;*/
-					
-					/*This is the old way which was to replace subsequences one at a time*/
-					newSubsequencePtr = 
-						AlterSubsequenceList(newSubsequencePtr, 
-											LoadSequenceStruct(peptide, 
-															peptideLength,
-															score, nodeValue, gapNum,
-															nodeCorrection));
+					AddToSubsequenceHeap(&gSubsequenceHeap, 
+										LoadSequenceStruct(peptide, peptideLength, 
+														score, nodeValue, gapNum,
+														nodeCorrection),
+										gParam.topSeqNum);
 				}
-
+				*subseqNum = gSubsequenceHeap.num;
 			}
 		}
 			
@@ -1132,7 +1224,7 @@ struct Sequence *StoreSubsequences(
 	}
 	free(peptide);
 	
-	return newSubsequencePtr;
+	return;
 }		
 
 /************************************* ExtensionsSortDescend ********************************************
@@ -1301,17 +1393,9 @@ struct extension Score2aaExtension(
 
 
 	massDiff = io2aaExtension.mass - gGapList[P];	/*Subtract the mass of proline.*/
-	for(i = 0; i < gAminoAcidNumber; i++)
+	if(ExtensionMassType(massDiff) & EXTENSION_NEAR_AA)
 	{
-		if(gGapList[i] != 0)
-		{
-			if(massDiff <= gGapList[i] + gParam.fragmentErr &&
-				massDiff >= gGapList[i] - gParam.fragmentErr)
-			{
-				prolinePossible = TRUE;
-				break;
-			}
-		}
+		prolinePossible = TRUE;
 	}
 	
 	/*
@@ -1418,187 +1502,184 @@ struct extension Score2aaExtension(
 	
 	return io2aaExtension;
 }		
-/*************************************AddExtensions********************************************
+/*************************************FindExtensions********************************************
 *
-*	This function adds single amino acid extensions onto the subsequences found in the linked
-*	list starting w/ subsequencePtr.  As a result, a new linked list starting with 
-*	newSubsequencePtr is generated.  When all of the extensions have been made and the list
-*	starting with newSubsequencePtr is complete, then the list starting with subsequencePtr
-*	is free'ed, and newSubsequencePtr is returned.  In addition to making one amino acid
-*	jumps between nodes, this function performs two amino acid jumps for subsequences that 
-*	cannot be extended any further, which leads to no penalty in the extension score.  If
-*	a jump is made between a one-edge node and a regular node, then this extension score is
-*	penalized by 0.75.  If a jump is made between two nodes that can be extended by single
-*	amino acid jumps, then that extension score is penalized by 0.5.
-*	The scores for the subsequences are derived from the array
-*	sequenceNode, and are a summation of the scores for the nodes within a subsequence.  The
-*	array gGapList and gGapListIndex describe the possible extensions that are allowed.
-*	The array aaPresent is a character array listing in single letter code, the amino acids
-*	known to be present.  If a completed sequence lacks one or more of these amino acids
-*	then it is not stored.  extThresh is the extension threshold as described earlier, and
-*	maxExtNum is the upper limit on the number of extensions allowed per subsequence.  The
-*	maxGapNum is the upper limit on the number of two amino acid extensions allowed per
-*	sequence (excluding the N-termninal two amino acids and certain C-terminal cases).  The
-*	finalSeqNum is the upper limit on the number of completed sequences that will be stored
-*	in the linked list of Sequence structs starting w/ gFinalSequencePtr.  The topSeqNum
-*	is the maximum number of subsequences that are in the linked list of sequences (both
-*	the list starting with subsequencePtr and newSubsequencePtr).
+*	Fills in extensionList w/ the one and two amino acid extensions that can be made from the
+*	node nodeValue, scored as AddExtensions scores them, and returns how many there are.  The
+*	one amino acid extensions come first.  extensionList must have room for MAX_GAPLIST.
 */
-struct Sequence *AddExtensions(struct Sequence *subsequencePtr, SCHAR *sequenceNode, 
-						INT_4 *oneEdgeNodes, INT_4 oneEdgeNodesIndex, 
-						INT_4 *aaPresentMass, 
-						INT_4 topSeqNum, INT_4 *lastNode, INT_4 lastNodeNum, 
-						INT_4 *seqNum, INT_4 maxLastNode, INT_4 minLastNode,
+INT_4 FindExtensions(struct extension *extensionList, INT_4 nodeValue, tNodeStore *sequenceNode,
+						INT_4 *oneEdgeNodes, INT_4 oneEdgeNodesIndex, INT_4 maxLastNode,
 						INT_4 lowSuperNode, INT_4 highSuperNode)
 {
-	struct Sequence *newSubsequencePtr;
-	struct Sequence *currPtr;
-	char doIt;		
-	BOOLEAN oneEdgeNNode, test;
-	INT_4 i, j, k, testValue, subseqNum, z=0, subseqCount;
-	INT_4 extNum;
+	INT_4 i, j, testValue, extNum;
 	INT_4 massDiff;
-	struct extension	clearExtension;
-	struct extension 	*extensionList;
-	
+	char doIt;
+	BOOLEAN oneEdgeNNode, test;
 	
-	clearExtension.gapSize        = 0;
-	clearExtension.mass           = 0;
-	clearExtension.singleAAFLAG   = 0;
-	clearExtension.score          = 0;
-	clearExtension.nodeCorrection = 0;
-
+	memset(extensionList, 0, MAX_GAPLIST * sizeof(struct extension));
 	
-	extensionList = (extension *) calloc(MAX_GAPLIST, sizeof(struct extension)); /* Note: memory is zeroed */
-	if(extensionList == NULL)
+	extNum = 0;
+	oneEdgeNNode = TRUE;	/*If it remains TRUE, then no one amino acid extensions found.*/
+	for(i = 0; i < gAminoAcidNumber; i++)	/*Find the one amino acid extensions.*/
 	{
-		printf("AddExtensions:  Out of memory");
-		exit(1);
-	}
-
-	subseqCount = 0;	/*This is used to count the number of subsequences in the old list*/
-	newSubsequencePtr = NULL;
-	currPtr = subsequencePtr;
-	subseqNum = 0;	/*This is used to count the number of subsequences in the new list
-					  and is used in the StoreSubsequences function to ensure that 
-					  only gParam.topSeqNum subsequences are stored.*/
-
-	while(currPtr != NULL)
-	{
-		/* Clear the extensionList */		
-		for (i = 0; i < MAX_GAPLIST; i++) {
-			extensionList[i] = clearExtension;
-		}
-		
-
-	
-		subseqCount++;	
-		extNum = 0;
-		oneEdgeNNode = TRUE;	/*If it remains TRUE, then no one amino acid extensions found.*/
-		for(i = 0; i < gAminoAcidNumber; i++)	/*Find the one amino acid extensions.*/
+		if(gGapList[i] != 0)
 		{
-			if(gGapList[i] != 0)
+			testValue = nodeValue + gGapList[i];
+			doIt = TRUE;
+			if(nodeValue < lowSuperNode && testValue > highSuperNode)
 			{
-				testValue = currPtr->nodeValue + gGapList[i];
-				doIt = TRUE;
-				if(currPtr->nodeValue < lowSuperNode && testValue > highSuperNode)
-				{
-					doIt = FALSE;
-				}
-				if(testValue >= gGraphLength)
-				{
-					doIt = FALSE;	/*you've gone past the graph length*/
-				}
-				if(sequenceNode[testValue] != 0 && testValue <= maxLastNode && doIt)
+				doIt = FALSE;
+			}
+			if(testValue >= gGraphLength)
+			{
+				doIt = FALSE;	/*you've gone past the graph length*/
+			}
+			if(doIt && NodeValue(sequenceNode, testValue) != 0 && testValue <= maxLastNode)
+			{
+				/* Add the single AA extension to the extensionList */
+				extensionList[extNum].mass           = gGapList[i];
+				extensionList[extNum].gapSize        = 0;
+				extensionList[extNum].singleAAFLAG   = 1;
+				extensionList[extNum].score          = NodeValue(sequenceNode, testValue);
+				extensionList[extNum].nodeCorrection = gNodeCorrection[i];
+				extNum++;
+				if(extNum >= MAX_GAPLIST)
 				{
-					/* Add the single AA extension to the extensionList */
-					extensionList[extNum].mass           = gGapList[i];
-					extensionList[extNum].gapSize        = 0;
-					extensionList[extNum].singleAAFLAG   = 1;
-					extensionList[extNum].score          = sequenceNode[testValue];
-					extensionList[extNum].nodeCorrection = gNodeCorrection[i];
-					extNum++;
-					if(extNum >= MAX_GAPLIST)
-					{
-						printf("AddExtensions:  extNum >= MAX_GAPLIST\n");
-						exit(1);
-					}
-					oneEdgeNNode = FALSE;
+					printf("FindExtensions:  extNum >= MAX_GAPLIST\n");
+					exit(1);
 				}
+				oneEdgeNNode = FALSE;
 			}
 		}
-		
+	}
+	
 /*
 *	Now find the two amino acid extensions.  Make sure that the two amino acid extension does not
 *	include one of the one amino acid extensions.  IE, if I find an edge for Ala, then I cannot
 *	use a two amino acid edge of 199, since 128 + 71 = 199.
 */
 
-		for(i = gAminoAcidNumber; i <= gGapListIndex; i++)/*Start at the end of the one aa 
-															extensions and move up from there.*/
+	for(i = gAminoAcidNumber; i <= gGapListIndex; i++)/*Start at the end of the one aa 
+														extensions and move up from there.*/
+	{
+		testValue = nodeValue + gGapList[i];/*This is the test mass (nominal).*/
+		doIt = TRUE;	/*check that no superNodes are involved*/
+		if(nodeValue < lowSuperNode && testValue > highSuperNode)
 		{
-			testValue = currPtr->nodeValue + gGapList[i];/*This is the test mass (nominal).*/
-			doIt = TRUE;	/*check that no superNodes are involved*/
-			if(currPtr->nodeValue < lowSuperNode && testValue > highSuperNode)
-			{
-				doIt = FALSE;
-			}
-			if(testValue >= gGraphLength)
-			{
-				doIt = FALSE;	/*you've gone past the graph length*/
-			}
-			if(doIt && sequenceNode[testValue] != 0 && testValue <= maxLastNode) {
-					/* If there is any evidence at that mass,
-					   and if the node is less than the peptide mass.*/
+			doIt = FALSE;
+		}
+		if(testValue >= gGraphLength)
+		{
+			doIt = FALSE;	/*you've gone past the graph length*/
+		}
+		if(doIt && NodeValue(sequenceNode, testValue) != 0 && testValue <= maxLastNode) {
+				/* If there is any evidence at that mass,
+				   and if the node is less than the peptide mass.*/
 
-				test = TRUE;	/*test is set to true, and if it continues to be true (see below),
-							      then this extension is allowed.*/
+			test = TRUE;	/*test is set to true, and if it continues to be true (see below),
+						      then this extension is allowed.*/
+			
+			j = 0;
+			while (extensionList[j].singleAAFLAG == 1 && j < extNum) {
+				/*Look at the one aa extensions.*/
+				massDiff = gGapList[i] - extensionList[j].mass;
+				if(ExtensionMassType(massDiff) & EXTENSION_NEAR_AA)
+				{
+					test = FALSE;	/*If the mass difference is equal to an amino acid
+									mass then its not allowed and test = FALSE.*/
+				}
 				
-				j = 0;
-				while (extensionList[j].singleAAFLAG == 1 && j < extNum) {
-					/*Look at the one aa extensions.*/
-					massDiff = gGapList[i] - extensionList[j].mass;
-					for(k = 0; k < gAminoAcidNumber; k++)	/*k = 0; k < gGapListIndex; k++*/
-					{
-						if(gGapList[k] != 0)
-						{
-							if(massDiff <= gGapList[k] + gParam.fragmentErr
-								&& massDiff >= gGapList[k] - gParam.fragmentErr)
-							{
-								test = FALSE;	/*If the mass difference is equal to an amino acid
-												mass then its not allowed and test = FALSE.*/
-								break;
-							}
-						}
-					}
-					
-					j++;
-				}				
-				if(test)	/*If test is still true then go ahead and save these as extensions.*/
+				j++;
+			}				
+			if(test)	/*If test is still true then go ahead and save these as extensions.*/
+			{
+				/*Add the 2 AA extension.*/
+				extensionList[extNum].mass           = gGapList[i];
+				extensionList[extNum].gapSize        = 1;
+				extensionList[extNum].singleAAFLAG   = 0;
+				extensionList[extNum].nodeCorrection = 0;
+				
+				/*Examine some special cases and then calculate the score for the 2 AA extension*/
+				extensionList[extNum] = Score2aaExtension(extensionList[extNum], 
+														  nodeValue,
+														  oneEdgeNodes,
+														  oneEdgeNodesIndex,
+														  oneEdgeNNode,
+														  NodeValue(sequenceNode, testValue));					
+				
+				extNum++;	/*Increment the number of extensions.*/
+				if(extNum >= MAX_GAPLIST)
 				{
-					/*Add the 2 AA extension.*/
-					extensionList[extNum].mass           = gGapList[i];
-					extensionList[extNum].gapSize        = 1;
-					extensionList[extNum].singleAAFLAG   = 0;
-					extensionList[extNum].nodeCorrection = 0;
-					
-					/*Examine some special cases and then calculate the score for the 2 AA extension*/
-					extensionList[extNum] = Score2aaExtension(extensionList[extNum], 
-															  currPtr->nodeValue,
-															  oneEdgeNodes,
-															  oneEdgeNodesIndex,
-															  oneEdgeNNode,
-															  sequenceNode[testValue]);					
-					
-					extNum++;	/*Increment the number of extensions.*/
-					if(extNum >= MAX_GAPLIST)
-					{
-						printf("AddExtensions:  extNum >= MAX_GAPLIST\n");
-						exit(1);
-					}
+					printf("FindExtensions:  extNum >= MAX_GAPLIST\n");
+					exit(1);
 				}
 			}
 		}
+	}
+
+	return(extNum);
+}
+
+/*************************************AddExtensions********************************************
+*
+*	This function adds single amino acid extensions onto the subsequences found in the linked
+*	list starting w/ subsequencePtr.  As a result, a new linked list starting with 
+*	newSubsequencePtr is generated.  When all of the extensions have been made and the list
+*	starting with newSubsequencePtr is complete, then the list starting with subsequencePtr
+*	is free'ed, and newSubsequencePtr is returned.  In addition to making one amino acid
+*	jumps between nodes, this function performs two amino acid jumps for subsequences that 
+*	cannot be extended any further, which leads to no penalty in the extension score.  If
+*	a jump is made between a one-edge node and a regular node, then this extension score is
+*	penalized by 0.75.  If a jump is made between two nodes that can be extended by single
+*	amino acid jumps, then that extension score is penalized by 0.5.
+*	The scores for the subsequences are derived from the array
+*	sequenceNode, and are a summation of the scores for the nodes within a subsequence.  The
+*	array gGapList and gGapListIndex describe the possible extensions that are allowed.
+*	The array aaPresent is a character array listing in single letter code, the amino acids
+*	known to be present.  If a completed sequence lacks one or more of these amino acids
+*	then it is not stored.  extThresh is the extension threshold as described earlier, and
+*	maxExtNum is the upper limit on the number of extensions allowed per subsequence.  The
+*	maxGapNum is the upper limit on the number of two amino acid extensions allowed per
+*	sequence (excluding the N-termninal two amino acids and certain C-terminal cases).  The
+*	finalSeqNum is the upper limit on the number of completed sequences that will be stored
+*	in the linked list of Sequence structs starting w/ gFinalSequencePtr.  The topSeqNum
+*	is the maximum number of subsequences that are in the linked list of sequences (both
+*	the list starting with subsequencePtr and newSubsequencePtr).
+*/
+struct Sequence *AddExtensions(struct Sequence *subsequencePtr, tNodeStore *sequenceNode, 
+						INT_4 *oneEdgeNodes, INT_4 oneEdgeNodesIndex, 
+						INT_4 *aaPresentMass, 
+						INT_4 topSeqNum, INT_4 *lastNode, INT_4 lastNodeNum, 
+						INT_4 *seqNum, INT_4 maxLastNode, INT_4 minLastNode,
+						INT_4 lowSuperNode, INT_4 highSuperNode)
+{
+	struct Sequence *newSubsequencePtr;
+	struct Sequence *currPtr;
+	INT_4 subseqNum, subseqCount;
+	INT_4 extNum;
+	struct extension 	*extensionList;
+	
+	
+	extensionList = (extension *) calloc(MAX_GAPLIST, sizeof(struct extension)); /* Note: memory is zeroed */
+	if(extensionList == NULL)
+	{
+		printf("AddExtensions:  Out of memory");
+		exit(1);
+	}
+
+	subseqCount = 0;	/*This is used to count the number of subsequences in the old list*/
+	newSubsequencePtr = NULL;
+	currPtr = subsequencePtr;
+	subseqNum = 0;	/*This is used to count the number of subsequences in the new list
+					  and is used in the StoreSubsequences function to ensure that 
+					  only gParam.topSeqNum subsequences are stored.*/
+
+	while(currPtr != NULL)
+	{
+		subseqCount++;	
+		extNum = FindExtensions(extensionList, currPtr->nodeValue, sequenceNode, oneEdgeNodes,
+								oneEdgeNodesIndex, maxLastNode, lowSuperNode, highSuperNode);
 
 /*
 *	Now I need to find the best extensions, ie, the top maxExtNum of them and only if these
@@ -1623,10 +1704,8 @@ struct Sequence *AddExtensions(struct Sequence *subsequencePtr, SCHAR *sequenceN
 *	variables are passed to a few functions that are used to set up the linked list of structs
 *	of type Sequence, which contain the next set of subsequences (newSubsequencePtr*/
 
-			newSubsequencePtr = StoreSubsequences(newSubsequencePtr, extensionList, currPtr,
-												  lastNode, lastNodeNum, maxLastNode, minLastNode,
-												  aaPresentMass, seqNum, &subseqNum,
-												  sequenceNode);
+			StoreSubsequences(extensionList, currPtr, lastNode, lastNodeNum, maxLastNode, 
+							  minLastNode, aaPresentMass, seqNum, &subseqNum, sequenceNode);
 
 			
 		}
@@ -1650,6 +1729,8 @@ struct Sequence *AddExtensions(struct Sequence *subsequencePtr, SCHAR *sequenceN
 	free(extensionList);
 
 	FreeSequenceStructs(subsequencePtr);
+	
+	newSubsequencePtr = SubsequenceHeapToList(&gSubsequenceHeap);
 
 	return(newSubsequencePtr);
 }
@@ -1726,12 +1807,7 @@ struct Sequence *LoadFinalSequenceStruct(INT_4 *peptide, INT_4 peptideLength,
 	INT_4 i;	
 	REAL_4 scoreAdjuster;
 
-	currPtr = (struct Sequence *) malloc(sizeof(struct Sequence));
-	if(currPtr == NULL)
-	{
-		printf("LoadFinalSequenceStruct:  Out of mammories");
-		exit(1);
-	}
+	currPtr = NewSequenceStruct();
 	
 	scoreAdjuster = nodeValue;				/*Here's the expected average peptide length.*/
 	scoreAdjuster = scoreAdjuster / gAvResidueMass;
@@ -1778,12 +1854,7 @@ struct Sequence *LoadSequenceStruct(INT_4 *peptide, INT_4 peptideLength,
 	struct Sequence *currPtr;
 	INT_4 i;	
 
-	currPtr = (struct Sequence *)calloc(1, sizeof(struct Sequence));
-	if(currPtr == NULL)
-	{
-		printf("LoadSequenceStruct:  Out of mammories");
-		exit(1);
-	}
+	currPtr = NewSequenceStruct();
 		
 	for(i = 0; i < peptideLength; i++)
 	{
@@ -1799,6 +1870,111 @@ struct Sequence *LoadSequenceStruct(INT_4 *peptide, INT_4 peptideLength,
 	return(currPtr);
 }
 
+/******************NewSequenceStruct********************************************
+*
+*	Returns a zeroed Sequence struct from the sequence arena.  Structs that were given back
+*	by DisposeSequenceStruct are used first; otherwise the next one in the current slab is 
+*	taken, and a new slab is malloc'ed only when all of the slabs are used up.
+*/
+struct Sequence *NewSequenceStruct(void)
+{
+	struct Sequence *currPtr;
+	tSequenceSlab *slabPtr;
+	
+	if(gSequenceArena.freePtr != NULL)
+	{
+		currPtr = gSequenceArena.freePtr;
+		gSequenceArena.freePtr = currPtr->next;
+	}
+	else
+	{
+		if(gSequenceArena.currSlab == NULL || gSequenceArena.slabUsed == SEQUENCE_SLAB_SIZE)
+		{
+			if(gSequenceArena.currSlab != NULL && gSequenceArena.currSlab->next != NULL)
+			{
+				slabPtr = gSequenceArena.currSlab->next;	/*left over from an earlier pass*/
+			}
+			else
+			{
+				slabPtr = (tSequenceSlab *) malloc(sizeof(tSequenceSlab));
+				if(slabPtr == NULL)
+				{
+					printf("NewSequenceStruct:  Out of mammories");
+					exit(1);
+				}
+				slabPtr->next = NULL;
+				if(gSequenceArena.currSlab == NULL)
+				{
+					gSequenceArena.firstSlab = slabPtr;
+				}
+				else
+				{
+					gSequenceArena.currSlab->next = slabPtr;
+				}
+			}
+			gSequenceArena.currSlab = slabPtr;
+			gSequenceArena.slabUsed = 0;
+		}
+		currPtr = &gSequenceArena.currSlab->sequence[gSequenceArena.slabUsed];
+		gSequenceArena.slabUsed++;
+	}
+	
+	memset(currPtr, 0, sizeof(struct Sequence));
+	return(currPtr);
+}
+
+/******************DisposeSequenceStruct****************************************
+*
+*	Gives a Sequence struct back to the sequence arena, so that NewSequenceStruct can hand
+*	it out again.
+*/
+void DisposeSequenceStruct(struct Sequence *currPtr)
+{
+	if(currPtr == NULL)
+	{
+		return;
+	}
+	currPtr->next = gSequenceArena.freePtr;
+	gSequenceArena.freePtr = currPtr;
+	
+	return;
+}
+
+/******************ResetSequenceArena*******************************************
+*
+*	Takes back every Sequence struct in the arena at once, whether or not it was disposed of.
+*	SequenceOneMass does this at the end of each pass, when none of the structs are in use 
+*	any more.  The slabs are kept for the next pass.
+*/
+void ResetSequenceArena(void)
+{
+	gSequenceArena.currSlab = gSequenceArena.firstSlab;
+	gSequenceArena.slabUsed = 0;
+	gSequenceArena.freePtr = NULL;
+	
+	return;
+}
+
+/******************FreeSequenceArena********************************************
+*
+*	Frees the slabs of the calling thread's sequence arena.
+*/
+void FreeSequenceArena(void)
+{
+	tSequenceSlab *slabPtr, *nextPtr;
+	
+	slabPtr = gSequenceArena.firstSlab;
+	while(slabPtr != NULL)
+	{
+		nextPtr = slabPtr->next;
+		free(slabPtr);
+		slabPtr = nextPtr;
+	}
+	memset(&gSequenceArena, 0, sizeof(gSequenceArena));
+	
+	return;
+}
+
 /**********************************NterminalSubsequences****************************************
 *
 *	This function sets up the first batch of subsequences.  It starts with a single subsequence
@@ -1814,20 +1990,19 @@ struct Sequence *LoadSequenceStruct(INT_4 *peptide, INT_4 peptideLength,
 *	a struct of type Sequence, which is the first element in a linked list of subsequences.
 */
 
-struct Sequence *NterminalSubsequences(SCHAR *sequenceNode, INT_4 maxLastNode, INT_4 lowSuperNode,
+struct Sequence *NterminalSubsequences(tNodeStore *sequenceNode, INT_4 maxLastNode, INT_4 lowSuperNode,
 										INT_4 highSuperNode)
 {
 	struct Sequence *subsequencePtr;
-	INT_4 i, j, k, m, testValue, nTerminus;
+	INT_4 i, j, k, testValue, nTerminus;
 	INT_4 *extensions, *extScore, extNum;
 	INT_4 *bestExtensions, *bestExtScore, bestExtNum;
 	INT_4 highestExtensionScore;
 	INT_4 threshold;
 	INT_4 score, *peptide, peptideLength, nodeValue, gapNum;
-	INT_4 *threeAA, threeAANum, sum;
 	INT_4 sameNum, averageExtension, *sameExtension;
 	INT_2 nodeCorrection;
-	char nTerminusPossible, duplicateFlag;
+	char nTerminusPossible;
 	char doIt;
 	char sameTest;
 	
@@ -1838,12 +2013,6 @@ struct Sequence *NterminalSubsequences(SCHAR *sequenceNode, INT_4 maxLastNode, I
 		exit(1);
 	}
 	
-	threeAA = (int *) malloc(gAminoAcidNumber*gAminoAcidNumber*gAminoAcidNumber*sizeof(INT_4));
-	if(threeAA == NULL)
-	{
-		printf("NterminalSubsequences:  Out of memory.");
-		exit(1);
-	}
 	extensions = (int *) malloc(MAX_GAPLIST * sizeof(INT_4 ));
 	if(extensions == NULL)
 	{
@@ -1876,49 +2045,6 @@ struct Sequence *NterminalSubsequences(SCHAR *sequenceNode, INT_4 maxLastNode, I
 		exit(1);
 	}
 
-/*	Fill in the masses for three amino acids.*/
-
-	threeAANum = 0;
-	for(i = 0; i < gAminoAcidNumber; i++)	/*Fill in the masses of the 3 AA extensions.*/
-	{
-		for(j = 0; j < gAminoAcidNumber; j++)
-		{
-			for(k = 0; k < gAminoAcidNumber; k++)
-			{
-				if(gGapList[i] != 0 && gGapList[j] != 0 && gGapList[k] != 0)
-				{
-					sum = gGapList[i] + gGapList[j] + gGapList[k];
-					duplicateFlag = FALSE;
-					for(m = 0; m < threeAANum; m++)
-					{
-						if(threeAA[m] == sum)
-						{
-							/* We already have this mass in threeAA so don't add it to the list. */
-							duplicateFlag = TRUE;
-							break;
-						}
-					}
-					if(duplicateFlag == FALSE)
-					{
-						for(m = 0; m <= gGapListIndex; m++)
-						{
-							if(gGapList[m] == sum)
-							{
-							/* We already have this mass  so don't add it to the list. */
-							duplicateFlag = TRUE;
-							break;
-							}
-						}
-					}
-					if(!duplicateFlag)
-					{
-						threeAA[threeAANum] = sum;
-						threeAANum++;
-					}
-				}
-			}
-		}
-	}
 
 	
 	extNum = 0;
@@ -1927,40 +2053,15 @@ struct Sequence *NterminalSubsequences(SCHAR *sequenceNode, INT_4 maxLastNode, I
 	
 
 
-/*	Find the one, two, and three amino acid jumps from gGapList and threeAA.*/
+/*	Find the one, two, and three amino acid jumps (see ExtensionMassType).*/
 
 	for(i = nTerminus + gMonoMass_x100[G]; i < gMonoMass_x100[W] * 3; i++)	/*step thru each node*/
 	{
-		if(sequenceNode[i] != 0)	/*ignore the nodes w/ zero evidence*/
+		if(i < gGraphLength && NodeValue(sequenceNode, i) != 0)	/*ignore the nodes w/ zero evidence*/
 		{
-			nTerminusPossible = FALSE;	/*start assuming that this is not an extension*/
-/*	Check for one and two amino acid extensions using the gGapList array.*/
-			for(j = 0; j <= gGapListIndex; j++)	
-			{
-				if(gGapList[j] != 0)
-				{
-					if(i - nTerminus == gGapList[j])
-					{
-						nTerminusPossible = TRUE;	/*its a possible extension*/
-						break;
-					}
-				}
-			}
-/*	Now check for three amino acid extensions if it wasn't a one or two aa extension.*/
-			if(nTerminusPossible == FALSE)
-			{
-				for(j = 0; j < threeAANum; j++)
-				{
-					if(threeAA[j] != 0)
-					{
-					 	if(i - nTerminus == threeAA[j])
-					 	{
-					 		nTerminusPossible = TRUE;
-					 		break;
-					 	}
-					}
-				}
-			}
+			/*Is it a one, two, or three amino acid extension?*/
+			nTerminusPossible = (ExtensionMassType(i - nTerminus) 
+								& (EXTENSION_GAP_LIST | EXTENSION_THREE_AA)) != 0;
 			doIt = TRUE;	/*check for superNodes when sequencetag specified*/
 			if(nTerminus < lowSuperNode && i > highSuperNode)
 			{
@@ -1969,7 +2070,7 @@ struct Sequence *NterminalSubsequences(SCHAR *sequenceNode, INT_4 maxLastNode, I
 			if(nTerminusPossible && i <= maxLastNode && doIt)	/*save as an extension?*/
 			{
 				extensions[extNum] = i - nTerminus;
-				extScore[extNum] = sequenceNode[i];
+				extScore[extNum] = NodeValue(sequenceNode, i);
 				extNum++;
 			}
 		}
@@ -2057,16 +2158,9 @@ struct Sequence *NterminalSubsequences(SCHAR *sequenceNode, INT_4 maxLastNode, I
 			for(j = i + 1; j < extNum; j++)
 			{
 				testValue = extensions[j] - extensions[i];
-				for(k = 0; k < gAminoAcidNumber; k++)
+				if(ExtensionMassType(testValue) & EXTENSION_NEAR_AA)
 				{
-					if(gGapList[k] != 0)
-					{
-						if(testValue <= gGapList[k] + gParam.fragmentErr &&
-							testValue >= gGapList[k] - gParam.fragmentErr)
-						{
-							extScore[j] = 0;
-						}
-					}
+					extScore[j] = 0;
 				}
 			}
 		}
@@ -2145,46 +2239,753 @@ struct Sequence *NterminalSubsequences(SCHAR *sequenceNode, INT_4 maxLastNode, I
 	free(bestExtScore);
 	free(peptide);
 	free(sameExtension);
-	free(threeAA);
 	
 	return(subsequencePtr);
 }
 
 
-/**********************************SubsequenceMaker********************************************
+/****************************GrowPathArray**********************************************
 *
-*	This function uses a subsequencing approach to derive a list of completed peptide sequences.
-*	The array sequenceNode contains the information used to build the subsequences.  The indexing
-*	of this array corresponds to nominal masses of b ions, and the information contained 
-*	relates to the probability that a cleavage was actually present at that nominal mass.  The
-*	array oneEdgeNodes lists the nodes that could not be connected to any other node N-terminal
-*	to it, and oneEdgeNodesIndex is the number of such nodes listed in the array.  The arrays
-*	aaPresent and aaAbsent contain the amino acids (single letter code) that are either present
-*	or absent in the peptide.  The value of cysMW allows for alteration of the residue mass of
-*	cysteine, which can be alkylated w/ various reagents.  The extThresh is the fractional
-*	value of the highest ranked extension to a particular subsequence that can be used in 
-*	the formation of the next list of subsequences.  The value of maxExtNum is the maximum
-*	number of extensions per subsequence that is allowed.  The finalSeqNum is the upper limit
-*	on the number of completed sequences that will be stored and scored later.  The topSeqNum
-*	is the upper limit on the number of subsequences that are to be allowed.  If I run out
-*	of space, I may make these last two parameters changeable by the program - ie, if there
-*	is no space left then it will automatically purge 100 or so sequences and reset these
-*	upper limits to 100 less than before.  The maxGapNum is the maximum number of gaps that 
+*	Returns arrayPtr, reallocated if need be so that it holds at least neededNum objects of
+*	size objectSize.  *limit is the number of objects that arrayPtr had room for, and is 
+*	updated.  Arrays at least double when they grow.
+*/
+static void *GrowPathArray(void *arrayPtr, INT_4 *limit, INT_4 neededNum, size_t objectSize)
+{
+	INT_4 newLimit;
+	
+	if(neededNum <= *limit && arrayPtr != NULL)
+	{
+		return(arrayPtr);
+	}
+	
+	newLimit = *limit * 2;
+	if(newLimit < neededNum)
+	{
+		newLimit = neededNum;
+	}
+	arrayPtr = realloc(arrayPtr, newLimit * objectSize);
+	if(arrayPtr == NULL)
+	{
+		printf("TopPathSequences:  Out of memory");
+		exit(1);
+	}
+	*limit = newLimit;
+	
+	return(arrayPtr);
+}
+
+/****************************PathStateKey**********************************************
+*
+*	Returns the key for a subsequence end; the keys go up w/ node, then node correction, and
+*	then gap number.
+*/
+static INT_4 PathStateKey(tPathGraph *graphPtr, INT_4 nodeValue, INT_2 nodeCorrection, INT_4 gapNum)
+{
+	return((nodeValue * PATH_CORRECTION_NUM + nodeCorrection + PATH_CORRECTION_NUM / 2)
+			* graphPtr->gapLimit + gapNum);
+}
+
+/****************************PathStateSlot**********************************************
+*
+*	Returns the slot in graphPtr->stateHash that has the state w/ the key, or the empty slot 
+*	where it would go.
+*/
+static INT_4 PathStateSlot(tPathGraph *graphPtr, INT_4 key)
+{
+	INT_4 slot, stateIndex;
+	tPathState *statePtr;
+	
+	slot = ((unsigned long)key * 2654435761UL) & (graphPtr->hashLimit - 1);
+	while((stateIndex = graphPtr->stateHash[slot]) != -1)
+	{
+		statePtr = &graphPtr->state[stateIndex];
+		if(PathStateKey(graphPtr, statePtr->nodeValue, statePtr->nodeCorrection, 
+						statePtr->gapNum) == key)
+		{
+			break;
+		}
+		slot = (slot + 1) & (graphPtr->hashLimit - 1);
+	}
+	
+	return(slot);
+}
+
+/****************************GrowPathStateHash**********************************************
+*
+*	Doubles the size of graphPtr->stateHash and puts the states back in it.
+*/
+static void GrowPathStateHash(tPathGraph *graphPtr)
+{
+	INT_4 i;
+	tPathState *statePtr;
+	
+	free(graphPtr->stateHash);
+	graphPtr->hashLimit = graphPtr->hashLimit == 0 ? 1024 : graphPtr->hashLimit * 2;
+	graphPtr->stateHash = (INT_4 *) malloc(graphPtr->hashLimit * sizeof(INT_4));
+	if(graphPtr->stateHash == NULL)
+	{
+		printf("TopPathSequences:  Out of memory");
+		exit(1);
+	}
+	memset(graphPtr->stateHash, -1, graphPtr->hashLimit * sizeof(INT_4));
+	
+	for(i = 1; i < graphPtr->stateNum; i++)	/*state 0 is not hashed*/
+	{
+		statePtr = &graphPtr->state[i];
+		graphPtr->stateHash[PathStateSlot(graphPtr, PathStateKey(graphPtr, statePtr->nodeValue,
+										statePtr->nodeCorrection, statePtr->gapNum))] = i;
+	}
+	
+	return;
+}
+
+/****************************PathStateIsLower**********************************************
+*
+*	Returns TRUE if state a has a lower key than state b.
+*/
+static BOOLEAN PathStateIsLower(tPathGraph *graphPtr, INT_4 a, INT_4 b)
+{
+	tPathState *aPtr = &graphPtr->state[a];
+	tPathState *bPtr = &graphPtr->state[b];
+	
+	return(PathStateKey(graphPtr, aPtr->nodeValue, aPtr->nodeCorrection, aPtr->gapNum) <
+			PathStateKey(graphPtr, bPtr->nodeValue, bPtr->nodeCorrection, bPtr->gapNum));
+}
+
+/****************************PushPathState**********************************************
+*
+*	Adds the state stateIndex to the heap of states whose extensions are still to be added.
+*/
+static void PushPathState(tPathGraph *graphPtr, INT_4 stateIndex)
+{
+	INT_4 index, parent;
+	
+	graphPtr->stateQueue = GrowPathArray(graphPtr->stateQueue, &graphPtr->queueLimit, 
+										graphPtr->queueNum + 1, sizeof(INT_4));
+	index = graphPtr->queueNum++;
+	while(index > 0)
+	{
+		parent = (index - 1) / 2;
+		if(!PathStateIsLower(graphPtr, stateIndex, graphPtr->stateQueue[parent]))
+		{
+			break;
+		}
+		graphPtr->stateQueue[index] = graphPtr->stateQueue[parent];
+		index = parent;
+	}
+	graphPtr->stateQueue[index] = stateIndex;
+	
+	return;
+}
+
+/****************************PopPathState**********************************************
+*
+*	Takes the state w/ the lowest key off of the heap of states whose extensions are still to 
+*	be added, and returns its index.
+*/
+static INT_4 PopPathState(tPathGraph *graphPtr)
+{
+	INT_4 index, child, lowest, lastState;
+	
+	lowest = graphPtr->stateQueue[0];
+	lastState = graphPtr->stateQueue[--graphPtr->queueNum];
+	index = 0;
+	child = 1;
+	while(child < graphPtr->queueNum)
+	{
+		if(child + 1 < graphPtr->queueNum && 
+			PathStateIsLower(graphPtr, graphPtr->stateQueue[child + 1], graphPtr->stateQueue[child]))
+		{
+			child++;
+		}
+		if(!PathStateIsLower(graphPtr, graphPtr->stateQueue[child], lastState))
+		{
+			break;
+		}
+		graphPtr->stateQueue[index] = graphPtr->stateQueue[child];
+		index = child;
+		child = 2 * index + 1;
+	}
+	if(graphPtr->queueNum > 0)
+	{
+		graphPtr->stateQueue[index] = lastState;
+	}
+	
+	return(lowest);
+}
+
+/****************************GetPathState**********************************************
+*
+*	Returns the index of the state for a subsequence ending at nodeValue, w/ nodeCorrection
+*	and gapNum, making it if it is not there yet.  New states go on the heap of states whose
+*	extensions are still to be added.
+*/
+static INT_4 GetPathState(tPathGraph *graphPtr, INT_4 nodeValue, INT_2 nodeCorrection, INT_4 gapNum)
+{
+	INT_4 key, slot;
+	tPathState *statePtr;
+	
+	if(graphPtr->stateNum * 2 >= graphPtr->hashLimit)
+	{
+		GrowPathStateHash(graphPtr);	/*keep it at most half full*/
+	}
+	key = PathStateKey(graphPtr, nodeValue, nodeCorrection, gapNum);
+	slot = PathStateSlot(graphPtr, key);
+	if(graphPtr->stateHash[slot] == -1)
+	{
+		graphPtr->state = GrowPathArray(graphPtr->state, &graphPtr->stateLimit, 
+										graphPtr->stateNum + 1, sizeof(tPathState));
+		statePtr = &graphPtr->state[graphPtr->stateNum];
+		memset(statePtr, 0, sizeof(tPathState));
+		statePtr->nodeValue = nodeValue;
+		statePtr->nodeCorrection = nodeCorrection;
+		statePtr->gapNum = gapNum;
+		statePtr->firstIn = -1;
+		graphPtr->stateHash[slot] = graphPtr->stateNum;
+		graphPtr->stateNum++;
+		PushPathState(graphPtr, graphPtr->stateHash[slot]);
+	}
+	
+	return(graphPtr->stateHash[slot]);
+}
+
+/****************************AddPathEdge**********************************************
+*
+*	Adds edgePtr (from and the extension fields filled in) as an edge into the state toState.
+*/
+static void AddPathEdge(tPathGraph *graphPtr, tPathEdge *edgePtr, INT_4 toState)
+{
+	graphPtr->edge = GrowPathArray(graphPtr->edge, &graphPtr->edgeLimit, 
+									graphPtr->edgeNum + 1, sizeof(tPathEdge));
+	edgePtr->nextIn = graphPtr->state[toState].firstIn;
+	graphPtr->edge[graphPtr->edgeNum] = *edgePtr;
+	graphPtr->state[toState].firstIn = graphPtr->edgeNum;
+	graphPtr->edgeNum++;
+	
+	return;
+}
+
+/****************************PathRankIsBetter**********************************************
+*
+*	Returns TRUE if path a ranks above path b:  it has the higher score, or the same score
+*	and it was found first.
+*/
+static BOOLEAN PathRankIsBetter(tPathRank *a, tPathRank *b)
+{
+	if(a->score != b->score)
+	{
+		return(a->score > b->score);
+	}
+	return(a->order < b->order);
+}
+
+/****************************PushPathCandidate**********************************************
+*
+*	Adds a candidate for the next path into statePtr to the state's heap of candidates.
+*/
+static void PushPathCandidate(tPathGraph *graphPtr, tPathState *statePtr, INT_4 edge, INT_4 rank, 
+								INT_4 score)
+{
+	INT_4 index, parent;
+	tPathRank newRank;
+	
+	newRank.edge = edge;
+	newRank.rank = rank;
+	newRank.score = score;
+	newRank.order = graphPtr->order++;
+	
+	statePtr->cand = GrowPathArray(statePtr->cand, &statePtr->candLimit, statePtr->candNum + 1,
+									sizeof(tPathRank));
+	index = statePtr->candNum++;
+	while(index > 0)
+	{
+		parent = (index - 1) / 2;
+		if(!PathRankIsBetter(&newRank, &statePtr->cand[parent]))
+		{
+			break;
+		}
+		statePtr->cand[index] = statePtr->cand[parent];
+		index = parent;
+	}
+	statePtr->cand[index] = newRank;
+	
+	return;
+}
+
+/****************************PopPathCandidate**********************************************
+*
+*	Takes the best candidate off of the state's heap, and adds it to the state's paths.
+*/
+static void PopPathCandidate(tPathState *statePtr)
+{
+	INT_4 index, child;
+	tPathRank lastRank;
+	
+	statePtr->path = GrowPathArray(statePtr->path, &statePtr->pathLimit, statePtr->pathNum + 1,
+									sizeof(tPathRank));
+	statePtr->path[statePtr->pathNum++] = statePtr->cand[0];
+	
+	lastRank = statePtr->cand[--statePtr->candNum];
+	index = 0;
+	child = 1;
+	while(child < statePtr->candNum)
+	{
+		if(child + 1 < statePtr->candNum && 
+			PathRankIsBetter(&statePtr->cand[child + 1], &statePtr->cand[child]))
+		{
+			child++;
+		}
+		if(!PathRankIsBetter(&statePtr->cand[child], &lastRank))
+		{
+			break;
+		}
+		statePtr->cand[index] = statePtr->cand[child];
+		index = child;
+		child = 2 * index + 1;
+	}
+	if(statePtr->candNum > 0)
+	{
+		statePtr->cand[index] = lastRank;
+	}
+	
+	return;
+}
+
+/****************************FindPath**********************************************
+*
+*	Makes sure that path number rank (0 is the best) into the state stateIndex has been found,
+*	and returns FALSE if there are not that many paths.  This is the recursive enumeration
+*	of k shortest paths of Jimenez and Marzal:  the first path into a state is the best of
+*	its edges after the best path into each edge's start, and the path after (edge, n) comes
+*	from the next best path into the start of that edge, (edge, n + 1).
+*/
+static BOOLEAN FindPath(tPathGraph *graphPtr, INT_4 stateIndex, INT_4 rank)
+{
+	INT_4 edge, from, nextRank;
+	tPathState *statePtr = &graphPtr->state[stateIndex];
+	tPathEdge *edgePtr;
+	
+	while(statePtr->pathNum <= rank)
+	{
+		if(statePtr->noMorePaths)
+		{
+			return(FALSE);
+		}
+		
+		if(statePtr->pathNum == 0)	/*the best path thru each edge*/
+		{
+			for(edge = statePtr->firstIn; edge != -1; edge = graphPtr->edge[edge].nextIn)
+			{
+				edgePtr = &graphPtr->edge[edge];
+				from = edgePtr->from;
+				if(from < 0)	/*it starts w/ an N-terminal subsequence*/
+				{
+					PushPathCandidate(graphPtr, statePtr, edge, 0, edgePtr->score);
+				}
+				else if(FindPath(graphPtr, from, 0))
+				{
+					PushPathCandidate(graphPtr, statePtr, edge, 0, 
+										graphPtr->state[from].path[0].score + edgePtr->score);
+				}
+			}
+		}
+		else	/*the next path thru the edge of the last path found*/
+		{
+			edge = statePtr->path[statePtr->pathNum - 1].edge;
+			nextRank = statePtr->path[statePtr->pathNum - 1].rank + 1;
+			edgePtr = &graphPtr->edge[edge];
+			from = edgePtr->from;
+			if(from >= 0 && FindPath(graphPtr, from, nextRank))
+			{
+				PushPathCandidate(graphPtr, statePtr, edge, nextRank,
+									graphPtr->state[from].path[nextRank].score + edgePtr->score);
+			}
+		}
+		
+		if(statePtr->candNum == 0)
+		{
+			statePtr->noMorePaths = TRUE;
+			return(FALSE);
+		}
+		PopPathCandidate(statePtr);
+	}
+	
+	return(TRUE);
+}
+
+/****************************PathPeptide**********************************************
+*
+*	Puts the residue masses of path number rank into the state stateIndex in peptide, and 
+*	returns the number of them, or zero if there are more than MAX_PEPTIDE_LENGTH.
+*/
+static INT_4 PathPeptide(tPathGraph *graphPtr, INT_4 stateIndex, INT_4 rank, INT_4 *peptide)
+{
+	INT_4 edgeList[MAX_PEPTIDE_LENGTH], edgeNum, i, j, peptideLength;
+	tPathRank *rankPtr;
+	tPathEdge *edgePtr;
+	struct Sequence *startPtr;
+	
+	/*Walk back to the N-terminal subsequence*/
+	edgeNum = 0;
+	while(stateIndex >= 0)
+	{
+		if(edgeNum >= MAX_PEPTIDE_LENGTH)
+		{
+			return(0);
+		}
+		rankPtr = &graphPtr->state[stateIndex].path[rank];
+		edgeList[edgeNum++] = rankPtr->edge;
+		stateIndex = graphPtr->edge[rankPtr->edge].from;
+		rank = rankPtr->rank;
+	}
+	
+	startPtr = graphPtr->start[-1 - stateIndex];
+	peptideLength = startPtr->peptideLength;
+	for(i = 0; i < peptideLength; i++)
+	{
+		peptide[i] = startPtr->peptide[i];
+	}
+	for(i = edgeNum - 1; i >= 0; i--)
+	{
+		edgePtr = &graphPtr->edge[edgeList[i]];
+		if(peptideLength + edgePtr->massNum > MAX_PEPTIDE_LENGTH)
+		{
+			return(0);
+		}
+		for(j = 0; j < edgePtr->massNum; j++)
+		{
+			peptide[peptideLength++] = edgePtr->mass[j];
+		}
+	}
+	
+	return(peptideLength);
+}
+
+/****************************TopPathSequences**********************************************
+*
+*	The exact alternative to the AddExtensions beam search (Subsequencing engine = E).  
+*	Starting from the N-terminal subsequences in startPtr, the subsequence ends (node, node 
+*	correction and number of gaps) and the extensions between them are worked out the same 
+*	way that AddExtensions and StoreSubsequences do it, except that there is no extension
+*	threshold and no limit on the number of extensions or subsequences.  Since extensions 
+*	only go up in mass this is a DAG, and the completed sequences are then taken off of it 
+*	in order of their summed extension scores, until gParam.finalSeqNum of them pass 
+*	CorrectMass.  They go into gFinalSequenceHeap, just like the ones from the beam search.
+*	startPtr is not changed.  Returns the number of sequences stored.
+*/
+INT_4 TopPathSequences(struct Sequence *startPtr, tNodeStore *sequenceNode, 
+						INT_4 *oneEdgeNodes, INT_4 oneEdgeNodesIndex, INT_4 *aaPresentMass, 
+						INT_4 *lastNode, INT_4 lastNodeNum, INT_4 maxLastNode, INT_4 minLastNode,
+						INT_4 lowSuperNode, INT_4 highSuperNode)
+{
+	tPathGraph graph;
+	tPathEdge newEdge;
+	tPathState *statePtr;
+	struct Sequence *currPtr;
+	struct extension *extensionList;
+	INT_4 i, j, startNum, nodeValue, stateIndex, extNum, cTermResidueNum;
+	INT_4 rank, seqNum, rejectNum, peptideLength, peptide[MAX_PEPTIDE_LENGTH];
+	BOOLEAN lastNodeTest;
+	
+	memset(&graph, 0, sizeof(tPathGraph));
+	graph.gapLimit = gParam.maxGapNum + 1;
+	extensionList = (struct extension *) malloc(MAX_GAPLIST * sizeof(struct extension));
+	if(extensionList == NULL)
+	{
+		printf("TopPathSequences:  Out of memory");
+		exit(1);
+	}
+	
+	/*State 0 is where the completed sequences end up*/
+	graph.state = GrowPathArray(graph.state, &graph.stateLimit, 1, sizeof(tPathState));
+	memset(&graph.state[0], 0, sizeof(tPathState));
+	graph.state[0].firstIn = -1;
+	graph.stateNum = 1;
+	
+	/*The N-terminal subsequences are the edges out of the N-terminus*/
+	startNum = 0;
+	for(currPtr = startPtr; currPtr != NULL; currPtr = currPtr->next)
+	{
+		startNum++;
+	}
+	graph.start = (struct Sequence **) malloc((startNum + 1) * sizeof(struct Sequence *));
+	if(graph.start == NULL)
+	{
+		printf("TopPathSequences:  Out of memory");
+		exit(1);
+	}
+	startNum = 0;
+	for(currPtr = startPtr; currPtr != NULL; currPtr = currPtr->next)
+	{
+		graph.start[startNum] = currPtr;
+		if(currPtr->gapNum <= gParam.maxGapNum && currPtr->nodeValue < gGraphLength)
+		{
+			memset(&newEdge, 0, sizeof(tPathEdge));
+			newEdge.from = -1 - startNum;
+			newEdge.score = currPtr->score;
+			AddPathEdge(&graph, &newEdge, GetPathState(&graph, currPtr->nodeValue, 
+												currPtr->nodeCorrection, currPtr->gapNum));
+		}
+		startNum++;
+	}
+	
+	/*Go thru the states in order of mass, finding the best path into each, and adding 
+	the extensions out of it.  Extensions only go up in mass, so the states that they make
+	come off of the heap later.*/
+	while(graph.queueNum > 0)
+	{
+		stateIndex = PopPathState(&graph);
+		nodeValue = graph.state[stateIndex].nodeValue;
+		FindPath(&graph, stateIndex, 0);
+		
+		extNum = FindExtensions(extensionList, nodeValue, sequenceNode, oneEdgeNodes,
+								oneEdgeNodesIndex, maxLastNode, lowSuperNode, highSuperNode);
+		for(i = 0; i < extNum; i++)
+		{
+			/*Work out where the extension goes, as in StoreSubsequences*/
+			statePtr = &graph.state[stateIndex];
+			memset(&newEdge, 0, sizeof(tPathEdge));
+			newEdge.from = stateIndex;
+			newEdge.score = extensionList[i].score;
+			newEdge.mass[0] = extensionList[i].mass;
+			newEdge.gapNum = statePtr->gapNum + extensionList[i].gapSize;
+			newEdge.nodeValue = nodeValue + extensionList[i].mass;
+			newEdge.nodeCorrection = statePtr->nodeCorrection + extensionList[i].nodeCorrection;
+			if(newEdge.nodeCorrection >= 10)
+			{
+				newEdge.nodeCorrection = newEdge.nodeCorrection - 10;
+				newEdge.nodeValue = newEdge.nodeValue + 1;
+			}
+			else if(newEdge.nodeCorrection <= -10)
+			{
+				newEdge.nodeCorrection = newEdge.nodeCorrection + 10;
+				newEdge.nodeValue = newEdge.nodeValue - 1;
+			}
+			newEdge.score += AddCterminalResidues(&newEdge.nodeValue, &newEdge.mass[1], 
+												&cTermResidueNum, NodeValue(sequenceNode, maxLastNode));
+			newEdge.massNum = cTermResidueNum + 1;
+			
+			if(newEdge.gapNum > gParam.maxGapNum)
+			{
+				continue;	/*too many gaps to be stored or continued*/
+			}
+			
+			lastNodeTest = FALSE;
+			if(newEdge.nodeValue >= minLastNode && newEdge.nodeValue <= maxLastNode)
+			{
+				for(j = 0; j < lastNodeNum; j++)
+				{
+					if(newEdge.nodeValue == lastNode[j])
+					{
+						lastNodeTest = TRUE;
+						AddPathEdge(&graph, &newEdge, 0);	/*a completed sequence*/
+					}
+				}
+			}
+			if(!lastNodeTest && newEdge.nodeValue < minLastNode)
+			{
+				AddPathEdge(&graph, &newEdge, GetPathState(&graph, newEdge.nodeValue,
+											newEdge.nodeCorrection, newEdge.gapNum));
+			}
+		}
+	}
+	
+	/*Take the completed sequences off, best first*/
+	seqNum = 0;
+	rejectNum = 0;
+	for(rank = 0; seqNum < gParam.finalSeqNum && rejectNum < MAX_REJECTED_PATHS; rank++)
+	{
+		if(!FindPath(&graph, 0, rank))
+		{
+			break;	/*that's all of them*/
+		}
+		peptideLength = PathPeptide(&graph, 0, rank, peptide);
+		if(peptideLength > 0 && CorrectMass(peptide, peptideLength, aaPresentMass))
+		{
+			j = graph.state[0].path[rank].edge;
+			AddToSubsequenceHeap(&gFinalSequenceHeap, 
+								LoadFinalSequenceStruct(peptide, peptideLength,
+														graph.state[0].path[rank].score, 
+														graph.edge[j].nodeValue, 
+														graph.edge[j].gapNum, 
+														graph.edge[j].nodeCorrection),
+								gParam.finalSeqNum);
+			seqNum++;
+		}
+		else
+		{
+			rejectNum++;
+		}
+	}
+	
+	if(gParam.fMonitor && gCorrectMass)
+	{
+		printf("Top paths:  %ld states, %ld extensions, %ld sequences.\n", 
+				(long)graph.stateNum, (long)graph.edgeNum, (long)seqNum);
+	}
+	if(rejectNum >= MAX_REJECTED_PATHS && 
+		(gParam.subseqEngine == 'C' || (gParam.fMonitor && gCorrectMass)))
+	{
+		printf("Top paths:  stopped after %ld paths failed CorrectMass, so these are not the exact top sequences.\n",
+				(long)rejectNum);
+	}
+	
+	for(i = 0; i < graph.stateNum; i++)
+	{
+		free(graph.state[i].path);
+		free(graph.state[i].cand);
+	}
+	free(graph.state);
+	free(graph.edge);
+	free(graph.stateHash);
+	free(graph.stateQueue);
+	free(graph.start);
+	free(extensionList);
+	
+	return(seqNum);
+}
+
+/****************************PeptideSortAscend**********************************************
+*
+*	For qsort of Sequence struct pointers by peptide length, and then by the peptide masses.
+*/
+static int PeptideSortAscend(const void *n1, const void *n2)
+{
+	struct Sequence *a = *(struct Sequence **)n1;
+	struct Sequence *b = *(struct Sequence **)n2;
+	INT_4 i;
+	
+	if(a->peptideLength != b->peptideLength)
+	{
+		return(a->peptideLength < b->peptideLength ? -1 : 1);
+	}
+	for(i = 0; i < a->peptideLength; i++)
+	{
+		if(a->peptide[i] != b->peptide[i])
+		{
+			return(a->peptide[i] < b->peptide[i] ? -1 : 1);
+		}
+	}
+	return(0);
+}
+
+/****************************SortedPeptides**********************************************
+*
+*	Returns an array of the Sequence structs in the list firstPtr, sorted by 
+*	PeptideSortAscend, and puts the number of them in *num.
+*/
+static struct Sequence **SortedPeptides(struct Sequence *firstPtr, INT_4 *num)
+{
+	struct Sequence **sorted, *currPtr;
+	
+	*num = 0;
+	for(currPtr = firstPtr; currPtr != NULL; currPtr = currPtr->next)
+	{
+		(*num)++;
+	}
+	sorted = (struct Sequence **) malloc((*num + 1) * sizeof(struct Sequence *));
+	if(sorted == NULL)
+	{
+		printf("CompareSubsequencing:  Out of memory");
+		exit(1);
+	}
+	*num = 0;
+	for(currPtr = firstPtr; currPtr != NULL; currPtr = currPtr->next)
+	{
+		sorted[(*num)++] = currPtr;
+	}
+	qsort(sorted, *num, sizeof(struct Sequence *), PeptideSortAscend);
+	
+	return(sorted);
+}
+
+/****************************CompareSubsequencing**********************************************
+*
+*	Prints how the completed sequences from the beam search compare w/ the ones from 
+*	TopPathSequences (Subsequencing engine = C):  how long each took, how many sequences 
+*	there are, the best scores, and how many of the exact top sequences the beam search found.
+*/
+static void CompareSubsequencing(struct Sequence *beamPtr, clock_t beamTicks, 
+									struct Sequence *exactPtr, clock_t exactTicks)
+{
+	struct Sequence **beamSorted, **exactSorted;
+	INT_4 beamNum, exactNum, foundNum, i, j, order;
+	
+	beamSorted = SortedPeptides(beamPtr, &beamNum);
+	exactSorted = SortedPeptides(exactPtr, &exactNum);
+	
+	foundNum = 0;
+	i = 0;
+	j = 0;
+	while(i < beamNum && j < exactNum)
+	{
+		order = PeptideSortAscend(&beamSorted[i], &exactSorted[j]);
+		if(order == 0)
+		{
+			foundNum++;
+			i++;
+			j++;
+		}
+		else if(order < 0)
+		{
+			i++;
+		}
+		else
+		{
+			j++;
+		}
+	}
+	
+	printf("Subsequencing:  beam search %.2f s, %ld sequences, best score %ld\n", 
+			(REAL_8)beamTicks / CLOCKS_PER_SEC, (long)beamNum, 
+			(long)(beamPtr == NULL ? 0 : beamPtr->score));
+	printf("Subsequencing:  top paths %.2f s, %ld sequences, best score %ld, %ld of them from the beam search\n", 
+			(REAL_8)exactTicks / CLOCKS_PER_SEC, (long)exactNum, 
+			(long)(exactPtr == NULL ? 0 : exactPtr->score), (long)foundNum);
+	
+	free(beamSorted);
+	free(exactSorted);
+	
+	return;
+}
+
+/**********************************SubsequenceMaker********************************************
+*
+*	This function uses a subsequencing approach to derive a list of completed peptide sequences.
+*	The array sequenceNode contains the information used to build the subsequences.  The indexing
+*	of this array corresponds to nominal masses of b ions, and the information contained 
+*	relates to the probability that a cleavage was actually present at that nominal mass.  The
+*	array oneEdgeNodes lists the nodes that could not be connected to any other node N-terminal
+*	to it, and oneEdgeNodesIndex is the number of such nodes listed in the array.  The arrays
+*	aaPresent and aaAbsent contain the amino acids (single letter code) that are either present
+*	or absent in the peptide.  The value of cysMW allows for alteration of the residue mass of
+*	cysteine, which can be alkylated w/ various reagents.  The extThresh is the fractional
+*	value of the highest ranked extension to a particular subsequence that can be used in 
+*	the formation of the next list of subsequences.  The value of maxExtNum is the maximum
+*	number of extensions per subsequence that is allowed.  The finalSeqNum is the upper limit
+*	on the number of completed sequences that will be stored and scored later.  The topSeqNum
+*	is the upper limit on the number of subsequences that are to be allowed.  If I run out
+*	of space, I may make these last two parameters changeable by the program - ie, if there
+*	is no space left then it will automatically purge 100 or so sequences and reset these
+*	upper limits to 100 less than before.  The maxGapNum is the maximum number of gaps that 
 *	are allowed - its either zero or one.
 *
 */
 
 struct Sequence *SubsequenceMaker(INT_4 *oneEdgeNodes, INT_4 oneEdgeNodesIndex, 
-						SCHAR *sequenceNode)
+						tNodeStore *sequenceNode, tNodeList *nodeList)
 {
 	struct Sequence *subsequencePtr;
 	INT_4 *lastNode, lastNodeNum, aaPresentMass[AMINO_ACID_NUMBER];
 	INT_4 maxLastNodeNum;	/*max num of lastnodes*/
 	INT_4 maxLastNode, minLastNode;		/*the highest and lowest last node value*/
-	INT_4 i, j, seqNum, finalSeqNum, topSeqNum, correctPeptideLength;
+	INT_4 i, j, pos, seqNum, finalSeqNum, topSeqNum, correctPeptideLength;
 	INT_4 highSuperNode, lowSuperNode;	/*used when a specific sequence tag is to be used*/
 	INT_4 halfAsManySubsequences, quarterAsManySubsequences;
 	char test;
+	struct Sequence *exactSequencePtr = NULL;	/*for gParam.subseqEngine == 'C'*/
+	clock_t exactTicks = 0, beamTicks = 0;
 	
 	gFinalSequencePtr = NULL;
 	subsequencePtr = NULL;
@@ -2196,34 +2997,35 @@ struct Sequence *SubsequenceMaker(INT_4 *oneEdgeNodes, INT_4 oneEdgeNodesIndex,
 	quarterAsManySubsequences	= gParam.topSeqNum / 4;
 
 
-/*	Determine the values of highSuperNode and lowSuperNode*/
+/*	Determine the values of highSuperNode and lowSuperNode.  Only the nodes in nodeList 
+*	can be non-zero in sequenceNode.*/
 	highSuperNode = gGraphLength -1;
 	lowSuperNode = 0;
 	
 	if(gParam.tagSequence[0] != '*')
 	{
-		for(i = gGraphLength - 1; i >= 0; i--)
+		for(pos = nodeList->numObjects - 1; pos >= 0; pos--)
 		{
-			if(sequenceNode[i] == -1)
+			if(NodeValue(sequenceNode, nodeList->node[pos]) == -1)
 			{
-				highSuperNode = i;
+				highSuperNode = nodeList->node[pos];
 				break;
 			}
 		}
 		
-		for(i = 0; i < gGraphLength; i++)
+		for(pos = 0; pos < nodeList->numObjects; pos++)
 		{
-			if(sequenceNode[i] == -1)
+			if(NodeValue(sequenceNode, nodeList->node[pos]) == -1)
 			{
-				lowSuperNode = i;
+				lowSuperNode = nodeList->node[pos];
 				break;
 			}
 		}
-		for(i = 0; i < gGraphLength; i++)
+		for(pos = 0; pos < nodeList->numObjects; pos++)
 		{
-			if(sequenceNode[i] == -1)
+			if(NodeValue(sequenceNode, nodeList->node[pos]) == -1)
 			{
-				sequenceNode[i] = 127;
+				SetNodeValue(sequenceNode, nodeList->node[pos], 127);
 			}
 		}
 	}
@@ -2278,15 +3080,16 @@ struct Sequence *SubsequenceMaker(INT_4 *oneEdgeNodes, INT_4 oneEdgeNodesIndex,
 
 
 	lastNodeNum = 0;
-	i = gGraphLength - 1;
+	pos = nodeList->numObjects - 1;
 	test = TRUE;
-	while(i > 0 && test)
+	while(pos >= 0 && nodeList->node[pos] > 0 && test)
 	{
-		if(sequenceNode[i] > 0)
+		i = nodeList->node[pos];
+		if(NodeValue(sequenceNode, i) > 0)
 		{
 			test = FALSE;
 			maxLastNode = i;
-			while(sequenceNode[i] > 0)
+			while(i >= 0 && NodeValue(sequenceNode, i) > 0)
 			{
 				lastNode[lastNodeNum] = i;
 				minLastNode = i;
@@ -2299,7 +3102,7 @@ struct Sequence *SubsequenceMaker(INT_4 *oneEdgeNodes, INT_4 oneEdgeNodesIndex,
 				i--;
 			}
 		}
-		i--;
+		pos--;
 	}
 	
 	if(gParam.proteolysis == 'T')
@@ -2363,15 +3166,38 @@ struct Sequence *SubsequenceMaker(INT_4 *oneEdgeNodes, INT_4 oneEdgeNodesIndex,
 *	two amino acid jumps are penalized so that the extension score is reduced by factors 
 *	NODE_NODE_PENALTY, NODE_EDGE_PENALTY, and EDGE_EDGE_PENALTY as defined in lutefisk.h.
 *	Once there are no more nodes remaining, then the function returns a NULL value.
+*
+*	If gParam.subseqEngine is 'E', TopPathSequences finds the best completed sequences w/o 
+*	the beam search, and if its 'C' both are done and compared (the beam search results are
+*	the ones that are kept).
 */
 	
+	if(gParam.subseqEngine == 'E')
+	{
+		seqNum = TopPathSequences(subsequencePtr, sequenceNode, oneEdgeNodes, oneEdgeNodesIndex,
+									aaPresentMass, lastNode, lastNodeNum, maxLastNode, 
+									minLastNode, lowSuperNode, highSuperNode);
+		FreeSequenceStructs(subsequencePtr);
+		subsequencePtr = NULL;
+	}
+	else if(gParam.subseqEngine == 'C')
+	{
+		exactTicks = SearchTicks();
+		TopPathSequences(subsequencePtr, sequenceNode, oneEdgeNodes, oneEdgeNodesIndex,
+							aaPresentMass, lastNode, lastNodeNum, maxLastNode, minLastNode, 
+							lowSuperNode, highSuperNode);
+		exactSequencePtr = SubsequenceHeapToList(&gFinalSequenceHeap);
+		exactTicks = SearchTicks() - exactTicks;
+		beamTicks = SearchTicks();
+	}
+	
 	while(subsequencePtr != NULL)
 	{
-		if((clock() - gParam.startTicks)/ CLOCKS_PER_SEC > 30)
+		if((SearchTicks() - gParam.startTicks)/ CLOCKS_PER_SEC > 30)
 		{
 			gParam.topSeqNum = halfAsManySubsequences;	/*its taking too long, so speed it up*/
 		}
-		if((clock() - gParam.startTicks)/ CLOCKS_PER_SEC > 60)
+		if((SearchTicks() - gParam.startTicks)/ CLOCKS_PER_SEC > 60)
 		{
 			gParam.topSeqNum = quarterAsManySubsequences;	/*this is really taking too long*/
 		}
@@ -2388,6 +3214,17 @@ struct Sequence *SubsequenceMaker(INT_4 *oneEdgeNodes, INT_4 oneEdgeNodesIndex,
 		}
 	}
 	
+	gFinalSequencePtr = SubsequenceHeapToList(&gFinalSequenceHeap);
+	FreeSubsequenceHeap(&gSubsequenceHeap);
+	FreeSubsequenceHeap(&gFinalSequenceHeap);
+	
+	if(gParam.subseqEngine == 'C')
+	{
+		beamTicks = SearchTicks() - beamTicks;
+		CompareSubsequencing(gFinalSequencePtr, beamTicks, exactSequencePtr, exactTicks);
+		FreeSequenceStructs(exactSequencePtr);
+	}
+	
 	if(gCheckItOut)
 	{
 		correctPeptideLength = 14;
@@ -41,71 +41,68 @@ jsrichar@alum.mit.edu
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "LutefiskPrototypes.h"
 #include "LutefiskDefinitions.h"
-
-/*Define some globals that were defined in LutefiskMain.c.*/
-extern INT_4 gNomMass[AMINO_ACID_NUMBER];
+#include "ListRoutines.h"
 
 /********************************AddExtraNodes***********************************************
 *
 *	This function compares the arrays "sequenceNode" and "evidence" to see if there are
 *	nodes that were not connected to the C-terminus.  It ignores nodes that are adjacent
 *	to nodes that had been connected.  It adds the values in sequenceNodeN and sequenceNodeC
-*	and puts them into the array sequenceNode.
+*	and puts them into the array sequenceNode.  Only the occupied nodes in nodeList are
+*	visited; a run of consecutive node positions in the list is a series of adjacent nodes.
 */
-void AddExtraNodes(SCHAR *sequenceNode, SCHAR *sequenceNodeN, 
-		   SCHAR *sequenceNodeC, char *evidence)
+void AddExtraNodes(tNodeStore *sequenceNode, tNodeStore *sequenceNodeN, 
+		   tNodeStore *sequenceNodeC, tNodeList *nodeList)
 {
 	INT_4 i, j, k, newNodeValue;
+	INT_4 *node = nodeList->node;
 	char test;
 	
-	i = gGraphLength - 1;	/*Start out at the maximum node position.*/
-	while(i >= 0)	/*Don't let the index value go negative (there are no negative b ions).*/
+	i = nodeList->numObjects - 1;	/*Start out at the highest occupied node.*/
+	while(i >= 0)
 	{
-		if(evidence[i] != 0)	/*If I hit a node that has any cleavage evidence, then do this.*/
+		test = TRUE;	/*Test is used to determine if consecutive evidence nodes have been
+						represented already in the sequenceNode array.  In other words, if
+						there is a series of three consecutive nodes w/ non-zero evidence,
+						it may be that the middle one actually can be connected to the
+						C-terminus, and therefore that node position or index 
+						value for the array sequenceNode is non-zero.  In such situations,
+						I don't bother adding the adjacent nodes to the array sequenceNode.*/
+		j = i;	/*I need a new index to step through the consecutive non-zero nodes.*/
+		while(j >= 0 && node[j] == node[i] - (i - j))
 		{
-			test = TRUE;	/*Test is used to determine if consecutive evidence nodes have been
-							represented already in the sequenceNode array.  In other words, if
-							there is a series of three consecutive nodes w/ non-zero evidence,
-							it may be that the middle one actually can be connected to the
-							C-terminus (as above), and therefore that node position or index 
-							value for the array sequenceNode is non-zero.  In such situations,
-							I don't bother adding the adjacent nodes to the array sequenceNode.*/
-			j = i;	/*I need a new index to step through the consecutive non-zero nodes.*/
-			while(evidence[j] != 0)
+			if(NodeValue(sequenceNode, node[j]) != 0)
 			{
-				if(sequenceNode[j] != 0)
-				{
-					test = FALSE;	/*I've found a node that has already been included in sequenceNode.*/
-				}
-				j--;	/*Keep stepping down so that I can find the end of this series of nodes.*/
+				test = FALSE;	/*I've found a node that has already been included in sequenceNode.*/
 			}
-			if(test || gParam.fragmentErr <= 0.5 * gMultiplier)	/*Alter the relevant values of sequenceNode.
-													If the fragment tolerance is less than 0.5,
-													then adjacent nodes are not due to slop in
-													mass assignments, and should therefore be
-													taken seriously.*/
+			j--;	/*Keep stepping down so that I can find the end of this series of nodes.*/
+		}
+		if(test || gParam.fragmentErr <= 0.5 * gMultiplier)	/*Alter the relevant values of sequenceNode.
+												If the fragment tolerance is less than 0.5,
+												then adjacent nodes are not due to slop in
+												mass assignments, and should therefore be
+												taken seriously.*/
+		{
+			for(k = j + 1; k <= i; k++)	/*node[j] is not part of this series.*/
 			{
-				for(k = j + 1; k <= i; k++)	/*evidence[j] is zero, so just go up to it.*/
+				newNodeValue = NodeValue(sequenceNodeC, node[k]) + NodeValue(sequenceNodeN, node[k]);
+				
+				if(newNodeValue > 127 || newNodeValue < -127)
 				{
-					newNodeValue = sequenceNodeC[k] + sequenceNodeN[k];
-					
-					if(newNodeValue > 127 || newNodeValue < -127)
-					{
-						newNodeValue = 127;
-					}
-					
-					if(newNodeValue > sequenceNode[k])
-					{
-						sequenceNode[k] = newNodeValue;
-					}
+					newNodeValue = 127;
+				}
+				
+				if(newNodeValue > NodeValue(sequenceNode, node[k]))
+				{
+					SetNodeValue(sequenceNode, node[k], newNodeValue);
 				}
 			}
-					
-			i = j + 1;	/*Must be j+1, cuz its incremented down before starting the while loop.*/
 		}
-		i--;
+				
+		i = j;	/*Move on to the next series of nodes.*/
 	}
 	
 	
@@ -120,131 +117,80 @@ void AddExtraNodes(SCHAR *sequenceNode, SCHAR *sequenceNodeN,
 
 void SortOneEdgeNodes(INT_4 *oneEdgeNodes, INT_4 *oneEdgeNodesIndex)
 {
-	INT_4 i;
-	char test = TRUE;
-	INT_4 *tempNode, tempIndex, smallestTemp, smallestTempValue;
-	
-	tempNode = (int *) malloc(gGraphLength * sizeof(INT_4));	/*Will contain C-terminal evidence.*/
-	if(tempNode == NULL)
-	{
-		printf("SortOneEdgeNodes:  Out of memory");
-		exit(1);
-	}
+	INT_4 i, tempIndex;
 	
-	if(*oneEdgeNodesIndex >= gGraphLength)
-	{
-		printf("SortOneEdgeNodes:  *oneEdgeNodesIndex >= gGraphLength\n");
-		exit(1);
-	}
-
+	qsort(oneEdgeNodes, *oneEdgeNodesIndex, sizeof(INT_4), NodeAscendSortFunc);
 	
 	tempIndex = 0;
-	
-	while(test)
+	for(i = 0; i < *oneEdgeNodesIndex; i++)	/*Keep one copy of each positive node.*/
 	{
-		test = FALSE;
-		
-		i = 0;
-		while(i < *oneEdgeNodesIndex)	/*Find a positive number.*/
+		if(oneEdgeNodes[i] > 0 && (tempIndex == 0 || oneEdgeNodes[i] != oneEdgeNodes[tempIndex - 1]))
 		{
-			if(oneEdgeNodes[i] > 0)
-			{
-				test = TRUE;
-				smallestTemp = i;
-				smallestTempValue = oneEdgeNodes[i];
-				break;
-			}
-			i++;
-		}
-		
-		if(test)
-		{		
-			for(i = 0; i < *oneEdgeNodesIndex; i++)	/*Find the smallest value that is not zero.*/
-			{
-				if(oneEdgeNodes[i] > 0)
-				{
-					if(oneEdgeNodes[i] < smallestTempValue)
-					{
-						smallestTemp = i;
-						smallestTempValue = oneEdgeNodes[i];
-					}
-				}
-			}
-			
-			for(i = 0; i < *oneEdgeNodesIndex; i++)	/*Find the ones that are identical.*/
-			{
-				if(i != smallestTemp)
-				{
-					if(smallestTempValue == oneEdgeNodes[i])
-					{
-						oneEdgeNodes[i] = 0;
-					}
-				}
-			}
-			
-			tempNode[tempIndex] = smallestTempValue;	/*Set the temporary value.*/
-			tempIndex++;							/*Increment the number of values.*/
-			if(tempIndex >= gGraphLength)
-			{
-				printf("gGraphLength is too small.");
-				exit(1);
-			}
-			oneEdgeNodes[smallestTemp] = 0;			/*Set this to zero so that its not used
-													again.*/
+			oneEdgeNodes[tempIndex] = oneEdgeNodes[i];
+			tempIndex++;
 		}
 	}
 	
-	*oneEdgeNodesIndex = tempIndex;	/*Transfer to the oneEdgeNodes array.*/
-	if(*oneEdgeNodesIndex >= gGraphLength)
+	*oneEdgeNodesIndex = tempIndex;
+
+	return;
+}
+
+/********************************NodeAscendSortFunc********************************************
+*
+*	qsort comparison function that puts node positions in increasing order.
+*/
+
+int NodeAscendSortFunc(const void *n1, const void *n2)
+{
+	INT_4 nodeA = *(const INT_4 *)n1;
+	INT_4 nodeB = *(const INT_4 *)n2;
+	
+	if(nodeA < nodeB)
 	{
-		printf("SortOneEdgeNodes:  *oneEdgeNodesIndex >= gGraphLength\n");
-		exit(1);
+		return(-1);
 	}
-	for(i = 0; i < tempIndex; i++)
+	if(nodeA > nodeB)
 	{
-		oneEdgeNodes[i] = tempNode[i];
+		return(1);
 	}
-
-	free(tempNode);
-
-	return;
+	return(0);
 }
 
 /********************************FindCurrentNode*********************************************
 *
 *	This function takes the currentNode from which amino acid residue masses have already been
 *	subtracted, and finds the next node lower in mass that can be connected to the C-terminus.
-*	That new node serves as the next currentNode.
+*	That new node serves as the next currentNode.  Only the occupied nodes below currentNode
+*	are examined; *nodePos is the position of currentNode in the node list on the way in, and
+*	of the new currentNode on the way out.
 */
 
-INT_4 FindCurrentNode(SCHAR *sequenceNode, INT_4 currentNode)
+INT_4 FindCurrentNode(tNodeStore *sequenceNode, INT_4 currentNode, INT_4 *node, INT_4 *nodePos)
 {
 	INT_4 i;
 	
-	i = currentNode;
+	i = *nodePos;
 	
 	while(i > 0)
 	{
 		i--;
 		
-		if(i < currentNode - 190 * gMultiplier)	/* If i goes below the mass of currentNode - Trp, then
+		if(node[i] < currentNode - 190 * gMultiplier)	/* If i goes below the mass of currentNode - Trp, then
 									terminate the search.  I used 190 as the mass of Trp 
 									plus an inordinately large error.*/
 		{
-			currentNode = 0;
-			return(currentNode);
+			return(0);
 		}
 		
-		if(sequenceNode[i] > 0)
+		if(NodeValue(sequenceNode, node[i]) > 0)
 		{
-			currentNode = i;
-			return(currentNode);
+			*nodePos = i;
+			return(node[i]);
 		}
 	}
-	
-	currentNode = i;
 
-	return(currentNode);
+	return(0);
 }
 
 /********************************AssignProNodeValue*********************************************
@@ -258,25 +204,25 @@ INT_4 FindCurrentNode(SCHAR *sequenceNode, INT_4 currentNode)
 *	evidence for the nextNode does not match w/ the currentNode, then the values for 
 *	sequenceNodeC and sequenceNodeN only are summed.
 */
-void AssignProNodeValue(INT_4 nextNode, INT_4 currentNode, char *evidence, 
-		        SCHAR *sequenceNode, SCHAR *sequenceNodeC,
-		  	SCHAR *sequenceNodeN, INT_4 totalIonVal)
+void AssignProNodeValue(INT_4 nextNode, INT_4 currentNode, tNodeStore *evidence, 
+		        tNodeStore *sequenceNode, tNodeStore *sequenceNodeC,
+		  	tNodeStore *sequenceNodeN, INT_4 totalIonVal)
 {
 	INT_4 nodeScore = 0;
 		
 /*	The 2 aa extension w/ proline is only used if its a tryptic peptide and therefore
 	only y ions would be expected if there are no ions delineating pro.*/
-	if((evidence[nextNode] == 'B' || evidence[nextNode] == 'C') &&
-		(evidence[currentNode] == 'B' || evidence[currentNode] == 'C'))
+	if((NodeValue(evidence, nextNode) == 'B' || NodeValue(evidence, nextNode) == 'C') &&
+		(NodeValue(evidence, currentNode) == 'B' || NodeValue(evidence, currentNode) == 'C'))
 	{
-		nodeScore = sequenceNodeC[nextNode] + sequenceNodeN[nextNode]
+		nodeScore = NodeValue(sequenceNodeC, nextNode) + NodeValue(sequenceNodeN, nextNode)
 					+ (totalIonVal * TOTALIONVAL_MULTIPLIER * 0.5);
 					
 	}
 
-	if(sequenceNode[nextNode] < 0)	/*If the nextNode value is negative, make it positive.*/
+	if(NodeValue(sequenceNode, nextNode) < 0)	/*If the nextNode value is negative, make it positive.*/
 	{
-		sequenceNode[nextNode] = -1 * sequenceNode[nextNode];
+		SetNodeValue(sequenceNode, nextNode, -1 * NodeValue(sequenceNode, nextNode));
 	}
 	
 	if(nodeScore > 127 || nodeScore < -127)
@@ -284,11 +230,11 @@ void AssignProNodeValue(INT_4 nextNode, INT_4 currentNode, char *evidence,
 		nodeScore = 127;
 	}
 	
-	if(nodeScore > sequenceNode[nextNode])	/*If the new nodeScore is greater, then assign its
+	if(nodeScore > NodeValue(sequenceNode, nextNode))	/*If the new nodeScore is greater, then assign its
 											value to sequencNode[nextNode], otherwise leave
 											the original value as a positive number.*/
 	{
-		sequenceNode[nextNode] = nodeScore;
+		SetNodeValue(sequenceNode, nextNode, nodeScore);
 	}
 		
 	return;
@@ -306,9 +252,9 @@ void AssignProNodeValue(INT_4 nextNode, INT_4 currentNode, char *evidence,
 *	evidence for the nextNode does not match w/ the currentNode, then the values for 
 *	sequenceNodeC and sequenceNodeN only are summed.
 */
-void AssignNodeValue(INT_4 nextNode, INT_4 currentNode, char *evidence, 
-					SCHAR *sequenceNode, SCHAR *sequenceNodeC,
-					SCHAR *sequenceNodeN, INT_4 totalIonVal)
+void AssignNodeValue(INT_4 nextNode, INT_4 currentNode, tNodeStore *evidence, 
+					tNodeStore *sequenceNode, tNodeStore *sequenceNodeC,
+					tNodeStore *sequenceNodeN, INT_4 totalIonVal)
 {
 	INT_4 nodeScore = 0;
 	INT_4 i = 0;
@@ -325,9 +271,9 @@ void AssignNodeValue(INT_4 nextNode, INT_4 currentNode, char *evidence,
 														the average connection.*/
 	scoreAdjuster = (scoreAdjuster + 99) / 100;	/*Reduce scoreAdjuster effect.*/
 	
-	if(evidence[nextNode] == 'B' || evidence[currentNode] == 'B')
+	if(NodeValue(evidence, nextNode) == 'B' || NodeValue(evidence, currentNode) == 'B')
 	{
-		nodeScore = sequenceNodeC[nextNode] + sequenceNodeN[nextNode]
+		nodeScore = NodeValue(sequenceNodeC, nextNode) + NodeValue(sequenceNodeN, nextNode)
 					+ (totalIonVal * TOTALIONVAL_MULTIPLIER);
 					/*((nodeScore + totalIonVal) + (nodeScore * totalIonVal)) / 2;*/
 					/*(totalIonVal * TOTALIONVAL_MULTIPLIER);*/
@@ -335,13 +281,13 @@ void AssignNodeValue(INT_4 nextNode, INT_4 currentNode, char *evidence,
 	}
 	else
 	{
-		if(evidence[nextNode] != evidence[currentNode])
+		if(NodeValue(evidence, nextNode) != NodeValue(evidence, currentNode))
 		{
-			nodeScore = sequenceNodeC[nextNode] + sequenceNodeN[nextNode];
+			nodeScore = NodeValue(sequenceNodeC, nextNode) + NodeValue(sequenceNodeN, nextNode);
 		}
 		else
 		{
-			nodeScore = sequenceNodeC[nextNode] + sequenceNodeN[nextNode]
+			nodeScore = NodeValue(sequenceNodeC, nextNode) + NodeValue(sequenceNodeN, nextNode)
 						+ (totalIonVal * TOTALIONVAL_MULTIPLIER);
 						/*((nodeScore + totalIonVal) + (nodeScore * totalIonVal)) / 2;*/
 						/*(totalIonVal * TOTALIONVAL_MULTIPLIER);*/
@@ -351,9 +297,9 @@ void AssignNodeValue(INT_4 nextNode, INT_4 currentNode, char *evidence,
 	
 	nodeScore = (nodeScore * scoreAdjuster) + 0.5;	/*Adjust score for size of extension.*/
 	
-	if(sequenceNode[nextNode] < 0)	/*If the nextNode value is negative, make it positive.*/
+	if(NodeValue(sequenceNode, nextNode) < 0)	/*If the nextNode value is negative, make it positive.*/
 	{
-		sequenceNode[nextNode] = -1 * sequenceNode[nextNode];
+		SetNodeValue(sequenceNode, nextNode, -1 * NodeValue(sequenceNode, nextNode));
 	}
 	
 	if(nodeScore > 127 || nodeScore < -127)
@@ -361,11 +307,11 @@ void AssignNodeValue(INT_4 nextNode, INT_4 currentNode, char *evidence,
 		nodeScore = 127;
 	}
 	
-	if(nodeScore > sequenceNode[nextNode])	/*If the new nodeScore is greater, then assign its
+	if(nodeScore > NodeValue(sequenceNode, nextNode))	/*If the new nodeScore is greater, then assign its
 											value to sequencNode[nextNode], otherwise leave
 											the original value as a positive number.*/
 	{
-		sequenceNode[nextNode] = nodeScore;
+		SetNodeValue(sequenceNode, nextNode, nodeScore);
 	}
 		
 	return;
@@ -373,51 +319,33 @@ void AssignNodeValue(INT_4 nextNode, INT_4 currentNode, char *evidence,
 
 /***************************************InitSummedNodeArrays********************************
 *
-*		This function initializes some of the arrrays used by the function SummedNodeScore.
+*		This function initializes sequenceNode and the evidence for each of the nodes in
+*	nodeList, which are the nodes that have any evidence.
 */
-void InitSummedNodeArrays(SCHAR *sequenceNode, SCHAR *sequenceNodeC, 
-							SCHAR *sequenceNodeN, INT_4 *oneEdgeNodes, 
-							char *evidence)
+void InitSummedNodeArrays(tNodeStore *sequenceNode, tNodeStore *sequenceNodeC, 
+							tNodeStore *sequenceNodeN, tNodeStore *evidence, tNodeList *nodeList)
 {
-	INT_4 i;
+	INT_4 i, k;
 	
-	for(i = 0; i < gGraphLength; i++)	/*Initialize these arrays.*/
-	{
-		sequenceNode[i] = 0;
-		evidence[i] = 0;
-	}
+	ClearNodeStore(sequenceNode);	/*evidence is new.*/
 	
-	for(i = 0; i < gGraphLength; i++)
+	for(k = 0; k < nodeList->numObjects; k++)	/*Set up the evidence.*/
 	{
-		oneEdgeNodes[i] = 0;
-	}
-	
-	for(i = 0; i < gGraphLength; i++)	/*Set up the evidence array.*/
-	{
-	
-		if(sequenceNodeC[i] != 0 && sequenceNodeN[i] != 0)
+		i = nodeList->node[k];
+		if(NodeValue(sequenceNodeC, i) != 0 && NodeValue(sequenceNodeN, i) != 0)
 		{
-			evidence[i] = 'B';
+			SetNodeValue(evidence, i, 'B');	/*-1 and -1 implies a sequencetag, which is also 'B'.*/
 		}
-	
-		if(sequenceNodeC[i] != 0 && sequenceNodeN[i] == 0)
+		else if(NodeValue(sequenceNodeC, i) != 0)
 		{
-			evidence[i] = 'C';
+			SetNodeValue(evidence, i, 'C');
 		}
-		
-		if(sequenceNodeC[i] == 0 && sequenceNodeN[i] != 0)
+		else
 		{
-			evidence[i] = 'N';
+			SetNodeValue(evidence, i, 'N');
 		}
 	}
 	
-	for(i = 0; i < gGraphLength; i++)	/*-1 implies a sequencetag*/
-	{
-		if(sequenceNodeC[i] == -1 && sequenceNodeN[i] == -1)
-		{
-			evidence[i] = 'B';
-		}
-	}
 	return;
 }
 
@@ -437,29 +365,39 @@ void InitSummedNodeArrays(SCHAR *sequenceNode, SCHAR *sequenceNodeC,
 *	and it will use the scores held in sequenceNode to guide the way towards the C-terminus.
 *		In addition, this function keeps track of those nodes that can be connected to the
 *	C-terminus, but do not connect to any other nodes N-terminal to it.  These so-called one-
-*	edged nodes will be used for making two amino acid jumps between nodes.
+*	edged nodes will be used for making two amino acid jumps between nodes, and are returned
+*	as a list.  nodeList is the list of nodes w/ any evidence made by MakeSequenceGraph.
 */
 
-void SummedNodeScore(SCHAR *sequenceNode, SCHAR *sequenceNodeC, 
-					SCHAR *sequenceNodeN, INT_4 *oneEdgeNodes,
-					INT_4 *oneEdgeNodesIndex, INT_4 totalIonVal)
+tNodeList *SummedNodeScore(tNodeStore *sequenceNode, tNodeStore *sequenceNodeC, 
+					tNodeStore *sequenceNodeN, tNodeList *nodeList, INT_4 totalIonVal)
 {
 	INT_4 i, k;
 	INT_4 j, currentNode, nextNode, lowSuperNode, highSuperNode;
 	INT_4 highArgNode, highLysNode, lowArgNode, lowLysNode, lowMassCutoff, y2;
-	char *evidence;
-	char test = TRUE;
+	INT_4 *node, nodeNum, pos, nodePos;
+	tNodeStore *evidence;
 	char anotherTest, doIt;	
+	tNodeList *oneEdgeNodes;
 
 	
-	evidence = (char *) malloc(gGraphLength * sizeof(char ));	/*Will contain C-terminal evidence.*/
-	if(evidence == NULL)
+	evidence = CreateNodeStore(sizeof(SCHAR));	/*Will contain C-terminal evidence.*/
+	oneEdgeNodes = (tNodeList *) CreateNewList(sizeof(INT_4), 100, 100);
+	if(oneEdgeNodes == NULL)
 	{
 		printf("SummedNodeScore:  Out of memory");
 		exit(1);
 	}
 	
-	*oneEdgeNodesIndex = 0;
+/*	Initialize sequenceNode to zero.  Then assign values of either B, N, or C to those 
+*	nodes that have any evidence derived from both the N- and C-terminii, the N-terminus 
+*	only, or the C-terminus only.  nodeList holds the positions of those nodes in increasing 
+*	order, and is what the rest of this function walks; for high accuracy data it is much 
+*	shorter than gGraphLength.
+*/
+	InitSummedNodeArrays(sequenceNode, sequenceNodeC, sequenceNodeN, evidence, nodeList);
+	node = nodeList->node;
+	nodeNum = nodeList->numObjects;
 	
 /*	Find the low mass cutoff to be used for LCQ data.*/
 	lowMassCutoff = (gParam.peptideMW + (gParam.chargeState * gElementMass_x100[HYDROGEN])) / 
@@ -472,20 +410,20 @@ void SummedNodeScore(SCHAR *sequenceNode, SCHAR *sequenceNodeC,
 	
 	if(gParam.tagSequence[0] != '*')
 	{
-		for(i = gGraphLength - 1; i >= 0; i--)
+		for(pos = nodeNum - 1; pos >= 0; pos--)
 		{
-			if(sequenceNodeN[i] == -1 && sequenceNodeC[i] == -1)
+			if(NodeValue(sequenceNodeN, node[pos]) == -1 && NodeValue(sequenceNodeC, node[pos]) == -1)
 			{
-				highSuperNode = i;
+				highSuperNode = node[pos];
 				break;
 			}
 		}
 		
-		for( i = 0; i < gGraphLength; i++)
+		for(pos = 0; pos < nodeNum; pos++)
 		{
-			if(sequenceNodeN[i] == -1 && sequenceNodeC[i] == -1)
+			if(NodeValue(sequenceNodeN, node[pos]) == -1 && NodeValue(sequenceNodeC, node[pos]) == -1)
 			{
-				lowSuperNode = i;
+				lowSuperNode = node[pos];
 				break;
 			}
 		}
@@ -496,14 +434,18 @@ void SummedNodeScore(SCHAR *sequenceNode, SCHAR *sequenceNodeC,
 *	a section below that compensates for the absence of y2 ions in higher mass peptides
 *	obtained from ion traps w/ a low mass cutoff of 1/3 of the precursor ion.
 */
-	i = gGraphLength - 1;
-	while(i > 0 && sequenceNodeC[i] == 0)
+	i = 0;
+	for(pos = nodeNum - 1; pos >= 0 && node[pos] > 0; pos--)
 	{
-		i--;
+		if(NodeValue(sequenceNodeC, node[pos]) != 0)
+		{
+			i = node[pos];
+			break;
+		}
 	}
 	highArgNode = i - gGapList[R];
 	highLysNode = i - gGapList[K];
-	while(i > 0 && sequenceNodeC[i] != 0)
+	while(i > 0 && NodeValue(sequenceNodeC, i) != 0)
 	{
 		i--;
 	}
@@ -512,37 +454,30 @@ void SummedNodeScore(SCHAR *sequenceNode, SCHAR *sequenceNodeC,
 	lowLysNode = i - gGapList[K];
 	
 	
-/*	Initialize sequenceNode, oneEdgeNodes, and evidence to zero.  Then assign values of
-*	either B, N, or C to those nodes that have any evidence derived from both the N- and
-*	C-terminii, the N-terminus only, or the C-terminus only.
+/*	Start at the highest occupied node below the top of the graph.  Thereafter the loop
+*	continues only as long as the next occupied node is adjacent to the last one, which is
+*	only possible for those nodes that are due to multiple C-terminal nodes resulting from a
+*	large error in the peptide mass measurement.
 */
-	InitSummedNodeArrays(sequenceNode, sequenceNodeC, sequenceNodeN, oneEdgeNodes, evidence);
-
-	
-/*	Make sure that the index is greater than zero.  The first time evidence is not zero,
-*	the value of test becomes FALSE, which means that thereafter the while loop will continue
-*	only as INT_4 as evidence does not equal zero, which is only possible for those nodes
-*	that are due to multiple C-terminal nodes resulting from a large error in the peptide
-*	mass measurement.
-*/
-	i = gGraphLength - 1;
-	while(i > 0 && (test || evidence[i] != 0))
+	pos = nodeNum - 1;
+	while(pos >= 0 && node[pos] >= gGraphLength - 1)
 	{
-		i--;
-		if(evidence[i] != 0)
-		{
-			test = FALSE;
-			currentNode = i;
+		pos--;
+	}
+	while(pos >= 0)
+	{
+		currentNode = node[pos];
+		nodePos = pos;
 
 /*	Assign the value to the C-terminal node of sequenceNode.*/
-			if(sequenceNodeC[currentNode] + sequenceNodeN[currentNode] < 127)
-			{
-				sequenceNode[currentNode] = sequenceNodeC[currentNode] + sequenceNodeN[currentNode];
-			}
-			else
-			{
-				sequenceNode[currentNode] = 127;
-			}
+		if(NodeValue(sequenceNodeC, currentNode) + NodeValue(sequenceNodeN, currentNode) < 127)
+		{
+			SetNodeValue(sequenceNode, currentNode, NodeValue(sequenceNodeC, currentNode) + NodeValue(sequenceNodeN, currentNode));
+		}
+		else
+		{
+			SetNodeValue(sequenceNode, currentNode, 127);
+		}
 
 /*	Now that I've found a C-terminal Node, lets start connecting the dots.*/
 
@@ -562,160 +497,155 @@ void SummedNodeScore(SCHAR *sequenceNode, SCHAR *sequenceNodeC,
 *	the next node down that has a positive value for sequenceNode[node].
 */
 
-			while(currentNode != 0)
+		while(currentNode != 0)
+		{
+			anotherTest = TRUE;
+			for(j = 0; j < gAminoAcidNumber; j++)
+			{
+				if(gGapList[j] != 0)
+				{
+					nextNode = currentNode - gGapList[j];
+					doIt = TRUE;
+					if(currentNode > highSuperNode && nextNode < lowSuperNode)
+					{
+						doIt = FALSE;	/*you skipped a superNode*/
+					}
+					if(nextNode >= 0 && NodeValue(evidence, nextNode) != 0 && doIt)
+					{
+						anotherTest = FALSE;
+						AssignNodeValue(nextNode, currentNode, evidence, sequenceNode, 
+								sequenceNodeC, sequenceNodeN, totalIonVal);
+					}
+				}
+			}
+			
+			if(gParam.fragmentPattern == 'T' || gParam.fragmentPattern == 'Q' 
+				|| gParam.fragmentPattern == 'L')
 			{
-				anotherTest = TRUE;
-				for(j = 0; j < gAminoAcidNumber; j++)
+				for(j = 0; j < gAminoAcidNumber; j++)	/*check for 2aa's w/ proline*/
 				{
 					if(gGapList[j] != 0)
 					{
-						nextNode = currentNode - gGapList[j];
+						nextNode = currentNode - gGapList[j] - gGapList[P];
 						doIt = TRUE;
 						if(currentNode > highSuperNode && nextNode < lowSuperNode)
 						{
 							doIt = FALSE;	/*you skipped a superNode*/
 						}
-						if(nextNode >= 0 && evidence[nextNode] != 0 && doIt)
+						if(nextNode >= 0 && NodeValue(evidence, nextNode) != 0 && doIt)
 						{
 							anotherTest = FALSE;
-							AssignNodeValue(nextNode, currentNode, evidence, sequenceNode, 
-									sequenceNodeC, sequenceNodeN, totalIonVal);
+							AssignProNodeValue(nextNode, currentNode, evidence, sequenceNode, 
+											sequenceNodeC, sequenceNodeN, totalIonVal);
 						}
 					}
 				}
-				
-				if(gParam.fragmentPattern == 'T' || gParam.fragmentPattern == 'Q' 
-					|| gParam.fragmentPattern == 'L')
+			}
+			
+			/*For LCQ data the y2 ions may be missing for ions greater than 1200 
+			(1200 is chosen because GK y2 would be below the ion trap low mass cutoff),
+			so 2 amino acid extensions are allowed for tryptic peptides below R or K.*/
+			if(gParam.fragmentPattern == 'L' && gParam.peptideMW > 1200 * gMultiplier
+				&& gParam.proteolysis == 'T' && gParam.chargeState <= 2)
+			{
+				if((currentNode <= highArgNode && currentNode >= lowArgNode) ||
+					(currentNode <= highLysNode && currentNode >= lowLysNode))
 				{
-					for(j = 0; j < gAminoAcidNumber; j++)	/*check for 2aa's w/ proline*/
+					for(j = 0; j < gAminoAcidNumber; j++)	/*check for 2aa's*/
 					{
 						if(gGapList[j] != 0)
 						{
-							nextNode = currentNode - gGapList[j] - gGapList[P];
-							doIt = TRUE;
-							if(currentNode > highSuperNode && nextNode < lowSuperNode)
+							for(k = j; k < gAminoAcidNumber; k++)
 							{
-								doIt = FALSE;	/*you skipped a superNode*/
-							}
-							if(nextNode >= 0 && evidence[nextNode] != 0 && doIt)
-							{
-								anotherTest = FALSE;
-								AssignProNodeValue(nextNode, currentNode, evidence, sequenceNode, 
-												sequenceNodeC, sequenceNodeN, totalIonVal);
-							}
-						}
-					}
-				}
-				
-				/*For LCQ data the y2 ions may be missing for ions greater than 1200 
-				(1200 is chosen because GK y2 would be below the ion trap low mass cutoff),
-				so 2 amino acid extensions are allowed for tryptic peptides below R or K.*/
-				if(gParam.fragmentPattern == 'L' && gParam.peptideMW > 1200 * gMultiplier
-					&& gParam.proteolysis == 'T' && gParam.chargeState <= 2)
-				{
-					if((currentNode <= highArgNode && currentNode >= lowArgNode) ||
-						(currentNode <= highLysNode && currentNode >= lowLysNode))
-					{
-						for(j = 0; j < gAminoAcidNumber; j++)	/*check for 2aa's*/
-						{
-							if(gGapList[j] != 0)
-							{
-								for(k = j; k < gAminoAcidNumber; k++)
+								if(gGapList[k] != 0)
 								{
-									if(gGapList[k] != 0)
+									nextNode = currentNode - gGapList[j] - gGapList[k];
+									doIt = TRUE;
+									if(currentNode > highSuperNode && nextNode < lowSuperNode)
+									{
+										doIt = FALSE;	/*you skipped a superNode*/
+									}
+									y2 = 147 * gMultiplier;	/*y1 ion for c-term Lys*/
+									if(gGapList[j] < gGapList[k])
+									{
+										y2 += gGapList[j];	/*add the lowest mass aa*/
+									}
+									else
 									{
-										nextNode = currentNode - gGapList[j] - gGapList[k];
-										doIt = TRUE;
-										if(currentNode > highSuperNode && nextNode < lowSuperNode)
-										{
-											doIt = FALSE;	/*you skipped a superNode*/
-										}
-										y2 = 147 * gMultiplier;	/*y1 ion for c-term Lys*/
-										if(gGapList[j] < gGapList[k])
-										{
-											y2 += gGapList[j];	/*add the lowest mass aa*/
-										}
-										else
-										{
-											y2 += gGapList[k];
-										}
-										if(y2 > lowMassCutoff)
-										{
-											doIt = FALSE;	/*this y2 should be within range*/
-										}
-										if(nextNode >= 0 && evidence[nextNode] != 0 && doIt)
-										{
-											anotherTest = FALSE;
-											AssignNodeValue(nextNode, currentNode, evidence, 
-																sequenceNode, sequenceNodeC, 
-																sequenceNodeN, totalIonVal);
-										}
+										y2 += gGapList[k];
+									}
+									if(y2 > lowMassCutoff)
+									{
+										doIt = FALSE;	/*this y2 should be within range*/
+									}
+									if(nextNode >= 0 && NodeValue(evidence, nextNode) != 0 && doIt)
+									{
+										anotherTest = FALSE;
+										AssignNodeValue(nextNode, currentNode, evidence, 
+															sequenceNode, sequenceNodeC, 
+															sequenceNodeN, totalIonVal);
 									}
 								}
 							}
 						}
 					}
 				}
+			}
 
 
-				if(anotherTest)
+			if(anotherTest)
+			{
+				if(!AddToList(&currentNode, oneEdgeNodes))
 				{
-					if(*oneEdgeNodesIndex < gGraphLength - 1)
-					{
-						oneEdgeNodes[*oneEdgeNodesIndex] = currentNode;
-						*oneEdgeNodesIndex += 1;
-						if(*oneEdgeNodesIndex >= gGraphLength)
-						{
-							printf("SummedNodeScore:  *oneEdgeNodesIndex >= gGraphLength\n");
-							exit(1);
-						}
-					}
-					else
-					{
-						printf("gGraphLength is too small.");
-						exit(1);
-					}
+					printf("SummedNodeScore:  Out of memory");
+					exit(1);
 				}
+			}
 /*	
 *	If I reach the N-terminus, or no further connections can be made, then FindCurrentNode
 *	returns a value of zero, which terminates the while loop.
 */
-				currentNode = FindCurrentNode(sequenceNode, currentNode);
-				if(currentNode > gGraphLength || currentNode < 0)
-				{
-					printf("SummedNodeScore:  currentNode > gGraphLength || currentNode < 0\n");
-					exit(1);
-				}
+			currentNode = FindCurrentNode(sequenceNode, currentNode, node, &nodePos);
+			if(currentNode > gGraphLength || currentNode < 0)
+			{
+				printf("SummedNodeScore:  currentNode > gGraphLength || currentNode < 0\n");
+				exit(1);
 			}
-			
-			for(j = 0; j < gGraphLength; j++)	/*Make all of the positive values negative.*/
+		}
+		
+		for(k = 0; k < nodeNum; k++)	/*Make all of the positive values negative.*/
+		{
+			if(NodeValue(sequenceNode, node[k]) > 0)
 			{
-				if(sequenceNode[j] > 0)
-				{
-					sequenceNode[j] = -1 * (INT_2)sequenceNode[j];
-				}
+				SetNodeValue(sequenceNode, node[k], -1 * (INT_2)NodeValue(sequenceNode, node[k]));
 			}
 		}
+		
+		pos--;
+		if(pos >= 0 && node[pos] != node[pos + 1] - 1)
+		{
+			break;	/*Not adjacent to the last C-terminal node.*/
+		}
 	}
 	
-	for(i = 0; i < gGraphLength; i++)	/*Make everything positive.*/
+	for(k = 0; k < nodeNum; k++)	/*Make everything positive.*/
 	{
-		if(sequenceNode[i] < 0)
+		if(NodeValue(sequenceNode, node[k]) < 0)
 		{
-			sequenceNode[i] = -1 * sequenceNode[i];
+			SetNodeValue(sequenceNode, node[k], -1 * NodeValue(sequenceNode, node[k]));
 		}
 	}
 	
-	SortOneEdgeNodes(oneEdgeNodes, oneEdgeNodesIndex);
+	SortOneEdgeNodes(oneEdgeNodes->node, &oneEdgeNodes->numObjects);
 	
-	AddExtraNodes(sequenceNode, sequenceNodeN, sequenceNodeC, evidence);
+	AddExtraNodes(sequenceNode, sequenceNodeN, sequenceNodeC, nodeList);
 	
 /*	Add -1 to the superNode positions of sequenceNode*/
-	for(i = 0; i < gGraphLength; i++)
+	for(k = 0; k < nodeNum; k++)
 	{
-		if(sequenceNodeN[i] == -1 && sequenceNodeC[i] == -1)
+		if(NodeValue(sequenceNodeN, node[k]) == -1 && NodeValue(sequenceNodeC, node[k]) == -1)
 		{
-			sequenceNode[i] = -1;
+			SetNodeValue(sequenceNode, node[k], -1);
 		}
 	}
 	
@@ -724,9 +654,9 @@ void SummedNodeScore(SCHAR *sequenceNode, SCHAR *sequenceNodeC,
 		printf("Graph is finished. \n");
 	}
 	
-	free(evidence);	
+	DisposeNodeStore(evidence);
 	
-	return;
+	return(oneEdgeNodes);
 }
 	
 	
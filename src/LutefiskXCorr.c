@@ -69,13 +69,28 @@ jsrichar@alum.mit.edu
 #define BAD_A_ATT 0.05	/*Peak heights for a ions that are not very likely.*/
 #define INT_FRAG_ATT 0.1	/*peak heights for internal fragment ions.*/
 #define BAD_Y_ATT	0.05	/*Peak heights for y ions that are not very likely.*/
+#define MOCK_INTENSITY	50	/*Highest peak in the mock spectrum; it should match the spectrum1 max value.*/
 
-extern REAL_4 	*spectrum1;
-extern REAL_4 	*spectrum2;
-extern REAL_4 	*tau;
+/*	The cross-correlation buffers belong to the current search context.	*/
+#define spectrum1		(gSearch->spectrum1)
+#define spectrum2		(gSearch->spectrum2)
+#define tau				(gSearch->tau)
+#define spectrum1FT		(gSearch->spectrum1FT)
+#define SIZEOF_SPECTRA	(gSearch->sizeofSpectra)	/* Smallest power of 2 (for cross-correlation)*/
+#define xcorrSpectrum	(gSearch->xcorrSpectrum)
+#define mockBins		(gSearch->mockBins)
+#define mockBinNum		(gSearch->mockBinNum)
 
-UINT_4 SIZEOF_SPECTRA;	/* Smallest power of 2 (for cross-correlation)*/
-REAL_4 gSidePeakAtt = SIDE_PEAK_ATT;
+THREAD_LOCAL REAL_4 gSidePeakAtt = SIDE_PEAK_ATT;
+
+typedef struct	/*A sequence waiting to be cross-correlated, w/ the values SeqComboScoreRanker sorts by*/
+{
+	struct SequenceScore *scorePtr;
+	REAL_4	comboScore;		/*ComboScoreBound until it has been cross-correlated, then ComboScoreAt*/
+	REAL_4	probScore;
+	REAL_4	intensityScore;	/*clipped at one, as in DetermineBestCandidates*/
+	INT_4	order;			/*list order*/
+}tXCorrCandidate;
 
 
 /*Here's some globals that are specific to this file.  They are two amino acid nominal masses
@@ -106,7 +121,7 @@ INT_4 gLysPlusXCorr[AMINO_ACID_NUMBER] = {
 	0,0,0,0,0
 };
 
-INT_4 lowMassIonMass[AMINO_ACID_NUMBER] = {
+THREAD_LOCAL INT_4 lowMassIonMass[AMINO_ACID_NUMBER] = {
 	44, 112, 87, 88, 76, 102, 102, 30, 110, 86, 
 	86, 129, 104, 120, 70, 60, 74, 159, 136, 72,
 	0,0,0,0,0
@@ -119,6 +134,13 @@ REAL_4 lowMassIonIntFactor[AMINO_ACID_NUMBER] = {
 };
 
 extern void CrossCorrScoreTheSeq(struct SequenceScore *currScorePtr);
+static REAL_4 FastXCorrScore(void);
+static BOOLEAN XCorrCanBePruned(struct SequenceScore *firstScorePtr, INT_4 seqNum, REAL_4 autocorrelation);
+static REAL_4 LowestXCorrScore(REAL_4 autocorrelation);
+static void CrossCorrScoreTheBestSeqs(struct SequenceScore *firstScorePtr, INT_4 seqNum, 
+						REAL_4 autocorrelation);
+static int XCorrCandidateSortDescend(const void *n1, const void *n2);
+static void RaiseMockBin(REAL_4 *spectrum, INT_4 bin, REAL_4 intensity);
 
 /***************************YXCorrCalc*****************************************************
 *
@@ -297,7 +319,7 @@ void DoCrossCorrelationScoring(struct SequenceScore *firstScorePtr, struct MSDat
 	REAL_4		normalizedScore;		/* The max absolute cross-correlation value
 										*   (Later used as the normalizing factor)*/
 	REAL_4		tauDiff, intensityAccountedFor, autocorrelation;
-	struct SequenceScore *currSeqPtr;
+	struct SequenceScore *currSeqPtr, **rankPtr;
 
 
 	if (!firstScorePtr) 
@@ -343,27 +365,35 @@ void DoCrossCorrelationScoring(struct SequenceScore *firstScorePtr, struct MSDat
 	
 	/*Do an autocorrelation of the spectrum.  This is the normalizing factor used later*/
 	
-	CrossCorrelate(spectrum1-1, spectrum1-1, (UINT_4) SIZEOF_SPECTRA, tau-1);
-	for(i = 0; i < SIZEOF_SPECTRA; i++)
+	if(gParam.fastXCorr)
 	{
-		if(tau[i] < 1)
-		{
-			tau[i] = 0;
-		}
+		autocorrelation = SetupFastXCorr();
 	}
-	
-	
-	intensityAccountedFor = 0.0;
-	for(i = 1; i < 250; i++)
+	else
 	{
-		tauDiff = tau[i] - tau[SIZEOF_SPECTRA - i];
-		if(tauDiff < 0)
+		TransformSpectrum1();	/*spectrum1 is transformed once and for all*/
+		CrossCorrelateSpectrum1(spectrum1-1, tau-1);
+		for(i = 0; i < SIZEOF_SPECTRA; i++)
 		{
-			tauDiff = tauDiff * -1;
+			if(tau[i] < 1)
+			{
+				tau[i] = 0;
+			}
 		}
-		intensityAccountedFor += tauDiff;
+		
+		
+		intensityAccountedFor = 0.0;
+		for(i = 1; i < 250; i++)
+		{
+			tauDiff = tau[i] - tau[SIZEOF_SPECTRA - i];
+			if(tauDiff < 0)
+			{
+				tauDiff = tauDiff * -1;
+			}
+			intensityAccountedFor += tauDiff;
+		}
+		autocorrelation = tau[0] - intensityAccountedFor/250; /*should be equal to tau(0)*/
 	}
-	autocorrelation = tau[0] - intensityAccountedFor/250; /*should be equal to tau(0)*/
 
 	
 	/*debug spectrum1*/
@@ -391,19 +421,23 @@ void DoCrossCorrelationScoring(struct SequenceScore *firstScorePtr, struct MSDat
 		seqNum = MAX_X_CORR_NUM;
 	}
 	
-/*Cross-correlate the sequences.  Only do the top intensity-scorers.*/
-	for(i = 1; i <= seqNum; i++)
-	{	
-		currSeqPtr = firstScorePtr;
-		while(currSeqPtr != NULL)
-		{
-			if(i == currSeqPtr->rank)
+/*Cross-correlate the sequences.  If the final list can be found w/o doing them all, then only
+do the ones that might make it.  Otherwise do the top intensity-scorers, in rank order.*/
+	if(XCorrCanBePruned(firstScorePtr, seqNum, autocorrelation))
+	{
+		CrossCorrScoreTheBestSeqs(firstScorePtr, seqNum, autocorrelation);
+	}
+	else
+	{
+		rankPtr = SeqScoreRanks(firstScorePtr, seqNum);
+		for(i = 1; i <= seqNum; i++)
+		{	
+			if(rankPtr[i] != NULL)
 			{
-				CrossCorrScoreTheSeq(currSeqPtr);
+				CrossCorrScoreTheSeq(rankPtr[i]);
 			}
-			currSeqPtr = currSeqPtr->next;
 		}
-
+		free(rankPtr);
 	}
 		
 	/* Normalize the cross-correlation results to 1.0*/
@@ -443,11 +477,213 @@ void DoCrossCorrelationScoring(struct SequenceScore *firstScorePtr, struct MSDat
 										*  continue the while loop.	*/
 	}	
 	
-	if (spectrum1)	free(spectrum1);	spectrum1 = NULL;
-	if (tau)        free(tau);	          tau = NULL;
+	/*The buffers stay with gSearch for the next peptide MW (see SetupCrossCorrelation)*/
 	
 	return;
 }
+/**************************	XCorrCanBePruned*******************************************
+*
+*  The cross-correlation can be skipped for sequences that can't make the final list only if
+*  nothing but the final list is looked at afterwards.  Database sequences are compared against 
+*  the highest x-corr of all of them in DetermineBestCandidates, PrintToConsole looks at the 
+*  top 50 intensity-scorers, and if there are more sequences than are cross-correlated the 
+*  extras can turn up in the final list w/o a combo score rank.  A negative autocorrelation 
+*  would flip the x-corr scores around, so don't bother with that either.
+*/
+static BOOLEAN XCorrCanBePruned(struct SequenceScore *firstScorePtr, INT_4 seqNum, REAL_4 autocorrelation) 
+{
+	INT_4	listNum;
+	struct SequenceScore *currSeqPtr;
+	
+	if(gParam.fMonitor && gCorrectMass)
+	{
+		return(FALSE);
+	}
+	if(autocorrelation <= 0)
+	{
+		return(FALSE);
+	}
+	
+	listNum = 0;
+	currSeqPtr = firstScorePtr;
+	while(currSeqPtr != NULL)
+	{
+		if(currSeqPtr->databaseSeq)
+		{
+			return(FALSE);
+		}
+		listNum++;
+		currSeqPtr = currSeqPtr->next;
+	}
+	if(listNum != seqNum || seqNum <= gParam.outputSeqNum)
+	{
+		return(FALSE);
+	}
+	
+	return(TRUE);
+}
+/**************************	LowestXCorrScore*******************************************
+*
+*  Returns a normalized cross-correlation score that no sequence can score below, so that
+*  ComboScoreBound has both ends of the x-corr range.  No mock peak is higher than 
+*  MOCK_INTENSITY.  For the fast cross-correlation, the score is the mock spectrum dotted 
+*  with xcorrSpectrum, so it can't be less than MOCK_INTENSITY times the negative part of 
+*  xcorrSpectrum over the scan range.  For the FFT, tau(0) and the other tau's are at least zero, 
+*  and so the score can't be less than minus the biggest tau, which is no more than 
+*  MOCK_INTENSITY times the summed spectrum1.  Both are padded by a percent for round off.
+*/
+static REAL_4 LowestXCorrScore(REAL_4 autocorrelation) 
+{
+	INT_4	i, lowBin, highBin;
+	REAL_8	lowestScore;
+	
+	lowestScore = 0;
+	if(gParam.fastXCorr)
+	{
+		lowBin = ((INT_4)msms.scanMassLow)*2 - 1;
+		highBin = ((INT_4)msms.scanMassHigh)*2 + 1;
+		for(i = 0; i < SIZEOF_SPECTRA; i++)
+		{
+			if(i >= lowBin && i <= highBin && xcorrSpectrum[i] < 0)
+			{
+				lowestScore += xcorrSpectrum[i];
+			}
+		}
+	}
+	else
+	{
+		for(i = 0; i < SIZEOF_SPECTRA; i++)
+		{
+			lowestScore -= fabs(spectrum1[i]);
+		}
+	}
+	lowestScore = lowestScore * MOCK_INTENSITY * 1.01 - 1;
+	
+	return((REAL_4)(lowestScore / autocorrelation));
+}
+/**************************	CrossCorrScoreTheBestSeqs*******************************************
+*
+*  Cross-correlates only the sequences that might make the final list of gParam.outputSeqNum 
+*  sequences.  The x-corr scores are normalized by the autocorrelation, so a sequence's score 
+*  does not depend on the others, and ComboScoreBound gives the best combo score that each 
+*  sequence could get before it is cross-correlated.  The sequences are cross-correlated from 
+*  the highest bound on down, and once the final list is full and its last one beats the next 
+*  bound (in the order used by SeqComboScoreRanker), the rest can't make the list and are 
+*  left alone, just like the sequences ranked below MAX_X_CORR_NUM.  Their bounds also cover 
+*  the x-corr they are left with, so they drop out of the final list in DetermineBestCandidates.
+*/
+static void CrossCorrScoreTheBestSeqs(struct SequenceScore *firstScorePtr, INT_4 seqNum, 
+						REAL_4 autocorrelation) 
+{
+	INT_4	i, j, bestNum;
+	REAL_4	xcorrNormalizer, xcorrFloor, xcorrLow;
+	tXCorrCandidate	*candidate, *best;
+	struct SequenceScore *currSeqPtr;
+	
+	candidate = (tXCorrCandidate *) malloc(seqNum * sizeof(tXCorrCandidate));
+	best = (tXCorrCandidate *) malloc(gParam.outputSeqNum * sizeof(tXCorrCandidate));
+	if(candidate == NULL || best == NULL)
+	{
+		printf("CrossCorrScoreTheBestSeqs:  Out of memory.");
+		exit(1);
+	}
+	
+	xcorrNormalizer = 1 / autocorrelation;	/*same as DoCrossCorrelationScoring*/
+	xcorrFloor = LowestXCorrScore(autocorrelation);
+	
+/*	Find the bounds, and sort the sequences by them.*/
+	i = 0;
+	currSeqPtr = firstScorePtr;
+	while(currSeqPtr != NULL && i < seqNum)
+	{
+		xcorrLow = xcorrNormalizer * currSeqPtr->crossDressingScore;	/*in case its not done*/
+		if(xcorrLow > xcorrFloor)
+		{
+			xcorrLow = xcorrFloor;
+		}
+		candidate[i].scorePtr = currSeqPtr;
+		candidate[i].comboScore = ComboScoreBound(currSeqPtr, xcorrLow);
+		candidate[i].probScore = currSeqPtr->probScore;
+		candidate[i].intensityScore = currSeqPtr->intensityScore;
+		if(candidate[i].intensityScore > 1)
+		{
+			candidate[i].intensityScore = 1;
+		}
+		candidate[i].order = i;
+		i++;
+		currSeqPtr = currSeqPtr->next;
+	}
+	qsort(candidate, seqNum, sizeof(tXCorrCandidate), XCorrCandidateSortDescend);
+	
+/*	Cross-correlate them until the rest can't make it into best.*/
+	bestNum = 0;
+	for(i = 0; i < seqNum; i++)
+	{
+		if(bestNum == gParam.outputSeqNum && 
+			XCorrCandidateSortDescend(&best[bestNum - 1], &candidate[i]) < 0)
+		{
+			break;
+		}
+		
+		currSeqPtr = candidate[i].scorePtr;
+		CrossCorrScoreTheSeq(currSeqPtr);
+		candidate[i].comboScore = ComboScoreAt(currSeqPtr, 
+									xcorrNormalizer * currSeqPtr->crossDressingScore);
+		if(candidate[i].comboScore == 0)
+		{
+			continue;	/*DetermineBestCandidates doesn't keep these*/
+		}
+		
+		/*Put it in place in best, and push the last one off if its full.*/
+		j = bestNum;
+		if(bestNum < gParam.outputSeqNum)
+		{
+			bestNum++;
+		}
+		while(j > 0 && XCorrCandidateSortDescend(&best[j - 1], &candidate[i]) > 0)
+		{
+			if(j < bestNum)
+			{
+				best[j] = best[j - 1];
+			}
+			j--;
+		}
+		if(j < bestNum)
+		{
+			best[j] = candidate[i];
+		}
+	}
+	
+	free(candidate);
+	free(best);
+	return;
+}
+/**************************	XCorrCandidateSortDescend*******************************************
+*
+*  For qsort; the same order as ComboScoreSortDescend (highest comboScore first, then highest
+*  probScore, then highest intensityScore, and then list order).
+*/
+static int XCorrCandidateSortDescend(const void *n1, const void *n2)
+{
+	tXCorrCandidate *n3, *n4;
+	
+	n3 = (tXCorrCandidate *)n1;
+	n4 = (tXCorrCandidate *)n2;
+	
+	if(n3->comboScore != n4->comboScore)
+	{
+		return(n3->comboScore < n4->comboScore ? 1 : -1);
+	}
+	if(n3->probScore != n4->probScore)
+	{
+		return(n3->probScore < n4->probScore ? 1 : -1);
+	}
+	if(n3->intensityScore != n4->intensityScore)
+	{
+		return(n3->intensityScore < n4->intensityScore ? 1 : -1);
+	}
+	return(n3->order < n4->order ? -1 : 1);
+}
 /**************************	CrossCorrScoreTheSeq*******************************************
 *
 *  This function calculates the cross-correlation score for ea. peptide passed to it.
@@ -503,21 +739,14 @@ void CrossCorrScoreTheSeq(struct SequenceScore *currScorePtr)
 		widePeak = TRUE;	/*mock peak widths are 2.5 daltons*/
 	}
 		
-	if (spectrum2) {
-		free(spectrum2);   /* Throw away the old data (if any exists) */
-		spectrum2 = NULL;
-	}	
-	spectrum2 = (REAL_4 *) malloc(SIZEOF_SPECTRA*sizeof(REAL_4));
-	if(spectrum2 == NULL)
-	{
-		printf("Out of memory");
-		exit(1);
-	}
-	for(i = 0; i < SIZEOF_SPECTRA; i++)
+	if (!spectrum2) return;	/*SetupCrossCorrelation allocated it for all of the candidates*/
+	if(!gParam.fastXCorr)	/*the fast scoring keeps spectrum2 clean, see FastXCorrScore*/
 	{
-		spectrum2[i] = 0;
+		for(i = 0; i < SIZEOF_SPECTRA; i++)
+		{
+			spectrum2[i] = 0;
+		}
 	}
-	if (!spectrum2) return;
 
 	seqLength = 0;
 	
@@ -564,7 +793,7 @@ void CrossCorrScoreTheSeq(struct SequenceScore *currScorePtr)
 */
 	for (i = seqLength - 1; i > 0; i--) 
 	{
-		fullIntensity = 50;	/*Arbitrary, but it should match the spectrum1 max value.*/
+		fullIntensity = MOCK_INTENSITY;	/*Arbitrary, but it should match the spectrum1 max value.*/
 
 /*	Figure out what Bion and Yion should be.*/
 		Bion = BXCorrCalc(i, currScorePtr, BionStart);
@@ -839,7 +1068,7 @@ void CrossCorrScoreTheSeq(struct SequenceScore *currScorePtr)
 	
 	/* If the peptide is 4 residues or INT_4er, look for internal fragment ions. 
 	*  (Only +1 right now).  Skip if LCQ data.*/
-	fullIntensity = 50;
+	fullIntensity = MOCK_INTENSITY;
 	if (seqLength > 4 && gParam.fragmentPattern != 'L') {
 		for (i = 1; i < seqLength - 2; i++) {
 			for (j = i+1; j < seqLength - 1; j++) 
@@ -930,6 +1159,12 @@ void CrossCorrScoreTheSeq(struct SequenceScore *currScorePtr)
 		spectrum2[((INT_4)(parentMin2NH3 + 0.5)) + 2] = 0;
 	}
 	
+	if(gParam.fastXCorr)
+	{
+		currScorePtr->crossDressingScore = FastXCorrScore();	/*does its own scan range check*/
+		return;
+	}
+	
 /*	Wipe out regions outside of scan range.*/
 	for(i = 0; i < SIZEOF_SPECTRA; i++)
 	{
@@ -958,7 +1193,7 @@ void CrossCorrScoreTheSeq(struct SequenceScore *currScorePtr)
 	
 	
 	/* Cross-correlation analysis */	
-	CrossCorrelate(spectrum2-1, spectrum1-1,(UINT_4) SIZEOF_SPECTRA, tau-1);
+	CrossCorrelateSpectrum1(spectrum2-1, tau-1);
 		
 	/* The cross-correlation score is tau[0] minus the mean of -75 < tau < 75.
 	   tau[-1 to -75] are stored in wrapped around order at the end of tau.  */
@@ -991,8 +1226,36 @@ void CrossCorrScoreTheSeq(struct SequenceScore *currScorePtr)
 		intensityAccountedFor += tauDiff;	/*add it all up*/
 	}
 	currScorePtr->crossDressingScore = tau[0] - intensityAccountedFor/250;/*divide by 250*/
+}
+/**************************	FastXCorrScore *******************************************
+*
+*  Scores the mock spectrum that CrossCorrScoreTheSeq just made by dotting the bins that it
+*  filled in with the xcorrSpectrum from SetupFastXCorr, which gives tau(0) minus the mean 
+*  background around it without any FFTs.  Bins outside of the scan range don't count, just as 
+*  they are wiped out before the FFT, and the bins are set back to zero for the next candidate.
+*/
+static REAL_4 FastXCorrScore(void) 
+{
+
+	INT_4	i, bin, lowBin, highBin;
+	REAL_8	score;
+	
+	lowBin = ((INT_4)msms.scanMassLow)*2 - 1;
+	highBin = ((INT_4)msms.scanMassHigh)*2 + 1;
+	
+	score = 0;
+	for(i = 0; i < mockBinNum; i++)
+	{
+		bin = mockBins[i];
+		if(bin >= lowBin && bin <= highBin)
+		{
+			score += spectrum2[bin] * xcorrSpectrum[bin];
+		}
+		spectrum2[bin] = 0;
+	}
+	mockBinNum = 0;
 	
-	if (spectrum2)	free(spectrum2);	spectrum2 = NULL;	
+	return((REAL_4) score);
 }
 /**************************	AddPeakToSpectrum *******************************************
 *
@@ -1017,22 +1280,34 @@ void AddPeakToSpectrum( REAL_4 *spectrum, REAL_4 mass, REAL_4 intensity) {
 	/* Make sure that the mass is within the spectrum's range */
 	if ( (INT_4)(mass + 0.5) > 2 && (INT_4)(mass + 0.5) < SIZEOF_SPECTRA - 2 ) {
 		/* Set the intensity of the peak center */
-		if (spectrum[(INT_4) (mass + 0.5)] < intensity)
-			spectrum[(INT_4) (mass + 0.5)] = intensity;
+		RaiseMockBin(spectrum, (INT_4) (mass + 0.5), intensity);
 			
 		/* Set the intensity of the peak sides */
-		if (spectrum[((INT_4) (mass + 0.5)) - 1] < intensity * gSidePeakAtt)
-			spectrum[((INT_4) (mass + 0.5)) - 1] = intensity * gSidePeakAtt;
-		if (spectrum[((INT_4) (mass + 0.5)) + 1] < intensity * gSidePeakAtt)
-			spectrum[((INT_4) (mass + 0.5)) + 1] = intensity * gSidePeakAtt;
+		RaiseMockBin(spectrum, ((INT_4) (mass + 0.5)) - 1, intensity * gSidePeakAtt);
+		RaiseMockBin(spectrum, ((INT_4) (mass + 0.5)) + 1, intensity * gSidePeakAtt);
 
 		if(widePeak)
 		{
 			/* Set the intensity of the peak side's side*/
-			if (spectrum[((INT_4) (mass + 0.5)) - 2] < intensity * gSidePeakAtt * gSidePeakAtt)
-				spectrum[((INT_4) (mass + 0.5)) - 2] = intensity * gSidePeakAtt * gSidePeakAtt;
-			if (spectrum[((INT_4) (mass + 0.5)) + 2] < intensity * gSidePeakAtt * gSidePeakAtt)
-				spectrum[((INT_4) (mass + 0.5)) + 2] = intensity * gSidePeakAtt * gSidePeakAtt;
+			RaiseMockBin(spectrum, ((INT_4) (mass + 0.5)) - 2, intensity * gSidePeakAtt * gSidePeakAtt);
+			RaiseMockBin(spectrum, ((INT_4) (mass + 0.5)) + 2, intensity * gSidePeakAtt * gSidePeakAtt);
+		}
+	}
+}
+/**************************	RaiseMockBin *******************************************
+*
+*  Raises a bin of the mock spectrum to the intensity, if it isn't that high already.  For the
+*  fast cross-correlation, the bins of spectrum2 are listed in mockBins as they are first filled in.
+*/
+static void RaiseMockBin(REAL_4 *spectrum, INT_4 bin, REAL_4 intensity) 
+{
+	if (spectrum[bin] < intensity)
+	{
+		if (spectrum[bin] == 0 && spectrum == spectrum2 && mockBins != NULL)
+		{
+			mockBins[mockBinNum] = bin;
+			mockBinNum++;
 		}
+		spectrum[bin] = intensity;
 	}
 }		